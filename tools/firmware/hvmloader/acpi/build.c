@@ -152,11 +152,153 @@ static int construct_hpet(struct acpi_20_hpet *hpet)
     return offset;
 }
 
+/* Vcpus are spread over the virtual nodes in equal contiguous runs. */
+static unsigned int vcpu_to_vnode(unsigned int vcpu)
+{
+    return (vcpu * hvm_info->nr_vnodes) / hvm_info->nr_vcpus;
+}
+
+static struct acpi_20_srat_memory *srat_memory(
+    struct acpi_20_srat_memory *mem, unsigned int node,
+    uint64_t base, uint64_t length)
+{
+    memset(mem, 0, sizeof(*mem));
+    mem->type         = ACPI_MEMORY_AFFINITY;
+    mem->length       = sizeof(*mem);
+    mem->domain       = node;
+    mem->base_address = base;
+    mem->mem_length   = length;
+    mem->flags        = ACPI_SRAT_ENABLED;
+    return mem + 1;
+}
+
+/*
+ * Describe the part of a node's block [s,e), counted in the domain
+ * builder's frame order, that falls in [base,end) of that order and now
+ * lives from guest frame 'pfn' up. Frames at or above 'limit' have since
+ * been taken back by hvmloader and are not RAM any more.
+ */
+static struct acpi_20_srat_memory *srat_memory_range(
+    struct acpi_20_srat_memory *mem, unsigned int node, uint64_t s,
+    uint64_t e, uint64_t base, uint64_t end, uint64_t pfn, uint64_t limit)
+{
+    if ( s < base )
+        s = base;
+    if ( e > end )
+        e = end;
+    if ( s >= e )
+        return mem;
+
+    s = pfn + (s - base);
+    e = pfn + (e - base);
+    if ( e > limit )
+        e = limit;
+    if ( s >= e )
+        return mem;
+
+    return srat_memory(mem, node, s << PAGE_SHIFT, (e - s) << PAGE_SHIFT);
+}
+
+static int construct_srat(struct acpi_20_srat *srat)
+{
+    struct acpi_20_srat_processor *cpu;
+    struct acpi_20_srat_memory *mem;
+    uint64_t four_gb = 1ull << (32 - PAGE_SHIFT);
+    uint64_t low = orig_low_mem_pgend, high = orig_high_mem_pgend;
+    uint64_t moved = pci_mem_start >> PAGE_SHIFT, total, s, e;
+    unsigned int i;
+
+    /*
+     * The builder laid the nodes out over the RAM below 4GB and then the
+     * RAM above it. pci_setup() has since moved frames [moved,low) of
+     * that order to the end of high memory, so follow them there.
+     */
+    if ( high == 0 )
+        high = four_gb;
+    total = low + (high - four_gb);
+    if ( moved > low )
+        moved = low;
+
+    memset(srat, 0, sizeof(*srat));
+    srat->header.signature    = ACPI_2_0_SRAT_SIGNATURE;
+    srat->header.revision     = ACPI_2_0_SRAT_REVISION;
+    fixed_strcpy(srat->header.oem_id, ACPI_OEM_ID);
+    fixed_strcpy(srat->header.oem_table_id, ACPI_OEM_TABLE_ID);
+    srat->header.oem_revision = ACPI_OEM_REVISION;
+    srat->header.creator_id   = ACPI_CREATOR_ID;
+    srat->header.creator_revision = ACPI_CREATOR_REVISION;
+    srat->table_revision      = ACPI_SRAT_TABLE_REVISION;
+
+    cpu = (struct acpi_20_srat_processor *)(srat + 1);
+    for ( i = 0; i < hvm_info->nr_vcpus; i++ )
+    {
+        memset(cpu, 0, sizeof(*cpu));
+        cpu->type    = ACPI_PROCESSOR_AFFINITY;
+        cpu->length  = sizeof(*cpu);
+        cpu->domain  = vcpu_to_vnode(i);
+        cpu->apic_id = LAPIC_ID(i);
+        cpu->flags   = ACPI_SRAT_ENABLED;
+        cpu++;
+    }
+
+    mem = (struct acpi_20_srat_memory *)cpu;
+    for ( i = 0; i < hvm_info->nr_vnodes; i++ )
+    {
+        s = (uint64_t)i * hvm_info->vnode_pages;
+        e = s + hvm_info->vnode_pages;
+        if ( (i == hvm_info->nr_vnodes - 1) || (e > total) )
+            e = total;
+        if ( s >= e )
+            continue;
+
+        mem = srat_memory_range(mem, i, s, e, 0, moved, 0,
+                                hvm_info->low_mem_pgend);
+        mem = srat_memory_range(mem, i, s, e, low, total, four_gb,
+                                hvm_info->high_mem_pgend);
+        mem = srat_memory_range(mem, i, s, e, moved, low, high,
+                                hvm_info->high_mem_pgend);
+    }
+
+    srat->header.length = (unsigned long)mem - (unsigned long)srat;
+    set_checksum(srat, offsetof(struct acpi_header, checksum),
+                 srat->header.length);
+
+    return align16(srat->header.length);
+}
+
+static int construct_slit(struct acpi_20_slit *slit)
+{
+    unsigned int i, j, nr = hvm_info->nr_vnodes;
+
+    memset(slit, 0, sizeof(*slit));
+    slit->header.signature    = ACPI_2_0_SLIT_SIGNATURE;
+    slit->header.revision     = ACPI_2_0_SLIT_REVISION;
+    fixed_strcpy(slit->header.oem_id, ACPI_OEM_ID);
+    fixed_strcpy(slit->header.oem_table_id, ACPI_OEM_TABLE_ID);
+    slit->header.oem_revision = ACPI_OEM_REVISION;
+    slit->header.creator_id   = ACPI_CREATOR_ID;
+    slit->header.creator_revision = ACPI_CREATOR_REVISION;
+    slit->localities          = nr;
+
+    for ( i = 0; i < nr; i++ )
+        for ( j = 0; j < nr; j++ )
+            slit->entry[i * nr + j] = (i == j) ? ACPI_SLIT_LOCAL_DISTANCE
+                                               : ACPI_SLIT_REMOTE_DISTANCE;
+
+    slit->header.length = sizeof(*slit) + nr * nr;
+    set_checksum(slit, offsetof(struct acpi_header, checksum),
+                 slit->header.length);
+
+    return align16(slit->header.length);
+}
+
 static int construct_secondary_tables(uint8_t *buf, unsigned long *table_ptrs)
 {
     int offset = 0, nr_tables = 0;
     struct acpi_20_madt *madt;
     struct acpi_20_hpet *hpet;
+    struct acpi_20_srat *srat;
+    struct acpi_20_slit *slit;
     struct acpi_20_tcpa *tcpa;
     static const uint16_t tis_signature[] = {0x0001, 0x0001, 0x0001};
     uint16_t *tis_hdr;
@@ -170,6 +312,18 @@ static int construct_secondary_tables(uint8_t *buf, unsigned long *table_ptrs)
         table_ptrs[nr_tables++] = (unsigned long)madt;
     }
 
+    /* SRAT and SLIT, if the builder laid the guest out over several nodes. */
+    if ( hvm_info->nr_vnodes > 1 )
+    {
+        srat = (struct acpi_20_srat *)&buf[offset];
+        offset += construct_srat(srat);
+        table_ptrs[nr_tables++] = (unsigned long)srat;
+
+        slit = (struct acpi_20_slit *)&buf[offset];
+        offset += construct_slit(slit);
+        table_ptrs[nr_tables++] = (unsigned long)slit;
+    }
+
     /* HPET. */
     if ( hpet_exists(ACPI_HPET_ADDRESS) )
     {
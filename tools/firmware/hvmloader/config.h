@@ -19,6 +19,9 @@
 #define PCI_MEM_END         0xfc000000
 extern unsigned long pci_mem_start, pci_mem_end;
 
+/* RAM layout as the domain builder left it, before pci_setup() moved any. */
+extern uint32_t orig_low_mem_pgend, orig_high_mem_pgend;
+
 /* We reserve 16MB for special BIOS mappings, etc. */
 #define RESERVED_MEMBASE    0xfc000000
 #define RESERVED_MEMSIZE    0x01000000
@@ -103,6 +103,8 @@ asm (
 unsigned long pci_mem_start = PCI_MEM_START;
 unsigned long pci_mem_end = PCI_MEM_END;
 
+uint32_t orig_low_mem_pgend, orig_high_mem_pgend;
+
 static enum { VGA_none, VGA_std, VGA_cirrus } virtual_vga = VGA_none;
 
 static void init_hypercalls(void)
@@ -286,6 +288,9 @@ static void pci_setup(void)
             ((pci_mem_start << 1) != 0) )
         pci_mem_start <<= 1;
 
+    orig_low_mem_pgend = hvm_info->low_mem_pgend;
+    orig_high_mem_pgend = hvm_info->high_mem_pgend;
+
     while ( (pci_mem_start >> PAGE_SHIFT) < hvm_info->low_mem_pgend )
     {
         struct xen_add_to_physmap xatp;
@@ -75,6 +75,7 @@ struct xc_dom_image {
 
     /* physical memory */
     xen_pfn_t total_pages;
+    uint64_t node_mask;         /* NUMA nodes to place memory on, 0: any */
     struct xc_dom_phys *phys_pages;
     int realmodearea_log;
 
@@ -695,6 +695,8 @@ int arch_setup_meminit(struct xc_dom_image *dom)
 {
     int rc;
     xen_pfn_t pfn, allocsz, i;
+    unsigned long node_end;
+    unsigned int mem_flags;
 
     rc = x86_compat(dom->guest_xc, dom->guest_domid, dom->guest_type);
     if ( rc )
@@ -715,11 +717,14 @@ int arch_setup_meminit(struct xc_dom_image *dom)
     /* allocate guest memory */
     for ( i = rc = allocsz = 0; (i < dom->total_pages) && !rc; i += allocsz )
     {
-        allocsz = dom->total_pages - i;
+        mem_flags = xg_node_memflags(dom->node_mask, i, dom->total_pages,
+                                     &node_end);
+        allocsz = node_end - i;
         if ( allocsz > 1024*1024 )
             allocsz = 1024*1024;
         rc = xc_domain_memory_populate_physmap(
-            dom->guest_xc, dom->guest_domid, allocsz, 0, 0, &dom->p2m_host[i]);
+            dom->guest_xc, dom->guest_domid, allocsz, 0, mem_flags,
+            &dom->p2m_host[i]);
     }
 
     return rc;
@@ -383,6 +383,92 @@ int xc_shadow_control(int xc_handle,
     return (rc == 0) ? domctl.u.shadow_op.pages : rc;
 }
 
+int xc_shadow_set_auto_allocation(int xc_handle,
+                                  uint32_t domid,
+                                  unsigned int min_mb,
+                                  unsigned int max_mb)
+{
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_shadow_op;
+    domctl.domain = (domid_t)domid;
+    domctl.u.shadow_op.op = XEN_DOMCTL_SHADOW_OP_SET_AUTO_ALLOCATION;
+    domctl.u.shadow_op.min_mb = min_mb;
+    domctl.u.shadow_op.max_mb = max_mb;
+
+    return do_domctl(xc_handle, &domctl);
+}
+
+int xc_shadow_get_auto_allocation(int xc_handle,
+                                  uint32_t domid,
+                                  unsigned int *mb,
+                                  unsigned int *min_mb,
+                                  unsigned int *max_mb,
+                                  xc_shadow_pool_stats_t *stats)
+{
+    int rc;
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_shadow_op;
+    domctl.domain = (domid_t)domid;
+    domctl.u.shadow_op.op = XEN_DOMCTL_SHADOW_OP_GET_AUTO_ALLOCATION;
+
+    if ( (rc = do_domctl(xc_handle, &domctl)) != 0 )
+        return rc;
+
+    if ( mb )
+        *mb = domctl.u.shadow_op.mb;
+    if ( min_mb )
+        *min_mb = domctl.u.shadow_op.min_mb;
+    if ( max_mb )
+        *max_mb = domctl.u.shadow_op.max_mb;
+    if ( stats )
+        memcpy(stats, &domctl.u.shadow_op.pool_stats, sizeof(*stats));
+
+    return 0;
+}
+
+int xc_domain_log_dirty_extents(int xc_handle,
+                                uint32_t domid,
+                                uint32_t flags,
+                                uint64_t *start_pfn,
+                                uint64_t end_pfn,
+                                xc_log_dirty_extent_t *extents,
+                                unsigned int *nr_extents,
+                                uint64_t *dirty_pages)
+{
+    int rc;
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_log_dirty_extents;
+    domctl.domain = (domid_t)domid;
+    domctl.u.log_dirty_extents.flags = flags;
+    domctl.u.log_dirty_extents.nr_extents = *nr_extents;
+    domctl.u.log_dirty_extents.start_pfn = *start_pfn;
+    domctl.u.log_dirty_extents.end_pfn = end_pfn;
+    set_xen_guest_handle(domctl.u.log_dirty_extents.extents, extents);
+
+    if ( lock_pages(extents, *nr_extents * sizeof(*extents)) != 0 )
+    {
+        PERROR("Could not lock memory for log-dirty extents");
+        return -1;
+    }
+
+    rc = do_domctl(xc_handle, &domctl);
+
+    unlock_pages(extents, *nr_extents * sizeof(*extents));
+
+    if ( rc == 0 )
+    {
+        *start_pfn = domctl.u.log_dirty_extents.start_pfn;
+        *nr_extents = domctl.u.log_dirty_extents.nr_extents;
+        if ( dirty_pages )
+            *dirty_pages = domctl.u.log_dirty_extents.dirty_pages;
+    }
+
+    return rc;
+}
+
 int xc_domain_setmaxmem(int xc_handle,
                         uint32_t domid,
                         unsigned int max_memkb)
@@ -1165,6 +1251,80 @@ int xc_domain_suppress_spurious_page_faults(int xc, uint32_t domid)
 
 }
 
+int xc_domain_get_node_pages(int xc_handle,
+                             uint32_t domid,
+                             unsigned int *nr_nodes,
+                             uint64_t *pages)
+{
+    DECLARE_DOMCTL;
+    int ret = -1;
+
+    domctl.cmd = XEN_DOMCTL_getnodepages;
+    domctl.domain = (domid_t)domid;
+    domctl.u.getnodepages.nr_nodes = *nr_nodes;
+    set_xen_guest_handle(domctl.u.getnodepages.pages, pages);
+
+    if ( lock_pages(pages, *nr_nodes * sizeof(*pages)) != 0 )
+    {
+        PERROR("Could not lock memory for Xen hypercall");
+        goto out;
+    }
+
+    ret = do_domctl(xc_handle, &domctl);
+
+    unlock_pages(pages, *nr_nodes * sizeof(*pages));
+
+    if ( ret == 0 )
+        *nr_nodes = domctl.u.getnodepages.nr_nodes;
+ out:
+    return ret;
+}
+
+int xc_domain_hvm_exit_stats(int xc_handle,
+                             uint32_t domid,
+                             uint32_t op,
+                             uint32_t vcpu,
+                             xc_hvm_exit_reason_t *reasons,
+                             unsigned int *nr_reasons,
+                             uint32_t *vendor,
+                             uint64_t *tsc_khz)
+{
+    DECLARE_DOMCTL;
+    unsigned int nr = (nr_reasons != NULL) ? *nr_reasons : 0;
+    int ret;
+
+    memset(&domctl, 0, sizeof(domctl));
+    domctl.cmd = XEN_DOMCTL_hvm_exit_stats;
+    domctl.domain = (domid_t)domid;
+    domctl.u.hvm_exit_stats.op = op;
+    domctl.u.hvm_exit_stats.vcpu = vcpu;
+    domctl.u.hvm_exit_stats.nr_reasons = nr;
+    set_xen_guest_handle(domctl.u.hvm_exit_stats.reasons, reasons);
+
+    if ( (nr != 0) && (lock_pages(reasons, nr * sizeof(*reasons)) != 0) )
+    {
+        PERROR("Could not lock memory for Xen hypercall");
+        return -1;
+    }
+
+    ret = do_domctl(xc_handle, &domctl);
+
+    if ( nr != 0 )
+        unlock_pages(reasons, nr * sizeof(*reasons));
+
+    if ( ret == 0 )
+    {
+        if ( nr_reasons != NULL )
+            *nr_reasons = domctl.u.hvm_exit_stats.nr_reasons;
+        if ( vendor != NULL )
+            *vendor = domctl.u.hvm_exit_stats.vendor;
+        if ( tsc_khz != NULL )
+            *tsc_khz = domctl.u.hvm_exit_stats.tsc_khz;
+    }
+
+    return ret;
+}
+
 int xc_domain_debug_control(int xc, uint32_t domid, uint32_t sop, uint32_t vcpu)
 {
     DECLARE_DOMCTL;
@@ -22,6 +22,9 @@
 #define SUPERPAGE_PFN_SHIFT  9
 #define SUPERPAGE_NR_PFNS    (1UL << SUPERPAGE_PFN_SHIFT)
 
+#define SUPERPAGE_1GB_SHIFT   18
+#define SUPERPAGE_1GB_NR_PFNS (1UL << SUPERPAGE_1GB_SHIFT)
+
 #define SPECIALPAGE_BUFIOREQ 0
 #define SPECIALPAGE_XENSTORE 1
 #define SPECIALPAGE_IOREQ    2
@@ -30,11 +33,13 @@
 #define NR_SPECIAL_PAGES     5
 #define special_pfn(x) (0xff000u - NR_SPECIAL_PAGES + (x))
 
-static void build_hvm_info(void *hvm_info_page, uint64_t mem_size)
+static void build_hvm_info(void *hvm_info_page, uint64_t mem_size,
+                           uint64_t node_mask)
 {
     struct hvm_info_table *hvm_info = (struct hvm_info_table *)
         (((unsigned char *)hvm_info_page) + HVM_INFO_OFFSET);
     uint64_t lowmem_end = mem_size, highmem_end = 0;
+    unsigned long vnode_end;
     uint8_t sum;
     int i;
 
@@ -60,6 +65,18 @@ static void build_hvm_info(void *hvm_info_page, uint64_t mem_size)
     hvm_info->high_mem_pgend = highmem_end >> PAGE_SHIFT;
     hvm_info->reserved_mem_pgstart = special_pfn(0);
 
+    /* Virtual NUMA topology: one virtual node per host node used. */
+    for ( i = 0; i < 64; i++ )
+        if ( node_mask & (1ULL << i) )
+            hvm_info->nr_vnodes++;
+    if ( hvm_info->nr_vnodes > 1 )
+    {
+        xg_node_memflags(node_mask, 0, mem_size >> PAGE_SHIFT, &vnode_end);
+        hvm_info->vnode_pages = vnode_end;
+    }
+    else
+        hvm_info->nr_vnodes = 0;
+
     /* Finish with the checksum. */
     for ( i = 0, sum = 0; i < hvm_info->length; i++ )
         sum += ((uint8_t *)hvm_info)[i];
@@ -102,13 +119,15 @@ static int loadelfimage(
 
 static int setup_guest(int xc_handle,
                        uint32_t dom, int memsize, int target,
+                       uint64_t node_mask,
                        char *image, unsigned long image_size)
 {
     xen_pfn_t *page_array = NULL;
     unsigned long i, nr_pages = (unsigned long)memsize << (20 - PAGE_SHIFT);
     unsigned long target_pages = (unsigned long)target << (20 - PAGE_SHIFT);
     unsigned long pod_pages = 0;
-    unsigned long entry_eip, cur_pages;
+    unsigned long entry_eip, cur_pages, node_end;
+    unsigned int mem_flags;
     struct xen_add_to_physmap xatp;
     struct shared_info *shared_info;
     void *hvm_info_page;
@@ -168,17 +187,64 @@ static int setup_guest(int xc_handle,
      * Allocate memory for HVM guest, skipping VGA hole 0xA0000-0xC0000.
      * We allocate pages in batches of no more than 8MB to ensure that
      * we can be preempted and hence dom0 remains responsive.
+     * If a node mask was given, no extent straddles two nodes' blocks.
      */
+    mem_flags = xg_node_memflags(node_mask, 0, nr_pages, &node_end);
     rc = xc_domain_memory_populate_physmap(
-        xc_handle, dom, 0xa0, 0, 0, &page_array[0x00]);
+        xc_handle, dom, 0xa0, 0, mem_flags, &page_array[0x00]);
     cur_pages = 0xc0;
     while ( (rc == 0) && (nr_pages > cur_pages) )
     {
+        unsigned long count;
+
+        mem_flags = xg_node_memflags(node_mask, cur_pages, nr_pages,
+                                     &node_end);
+        count = node_end - cur_pages;
+
+        /*
+         * Attempt a 1GB extent where the guest frames are 1GB aligned and
+         * contiguous, so that HAP can map it with a single 1GB entry.
+         * PoD only deals in 2MB superpages, so skip this in PoD mode.
+         * Xen can only preempt populate_physmap between extents, so ask
+         * for one extent per call: that keeps each hypercall to a single
+         * 2^18-page allocation and p2m update, the same bound any guest
+         * allowed multipage allocations already has.
+         */
+        if ( !pod_mode && (count >= SUPERPAGE_1GB_NR_PFNS) &&
+             ((page_array[cur_pages] & (SUPERPAGE_1GB_NR_PFNS-1)) == 0) &&
+             (page_array[cur_pages + SUPERPAGE_1GB_NR_PFNS - 1] ==
+              page_array[cur_pages] + SUPERPAGE_1GB_NR_PFNS - 1) )
+        {
+            xen_pfn_t sp_extent = page_array[cur_pages];
+            struct xen_memory_reservation sp_req = {
+                .nr_extents   = 1,
+                .extent_order = SUPERPAGE_1GB_SHIFT,
+                .mem_flags    = mem_flags,
+                .domid        = dom
+            };
+
+            set_xen_guest_handle(sp_req.extent_start, &sp_extent);
+            if ( xc_memory_op(xc_handle, XENMEM_populate_physmap,
+                              &sp_req) == 1 )
+            {
+                cur_pages += SUPERPAGE_1GB_NR_PFNS;
+                continue;
+            }
+        }
+
         /* Clip count to maximum 8MB extent. */
-        unsigned long count = nr_pages - cur_pages;
         if ( count > 2048 )
             count = 2048;
 
+        /* Stop at the next 1GB-aligned gfn, so it can get a 1GB extent. */
+        if ( !pod_mode )
+        {
+            unsigned long to_1gb =
+                -page_array[cur_pages] & (SUPERPAGE_1GB_NR_PFNS-1);
+            if ( (to_1gb != 0) && (count > to_1gb) )
+                count = to_1gb;
+        }
+
         /* Clip partial superpage extents to superpage boundaries. */
         if ( ((cur_pages & (SUPERPAGE_NR_PFNS-1)) != 0) &&
              (count > (-cur_pages & (SUPERPAGE_NR_PFNS-1))) )
@@ -195,11 +261,12 @@ static int setup_guest(int xc_handle,
             struct xen_memory_reservation sp_req = {
                 .nr_extents   = count >> SUPERPAGE_PFN_SHIFT,
                 .extent_order = SUPERPAGE_PFN_SHIFT,
+                .mem_flags    = mem_flags,
                 .domid        = dom
             };
 
             if ( pod_mode )
-                sp_req.mem_flags = XENMEMF_populate_on_demand;
+                sp_req.mem_flags |= XENMEMF_populate_on_demand;
 
             set_xen_guest_handle(sp_req.extent_start, sp_extents);
             for ( i = 0; i < sp_req.nr_extents; i++ )
@@ -222,7 +289,7 @@ static int setup_guest(int xc_handle,
         if ( count != 0 )
         {
             rc = xc_domain_memory_populate_physmap(
-                xc_handle, dom, count, 0, 0, &page_array[cur_pages]);
+                xc_handle, dom, count, 0, mem_flags, &page_array[cur_pages]);
             cur_pages += count;
             if ( pod_mode )
                 pod_pages -= count;
@@ -248,7 +315,7 @@ static int setup_guest(int xc_handle,
               xc_handle, dom, PAGE_SIZE, PROT_READ | PROT_WRITE,
               HVM_INFO_PFN)) == NULL )
         goto error_out;
-    build_hvm_info(hvm_info_page, v_end);
+    build_hvm_info(hvm_info_page, v_end, node_mask);
     munmap(hvm_info_page, PAGE_SIZE);
 
     /* Map and initialise shared_info page. */
@@ -330,6 +397,7 @@ static int xc_hvm_build_internal(int xc_handle,
                                  uint32_t domid,
                                  int memsize,
                                  int target,
+                                 uint64_t node_mask,
                                  char *image,
                                  unsigned long image_size)
 {
@@ -339,7 +407,8 @@ static int xc_hvm_build_internal(int xc_handle,
         return -1;
     }
 
-    return setup_guest(xc_handle, domid, memsize, target, image, image_size);
+    return setup_guest(xc_handle, domid, memsize, target, node_mask,
+                       image, image_size);
 }
 
 /* xc_hvm_build:
@@ -358,7 +427,8 @@ int xc_hvm_build(int xc_handle,
          ((image = xc_read_image(image_name, &image_size)) == NULL) )
         return -1;
 
-    sts = xc_hvm_build_internal(xc_handle, domid, memsize, memsize, image, image_size);
+    sts = xc_hvm_build_internal(xc_handle, domid, memsize, memsize, 0,
+                                image, image_size);
 
     free(image);
 
@@ -385,7 +455,37 @@ int xc_hvm_build_target_mem(int xc_handle,
          ((image = xc_read_image(image_name, &image_size)) == NULL) )
         return -1;
 
-    sts = xc_hvm_build_internal(xc_handle, domid, memsize, target, image, image_size);
+    sts = xc_hvm_build_internal(xc_handle, domid, memsize, target, 0,
+                                image, image_size);
+
+    free(image);
+
+    return sts;
+}
+
+/* xc_hvm_build_nodes:
+ * As xc_hvm_build_target_mem, but place guest memory on the NUMA nodes
+ * in node_mask, split evenly in guest-physical order.  With more than one
+ * node the layout is also recorded in the HVM info table, from which
+ * hvmloader builds SRAT/SLIT.  A zero mask leaves placement to Xen.
+ */
+int xc_hvm_build_nodes(int xc_handle,
+                       uint32_t domid,
+                       int memsize,
+                       int target,
+                       const char *image_name,
+                       uint64_t node_mask)
+{
+    char *image;
+    int  sts;
+    unsigned long image_size;
+
+    if ( (image_name == NULL) ||
+         ((image = xc_read_image(image_name, &image_size)) == NULL) )
+        return -1;
+
+    sts = xc_hvm_build_internal(xc_handle, domid, memsize, target, node_mask,
+                                image, image_size);
 
     free(image);
 
@@ -420,7 +520,7 @@ int xc_hvm_build_mem(int xc_handle,
         return -1;
     }
 
-    sts = xc_hvm_build_internal(xc_handle, domid, memsize, memsize,
+    sts = xc_hvm_build_internal(xc_handle, domid, memsize, memsize, 0,
                                 img, img_len);
 
     /* xc_inflate_buffer may return the original buffer pointer (for
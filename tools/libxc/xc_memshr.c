@@ -0,0 +1,92 @@
+/******************************************************************************
+ * xc_memshr.c
+ *
+ * Interface to the hypervisor's transparent page sharing.
+ */
+
+#include "xc_private.h"
+
+static int xc_memshr_op(int xc_handle, uint32_t domid,
+                        xen_domctl_mem_sharing_op_t *op)
+{
+    DECLARE_DOMCTL;
+    int rc;
+
+    domctl.cmd = XEN_DOMCTL_mem_sharing_op;
+    domctl.domain = (domid_t)domid;
+    domctl.u.mem_sharing_op = *op;
+
+    rc = do_domctl(xc_handle, &domctl);
+    *op = domctl.u.mem_sharing_op;
+
+    return rc;
+}
+
+int xc_memshr_nominate_gfn(int xc_handle, uint32_t domid,
+                           unsigned long gfn, uint64_t *hash)
+{
+    xen_domctl_mem_sharing_op_t op = { 0 };
+    int rc;
+
+    op.op = XEN_DOMCTL_MEM_SHARING_OP_NOMINATE_GFN;
+    op.u.nominate.gfn = gfn;
+
+    rc = xc_memshr_op(xc_handle, domid, &op);
+    if ( (rc == 0) && (hash != NULL) )
+        *hash = op.u.nominate.hash;
+
+    return rc;
+}
+
+int xc_memshr_share(int xc_handle,
+                    uint32_t source_domid, unsigned long source_gfn,
+                    uint32_t client_domid, unsigned long client_gfn)
+{
+    xen_domctl_mem_sharing_op_t op = { 0 };
+
+    op.op = XEN_DOMCTL_MEM_SHARING_OP_SHARE;
+    op.u.share.source_gfn = source_gfn;
+    op.u.share.client_gfn = client_gfn;
+    op.u.share.client_domain = (domid_t)client_domid;
+
+    return xc_memshr_op(xc_handle, source_domid, &op);
+}
+
+int xc_memshr_unshare(int xc_handle, uint32_t domid, unsigned long gfn)
+{
+    xen_domctl_mem_sharing_op_t op = { 0 };
+
+    op.op = XEN_DOMCTL_MEM_SHARING_OP_UNSHARE;
+    op.u.unshare.gfn = gfn;
+
+    return xc_memshr_op(xc_handle, domid, &op);
+}
+
+int xc_memshr_stats(int xc_handle, uint32_t domid,
+                    xc_memshr_stats_t *stats)
+{
+    xen_domctl_mem_sharing_op_t op = { 0 };
+    int rc;
+
+    op.op = XEN_DOMCTL_MEM_SHARING_OP_STATS;
+
+    rc = xc_memshr_op(xc_handle, domid, &op);
+    if ( rc == 0 )
+    {
+        stats->shared_frames = op.u.stats.shared_frames;
+        stats->shared_gfns = op.u.stats.shared_gfns;
+        stats->domain_gfns = op.u.stats.domain_gfns;
+    }
+
+    return rc;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-set-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -6,6 +6,7 @@
 
 #include "xc_private.h"
 #include <xen/hvm/hvm_op.h>
+#include <xen/hvm/ioreq.h>
 
 int xc_readconsolering(int xc_handle,
                        char **pbuffer,
@@ -267,6 +268,108 @@ int xc_hvm_track_dirty_vram(
     return rc;
 }
 
+int xc_hvm_map_dirty_vram(
+    int xc_handle, domid_t dom,
+    uint64_t first_pfn, uint64_t nr,
+    uint64_t *bitmap_mfn)
+{
+    DECLARE_HYPERCALL;
+    struct xen_hvm_map_dirty_vram arg;
+    int rc;
+
+    hypercall.op     = __HYPERVISOR_hvm_op;
+    hypercall.arg[0] = HVMOP_map_dirty_vram;
+    hypercall.arg[1] = (unsigned long)&arg;
+
+    arg.domid     = dom;
+    arg.first_pfn = first_pfn;
+    arg.nr        = nr;
+
+    if ( (rc = lock_pages(&arg, sizeof(arg))) != 0 )
+    {
+        PERROR("Could not lock memory");
+        return rc;
+    }
+
+    rc = do_xen_hypercall(xc_handle, &hypercall);
+
+    unlock_pages(&arg, sizeof(arg));
+
+    if ( rc == 0 && bitmap_mfn != NULL )
+        *bitmap_mfn = arg.bitmap_mfn;
+
+    return rc;
+}
+
+int xc_hvm_set_posted_io_range(
+    int xc_handle, domid_t dom, int is_mmio,
+    uint64_t first, uint64_t last, int enable)
+{
+    DECLARE_HYPERCALL;
+    struct xen_hvm_set_posted_io_range arg;
+    int rc;
+
+    hypercall.op     = __HYPERVISOR_hvm_op;
+    hypercall.arg[0] = HVMOP_set_posted_io_range;
+    hypercall.arg[1] = (unsigned long)&arg;
+
+    arg.domid  = dom;
+    arg.type   = is_mmio ? IOREQ_TYPE_COPY : IOREQ_TYPE_PIO;
+    arg.enable = !!enable;
+    arg.first  = first;
+    arg.last   = last;
+
+    if ( (rc = lock_pages(&arg, sizeof(arg))) != 0 )
+    {
+        PERROR("Could not lock memory");
+        return rc;
+    }
+
+    rc = do_xen_hypercall(xc_handle, &hypercall);
+
+    unlock_pages(&arg, sizeof(arg));
+
+    return rc;
+}
+
+int xc_hvm_set_doorbell(
+    int xc_handle, domid_t dom, int is_mmio, uint64_t addr,
+    unsigned int size, int datamatch, uint64_t data, int enable,
+    evtchn_port_t *port)
+{
+    DECLARE_HYPERCALL;
+    struct xen_hvm_set_doorbell arg;
+    int rc;
+
+    hypercall.op     = __HYPERVISOR_hvm_op;
+    hypercall.arg[0] = HVMOP_set_doorbell;
+    hypercall.arg[1] = (unsigned long)&arg;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.domid  = dom;
+    arg.type   = is_mmio ? IOREQ_TYPE_COPY : IOREQ_TYPE_PIO;
+    arg.enable = !!enable;
+    arg.size   = size;
+    arg.flags  = datamatch ? HVM_DOORBELL_DATAMATCH : 0;
+    arg.addr   = addr;
+    arg.data   = data;
+
+    if ( (rc = lock_pages(&arg, sizeof(arg))) != 0 )
+    {
+        PERROR("Could not lock memory");
+        return rc;
+    }
+
+    rc = do_xen_hypercall(xc_handle, &hypercall);
+
+    unlock_pages(&arg, sizeof(arg));
+
+    if ( (rc == 0) && enable && (port != NULL) )
+        *port = arg.port;
+
+    return rc;
+}
+
 int xc_hvm_modified_memory(
     int xc_handle, domid_t dom, uint64_t first_pfn, uint64_t nr)
 {
@@ -0,0 +1,62 @@
+/****************************************************************************
+ *
+ *        File: xc_rt.c
+ *
+ * Description: XC Interface to the global EDF real-time scheduler
+ *
+ */
+#include "xc_private.h"
+
+
+static int
+xc_sched_rt_domain_op(
+    int xc_handle,
+    uint32_t domid,
+    uint32_t cmd,
+    struct xen_domctl_sched_rt *sdom)
+{
+    DECLARE_DOMCTL;
+    int err;
+
+    domctl.cmd = XEN_DOMCTL_scheduler_op;
+    domctl.domain = (domid_t) domid;
+    domctl.u.scheduler_op.sched_id = XEN_SCHEDULER_RT;
+    domctl.u.scheduler_op.cmd = cmd;
+    domctl.u.scheduler_op.u.rt = *sdom;
+
+    err = do_domctl(xc_handle, &domctl);
+    if ( err == 0 )
+        *sdom = domctl.u.scheduler_op.u.rt;
+
+    return err;
+}
+
+int
+xc_sched_rt_domain_set(
+    int xc_handle,
+    uint32_t domid,
+    struct xen_domctl_sched_rt *sdom)
+{
+    return xc_sched_rt_domain_op(xc_handle, domid,
+                                 XEN_DOMCTL_SCHEDOP_putinfo, sdom);
+}
+
+int
+xc_sched_rt_domain_get(
+    int xc_handle,
+    uint32_t domid,
+    struct xen_domctl_sched_rt *sdom)
+{
+    return xc_sched_rt_domain_op(xc_handle, domid,
+                                 XEN_DOMCTL_SCHEDOP_getinfo, sdom);
+}
+
+int
+xc_sched_rt_domain_admit(
+    int xc_handle,
+    uint32_t domid,
+    struct xen_domctl_sched_rt *sdom)
+{
+    return xc_sched_rt_domain_op(xc_handle, domid,
+                                 XEN_DOMCTL_SCHEDOP_admit, sdom);
+}
@@ -134,3 +134,14 @@ int xc_tbuf_set_evt_mask(int xc_handle, uint32_t mask)
     return do_sysctl(xc_handle, &sysctl);
 }
 
+int xc_tbuf_set_cls_mask(int xc_handle, uint32_t mask)
+{
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_tbuf_op;
+    sysctl.interface_version = XEN_SYSCTL_INTERFACE_VERSION;
+    sysctl.u.tbuf_op.cmd  = XEN_SYSCTL_TBUFOP_set_cls_mask;
+    sysctl.u.tbuf_op.evt_mask = mask;
+
+    return do_sysctl(xc_handle, &sysctl);
+}
@@ -437,6 +437,50 @@ int xc_shadow_control(int xc_handle,
                       uint32_t mode,
                       xc_shadow_op_stats_t *stats);
 
+/**
+ * Let Xen grow and shrink the shadow pool of a domain between min_mb and
+ * max_mb according to how hard the pool is being used.  max_mb == 0
+ * turns this off.
+ */
+int xc_shadow_set_auto_allocation(int xc_handle,
+                                  uint32_t domid,
+                                  unsigned int min_mb,
+                                  unsigned int max_mb);
+
+/**
+ * Read the current shadow pool size, the auto-sizing bounds and pool
+ * pressure statistics.  Any output pointer may be NULL.
+ */
+typedef xen_domctl_shadow_pool_stats_t xc_shadow_pool_stats_t;
+int xc_shadow_get_auto_allocation(int xc_handle,
+                                  uint32_t domid,
+                                  unsigned int *mb,
+                                  unsigned int *min_mb,
+                                  unsigned int *max_mb,
+                                  xc_shadow_pool_stats_t *stats);
+
+/**
+ * Harvest the log-dirty bitmap of pfns [*start_pfn, end_pfn) as a list of
+ * runs of dirty pfns.  With XEN_DOMCTL_LOG_DIRTY_CLEAN in flags the
+ * harvested pfns are cleaned for the next round.  If the extents buffer
+ * fills up, *start_pfn is left at the first pfn that was not harvested;
+ * call again from there until *start_pfn == end_pfn.
+ *
+ * @parm extents buffer receiving the extents
+ * @parm nr_extents IN: size of the buffer; OUT: number of extents returned
+ * @parm dirty_pages if not NULL, set to the number of pfns covered
+ * @return 0 on success, -1 on failure
+ */
+typedef xen_domctl_log_dirty_extent_t xc_log_dirty_extent_t;
+int xc_domain_log_dirty_extents(int xc_handle,
+                                uint32_t domid,
+                                uint32_t flags,
+                                uint64_t *start_pfn,
+                                uint64_t end_pfn,
+                                xc_log_dirty_extent_t *extents,
+                                unsigned int *nr_extents,
+                                uint64_t *dirty_pages);
+
 int xc_sedf_domain_set(int xc_handle,
                        uint32_t domid,
                        uint64_t period, uint64_t slice,
@@ -457,6 +501,28 @@ int xc_sched_credit_domain_get(int xc_handle,
                                uint32_t domid,
                                struct xen_domctl_sched_credit *sdom);
 
+int xc_sched_rt_domain_set(int xc_handle,
+                           uint32_t domid,
+                           struct xen_domctl_sched_rt *sdom);
+
+int xc_sched_rt_domain_get(int xc_handle,
+                           uint32_t domid,
+                           struct xen_domctl_sched_rt *sdom);
+
+/**
+ * Check whether a real-time reservation would pass the scheduler's
+ * admission control, without applying it.
+ *
+ * @parm xc_handle a handle to an open hypervisor interface
+ * @parm domid the domain the reservation is for
+ * @parm sdom the requested period and budget
+ * return 0 if the reservation is admissible, -1 otherwise (errno ENOSPC
+ *        if the system would be overcommitted)
+ */
+int xc_sched_rt_domain_admit(int xc_handle,
+                             uint32_t domid,
+                             struct xen_domctl_sched_rt *sdom);
+
 /**
  * This function sends a trigger to a domain.
  *
@@ -824,6 +890,13 @@ int xc_tbuf_set_cpu_mask(int xc_handle, uint32_t mask);
 
 int xc_tbuf_set_evt_mask(int xc_handle, uint32_t mask);
 
+/**
+ * Set the subclass mask of individual trace classes, leaving the others
+ * untouched. @mask selects the classes (bits 16-27) and gives their new
+ * subclass bits (bits 12-15); a zero subclass mask disables the class.
+ */
+int xc_tbuf_set_cls_mask(int xc_handle, uint32_t mask);
+
 int xc_domctl(int xc_handle, struct xen_domctl *domctl);
 int xc_sysctl(int xc_handle, struct xen_sysctl *sysctl);
 
@@ -974,6 +1047,38 @@ int xc_hvm_track_dirty_vram(
     uint64_t first_pfn, uint64_t nr,
     unsigned long *bitmap);
 
+/*
+ * Track dirty bit changes in the VRAM area through a bitmap page that the
+ * hypervisor updates in place (HAP guests only).  On success *bitmap_mfn
+ * is a machine frame to map from DOMID_XEN, as for the trace buffers.
+ * Atomically exchange its non-zero words with zero to harvest, then, only
+ * if anything was set, call this again with the same range to re-arm the
+ * harvested pages.  nr == 0 stops tracking.
+ */
+int xc_hvm_map_dirty_vram(
+    int xc_handle, domid_t dom,
+    uint64_t first_pfn, uint64_t nr,
+    uint64_t *bitmap_mfn);
+
+/*
+ * Add (enable != 0) or remove a range of emulated ports or MMIO (inclusive)
+ * to which writes may be posted through the buffered ioreq page.
+ */
+int xc_hvm_set_posted_io_range(
+    int xc_handle, domid_t dom, int is_mmio,
+    uint64_t first, uint64_t last, int enable);
+
+/*
+ * Add (enable != 0) or remove a doorbell: a 'size'-byte write to 'addr'
+ * (optionally only of value 'data') which Xen completes itself, signalling
+ * the returned event channel instead of sending an ioreq.  The caller binds
+ * to *port with xc_evtchn_bind_interdomain().
+ */
+int xc_hvm_set_doorbell(
+    int xc_handle, domid_t dom, int is_mmio, uint64_t addr,
+    unsigned int size, int datamatch, uint64_t data, int enable,
+    evtchn_port_t *port);
+
 /*
  * Notify that some pages got modified by the Device Model
  */
@@ -1129,6 +1234,38 @@ int xc_domain_get_machine_address_size(int handle,
 int xc_domain_suppress_spurious_page_faults(int handle,
 					  uint32_t domid);
 
+/**
+ * Get the number of pages a domain owns on each NUMA node.
+ *
+ * @parm nr_nodes in: entries in pages; out: node ids Xen can report
+ * @parm pages per-node page counts, indexed by node id
+ */
+int xc_domain_get_node_pages(int xc_handle,
+                             uint32_t domid,
+                             unsigned int *nr_nodes,
+                             uint64_t *pages);
+
+/**
+ * Control or read per-vcpu HVM exit statistics.
+ *
+ * @parm op XEN_DOMCTL_HVM_EXIT_STATS_{ENABLE,DISABLE,RESET,GET}
+ * @parm vcpu the vcpu to read (GET only)
+ * @parm reasons buffer receiving per-exit-reason counters (GET only)
+ * @parm nr_reasons in: entries in reasons; out: entries filled (GET only)
+ * @parm vendor if not NULL, set to XEN_HVM_EXIT_STATS_VMX or _SVM
+ * @parm tsc_khz if not NULL, set to the TSC rate the cycles are counted in
+ * @return 0 on success, -1 on failure
+ */
+typedef xen_domctl_hvm_exit_reason_t xc_hvm_exit_reason_t;
+int xc_domain_hvm_exit_stats(int xc_handle,
+                             uint32_t domid,
+                             uint32_t op,
+                             uint32_t vcpu,
+                             xc_hvm_exit_reason_t *reasons,
+                             unsigned int *nr_reasons,
+                             uint32_t *vendor,
+                             uint64_t *tsc_khz);
+
 /* Set the target domain */
 int xc_domain_set_target(int xc_handle,
                          uint32_t domid,
@@ -1140,6 +1277,36 @@ int xc_domain_debug_control(int xc_handle,
                             uint32_t sop,
                             uint32_t vcpu);
 
+/*
+ * Transparent page sharing for HVM guests.
+ *
+ * A gfn must be nominated before it can be shared; nomination makes it
+ * read-only to the guest and returns a hash of its contents.  Sharing two
+ * nominated gfns with identical contents frees one of their frames.  The
+ * guest gets a private copy back automatically when it writes to the gfn.
+ */
+typedef struct xc_memshr_stats {
+    uint64_t shared_frames;  /* frames backing shared gfns, all domains */
+    uint64_t shared_gfns;    /* gfns mapping those frames, all domains */
+    uint64_t domain_gfns;    /* shared gfns of the queried domain */
+} xc_memshr_stats_t;
+
+int xc_memshr_nominate_gfn(int xc_handle,
+                           uint32_t domid,
+                           unsigned long gfn,
+                           uint64_t *hash);
+int xc_memshr_share(int xc_handle,
+                    uint32_t source_domid,
+                    unsigned long source_gfn,
+                    uint32_t client_domid,
+                    unsigned long client_gfn);
+int xc_memshr_unshare(int xc_handle,
+                      uint32_t domid,
+                      unsigned long gfn);
+int xc_memshr_stats(int xc_handle,
+                    uint32_t domid,
+                    xc_memshr_stats_t *stats);
+
 #if defined(__i386__) || defined(__x86_64__)
 int xc_cpuid_check(int xc,
                    const unsigned int *input,
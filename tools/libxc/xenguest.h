@@ -136,6 +136,13 @@ int xc_hvm_build_target_mem(int xc_handle,
                             int target,
                             const char *image_name);
 
+int xc_hvm_build_nodes(int xc_handle,
+                       uint32_t domid,
+                       int memsize,
+                       int target,
+                       const char *image_name,
+                       uint64_t node_mask);
+
 int xc_hvm_build_mem(int xc_handle,
                      uint32_t domid,
                      int memsize,
@@ -183,6 +183,34 @@ __attribute__((weak))
     return -1;
 }
 
+unsigned int xg_node_memflags(uint64_t node_mask, unsigned long i,
+                              unsigned long nr, unsigned long *end)
+{
+    unsigned int node, k, nr_nodes = 0;
+    unsigned long block;
+
+    for ( node = 0; node < 64; node++ )
+        if ( node_mask & (1ULL << node) )
+            nr_nodes++;
+
+    if ( nr_nodes == 0 )
+    {
+        *end = nr;
+        return 0;
+    }
+
+    /* Keep block boundaries 2MB aligned so superpage extents survive. */
+    block = ((nr + nr_nodes - 1) / nr_nodes + 511) & ~511UL;
+    k = i / block;
+    *end = ((k + 1) * block < nr) ? (k + 1) * block : nr;
+
+    for ( node = 0; node < 64; node++ )
+        if ( (node_mask & (1ULL << node)) && (k-- == 0) )
+            break;
+
+    return XENMEMF_node(node);
+}
+
 void *xg_memalign(size_t alignment, size_t size)
 {
 #if defined(_POSIX_C_SOURCE) && !defined(__sun__)
@@ -34,6 +34,15 @@ char *xc_inflate_buffer(const char *in_buf,
 
 unsigned long csum_page (void * page);
 
+/*
+ * Spread nr guest pages over the NUMA nodes in node_mask as equal,
+ * contiguous blocks, lowest node first.  Returns the memflags to populate
+ * page i with and sets *end to the first page past i's block.  An empty
+ * mask gives no node preference and a single block.
+ */
+unsigned int xg_node_memflags(uint64_t node_mask, unsigned long i,
+                              unsigned long nr, unsigned long *end);
+
 #define _PAGE_PRESENT   0x001
 #define _PAGE_RW        0x002
 #define _PAGE_USER      0x004
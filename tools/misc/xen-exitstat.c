@@ -0,0 +1,495 @@
+/*
+ * xen-exitstat.c: top-like view of HVM exit reasons.
+ *
+ * Turns on the hypervisor's per-vcpu exit statistics for every HVM guest
+ * (or only the listed domains), then periodically harvests them and shows,
+ * for each domain, the exit rate, the share of vcpu time spent handling
+ * exits, and the busiest exit reasons with their average and tail latency.
+ * Statistics that this tool turned on are turned off again when it exits.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include <xenctrl.h>
+#include <inttypes.h>
+
+#define MAX_DOMAINS        1024
+#define DEFAULT_INTERVAL   2
+#define DEFAULT_TOP        10
+
+#define NR_REASONS         XEN_HVM_EXIT_STATS_REASONS
+#define NR_BUCKETS         XEN_HVM_EXIT_STATS_BUCKETS
+
+static const char *vmx_names[NR_REASONS] = {
+    [0]  = "EXCEPTION_NMI",       [1]  = "EXTERNAL_INTERRUPT",
+    [2]  = "TRIPLE_FAULT",        [3]  = "INIT",
+    [4]  = "SIPI",                [5]  = "IO_SMI",
+    [6]  = "OTHER_SMI",           [7]  = "PENDING_VIRT_INTR",
+    [8]  = "PENDING_VIRT_NMI",    [9]  = "TASK_SWITCH",
+    [10] = "CPUID",               [12] = "HLT",
+    [13] = "INVD",                [14] = "INVLPG",
+    [15] = "RDPMC",               [16] = "RDTSC",
+    [17] = "RSM",                 [18] = "VMCALL",
+    [19] = "VMCLEAR",             [20] = "VMLAUNCH",
+    [21] = "VMPTRLD",             [22] = "VMPTRST",
+    [23] = "VMREAD",              [24] = "VMRESUME",
+    [25] = "VMWRITE",             [26] = "VMXOFF",
+    [27] = "VMXON",               [28] = "CR_ACCESS",
+    [29] = "DR_ACCESS",           [30] = "IO_INSTRUCTION",
+    [31] = "MSR_READ",            [32] = "MSR_WRITE",
+    [33] = "INVALID_GUEST_STATE", [34] = "MSR_LOADING",
+    [36] = "MWAIT",               [37] = "MONITOR_TRAP_FLAG",
+    [39] = "MONITOR",             [40] = "PAUSE",
+    [41] = "MCE_DURING_VMENTRY",  [43] = "TPR_BELOW_THRESHOLD",
+    [44] = "APIC_ACCESS",         [48] = "EPT_VIOLATION",
+    [49] = "EPT_MISCONFIG",       [54] = "WBINVD",
+};
+
+static const char *svm_names[NR_REASONS] = {
+    [96]  = "INTR",         [97]  = "NMI",          [98]  = "SMI",
+    [99]  = "INIT",         [100] = "VINTR",        [101] = "CR0_SEL_WRITE",
+    [102] = "IDTR_READ",    [103] = "GDTR_READ",    [104] = "LDTR_READ",
+    [105] = "TR_READ",      [106] = "IDTR_WRITE",   [107] = "GDTR_WRITE",
+    [108] = "LDTR_WRITE",   [109] = "TR_WRITE",     [110] = "RDTSC",
+    [111] = "RDPMC",        [112] = "PUSHF",        [113] = "POPF",
+    [114] = "CPUID",        [115] = "RSM",          [116] = "IRET",
+    [117] = "SWINT",        [118] = "INVD",         [119] = "PAUSE",
+    [120] = "HLT",          [121] = "INVLPG",       [122] = "INVLPGA",
+    [123] = "IOIO",         [124] = "MSR",          [125] = "TASK_SWITCH",
+    [126] = "FERR_FREEZE",  [127] = "SHUTDOWN",     [128] = "VMRUN",
+    [129] = "VMMCALL",      [130] = "VMLOAD",       [131] = "VMSAVE",
+    [132] = "STGI",         [133] = "CLGI",         [134] = "SKINIT",
+    [135] = "RDTSCP",       [136] = "ICEBP",        [137] = "WBINVD",
+    [138] = "MONITOR",      [139] = "MWAIT",        [140] = "MWAIT_COND",
+    [XEN_HVM_EXIT_STATS_SVM_NPF] = "NPF",
+};
+
+/* What we last saw of a domain, to turn running totals into rates. */
+struct dom_state {
+    uint32_t             domid;
+    int                  seen;          /* still present this refresh */
+    int                  enabled_by_us;
+    int                  have_sample;
+    unsigned int         nr_vcpus;
+    xc_hvm_exit_reason_t sum[NR_REASONS];
+    uint64_t            *vcpu_count, *vcpu_cycles;
+};
+
+static int xc_handle;
+static struct dom_state *doms;
+static unsigned int nr_doms_tracked;
+static unsigned int top = DEFAULT_TOP;
+static int per_vcpu, batch, keep;
+static uint32_t vendor;
+static uint64_t tsc_khz;
+static volatile sig_atomic_t stop;
+
+static void handle_signal(int sig)
+{
+    stop = 1;
+}
+
+static double now_sec(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static const char *reason_name(unsigned int i, char *buf, size_t len)
+{
+    const char *name = (vendor == XEN_HVM_EXIT_STATS_SVM)
+        ? svm_names[i] : vmx_names[i];
+
+    if ( name != NULL )
+        return name;
+
+    if ( vendor == XEN_HVM_EXIT_STATS_SVM )
+    {
+        if ( i < 16 )
+            snprintf(buf, len, "CR%u_READ", i);
+        else if ( i < 32 )
+            snprintf(buf, len, "CR%u_WRITE", i - 16);
+        else if ( i < 48 )
+            snprintf(buf, len, "DR%u_READ", i - 32);
+        else if ( i < 64 )
+            snprintf(buf, len, "DR%u_WRITE", i - 48);
+        else if ( i < 96 )
+            snprintf(buf, len, "EXCEPTION_%u", i - 64);
+        else
+            snprintf(buf, len, "exit %u", i);
+    }
+    else
+        snprintf(buf, len, "exit %u", i);
+
+    return buf;
+}
+
+static struct dom_state *find_dom(uint32_t domid)
+{
+    struct dom_state *d;
+    unsigned int i;
+
+    for ( i = 0; i < nr_doms_tracked; i++ )
+        if ( doms[i].domid == domid )
+            return &doms[i];
+
+    d = &doms[nr_doms_tracked++];
+    memset(d, 0, sizeof(*d));
+    d->domid = domid;
+    return d;
+}
+
+static void forget_dom(struct dom_state *d)
+{
+    free(d->vcpu_count);
+    free(d->vcpu_cycles);
+    *d = doms[--nr_doms_tracked];
+}
+
+/* Turn statistics on, remembering whether someone else already had. */
+static int start_dom(struct dom_state *d)
+{
+    unsigned int nr = 0;
+
+    if ( xc_domain_hvm_exit_stats(xc_handle, d->domid,
+                                  XEN_DOMCTL_HVM_EXIT_STATS_GET, 0,
+                                  NULL, &nr, &vendor, &tsc_khz) == 0 )
+        return 0;
+
+    if ( xc_domain_hvm_exit_stats(xc_handle, d->domid,
+                                  XEN_DOMCTL_HVM_EXIT_STATS_ENABLE, 0,
+                                  NULL, NULL, &vendor, &tsc_khz) != 0 )
+    {
+        fprintf(stderr, "d%u: could not enable exit statistics: %s\n",
+                d->domid, strerror(errno));
+        return -1;
+    }
+
+    d->enabled_by_us = !keep;
+    return 0;
+}
+
+static void stop_all(void)
+{
+    unsigned int i;
+
+    for ( i = 0; i < nr_doms_tracked; i++ )
+        if ( doms[i].enabled_by_us )
+            xc_domain_hvm_exit_stats(xc_handle, doms[i].domid,
+                                     XEN_DOMCTL_HVM_EXIT_STATS_DISABLE, 0,
+                                     NULL, NULL, NULL, NULL);
+}
+
+/* Upper bound, in microseconds, of the bucket holding the pct'th exit. */
+static double percentile_us(const uint32_t *hist, uint64_t total, double pct)
+{
+    uint64_t want = (uint64_t)(total * pct / 100.0), seen = 0;
+    unsigned int b;
+
+    for ( b = 0; b < NR_BUCKETS - 1; b++ )
+    {
+        seen += hist[b];
+        if ( seen > want )
+            break;
+    }
+
+    return (double)(1ULL << (b + 9)) * 1000.0 / tsc_khz;
+}
+
+static void show_dom(struct dom_state *d, xc_hvm_exit_reason_t *sum,
+                     uint64_t *vcount, uint64_t *vcycles,
+                     unsigned int nr_vcpus, double elapsed)
+{
+    xc_hvm_exit_reason_t delta[NR_REASONS];
+    unsigned int order[NR_REASONS], i, j, b, nr_order = 0;
+    uint64_t exits = 0, cycles = 0;
+    double vcpu_cycles = elapsed * tsc_khz * 1000.0 * nr_vcpus;
+    char buf[32];
+
+    for ( i = 0; i < NR_REASONS; i++ )
+    {
+        delta[i].count = sum[i].count - d->sum[i].count;
+        delta[i].cycles = sum[i].cycles - d->sum[i].cycles;
+        for ( b = 0; b < NR_BUCKETS; b++ )
+            delta[i].hist[b] = sum[i].hist[b] - d->sum[i].hist[b];
+        exits += delta[i].count;
+        cycles += delta[i].cycles;
+        if ( delta[i].count == 0 )
+            continue;
+
+        /* Insertion sort by exit count, busiest first. */
+        for ( j = nr_order; (j > 0) &&
+                  (delta[order[j - 1]].count < delta[i].count); j-- )
+            order[j] = order[j - 1];
+        order[j] = i;
+        nr_order++;
+    }
+
+    printf("d%-5u %3u vcpus %12.0f exits/s %6.2f%% of vcpu time in Xen\n",
+           d->domid, nr_vcpus, exits / elapsed,
+           vcpu_cycles ? 100.0 * cycles / vcpu_cycles : 0.0);
+
+    if ( nr_order != 0 )
+        printf("  %-22s %12s %6s %9s %9s %9s\n",
+               "reason", "exits/s", "%exits", "avg(us)", "p50(us)",
+               "p99(us)");
+
+    for ( i = 0; (i < nr_order) && (i < top); i++ )
+    {
+        xc_hvm_exit_reason_t *r = &delta[order[i]];
+
+        printf("  %-22s %12.0f %6.1f %9.2f %9.2f %9.2f\n",
+               reason_name(order[i], buf, sizeof(buf)),
+               r->count / elapsed, 100.0 * r->count / exits,
+               r->cycles * 1000.0 / tsc_khz / r->count,
+               percentile_us(r->hist, r->count, 50.0),
+               percentile_us(r->hist, r->count, 99.0));
+    }
+
+    if ( per_vcpu && (nr_vcpus == d->nr_vcpus) )
+        for ( i = 0; i < nr_vcpus; i++ )
+            printf("  vcpu%-3u %12.0f exits/s %6.2f%% in Xen\n", i,
+                   (vcount[i] - d->vcpu_count[i]) / elapsed,
+                   100.0 * (vcycles[i] - d->vcpu_cycles[i]) /
+                   (elapsed * tsc_khz * 1000.0));
+
+    printf("\n");
+}
+
+/* Harvest every vcpu of a domain; show it if there is an earlier sample. */
+static void sample_dom(struct dom_state *d, unsigned int nr_vcpus,
+                       double elapsed)
+{
+    xc_hvm_exit_reason_t sum[NR_REASONS], cur[NR_REASONS];
+    uint64_t *vcount, *vcycles;
+    unsigned int v, i, b, nr;
+
+    vcount = calloc(nr_vcpus, sizeof(*vcount));
+    vcycles = calloc(nr_vcpus, sizeof(*vcycles));
+    if ( (vcount == NULL) || (vcycles == NULL) )
+    {
+        free(vcount);
+        free(vcycles);
+        return;
+    }
+
+    memset(sum, 0, sizeof(sum));
+    for ( v = 0; v < nr_vcpus; v++ )
+    {
+        nr = NR_REASONS;
+        if ( xc_domain_hvm_exit_stats(xc_handle, d->domid,
+                                      XEN_DOMCTL_HVM_EXIT_STATS_GET, v,
+                                      cur, &nr, &vendor, &tsc_khz) != 0 )
+            continue; /* offline or not yet allocated */
+        for ( i = 0; i < nr; i++ )
+        {
+            sum[i].count += cur[i].count;
+            sum[i].cycles += cur[i].cycles;
+            for ( b = 0; b < NR_BUCKETS; b++ )
+                sum[i].hist[b] += cur[i].hist[b];
+            vcount[v] += cur[i].count;
+            vcycles[v] += cur[i].cycles;
+        }
+    }
+
+    if ( d->have_sample && (elapsed > 0) && (tsc_khz != 0) )
+        show_dom(d, sum, vcount, vcycles, nr_vcpus, elapsed);
+    else
+        printf("d%-5u (sampling)\n\n", d->domid);
+
+    memcpy(d->sum, sum, sizeof(sum));
+    free(d->vcpu_count);
+    free(d->vcpu_cycles);
+    d->vcpu_count = vcount;
+    d->vcpu_cycles = vcycles;
+    d->nr_vcpus = nr_vcpus;
+    d->have_sample = 1;
+}
+
+static int wanted(uint32_t domid, int nr_only, const uint32_t *only)
+{
+    int i;
+
+    if ( nr_only == 0 )
+        return 1;
+
+    for ( i = 0; i < nr_only; i++ )
+        if ( only[i] == domid )
+            return 1;
+
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: xen-exitstat [options] [domid ...]\n\n"
+            "Show the busiest exit reasons of HVM guests (all of them, or\n"
+            "only the listed domains).\n\n"
+            "  -i, --interval=SECS   time between refreshes (default %d)\n"
+            "  -n, --iterations=N    stop after N refreshes\n"
+            "  -t, --top=N           reasons shown per domain (default %d)\n"
+            "  -v, --vcpus           per-vcpu exit rates too\n"
+            "  -b, --batch           append output instead of redrawing\n"
+            "  -k, --keep            leave statistics enabled on exit\n"
+            "  -h, --help            this message\n",
+            DEFAULT_INTERVAL, DEFAULT_TOP);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option opts[] = {
+        { "interval",   required_argument, NULL, 'i' },
+        { "iterations", required_argument, NULL, 'n' },
+        { "top",        required_argument, NULL, 't' },
+        { "vcpus",      no_argument,       NULL, 'v' },
+        { "batch",      no_argument,       NULL, 'b' },
+        { "keep",       no_argument,       NULL, 'k' },
+        { "help",       no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    xc_dominfo_t *info;
+    uint32_t *only;
+    int ch, i, nr_doms, nr_only = 0;
+    unsigned int interval = DEFAULT_INTERVAL, iterations = 0, iter, t, j;
+    double last = now_sec(), now;
+
+    while ( (ch = getopt_long(argc, argv, "i:n:t:vbkh", opts, NULL)) != -1 )
+    {
+        switch ( ch )
+        {
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            top = strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            per_vcpu = 1;
+            break;
+        case 'b':
+            batch = 1;
+            break;
+        case 'k':
+            keep = 1;
+            break;
+        default:
+            usage();
+            return (ch == 'h') ? 0 : 1;
+        }
+    }
+
+    if ( interval == 0 )
+        interval = 1;
+
+    only = calloc(argc, sizeof(*only));
+    info = calloc(MAX_DOMAINS, sizeof(*info));
+    doms = calloc(MAX_DOMAINS, sizeof(*doms));
+    if ( (only == NULL) || (info == NULL) || (doms == NULL) )
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for ( i = optind; i < argc; i++ )
+        only[nr_only++] = strtoul(argv[i], NULL, 0);
+
+    xc_handle = xc_interface_open();
+    if ( xc_handle < 0 )
+    {
+        fprintf(stderr, "Failed to open xc interface: %s\n", strerror(errno));
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    for ( iter = 0; !stop && ((iterations == 0) || (iter <= iterations));
+          iter++ )
+    {
+        nr_doms = xc_domain_getinfo(xc_handle, 0, MAX_DOMAINS, info);
+        if ( nr_doms < 0 )
+        {
+            fprintf(stderr, "could not list domains: %s\n", strerror(errno));
+            break;
+        }
+
+        now = now_sec();
+        if ( !batch )
+            printf("\033[H\033[2J");
+        printf("xen-exitstat: %s exits, TSC %"PRIu64" MHz, every %us\n\n",
+               (vendor == XEN_HVM_EXIT_STATS_SVM) ? "SVM" : "VMX",
+               tsc_khz / 1000, interval);
+
+        for ( j = 0; j < nr_doms_tracked; j++ )
+            doms[j].seen = 0;
+
+        for ( i = 0; (i < nr_doms) && !stop; i++ )
+        {
+            struct dom_state *d;
+
+            if ( !info[i].hvm || info[i].dying || info[i].shutdown ||
+                 !wanted(info[i].domid, nr_only, only) )
+                continue;
+
+            d = find_dom(info[i].domid);
+            d->seen = 1;
+            if ( !d->have_sample && (start_dom(d) != 0) )
+                continue;
+            sample_dom(d, info[i].max_vcpu_id + 1, now - last);
+        }
+
+        /* Domains that went away: nothing left to disable. */
+        for ( j = 0; j < nr_doms_tracked; )
+            if ( !doms[j].seen )
+                forget_dom(&doms[j]);
+            else
+                j++;
+
+        fflush(stdout);
+        last = now;
+
+        if ( (iterations != 0) && (iter == iterations) )
+            break;
+        for ( t = 0; (t < interval) && !stop; t++ )
+            sleep(1);
+    }
+
+    stop_all();
+    xc_interface_close(xc_handle);
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-set-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
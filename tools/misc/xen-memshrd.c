@@ -0,0 +1,420 @@
+/*
+ * xen-memshrd.c: find identical pages in HVM guests and share them.
+ *
+ * The daemon periodically maps every page of each HVM guest read-only,
+ * hashes it, and remembers the first page seen with each hash.  When a
+ * later page has the same hash, both are nominated for sharing and the
+ * hypervisor is asked to merge them; it compares the full contents, so a
+ * hash collision only costs a failed merge.  Written pages are unshared
+ * again by the hypervisor, transparently to the guest.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <syslog.h>
+#include <sys/mman.h>
+
+#include <xenctrl.h>
+#include <inttypes.h>
+
+#define BATCH_PAGES        1024
+#define MAX_DOMAINS        1024
+#define DEFAULT_INTERVAL   60
+#define DEFAULT_TABLE_SIZE (1UL << 20)
+
+/* Set by the kernel in a batch entry that could not be mapped. */
+#define MAPPING_FAILED     0xF0000000UL
+
+#define PAGE_SIZE_BYTES    (1UL << XC_PAGE_SHIFT)
+
+/* First page seen with a given hash.  domid == DOMID_INVALID is empty. */
+struct candidate {
+    uint64_t      hash;
+    uint32_t      domid;
+    unsigned long gfn;
+};
+
+/* A page matching a candidate, to be merged once the batch is unmapped. */
+struct match {
+    struct candidate *source;
+    unsigned long     gfn;
+};
+
+static int xc_handle;
+static struct candidate *table;
+static unsigned long table_size = DEFAULT_TABLE_SIZE, table_used;
+static int verbose, use_syslog;
+static volatile sig_atomic_t stop;
+
+static struct {
+    unsigned long scanned, unmapped, matched, merged, failed;
+} pass_stats;
+
+static void logmsg(int prio, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    if ( use_syslog )
+        vsyslog(prio, fmt, ap);
+    else
+    {
+        vfprintf((prio <= LOG_WARNING) ? stderr : stdout, fmt, ap);
+        fputc('\n', (prio <= LOG_WARNING) ? stderr : stdout);
+    }
+    va_end(ap);
+}
+
+static void handle_signal(int sig)
+{
+    stop = 1;
+}
+
+/* Same 64-bit FNV-1a that the hypervisor uses for nominated pages. */
+static uint64_t hash_page(const void *page)
+{
+    const uint64_t *p = page;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    unsigned int i;
+
+    for ( i = 0; i < PAGE_SIZE_BYTES / sizeof(*p); i++ )
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+
+    return h;
+}
+
+/* Find the slot for a hash: either its candidate or the empty slot where
+ * it belongs.  NULL if the table is full and the hash is not present. */
+static struct candidate *lookup(uint64_t hash)
+{
+    unsigned long i, idx = hash & (table_size - 1);
+
+    for ( i = 0; i < table_size; i++ )
+    {
+        struct candidate *c = &table[(idx + i) & (table_size - 1)];
+
+        if ( (c->domid == DOMID_INVALID) || (c->hash == hash) )
+            return c;
+    }
+
+    return NULL;
+}
+
+static void merge(uint32_t domid, struct match *m)
+{
+    struct candidate *src = m->source;
+
+    pass_stats.matched++;
+
+    /* The source may have been written, freed, or its domain destroyed
+     * since we saw it: if so, this page becomes the candidate instead. */
+    if ( xc_memshr_nominate_gfn(xc_handle, src->domid, src->gfn, NULL) != 0 )
+    {
+        src->domid = domid;
+        src->gfn = m->gfn;
+        return;
+    }
+
+    if ( (xc_memshr_nominate_gfn(xc_handle, domid, m->gfn, NULL) != 0) ||
+         (xc_memshr_share(xc_handle, src->domid, src->gfn,
+                          domid, m->gfn) != 0) )
+    {
+        pass_stats.failed++;
+        if ( verbose > 1 )
+            logmsg(LOG_DEBUG, "d%u:%lx -> d%u:%lx not shared: %s",
+                   domid, m->gfn, src->domid, src->gfn, strerror(errno));
+        return;
+    }
+
+    pass_stats.merged++;
+}
+
+static void scan_batch(uint32_t domid, unsigned long start, unsigned int nr)
+{
+    xen_pfn_t arr[BATCH_PAGES];
+    struct match matches[BATCH_PAGES];
+    unsigned int i, nr_matches = 0;
+    char *map;
+
+    for ( i = 0; i < nr; i++ )
+        arr[i] = start + i;
+
+    map = xc_map_foreign_batch(xc_handle, domid, PROT_READ, arr, nr);
+    if ( map == NULL )
+    {
+        pass_stats.unmapped += nr;
+        return;
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        struct candidate *c;
+        uint64_t hash;
+
+        /* Holes, MMIO and the like. */
+        if ( arr[i] & MAPPING_FAILED )
+        {
+            pass_stats.unmapped++;
+            continue;
+        }
+
+        pass_stats.scanned++;
+        hash = hash_page(map + i * PAGE_SIZE_BYTES);
+
+        c = lookup(hash);
+        if ( c == NULL )
+            continue;
+
+        if ( c->domid == DOMID_INVALID )
+        {
+            c->hash = hash;
+            c->domid = domid;
+            c->gfn = start + i;
+            table_used++;
+            continue;
+        }
+
+        if ( (c->domid == domid) && (c->gfn == start + i) )
+            continue;
+
+        matches[nr_matches].source = c;
+        matches[nr_matches].gfn = start + i;
+        nr_matches++;
+    }
+
+    /* Nominating a page fails while anyone (including us) has it mapped. */
+    munmap(map, nr * PAGE_SIZE_BYTES);
+
+    for ( i = 0; i < nr_matches; i++ )
+        merge(domid, &matches[i]);
+}
+
+static void scan_domain(uint32_t domid)
+{
+    domid_t dom = domid;
+    unsigned long gfn;
+    long max_gfn;
+
+    max_gfn = xc_memory_op(xc_handle, XENMEM_maximum_gpfn, &dom);
+    if ( max_gfn < 0 )
+    {
+        logmsg(LOG_WARNING, "d%u: could not get memory size: %s",
+               domid, strerror(errno));
+        return;
+    }
+
+    for ( gfn = 0; (gfn <= max_gfn) && !stop; gfn += BATCH_PAGES )
+        scan_batch(domid, gfn,
+                   (max_gfn - gfn + 1 < BATCH_PAGES) ?
+                   (max_gfn - gfn + 1) : BATCH_PAGES);
+}
+
+static int wanted(uint32_t domid, int nr_only, uint32_t *only)
+{
+    int i;
+
+    if ( nr_only == 0 )
+        return 1;
+
+    for ( i = 0; i < nr_only; i++ )
+        if ( only[i] == domid )
+            return 1;
+
+    return 0;
+}
+
+static void report(xc_domaininfo_t *info, int nr_doms)
+{
+    xc_memshr_stats_t st;
+    int i;
+
+    if ( xc_memshr_stats(xc_handle, 0, &st) != 0 )
+    {
+        logmsg(LOG_WARNING, "could not get sharing statistics: %s",
+               strerror(errno));
+        return;
+    }
+
+    logmsg(LOG_INFO, "scanned %lu pages (%lu unmappable), %lu matches, "
+           "%lu merged, %lu failed",
+           pass_stats.scanned, pass_stats.unmapped, pass_stats.matched,
+           pass_stats.merged, pass_stats.failed);
+    logmsg(LOG_INFO, "%"PRIu64" shared frames back %"PRIu64" gfns: "
+           "%"PRIu64" pages (%"PRIu64"MB) saved",
+           st.shared_frames, st.shared_gfns,
+           st.shared_gfns - st.shared_frames,
+           (st.shared_gfns - st.shared_frames) >> (20 - XC_PAGE_SHIFT));
+
+    if ( !verbose )
+        return;
+
+    for ( i = 0; i < nr_doms; i++ )
+    {
+        if ( !(info[i].flags & XEN_DOMINF_hvm_guest) ||
+             (xc_memshr_stats(xc_handle, info[i].domain, &st) != 0) )
+            continue;
+        logmsg(LOG_INFO, "  d%u: %"PRIu64" of %"PRIu64" pages shared",
+               info[i].domain, st.domain_gfns, info[i].tot_pages +
+               st.domain_gfns);
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: xen-memshrd [options] [domid ...]\n\n"
+            "Share identical pages of HVM guests (all of them, or only\n"
+            "the listed domains).\n\n"
+            "  -i, --interval=SECS   time between passes (default %d)\n"
+            "  -o, --once            do a single pass and exit\n"
+            "  -t, --table=ENTRIES   size of the page hash table, rounded\n"
+            "                        up to a power of two (default %lu)\n"
+            "  -d, --daemon          detach and log to syslog\n"
+            "  -v, --verbose         per-domain statistics; twice for\n"
+            "                        failed merges too\n"
+            "  -h, --help            this message\n",
+            DEFAULT_INTERVAL, DEFAULT_TABLE_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option opts[] = {
+        { "interval", required_argument, NULL, 'i' },
+        { "once",     no_argument,       NULL, 'o' },
+        { "table",    required_argument, NULL, 't' },
+        { "daemon",   no_argument,       NULL, 'd' },
+        { "verbose",  no_argument,       NULL, 'v' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    xc_domaininfo_t *info;
+    uint32_t *only;
+    int ch, i, nr_doms, nr_only = 0, once = 0, daemonize = 0;
+    unsigned int interval = DEFAULT_INTERVAL, t;
+    unsigned long want, n;
+
+    while ( (ch = getopt_long(argc, argv, "i:ot:dvh", opts, NULL)) != -1 )
+    {
+        switch ( ch )
+        {
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            once = 1;
+            break;
+        case 't':
+            want = strtoul(optarg, NULL, 0);
+            for ( table_size = 1; table_size < want; table_size <<= 1 )
+                continue;
+            break;
+        case 'd':
+            daemonize = 1;
+            break;
+        case 'v':
+            verbose++;
+            break;
+        default:
+            usage();
+            return (ch == 'h') ? 0 : 1;
+        }
+    }
+
+    only = calloc(argc, sizeof(*only));
+    info = calloc(MAX_DOMAINS, sizeof(*info));
+    table = malloc(table_size * sizeof(*table));
+    if ( (only == NULL) || (info == NULL) || (table == NULL) )
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for ( i = optind; i < argc; i++ )
+        only[nr_only++] = strtoul(argv[i], NULL, 0);
+
+    xc_handle = xc_interface_open();
+    if ( xc_handle < 0 )
+    {
+        fprintf(stderr, "Failed to open xc interface: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if ( daemonize )
+    {
+        if ( daemon(0, 0) != 0 )
+        {
+            perror("daemon");
+            return 1;
+        }
+        openlog("xen-memshrd", LOG_PID, LOG_DAEMON);
+        use_syslog = 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    while ( !stop )
+    {
+        /* Start every pass afresh: candidates go stale as guests run. */
+        for ( n = 0; n < table_size; n++ )
+            table[n].domid = DOMID_INVALID;
+        table_used = 0;
+        memset(&pass_stats, 0, sizeof(pass_stats));
+
+        nr_doms = xc_domain_getinfolist(xc_handle, 0, MAX_DOMAINS, info);
+        if ( nr_doms < 0 )
+        {
+            logmsg(LOG_ERR, "could not list domains: %s", strerror(errno));
+            break;
+        }
+
+        for ( i = 0; (i < nr_doms) && !stop; i++ )
+        {
+            if ( !(info[i].flags & XEN_DOMINF_hvm_guest) ||
+                 (info[i].flags & (XEN_DOMINF_dying|XEN_DOMINF_shutdown)) ||
+                 !wanted(info[i].domain, nr_only, only) )
+                continue;
+            scan_domain(info[i].domain);
+        }
+
+        report(info, nr_doms);
+        if ( table_used == table_size )
+            logmsg(LOG_WARNING, "hash table full: use a larger --table");
+
+        if ( once )
+            break;
+        for ( t = 0; (t < interval) && !stop; t++ )
+            sleep(1);
+    }
+
+    xc_interface_close(xc_handle);
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-set-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -408,6 +408,7 @@ static PyObject *pyxc_linux_build(XcObject *self,
     int flags = 0;
     int store_evtchn, console_evtchn;
     int vhpt = 0;
+    unsigned long long nodemask = 0;
     unsigned int mem_mb;
     unsigned long store_mfn = 0;
     unsigned long console_mfn = 0;
@@ -420,14 +421,14 @@ static PyObject *pyxc_linux_build(XcObject *self,
                                 "console_evtchn", "image",
                                 /* optional */
                                 "ramdisk", "cmdline", "flags",
-                                "features", "vhpt", NULL };
+                                "features", "vhpt", "nodemask", NULL };
 
-    if ( !PyArg_ParseTupleAndKeywords(args, kwds, "iiiis|ssisi", kwd_list,
+    if ( !PyArg_ParseTupleAndKeywords(args, kwds, "iiiis|ssisiK", kwd_list,
                                       &domid, &store_evtchn, &mem_mb,
                                       &console_evtchn, &image,
                                       /* optional */
                                       &ramdisk, &cmdline, &flags,
-                                      &features, &vhpt) )
+                                      &features, &vhpt, &nodemask) )
         return NULL;
 
     xc_dom_loginit();
@@ -436,6 +437,7 @@ static PyObject *pyxc_linux_build(XcObject *self,
 
     /* for IA64 */
     dom->vhpt_size_log2 = vhpt;
+    dom->node_mask = nodemask;
 
     if ( xc_dom_linux_build(self->xc_handle, dom, domid, mem_mb, image,
                             ramdisk, flags, store_evtchn, &store_mfn,
@@ -892,20 +894,21 @@ static PyObject *pyxc_hvm_build(XcObject *self,
 #endif
     char *image;
     int memsize, target=-1, vcpus = 1, acpi = 0, apic = 1;
+    unsigned long long nodemask = 0;
 
     static char *kwd_list[] = { "domid",
                                 "memsize", "image", "target", "vcpus", "acpi",
-                                "apic", NULL };
-    if ( !PyArg_ParseTupleAndKeywords(args, kwds, "iis|iiii", kwd_list,
+                                "apic", "nodemask", NULL };
+    if ( !PyArg_ParseTupleAndKeywords(args, kwds, "iis|iiiiK", kwd_list,
                                       &dom, &memsize, &image, &target, &vcpus,
-                                      &acpi, &apic) )
+                                      &acpi, &apic, &nodemask) )
         return NULL;
 
     if ( target == -1 )
         target = memsize;
 
-    if ( xc_hvm_build_target_mem(self->xc_handle, dom, memsize,
-                                 target, image) != 0 )
+    if ( xc_hvm_build_nodes(self->xc_handle, dom, memsize,
+                            target, image, nodemask) != 0 )
         return pyxc_error_to_exception();
 
 #if !defined(__ia64__)
@@ -1295,18 +1298,21 @@ static PyObject *pyxc_sched_credit_domain_set(XcObject *self,
     uint32_t domid;
     uint16_t weight;
     uint16_t cap;
-    static char *kwd_list[] = { "domid", "weight", "cap", NULL };
-    static char kwd_type[] = "I|HH";
+    uint16_t latency;
+    static char *kwd_list[] = { "domid", "weight", "cap", "latency", NULL };
+    static char kwd_type[] = "I|HHH";
     struct xen_domctl_sched_credit sdom;
     
     weight = 0;
     cap = (uint16_t)~0U;
+    latency = (uint16_t)~0U;
     if( !PyArg_ParseTupleAndKeywords(args, kwds, kwd_type, kwd_list, 
-                                     &domid, &weight, &cap) )
+                                     &domid, &weight, &cap, &latency) )
         return NULL;
 
     sdom.weight = weight;
     sdom.cap = cap;
+    sdom.latency = latency;
 
     if ( xc_sched_credit_domain_set(self->xc_handle, domid, &sdom) != 0 )
         return pyxc_error_to_exception();
@@ -1326,9 +1332,56 @@ static PyObject *pyxc_sched_credit_domain_get(XcObject *self, PyObject *args)
     if ( xc_sched_credit_domain_get(self->xc_handle, domid, &sdom) != 0 )
         return pyxc_error_to_exception();
 
-    return Py_BuildValue("{s:H,s:H}",
+    return Py_BuildValue("{s:H,s:H,s:H}",
                          "weight",  sdom.weight,
-                         "cap",     sdom.cap);
+                         "cap",     sdom.cap,
+                         "latency", sdom.latency);
+}
+
+static PyObject *pyxc_sched_rt_domain_set(XcObject *self,
+                                          PyObject *args,
+                                          PyObject *kwds)
+{
+    uint32_t domid;
+    uint64_t period, budget;
+    int admit = 0;
+    static char *kwd_list[] = { "domid", "period", "budget", "admit", NULL };
+    static char kwd_type[] = "ILL|i";
+    struct xen_domctl_sched_rt sdom;
+    int rc;
+
+    if( !PyArg_ParseTupleAndKeywords(args, kwds, kwd_type, kwd_list, 
+                                     &domid, &period, &budget, &admit) )
+        return NULL;
+
+    sdom.period = period;
+    sdom.budget = budget;
+
+    if ( admit )
+        rc = xc_sched_rt_domain_admit(self->xc_handle, domid, &sdom);
+    else
+        rc = xc_sched_rt_domain_set(self->xc_handle, domid, &sdom);
+    if ( rc != 0 )
+        return pyxc_error_to_exception();
+
+    Py_INCREF(zero);
+    return zero;
+}
+
+static PyObject *pyxc_sched_rt_domain_get(XcObject *self, PyObject *args)
+{
+    uint32_t domid;
+    struct xen_domctl_sched_rt sdom;
+    
+    if( !PyArg_ParseTuple(args, "I", &domid) )
+        return NULL;
+    
+    if ( xc_sched_rt_domain_get(self->xc_handle, domid, &sdom) != 0 )
+        return pyxc_error_to_exception();
+
+    return Py_BuildValue("{s:L,s:L}",
+                         "period",  sdom.period,
+                         "budget",  sdom.budget);
 }
 
 static PyObject *pyxc_domain_setmaxmem(XcObject *self, PyObject *args)
@@ -1364,6 +1417,42 @@ static PyObject *pyxc_domain_set_target_mem(XcObject *self, PyObject *args)
     return zero;
 }
 
+static PyObject *pyxc_domain_get_node_pages(XcObject *self, PyObject *args)
+{
+    uint32_t dom;
+    xc_physinfo_t info = { 0 };
+    unsigned int i, nr_nodes;
+    uint64_t pages[64];
+    PyObject *list, *pages_obj;
+
+    if (!PyArg_ParseTuple(args, "i", &dom))
+        return NULL;
+
+    if ( xc_physinfo(self->xc_handle, &info) != 0 )
+        return pyxc_error_to_exception();
+
+    nr_nodes = info.nr_nodes;
+    if ( nr_nodes > ARRAY_SIZE(pages) )
+        nr_nodes = ARRAY_SIZE(pages);
+
+    if ( xc_domain_get_node_pages(self->xc_handle, dom, &nr_nodes,
+                                  pages) != 0 )
+        return pyxc_error_to_exception();
+
+    if ( nr_nodes > info.nr_nodes )
+        nr_nodes = info.nr_nodes;
+
+    list = PyList_New(0);
+    for ( i = 0; i < nr_nodes && i < ARRAY_SIZE(pages); i++ )
+    {
+        pages_obj = PyLong_FromUnsignedLongLong(pages[i]);
+        PyList_Append(list, pages_obj);
+        Py_DECREF(pages_obj);
+    }
+
+    return list;
+}
+
 static PyObject *pyxc_domain_set_memmap_limit(XcObject *self, PyObject *args)
 {
     uint32_t dom;
@@ -1654,6 +1743,7 @@ static PyMethodDef pyxc_methods[] = {
       " ramdisk [str, n/a]: Name of ramdisk file, if any.\n"
       " cmdline [str, n/a]: Kernel parameters, if any.\n\n"
       " vcpus   [int, 1]:   Number of Virtual CPUS in domain.\n\n"
+      " nodemask [long, 0]: NUMA nodes to place memory on; 0 for any.\n\n"
       "Returns: [int] 0 on success; -1 on error.\n" },
 
     { "hvm_build", 
@@ -1663,6 +1753,7 @@ static PyMethodDef pyxc_methods[] = {
       " dom     [int]:      Identifier of domain to build into.\n"
       " image   [str]:      Name of HVM loader image file.\n"
       " vcpus   [int, 1]:   Number of Virtual CPUS in domain.\n\n"
+      " nodemask [long, 0]: NUMA nodes to place memory on; 0 for any.\n\n"
       "Returns: [int] 0 on success; -1 on error.\n" },
 
     { "hvm_get_param", 
@@ -1754,6 +1845,8 @@ static PyMethodDef pyxc_methods[] = {
       "SMP credit scheduler.\n"
       " domid     [int]:   domain id to set\n"
       " weight    [short]: domain's scheduling weight\n"
+      " cap       [short]: domain's cap (percentage of a CPU)\n"
+      " latency   [short]: boosted run time after wakeup, in us\n"
       "Returns: [int] 0 on success; -1 on error.\n" },
 
     { "sched_credit_domain_get",
@@ -1763,7 +1856,30 @@ static PyMethodDef pyxc_methods[] = {
       "SMP credit scheduler.\n"
       " domid     [int]:   domain id to get\n"
       "Returns:   [dict]\n"
-      " weight    [short]: domain's scheduling weight\n"},
+      " weight    [short]: domain's scheduling weight\n"
+      " cap       [short]: domain's cap\n"
+      " latency   [short]: boosted run time after wakeup, in us\n"},
+
+    { "sched_rt_domain_set",
+      (PyCFunction)pyxc_sched_rt_domain_set,
+      METH_KEYWORDS, "\n"
+      "Set the real-time reservation of a domain when running with the\n"
+      "global EDF scheduler.\n"
+      " domid     [int]:   domain id to set\n"
+      " period    [long]:  reservation period, in ns\n"
+      " budget    [long]:  CPU time per period, in ns (0 = best-effort)\n"
+      " admit     [int]:   only check the reservation would be admitted\n"
+      "Returns: [int] 0 on success; -1 on error.\n" },
+
+    { "sched_rt_domain_get",
+      (PyCFunction)pyxc_sched_rt_domain_get,
+      METH_VARARGS, "\n"
+      "Get the real-time reservation of a domain when running with the\n"
+      "global EDF scheduler.\n"
+      " domid     [int]:   domain id to get\n"
+      "Returns:   [dict]\n"
+      " period    [long]:  reservation period, in ns\n"
+      " budget    [long]:  CPU time per period, in ns\n"},
 
     { "evtchn_alloc_unbound", 
       (PyCFunction)pyxc_evtchn_alloc_unbound,
@@ -1852,6 +1968,13 @@ static PyMethodDef pyxc_methods[] = {
       " mem_kb [int]: .\n"
       "Returns: [int] 0 on success; -1 on error.\n" },
 
+    { "domain_get_node_pages", 
+      (PyCFunction)pyxc_domain_get_node_pages, 
+      METH_VARARGS, "\n"
+      "Get the number of pages a domain owns on each NUMA node\n"
+      " dom [int]: Identifier of domain.\n"
+      "Returns: [list] page count per node, indexed by node id.\n" },
+
     { "domain_set_memmap_limit", 
       (PyCFunction)pyxc_domain_set_memmap_limit, 
       METH_VARARGS, "\n"
@@ -2088,6 +2211,7 @@ PyMODINIT_FUNC initxc(void)
     /* Expose some libxc constants to Python */
     PyModule_AddIntConstant(m, "XEN_SCHEDULER_SEDF", XEN_SCHEDULER_SEDF);
     PyModule_AddIntConstant(m, "XEN_SCHEDULER_CREDIT", XEN_SCHEDULER_CREDIT);
+    PyModule_AddIntConstant(m, "XEN_SCHEDULER_RT", XEN_SCHEDULER_RT);
 
 }
 
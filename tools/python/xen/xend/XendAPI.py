@@ -1524,7 +1524,9 @@ class XendAPI(object):
            and 'cap' in xeninfo.info['vcpus_params']:
             weight = xeninfo.info['vcpus_params']['weight']
             cap = xeninfo.info['vcpus_params']['cap']
-            xendom.domain_sched_credit_set(xeninfo.getDomid(), weight, cap)
+            latency = xeninfo.info['vcpus_params'].get('latency')
+            xendom.domain_sched_credit_set(xeninfo.getDomid(), weight, cap,
+                                           latency)
 
     def VM_set_VCPUs_number_live(self, _, vm_ref, num):
         dom = XendDomain.instance().get_vm_by_uuid(vm_ref)
@@ -218,6 +218,7 @@ XENAPI_CFG_TYPES = {
     'cpuid' : dict,
     'cpuid_check' : dict,
     'machine_address_size': int,
+    'numa_nodes': str,
     'suppress_spurious_page_faults': bool0,
     's3_integrity' : int,
 }
@@ -603,6 +604,8 @@ class XendConfig(dict):
             int(sxp.child_value(sxp_cfg, "cpu_weight", 256))
         cfg["vcpus_params"]["cap"] = \
             int(sxp.child_value(sxp_cfg, "cpu_cap", 0))
+        cfg["vcpus_params"]["latency"] = \
+            int(sxp.child_value(sxp_cfg, "cpu_latency", 0))
 
         # Only extract options we know about.
         extract_keys = LEGACY_UNSUPPORTED_BY_XENAPI_CFG + \
@@ -1005,6 +1008,8 @@ class XendConfig(dict):
         self['vcpus_params']['weight'] = \
             int(self['vcpus_params'].get('weight', 256))
         self['vcpus_params']['cap'] = int(self['vcpus_params'].get('cap', 0))
+        self['vcpus_params']['latency'] = \
+            int(self['vcpus_params'].get('latency', 0))
 
     def cpuid_to_sxp(self, sxpr, field):
         regs_list = []
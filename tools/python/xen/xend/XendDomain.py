@@ -1591,7 +1591,7 @@ class XendDomain:
 
         @param domid: Domain ID or Name
         @type domid: int or string.
-        @rtype: dict with keys 'weight' and 'cap'
+        @rtype: dict with keys 'weight', 'cap' and 'latency'
         @return: credit scheduler parameters
         """
         dominfo = self.domain_lookup_nr(domid)
@@ -1605,19 +1605,23 @@ class XendDomain:
                 raise XendError(str(ex))
         else:
             return {'weight' : dominfo.getWeight(),
-                    'cap'    : dominfo.getCap()} 
+                    'cap'    : dominfo.getCap(),
+                    'latency': dominfo.getLatency()} 
     
-    def domain_sched_credit_set(self, domid, weight = None, cap = None):
+    def domain_sched_credit_set(self, domid, weight = None, cap = None,
+                                latency = None):
         """Set credit scheduler parameters for a domain.
 
         @param domid: Domain ID or Name
         @type domid: int or string.
         @type weight: int
         @type cap: int
+        @type latency: int
         @rtype: 0
         """
         set_weight = False
         set_cap = False
+        set_latency = False
         dominfo = self.domain_lookup_nr(domid)
         if not dominfo:
             raise XendInvalidDomain(str(domid))
@@ -1636,23 +1640,76 @@ class XendDomain:
             else:
                 set_cap = True
 
+            if latency is None:
+                latency = int(~0)
+            elif latency < 0 or latency > 65534:
+                raise XendError("latency is out of range")
+            else:
+                set_latency = True
+
             assert type(weight) == int
             assert type(cap) == int
+            assert type(latency) == int
 
             rc = 0
             if dominfo._stateGet() in (DOM_STATE_RUNNING, DOM_STATE_PAUSED):
-                rc = xc.sched_credit_domain_set(dominfo.getDomid(), weight, cap)
+                rc = xc.sched_credit_domain_set(dominfo.getDomid(), weight, cap,
+                                                latency)
             if rc == 0:
                 if set_weight:
                     dominfo.setWeight(weight)
                 if set_cap:
                     dominfo.setCap(cap)
+                if set_latency:
+                    dominfo.setLatency(latency)
                 self.managed_config_save(dominfo)
             return rc
         except Exception, ex:
             log.exception(ex)
             raise XendError(str(ex))
 
+    def domain_sched_rt_get(self, domid):
+        """Get real-time scheduler parameters for a domain.
+
+        @param domid: Domain ID or Name
+        @type domid: int or string.
+        @rtype: dict with keys 'period' and 'budget'
+        @return: real-time reservation, in nanoseconds
+        """
+        dominfo = self.domain_lookup_nr(domid)
+        if not dominfo:
+            raise XendInvalidDomain(str(domid))
+        try:
+            return xc.sched_rt_domain_get(dominfo.getDomid())
+        except Exception, ex:
+            raise XendError(str(ex))
+
+    def domain_sched_rt_set(self, domid, period, budget, admit = 0):
+        """Set real-time scheduler parameters for a domain.
+
+        @param domid: Domain ID or Name
+        @type domid: int or string.
+        @param period: reservation period in nanoseconds
+        @type period: int
+        @param budget: CPU time per period in nanoseconds, 0 for best-effort
+        @type budget: int
+        @param admit: only check that the reservation would be admitted
+        @type admit: int
+        @rtype: 0
+        """
+        dominfo = self.domain_lookup_nr(domid)
+        if not dominfo:
+            raise XendInvalidDomain(str(domid))
+        if budget < 0 or period < 0 or budget > period:
+            raise XendError("budget/period out of range")
+        try:
+            return xc.sched_rt_domain_set(dominfo.getDomid(),
+                                          long(period), long(budget),
+                                          int(admit))
+        except Exception, ex:
+            log.exception(ex)
+            raise XendError(str(ex))
+
     def domain_maxmem_set(self, domid, mem):
         """Set the memory limit for a domain.
 
@@ -415,6 +415,7 @@ class XendDomainInfo:
         self.console_mfn = None
 
         self.native_protocol = None
+        self.node_mask = 0
 
         self.vmWatch = None
         self.shutdownWatch = None
@@ -471,7 +472,8 @@ class XendDomainInfo:
                 if xennode.xenschedinfo() == 'credit':
                     xendomains.domain_sched_credit_set(self.getDomid(),
                                                        self.getWeight(),
-                                                       self.getCap())
+                                                       self.getCap(),
+                                                       self.getLatency())
             except:
                 log.exception('VM start failed')
                 self.destroy()
@@ -1779,6 +1781,10 @@ class XendDomainInfo:
         """For use only by image.py."""
         return self.info['features']
 
+    def getNodeMask(self):
+        """For use only by image.py."""
+        return self.node_mask
+
     def getVCpuCount(self):
         return self.info['VCPUs_max']
 
@@ -1835,6 +1841,12 @@ class XendDomainInfo:
     def setCap(self, cpu_cap):
         self.info['vcpus_params']['cap'] = cpu_cap
 
+    def getLatency(self):
+        return self.info['vcpus_params']['latency']
+
+    def setLatency(self, cpu_latency):
+        self.info['vcpus_params']['latency'] = cpu_latency
+
     def getWeight(self):
         return self.info['vcpus_params']['weight']
 
@@ -2459,7 +2471,36 @@ class XendDomainInfo:
                         return True
             return False
 
-        if has_cpus():
+        self.node_mask = 0
+
+        if self.info.has_key('numa_nodes') and self.info['numa_nodes']:
+            # Explicit placement: memory is split over the given nodes and
+            # vcpus not pinned by 'cpus' may run on any of their cpus.  HVM
+            # guests see one virtual node per host node, so each vcpu is
+            # kept on the node its SRAT entry names.
+            info = xc.physinfo()
+            try:
+                nodes = [int(n) for n in str(self.info['numa_nodes']).split(',')]
+            except ValueError:
+                raise VmError('Invalid numa_nodes: %s' % self.info['numa_nodes'])
+            cpumask = []
+            for n in nodes:
+                if n < 0 or n >= info['nr_nodes']:
+                    raise VmError('NUMA node %d does not exist' % n)
+                self.node_mask |= 1L << n
+                cpumask += info['node_to_cpu'][n]
+            # The builder lays memory out in ascending node order.
+            nodes = [n for n in range(0, info['nr_nodes'])
+                     if self.node_mask & (1L << n)]
+            nr_vcpus = self.info['VCPUs_max']
+            for v in range(0, nr_vcpus):
+                if self.info.is_hvm() and len(nodes) > 1:
+                    cpumask = info['node_to_cpu'][nodes[v * len(nodes) / nr_vcpus]]
+                if has_cpus() and self.info['cpus'][v]:
+                    xc.vcpu_setaffinity(self.domid, v, self.info['cpus'][v])
+                elif cpumask:
+                    xc.vcpu_setaffinity(self.domid, v, cpumask)
+        elif has_cpus():
             for v in range(0, self.info['VCPUs_max']):
                 if self.info['cpus'][v]:
                     xc.vcpu_setaffinity(self.domid, v, self.info['cpus'][v])
@@ -2504,6 +2545,10 @@ class XendDomainInfo:
                 cpumask = info['node_to_cpu'][index]
                 for v in range(0, self.info['VCPUs_max']):
                     xc.vcpu_setaffinity(self.domid, v, cpumask)
+                # Allocate from the chosen node explicitly rather than
+                # relying on the builder running on one of its cpus.
+                if index in candidate_node_list:
+                    self.node_mask = 1L << index
 
 
     def _initDomain(self):
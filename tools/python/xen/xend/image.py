@@ -682,7 +682,8 @@ class LinuxImageHandler(ImageHandler):
                               ramdisk        = self.ramdisk,
                               features       = self.vm.getFeatures(),
                               flags          = self.flags,
-                              vhpt           = self.vhpt)
+                              vhpt           = self.vhpt,
+                              nodemask       = self.vm.getNodeMask())
 
     def getRequiredAvailableMemory(self, mem_kb):
         if self.is_stubdom :
@@ -878,7 +879,8 @@ class HVMImageHandler(ImageHandler):
                           target         = mem_mb,
                           vcpus          = self.vm.getVCpuCount(),
                           acpi           = self.acpi,
-                          apic           = self.apic)
+                          apic           = self.apic,
+                          nodemask       = self.vm.getNodeMask())
         rc['notes'] = { 'SUSPEND_CANCEL': 1 }
 
         rc['store_mfn'] = xc.hvm_get_param(self.vm.getDomid(),
@@ -158,7 +158,8 @@ class SrvDomain(SrvDir):
         fn = FormFn(self.xd.domain_sched_credit_set,
                     [['dom', 'str'],
                      ['weight', 'int'],
-                     ['cap', 'int']])
+                     ['cap', 'int'],
+                     ['latency', 'int']])
         val = fn(req.args, {'dom': self.dom.getName()})
         return val
 
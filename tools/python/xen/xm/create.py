@@ -258,6 +258,11 @@ gopts.var('cpu_weight', val='WEIGHT',
           fn=set_int, default=None,
           use="""Set the cpu time ratio to be allocated to the domain.""")
 
+gopts.var('cpu_latency', val='LATENCY',
+          fn=set_int, default=None,
+          use="""Set how long, in microseconds, a woken vcpu keeps its
+          boosted priority under the credit scheduler (0 for the default).""")
+
 gopts.var('restart', val='onreboot|always|never',
           fn=set_value, default=None,
           use="""Deprecated.  Use on_poweroff, on_reboot, and on_crash
@@ -601,6 +606,11 @@ gopts.var('machine_address_size', val='BITS',
           fn=set_int, default=None,
           use="""Maximum machine address size""")
 
+gopts.var('numa_nodes', val='NODES',
+          fn=set_value, default=None,
+          use="""NUMA nodes to allocate memory from and run the domain on,
+          e.g. "0" or "0,1".  Defaults to the least loaded node that fits.""")
+
 gopts.var('suppress_spurious_page_faults', val='yes|no',
           fn=set_bool, default=None,
           use="""Do not inject spurious page faults into this guest""")
@@ -957,7 +967,8 @@ def make_config(vals):
                    'restart', 'on_poweroff',
                    'on_reboot', 'on_crash', 'vcpus', 'vcpu_avail', 'features',
                    'on_xend_start', 'on_xend_stop', 'target', 'cpuid',
-                   'cpuid_check', 'machine_address_size', 'suppress_spurious_page_faults'])
+                   'cpuid_check', 'machine_address_size', 'numa_nodes',
+                   'suppress_spurious_page_faults'])
 
     if vals.uuid is not None:
         config.append(['uuid', vals.uuid])
@@ -969,6 +980,8 @@ def make_config(vals):
         config.append(['cpu_cap', vals.cpu_cap])
     if vals.cpu_weight is not None:
         config.append(['cpu_weight', vals.cpu_weight])
+    if vals.cpu_latency is not None:
+        config.append(['cpu_latency', vals.cpu_latency])
     if vals.blkif:
         config.append(['backend', ['blkif']])
     if vals.netif:
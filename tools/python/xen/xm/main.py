@@ -147,8 +147,10 @@ SUBCOMMAND_HELP = {
     'log'         : ('', 'Print Xend log'),
     'rename'      : ('<Domain> <NewDomainName>', 'Rename a domain.'),
     'sched-sedf'  : ('<Domain> [options]', 'Get/set EDF parameters.'),
-    'sched-credit': ('[-d <Domain> [-w[=WEIGHT]|-c[=CAP]]]',
+    'sched-credit': ('[-d <Domain> [-w[=WEIGHT]|-c[=CAP]|-l[=LATENCY]]]',
                      'Get/set credit scheduler parameters.'),
+    'sched-rt'    : ('[-d <Domain> [-p PERIOD -b BUDGET] [-t]]',
+                     'Get/set real-time scheduler reservations.'),
     'sysrq'       : ('<Domain> <letter>', 'Send a sysrq to a domain.'),
     'debug-keys'  : ('<Keys>', 'Send debug keys to Xen.'),
     'trigger'     : ('<Domain> <nmi|reset|init|s3resume|power> [<VCPU>]',
@@ -240,6 +242,16 @@ SUBCOMMAND_OPTIONS = {
        ('-d DOMAIN', '--domain=DOMAIN', 'Domain to modify'),
        ('-w WEIGHT', '--weight=WEIGHT', 'Weight (int)'),
        ('-c CAP',    '--cap=CAP',       'Cap (int)'),
+       ('-l LATENCY', '--latency=LATENCY',
+        'Boosted run time after wakeup (us), 0 for the default'),
+    ),
+    'sched-rt': (
+       ('-d DOMAIN', '--domain=DOMAIN', 'Domain to modify'),
+       ('-p PERIOD', '--period=PERIOD', 'Reservation period (us)'),
+       ('-b BUDGET', '--budget=BUDGET',
+        'CPU time per period (us), 0 for best-effort'),
+       ('-t',        '--test',
+        'Only check the reservation passes admission control'),
     ),
     'list': (
        ('-l', '--long',         'Output all VM details in SXP'),
@@ -364,6 +376,7 @@ host_commands = [
 scheduler_commands = [
     "sched-credit",
     "sched-sedf",
+    "sched-rt",
     ]
 
 device_commands = [
@@ -1575,8 +1588,8 @@ def xm_sched_credit(args):
     check_sched_type('credit')
 
     try:
-        opts, params = getopt.getopt(args, "d:w:c:",
-            ["domain=", "weight=", "cap="])
+        opts, params = getopt.getopt(args, "d:w:c:l:",
+            ["domain=", "weight=", "cap=", "latency="])
     except getopt.GetoptError, opterr:
         err(opterr)
         usage('sched-credit')
@@ -1584,6 +1597,7 @@ def xm_sched_credit(args):
     domid = None
     weight = None
     cap = None
+    latency = None
 
     for o, a in opts:
         if o in ["-d", "--domain"]:
@@ -1592,17 +1606,19 @@ def xm_sched_credit(args):
             weight = int(a)
         elif o in ["-c", "--cap"]:
             cap = int(a);
+        elif o in ["-l", "--latency"]:
+            latency = int(a)
 
     doms = filter(lambda x : domid_match(domid, x),
                   [parse_doms_info(dom)
                   for dom in getDomains(None, 'all')])
 
-    if weight is None and cap is None:
+    if weight is None and cap is None and latency is None:
         if domid is not None and doms == []: 
             err("Domain '%s' does not exist." % domid)
             usage('sched-credit')
         # print header if we aren't setting any parameters
-        print '%-33s %4s %6s %4s' % ('Name','ID','Weight','Cap')
+        print '%-33s %4s %6s %4s %7s' % ('Name','ID','Weight','Cap','Latency')
         
         for d in doms:
             try:
@@ -1617,14 +1633,16 @@ def xm_sched_credit(args):
 
             if 'weight' not in info or 'cap' not in info:
                 # domain does not support sched-credit?
-                info = {'weight': -1, 'cap': -1}
+                info = {'weight': -1, 'cap': -1, 'latency': -1}
 
-            info['weight'] = int(info['weight'])
-            info['cap']    = int(info['cap'])
+            info['weight']  = int(info['weight'])
+            info['cap']     = int(info['cap'])
+            info['latency'] = int(info.get('latency', 0))
             
             info['name']  = d['name']
             info['domid'] = str(d['domid'])
-            print( ("%(name)-32s %(domid)5s %(weight)6d %(cap)4d") % info)
+            print( ("%(name)-32s %(domid)5s %(weight)6d %(cap)4d %(latency)7d")
+                   % info)
     else:
         if domid is None:
             # place holder for system-wide scheduler parameters
@@ -1641,6 +1659,11 @@ def xm_sched_credit(args):
                     get_single_vm(domid),
                     "cap",
                     cap)
+                if latency is not None:
+                    server.xenapi.VM.add_to_VCPUs_params_live(
+                        get_single_vm(domid),
+                        "latency",
+                        latency)
             else:
                 server.xenapi.VM.add_to_VCPUs_params(
                     get_single_vm(domid),
@@ -1650,11 +1673,85 @@ def xm_sched_credit(args):
                     get_single_vm(domid),
                     "cap",
                     cap)
+                if latency is not None:
+                    server.xenapi.VM.add_to_VCPUs_params(
+                        get_single_vm(domid),
+                        "latency",
+                        latency)
         else:
-            result = server.xend.domain.sched_credit_set(domid, weight, cap)
+            result = server.xend.domain.sched_credit_set(domid, weight, cap,
+                                                         latency)
             if result != 0:
                 err(str(result))
 
+def xm_sched_rt(args):
+    """Get/Set reservations for the global EDF real-time scheduler."""
+    xenapi_unsupported()
+
+    check_sched_type('rt')
+
+    try:
+        opts, params = getopt.getopt(args, "d:p:b:t",
+            ["domain=", "period=", "budget=", "test"])
+    except getopt.GetoptError, opterr:
+        err(opterr)
+        usage('sched-rt')
+
+    domid = None
+    period = None
+    budget = None
+    admit = 0
+
+    for o, a in opts:
+        if o in ["-d", "--domain"]:
+            domid = a
+        elif o in ["-p", "--period"]:
+            period = int(a) * 1000
+        elif o in ["-b", "--budget"]:
+            budget = int(a) * 1000
+        elif o in ["-t", "--test"]:
+            admit = 1
+
+    doms = filter(lambda x : domid_match(domid, x),
+                  [parse_doms_info(dom)
+                  for dom in getDomains(None, 'running')])
+
+    if period is None and budget is None:
+        if domid is not None and doms == []:
+            err("Domain '%s' does not exist." % domid)
+            usage('sched-rt')
+        # print header if we aren't setting any parameters
+        print '%-33s %4s %10s %10s' % ('Name','ID','Period(us)','Budget(us)')
+
+        for d in doms:
+            try:
+                info = server.xend.domain.sched_rt_get(d['name'])
+            except xmlrpclib.Fault:
+                # domain does not support sched-rt?
+                info = {'period': -1000, 'budget': -1000}
+
+            info['period'] = int(info['period']) / 1000
+            info['budget'] = int(info['budget']) / 1000
+            info['name']  = d['name']
+            info['domid'] = str(d['domid'])
+            print( ("%(name)-32s %(domid)5s %(period)10d %(budget)10d")
+                   % info)
+    else:
+        if domid is None:
+            err("No domain given.")
+            usage('sched-rt')
+        if budget is None:
+            err("No budget given.")
+            usage('sched-rt')
+        if period is None:
+            period = 0
+
+        try:
+            server.xend.domain.sched_rt_set(domid, period, budget, admit)
+        except xmlrpclib.Fault, ex:
+            err("Reservation not admitted: %s" % ex.faultString)
+            sys.exit(1)
+
 def xm_info(args):
     arg_check(args, "info", 0, 1)
     
@@ -2890,6 +2987,7 @@ commands = {
     # scheduler
     "sched-sedf": xm_sched_sedf,
     "sched-credit": xm_sched_credit,
+    "sched-rt": xm_sched_rt,
     # block
     "block-attach": xm_block_attach,
     "block-detach": xm_block_detach,
@@ -0,0 +1,188 @@
+/******************************************************************************
+ * test_hpet_stress.c
+ *
+ * HPET main-counter stress test. Run as root inside an HVM guest with the
+ * virtual HPET enabled: every thread maps the HPET registers through /dev/mem
+ * and reads the main counter in a tight loop, checking that it never goes
+ * backwards, either against its own previous read or against the highest
+ * value published by any thread before the read started. Optionally one
+ * comparator register is read on every iteration as well, to mix per-timer
+ * accesses in with the counter reads. Reports the aggregate read rate, which
+ * should scale with the number of threads when counter reads do not
+ * serialise in the hypervisor.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#define HPET_BASE_ADDRESS 0xfed00000UL
+#define HPET_MMAP_SIZE    1024
+#define HPET_COUNTER      0x0f0
+#define HPET_T0_CMP       0x108
+
+#define DEFAULT_THREADS   4
+#define DEFAULT_SECONDS   5
+
+static volatile uint8_t *hpet;
+static volatile int stop;
+static int read_comparator;
+
+/* Highest counter value seen by any thread. */
+static volatile uint64_t global_max;
+
+struct worker {
+    pthread_t thread;
+    unsigned int cpu;
+    unsigned long reads;
+    unsigned long local_backwards;
+    unsigned long global_backwards;
+};
+
+static inline uint64_t hpet_read_counter(void)
+{
+    return *(volatile uint64_t *)(hpet + HPET_COUNTER);
+}
+
+static void publish_max(uint64_t val)
+{
+    uint64_t old = global_max;
+
+    while ( (val > old) &&
+            !__sync_bool_compare_and_swap(&global_max, old, val) )
+        old = global_max;
+}
+
+static void *worker_fn(void *arg)
+{
+    struct worker *w = arg;
+    uint64_t last = 0, val, floor;
+    cpu_set_t mask;
+
+    CPU_ZERO(&mask);
+    CPU_SET(w->cpu, &mask);
+    (void)pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+
+    while ( !stop )
+    {
+        floor = global_max;
+        __sync_synchronize();
+
+        val = hpet_read_counter();
+        if ( read_comparator )
+            (void)*(volatile uint64_t *)(hpet + HPET_T0_CMP);
+
+        if ( val < last )
+            w->local_backwards++;
+        if ( val < floor )
+            w->global_backwards++;
+
+        publish_max(val);
+        last = val;
+        w->reads++;
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long nr_threads = DEFAULT_THREADS, seconds = DEFAULT_SECONDS;
+    unsigned long i, reads = 0, local_bw = 0, global_bw = 0;
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    struct worker *workers;
+    struct timespec start, end;
+    double elapsed;
+    int fd, opt;
+
+    while ( (opt = getopt(argc, argv, "c")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'c':
+            read_comparator = 1;
+            break;
+        default:
+            goto usage;
+        }
+    }
+
+    if ( optind < argc )
+        nr_threads = strtoul(argv[optind++], NULL, 0);
+    if ( optind < argc )
+        seconds = strtoul(argv[optind++], NULL, 0);
+    if ( (nr_threads == 0) || (seconds == 0) )
+        goto usage;
+
+    fd = open("/dev/mem", O_RDONLY | O_SYNC);
+    if ( fd < 0 )
+    {
+        perror("open /dev/mem");
+        return 1;
+    }
+
+    hpet = mmap(NULL, HPET_MMAP_SIZE, PROT_READ, MAP_SHARED, fd,
+                HPET_BASE_ADDRESS);
+    if ( hpet == MAP_FAILED )
+    {
+        perror("mmap HPET");
+        return 1;
+    }
+
+    workers = calloc(nr_threads, sizeof(*workers));
+    if ( workers == NULL )
+    {
+        perror("calloc");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for ( i = 0; i < nr_threads; i++ )
+    {
+        workers[i].cpu = i % (nr_cpus > 0 ? nr_cpus : 1);
+        if ( pthread_create(&workers[i].thread, NULL, worker_fn,
+                            &workers[i]) != 0 )
+        {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    sleep(seconds);
+    stop = 1;
+
+    for ( i = 0; i < nr_threads; i++ )
+    {
+        pthread_join(workers[i].thread, NULL);
+        reads += workers[i].reads;
+        local_bw += workers[i].local_backwards;
+        global_bw += workers[i].global_backwards;
+        printf("thread %lu (cpu %u): %lu reads\n",
+               i, workers[i].cpu, workers[i].reads);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) +
+        (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%lu threads%s: %lu reads in %.2fs, %.0f reads/s\n",
+           nr_threads, read_comparator ? " (+comparator)" : "",
+           reads, elapsed, reads / elapsed);
+    printf("backwards steps: %lu per-thread, %lu cross-thread\n",
+           local_bw, global_bw);
+
+    return (local_bw || global_bw) ? 2 : 0;
+
+ usage:
+    fprintf(stderr, "Usage: %s [-c] [threads] [seconds]\n", argv[0]);
+    return 1;
+}
@@ -57,6 +57,9 @@ typedef struct settings_st {
     unsigned long disk_rsvd;
     unsigned long timeout;
     unsigned long memory_buffer;
+    char *index_file;
+    uint32_t cls_mask[16];
+    int nr_cls_masks;
     uint8_t discard:1,
         disable_tracing:1;
 } settings_t;
@@ -69,6 +72,7 @@ static int xc_handle = -1;
 static int event_fd = -1;
 static int virq_port = -1;
 static int outfd = 1;
+static uint64_t out_offset; /* bytes written to outfd so far */
 
 static void close_handler(int signal)
 {
@@ -119,6 +123,156 @@ struct cpu_change_record {
      | (((sizeof(struct cpu_change_record)/sizeof(uint32_t)) - 1)   \
         << TRACE_EXTRA_SHIFT) )
 
+/*
+ * Index file layout (host endian): a struct index_header followed by
+ * nr_entries struct index_entry sorted by first_tsc.  Each entry describes
+ * one per-CPU window in the trace file: the file offset of its cpu_change
+ * record, the window size and the TSC range of its timestamped records.
+ * Analysis tools can binary-search the index to seek straight to a time.
+ */
+#define INDEX_MAGIC   0x58544958 /* "XITX" */
+#define INDEX_VERSION 1
+
+struct index_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nr_cpus;
+    uint32_t pad;
+    uint64_t nr_entries;
+};
+
+struct index_entry {
+    uint64_t first_tsc;
+    uint64_t last_tsc;
+    uint64_t offset;
+    uint32_t cpu;
+    uint32_t size;
+};
+
+#define INDEX_TSC_UNSET (~0ULL)
+
+static struct {
+    struct index_entry *ent;
+    unsigned long nr, max;
+    uint64_t *cpu_tsc;  /* last timestamp seen on each CPU */
+    unsigned int nr_cpus;
+} idx;
+
+static void index_init(unsigned int nr_cpus)
+{
+    idx.nr_cpus = nr_cpus;
+    idx.cpu_tsc = calloc(nr_cpus, sizeof(*idx.cpu_tsc));
+    if ( idx.cpu_tsc == NULL )
+    {
+        PERROR("Failed to allocate index");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void index_start_window(unsigned int cpu, uint64_t offset,
+                               unsigned long size)
+{
+    struct index_entry *e;
+
+    if ( idx.nr == idx.max )
+    {
+        idx.max = idx.max ? idx.max * 2 : 1024;
+        idx.ent = realloc(idx.ent, idx.max * sizeof(*idx.ent));
+        if ( idx.ent == NULL )
+        {
+            PERROR("Failed to grow index");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    e = &idx.ent[idx.nr++];
+    e->first_tsc = INDEX_TSC_UNSET;
+    e->last_tsc = idx.cpu_tsc[cpu];
+    e->offset = offset;
+    e->cpu = cpu;
+    e->size = size;
+}
+
+/* Record the TSC range of the records in (part of) the current window. */
+static void index_scan(unsigned int cpu, unsigned char *p, unsigned long size)
+{
+    struct index_entry *e = &idx.ent[idx.nr - 1];
+    struct t_rec *rec;
+    unsigned long rec_size;
+    uint64_t tsc;
+
+    while ( size >= sizeof(uint32_t) )
+    {
+        rec = (struct t_rec *)p;
+        rec_size = sizeof(uint32_t) * (1 + rec->extra_u32) +
+            (rec->cycles_included ? sizeof(uint64_t) : 0);
+        if ( rec_size > size )
+            break;
+
+        if ( rec->cycles_included )
+        {
+            tsc = ((uint64_t)rec->u.cycles.cycles_hi << 32) |
+                rec->u.cycles.cycles_lo;
+            if ( e->first_tsc == INDEX_TSC_UNSET )
+                e->first_tsc = tsc;
+            e->last_tsc = tsc;
+        }
+
+        p += rec_size;
+        size -= rec_size;
+    }
+
+    idx.cpu_tsc[cpu] = e->last_tsc;
+}
+
+static int index_cmp(const void *a, const void *b)
+{
+    const struct index_entry *x = a, *y = b;
+
+    if ( x->first_tsc != y->first_tsc )
+        return (x->first_tsc < y->first_tsc) ? -1 : 1;
+    if ( x->cpu != y->cpu )
+        return (x->cpu < y->cpu) ? -1 : 1;
+    return (x->offset < y->offset) ? -1 : (x->offset > y->offset);
+}
+
+static void index_write(void)
+{
+    struct index_header hdr = { 0 };
+    unsigned long i;
+    FILE *f;
+
+    /* Windows with no timestamped records sit at the CPU's previous TSC. */
+    for ( i = 0; i < idx.nr; i++ )
+        if ( idx.ent[i].first_tsc == INDEX_TSC_UNSET )
+            idx.ent[i].first_tsc = idx.ent[i].last_tsc;
+
+    qsort(idx.ent, idx.nr, sizeof(*idx.ent), index_cmp);
+
+    hdr.magic = INDEX_MAGIC;
+    hdr.version = INDEX_VERSION;
+    hdr.nr_cpus = idx.nr_cpus;
+    hdr.nr_entries = idx.nr;
+
+    f = fopen(opts.index_file, "w");
+    if ( f == NULL )
+    {
+        PERROR("Could not open index file %s", opts.index_file);
+        exit(EXIT_FAILURE);
+    }
+
+    if ( (fwrite(&hdr, sizeof(hdr), 1, f) != 1) ||
+         (idx.nr && (fwrite(idx.ent, sizeof(*idx.ent), idx.nr, f) != idx.nr)) ||
+         fclose(f) )
+    {
+        PERROR("Failed to write index file %s", opts.index_file);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "Wrote %lu index entries to %s\n", idx.nr,
+            opts.index_file);
+}
+
 void membuf_alloc(unsigned long size)
 {
     membuf.buf = malloc(size);
@@ -368,6 +522,9 @@ static void write_buffer(unsigned int cpu, unsigned char *start, int size,
             rec.data.cpu = cpu;
             rec.data.window_size = total_size;
 
+            if ( opts.index_file )
+                index_start_window(cpu, out_offset, total_size);
+
             written = write(outfd, &rec, sizeof(rec));
             if ( written != sizeof(rec) )
             {
@@ -375,6 +532,7 @@ static void write_buffer(unsigned int cpu, unsigned char *start, int size,
                         written);
                 goto fail;
             }
+            out_offset += written;
         }
     }
 
@@ -391,6 +549,10 @@ static void write_buffer(unsigned int cpu, unsigned char *start, int size,
                     size, written);
             goto fail;
         }
+        out_offset += written;
+
+        if ( opts.index_file )
+            index_scan(cpu, start, size);
     }
 
     return;
@@ -467,7 +629,7 @@ static struct t_buf *map_tbufs(unsigned long tbufs_mfn, unsigned int num,
 /**
  * set_mask - set the cpu/event mask in HV
  * @mask:           the new mask 
- * @type:           the new mask type,0-event mask, 1-cpu mask
+ * @type:           the new mask type,0-event mask, 1-cpu mask, 2-class mask
  *
  */
 static void set_mask(uint32_t mask, int type)
@@ -480,6 +642,9 @@ static void set_mask(uint32_t mask, int type)
     } else if (type == 0) {
         ret = xc_tbuf_set_evt_mask(xc_handle, mask);
         fprintf(stderr, "change evtmask to 0x%x\n", mask);
+    } else if (type == 2) {
+        ret = xc_tbuf_set_cls_mask(xc_handle, mask);
+        fprintf(stderr, "change clsmask to 0x%x\n", mask);
     }
 
     if ( ret != 0 )
@@ -664,6 +829,9 @@ static int monitor_tbufs(void)
     meta  = init_bufs_ptrs(tbufs_mapped, num, size);
     data  = init_rec_ptrs(meta, num);
 
+    if ( opts.index_file )
+        index_init(num);
+
     if ( opts.discard )
         for ( i = 0; i < num; i++ )
             meta[i]->cons = meta[i]->prod;
@@ -736,6 +904,9 @@ static int monitor_tbufs(void)
     if ( opts.memory_buffer )
         membuf_dump();
 
+    if ( opts.index_file )
+        index_write();
+
     /* cleanup */
     free(meta);
     free(data);
@@ -764,6 +935,9 @@ static void usage(void)
 "\n" \
 "  -c, --cpu-mask=c        Set cpu-mask\n" \
 "  -e, --evt-mask=e        Set evt-mask\n" \
+"  -C, --cls-mask=m        Set the subclass bits of m (bits 12-15) for\n" \
+"                          just the classes in m (bits 16-27).  May be\n" \
+"                          repeated; applied after --evt-mask.\n" \
 "  -s, --poll-sleep=p      Set sleep time, p, in milliseconds between\n" \
 "                          polling the trace buffer for new data\n" \
 "                          (default " xstr(POLL_SLEEP_MILLIS) ").\n" \
@@ -784,6 +958,9 @@ static void usage(void)
 "  -V, --version           Print program version\n" \
 "  -M, --memory-buffer=b   Copy trace records to a circular memory buffer.\n" \
 "                          Dump to file on exit.\n" \
+"  -I, --index=FILE        Write a per-CPU window index, sorted by\n" \
+"                          timestamp, to FILE on exit.  Not compatible\n" \
+"                          with --memory-buffer.\n" \
 "\n" \
 "This tool is used to capture trace buffer data from Xen. The\n" \
 "data is output in a binary format, in the following order:\n" \
@@ -900,6 +1077,8 @@ static void parse_args(int argc, char **argv)
         { "reserve-disk-space", required_argument, 0, 'r' },
         { "time-interval",  required_argument, 0, 'T' },
         { "memory-buffer",  required_argument, 0, 'M' },
+        { "cls-mask",       required_argument, 0, 'C' },
+        { "index",          required_argument, 0, 'I' },
         { "discard-buffers", no_argument,      0, 'D' },
         { "dont-disable-tracing", no_argument, 0, 'x' },
         { "help",           no_argument,       0, '?' },
@@ -907,7 +1086,7 @@ static void parse_args(int argc, char **argv)
         { 0, 0, 0, 0 }
     };
 
-    while ( (option = getopt_long(argc, argv, "t:s:c:e:S:r:T:M:Dx?V",
+    while ( (option = getopt_long(argc, argv, "t:s:c:e:C:S:r:T:M:I:Dx?V",
                     long_options, NULL)) != -1) 
     {
         switch ( option )
@@ -953,6 +1132,20 @@ static void parse_args(int argc, char **argv)
             opts.memory_buffer = sargtol(optarg, 0);
             break;
 
+        case 'C': /* set subclass mask of individual classes */
+            if ( opts.nr_cls_masks ==
+                 (sizeof(opts.cls_mask) / sizeof(opts.cls_mask[0])) )
+            {
+                fprintf(stderr, "Too many class masks\n");
+                usage();
+            }
+            opts.cls_mask[opts.nr_cls_masks++] = argtol(optarg, 0);
+            break;
+
+        case 'I':
+            opts.index_file = optarg;
+            break;
+
         default:
             usage();
         }
@@ -962,6 +1155,12 @@ static void parse_args(int argc, char **argv)
     if (optind != (argc-1))
         usage();
 
+    if ( opts.index_file && opts.memory_buffer )
+    {
+        fprintf(stderr, "--index cannot be used with --memory-buffer\n");
+        usage();
+    }
+
     opts.outfile = argv[optind];
 }
 
@@ -972,7 +1171,7 @@ static void parse_args(int argc, char **argv)
 
 int main(int argc, char **argv)
 {
-    int ret;
+    int ret, i;
     struct sigaction act;
 
     opts.outfile = 0;
@@ -995,6 +1194,9 @@ int main(int argc, char **argv)
     if ( opts.evt_mask != 0 )
         set_mask(opts.evt_mask, 0);
 
+    for ( i = 0; i < opts.nr_cls_masks; i++ )
+        set_mask(opts.cls_mask[i], 2);
+
     if ( opts.cpu_mask != 0 )
         set_mask(opts.cpu_mask, 1);
 
@@ -2854,8 +2854,10 @@ steal_page(struct domain *d, struct page_info *page, unsigned int memflags)
     } while (unlikely(y != x));
 
     /* Unlink from original owner. */
-    if ( !(memflags & MEMF_no_refcount) )
+    if ( !(memflags & MEMF_no_refcount) ) {
+        domain_adjust_node_pages(d, page, -1);
         d->tot_pages--;
+    }
     page_list_del(page, &d->page_list);
 
     spin_unlock(&d->page_alloc_lock);
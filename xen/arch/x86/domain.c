@@ -48,6 +48,7 @@
 #include <asm/msr.h>
 #include <asm/traps.h>
 #include <asm/nmi.h>
+#include <asm/mem_sharing.h>
 #include <xen/numa.h>
 #include <xen/iommu.h>
 #ifdef CONFIG_COMPAT
@@ -1339,6 +1340,10 @@ void context_switch(struct vcpu *prev, struct vcpu *next)
     if ( is_hvm_vcpu(prev) && !list_empty(&prev->arch.hvm_vcpu.tm_list) )
         pt_save_timer(prev);
 
+    /* Time blocked or waiting to run is not exit-handling time. */
+    if ( is_hvm_vcpu(prev) )
+        hvm_exit_stats_end(prev);
+
     local_irq_disable();
 
     set_current(next);
@@ -1862,6 +1867,10 @@ int domain_relinquish_resources(struct domain *d)
     switch ( d->arch.relmem )
     {
     case RELMEM_not_started:
+        /* Drop shared frames while the p2m still maps them. */
+        if ( is_hvm_domain(d) )
+            mem_sharing_teardown(d);
+
         /* Tear down paging-assistance stuff. */
         paging_teardown(d);
 
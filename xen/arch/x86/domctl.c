@@ -25,6 +25,7 @@
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/support.h>
 #include <asm/hvm/cacheattr.h>
+#include <asm/mem_sharing.h>
 #include <asm/processor.h>
 #include <xsm/xsm.h>
 #include <xen/iommu.h>
@@ -1100,6 +1101,65 @@ long arch_do_domctl(
     }
     break;
 
+    case XEN_DOMCTL_mem_sharing_op:
+    {
+        struct domain *d;
+
+        ret = -ESRCH;
+        d = rcu_lock_domain_by_id(domctl->domain);
+        if ( d == NULL )
+            break;
+
+        ret = mem_sharing_domctl(d, &domctl->u.mem_sharing_op);
+        if ( copy_to_guest(u_domctl, domctl, 1) )
+            ret = -EFAULT;
+
+        rcu_unlock_domain(d);
+    }
+    break;
+
+    case XEN_DOMCTL_log_dirty_extents:
+    {
+        struct domain *d;
+        struct xen_domctl_log_dirty_extents *op =
+            &domctl->u.log_dirty_extents;
+
+        ret = -ESRCH;
+        d = rcu_lock_domain_by_id(domctl->domain);
+        if ( d == NULL )
+            break;
+
+        ret = xsm_shadow_control(d, (op->flags & XEN_DOMCTL_LOG_DIRTY_CLEAN) ?
+                                 XEN_DOMCTL_SHADOW_OP_CLEAN :
+                                 XEN_DOMCTL_SHADOW_OP_PEEK);
+        if ( ret == 0 )
+            ret = paging_log_dirty_extents(d, op);
+        if ( copy_to_guest(u_domctl, domctl, 1) )
+            ret = -EFAULT;
+
+        rcu_unlock_domain(d);
+    }
+    break;
+
+    case XEN_DOMCTL_hvm_exit_stats:
+    {
+        struct domain *d;
+
+        ret = -ESRCH;
+        d = rcu_lock_domain_by_id(domctl->domain);
+        if ( d == NULL )
+            break;
+
+        ret = -EINVAL;
+        if ( is_hvm_domain(d) && (d != current->domain) )
+            ret = hvm_exit_stats_op(d, &domctl->u.hvm_exit_stats);
+        if ( copy_to_guest(u_domctl, domctl, 1) )
+            ret = -EFAULT;
+
+        rcu_unlock_domain(d);
+    }
+    break;
+
     default:
         ret = -ENOSYS;
         break;
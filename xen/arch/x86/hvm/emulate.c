@@ -15,18 +15,152 @@
 #include <xen/sched.h>
 #include <xen/paging.h>
 #include <xen/trace.h>
+#include <xen/domain_page.h>
+#include <xen/perfc.h>
 #include <asm/event.h>
 #include <asm/hvm/emulate.h>
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/trace.h>
 #include <asm/hvm/support.h>
 
+/*
+ * Per-domain cache of instruction-fetch translations. A driver's MMIO
+ * accesses come from a handful of RIPs, so a hit skips the guest pagetable
+ * walk and copies the instruction straight from the cached frame. The bytes
+ * are always re-read, so code modified in place is still seen. Entries are
+ * keyed on (CR3, linear RIP, user mode). They are dropped wholesale on
+ * guest TLB flushes that Xen observes, including every CR3 write. HAP guests flush without exiting
+ * (no INVLPG or CR3-load intercepts), so they never use the cache.
+ */
+static bool_t __read_mostly opt_insn_cache = 1;
+boolean_param("hvm_insn_cache", opt_insn_cache);
+
+#define HVM_INSN_CACHE_ENTRIES 64
+
+struct hvm_insn_cache_entry {
+    unsigned long cr3, addr, gfn;
+    unsigned int  gen;
+    bool_t        user;
+    uint8_t       insn[16];
+};
+
+struct hvm_insn_cache {
+    spinlock_t    lock;
+    unsigned int  gen;  /* entries from older generations are invalid */
+    struct hvm_insn_cache_entry ent[HVM_INSN_CACHE_ENTRIES];
+};
+
+void hvm_insn_cache_init(struct domain *d)
+{
+    struct hvm_insn_cache *ic;
+
+    /* The cache is an optimisation: run without it if allocation fails. */
+    if ( !opt_insn_cache || d->arch.hvm_domain.hap_enabled ||
+         ((ic = xmalloc(struct hvm_insn_cache)) == NULL) )
+        return;
+
+    memset(ic, 0, sizeof(*ic));
+    spin_lock_init(&ic->lock);
+    ic->gen = 1;
+    d->arch.hvm_domain.insn_cache = ic;
+}
+
+void hvm_insn_cache_destroy(struct domain *d)
+{
+    xfree(d->arch.hvm_domain.insn_cache);
+    d->arch.hvm_domain.insn_cache = NULL;
+}
+
+void hvm_insn_cache_flush(struct domain *d)
+{
+    struct hvm_insn_cache *ic = d->arch.hvm_domain.insn_cache;
+
+    if ( ic == NULL )
+        return;
+
+    spin_lock(&ic->lock);
+    ic->gen++;
+    spin_unlock(&ic->lock);
+    perfc_incr(hvm_insn_cache_flush);
+}
+
+static enum hvm_copy_result hvmemul_fetch_insn(
+    uint8_t *buf, unsigned long addr, unsigned int bytes, uint32_t pfec)
+{
+    struct vcpu *curr = current;
+    struct hvm_insn_cache *ic = curr->domain->arch.hvm_domain.insn_cache;
+    struct hvm_insn_cache_entry *e;
+    unsigned long cr3 = curr->arch.hvm_vcpu.guest_cr[3];
+    unsigned long gfn = INVALID_GFN;
+    bool_t user = !!(pfec & PFEC_user_mode);
+    unsigned int gen;
+    p2m_type_t p2mt;
+    mfn_t mfn;
+    uint8_t *p;
+
+    ASSERT(bytes <= sizeof(e->insn));
+
+    /* Fetches straddling a page boundary take the uncached path. */
+    if ( (ic == NULL) || (((addr & ~PAGE_MASK) + bytes) > PAGE_SIZE) )
+        return hvm_fetch_from_guest_virt_nofault(buf, addr, bytes, pfec);
+
+    e = &ic->ent[((addr >> 4) ^ (addr >> PAGE_SHIFT)) %
+                 HVM_INSN_CACHE_ENTRIES];
+
+    spin_lock(&ic->lock);
+    gen = ic->gen;
+    if ( (e->gen == gen) && (e->addr == addr) && (e->cr3 == cr3) &&
+         (e->user == user) )
+        gfn = e->gfn;
+    spin_unlock(&ic->lock);
+
+    if ( gfn != INVALID_GFN )
+        perfc_incr(hvm_insn_cache_hit);
+    else
+    {
+        perfc_incr(hvm_insn_cache_miss);
+        pfec |= PFEC_page_present;
+        if ( hvm_nx_enabled(curr) )
+            pfec |= PFEC_insn_fetch;
+        gfn = paging_gva_to_gfn(curr, addr, &pfec);
+        if ( gfn == INVALID_GFN )
+            return HVMCOPY_bad_gva_to_gfn;
+    }
+
+    mfn = gfn_to_mfn_current(gfn, &p2mt);
+    if ( !p2m_is_ram(p2mt) )
+        return HVMCOPY_bad_gfn_to_mfn;
+    ASSERT(mfn_valid(mfn_x(mfn)));
+
+    p = (uint8_t *)map_domain_page(mfn_x(mfn)) + (addr & ~PAGE_MASK);
+    memcpy(buf, p, bytes);
+    unmap_domain_page(p);
+
+    spin_lock(&ic->lock);
+    /* Do not install a translation that a concurrent flush has revoked. */
+    if ( ic->gen == gen )
+    {
+        if ( (e->gen == gen) && (e->addr == addr) && (e->cr3 == cr3) &&
+             (e->user == user) && memcmp(e->insn, buf, bytes) )
+            perfc_incr(hvm_insn_cache_stale);
+        e->cr3  = cr3;
+        e->addr = addr;
+        e->gfn  = gfn;
+        e->user = user;
+        e->gen  = gen;
+        memcpy(e->insn, buf, bytes);
+    }
+    spin_unlock(&ic->lock);
+
+    return HVMCOPY_okay;
+}
+
 static void hvmtrace_io_assist(int is_mmio, ioreq_t *p)
 {
     unsigned int size, event;
     unsigned char buffer[12];
 
-    if ( likely(!tb_init_done) )
+    if ( likely(!tb_event_enabled(TRC_HVM)) )
         return;
 
     if ( is_mmio )
@@ -78,7 +212,7 @@ static int hvmemul_do_io(
         p_data = NULL;
     }
 
-    if ( is_mmio && !value_is_ptr )
+    if ( is_mmio && !value_is_ptr && (*reps == 1) )
     {
         /* Part of a multi-cycle read or write? */
         if ( dir == IOREQ_WRITE )
@@ -153,6 +287,10 @@ static int hvmemul_do_io(
         rc = hvm_portio_intercept(p);
     }
 
+    if ( (rc == X86EMUL_UNHANDLEABLE) &&
+         (hvm_doorbell_send(p) || hvm_posted_io_send(p)) )
+        rc = X86EMUL_OKAY;
+
     switch ( rc )
     {
     case X86EMUL_OKAY:
@@ -180,7 +318,7 @@ static int hvmemul_do_io(
     if ( p_data != NULL )
         memcpy(p_data, &curr->arch.hvm_vcpu.io_data, size);
 
-    if ( is_mmio && !value_is_ptr )
+    if ( is_mmio && !value_is_ptr && (*reps == 1) )
     {
         /* Part of a multi-cycle read or write? */
         if ( dir == IOREQ_WRITE )
@@ -693,6 +831,45 @@ static int hvmemul_rep_movs(
     return X86EMUL_OKAY;
 }
 
+static int hvmemul_rep_stos(
+    void *p_data,
+    enum x86_segment dst_seg,
+    unsigned long dst_offset,
+    unsigned int bytes_per_rep,
+    unsigned long *reps,
+    struct x86_emulate_ctxt *ctxt)
+{
+    struct hvm_emulate_ctxt *hvmemul_ctxt =
+        container_of(ctxt, struct hvm_emulate_ctxt, ctxt);
+    unsigned long addr;
+    uint32_t pfec = PFEC_page_present | PFEC_write_access;
+    paddr_t gpa;
+    p2m_type_t p2mt;
+    int rc;
+
+    rc = hvmemul_virtual_to_linear(
+        dst_seg, dst_offset, bytes_per_rep, reps, hvm_access_write,
+        hvmemul_ctxt, &addr);
+    if ( rc != X86EMUL_OKAY )
+        return rc;
+
+    if ( hvmemul_ctxt->seg_reg[x86_seg_ss].attr.fields.dpl == 3 )
+        pfec |= PFEC_user_mode;
+
+    rc = hvmemul_linear_to_phys(
+        addr, &gpa, bytes_per_rep, reps, pfec, hvmemul_ctxt);
+    if ( rc != X86EMUL_OKAY )
+        return rc;
+
+    /* Leave RAM to the one-at-a-time path; batch MMIO into one ioreq. */
+    (void)gfn_to_mfn_current(gpa >> PAGE_SHIFT, &p2mt);
+    if ( p2m_is_ram(p2mt) )
+        return X86EMUL_UNHANDLEABLE;
+
+    return hvmemul_do_mmio(gpa, reps, bytes_per_rep, 0, IOREQ_WRITE,
+                           !!(ctxt->regs->eflags & X86_EFLAGS_DF), p_data);
+}
+
 static int hvmemul_read_segment(
     enum x86_segment seg,
     struct segment_register *reg,
@@ -930,6 +1107,7 @@ static struct x86_emulate_ops hvm_emulate_ops = {
     .rep_ins       = hvmemul_rep_ins,
     .rep_outs      = hvmemul_rep_outs,
     .rep_movs      = hvmemul_rep_movs,
+    .rep_stos      = hvmemul_rep_stos,
     .read_segment  = hvmemul_read_segment,
     .write_segment = hvmemul_write_segment,
     .read_io       = hvmemul_read_io,
@@ -978,7 +1156,7 @@ int hvm_emulate_one(
             x86_seg_cs, &hvmemul_ctxt->seg_reg[x86_seg_cs],
             regs->eip, sizeof(hvmemul_ctxt->insn_buf),
             hvm_access_insn_fetch, hvmemul_ctxt->ctxt.addr_size, &addr) &&
-         !hvm_fetch_from_guest_virt_nofault(
+         !hvmemul_fetch_insn(
              hvmemul_ctxt->insn_buf, addr,
              sizeof(hvmemul_ctxt->insn_buf), pfec))
         ? sizeof(hvmemul_ctxt->insn_buf) : 0;
@@ -89,21 +89,82 @@
     ((timer_config(h, n) & HPET_TN_INT_ROUTE_CAP_MASK) \
         >> HPET_TN_INT_ROUTE_CAP_SHIFT)
 
-static inline uint64_t hpet_read_maincounter(HPETState *h)
+/*
+ * Locking: h->lock covers the global registers, and each timer's registers
+ * and periodic_time are covered by h->timer_lock[n].  Writes to global
+ * registers may start or stop every timer, so they take h->lock and then
+ * all the timer locks in order.  The main counter is read with no lock at
+ * all: config, mc64 and mc_offset only change between hpet_mc_begin() and
+ * hpet_mc_end(), and readers retry if mc_seq moved underneath them.
+ */
+static void hpet_lock_all(HPETState *h)
+{
+    unsigned int i;
+
+    spin_lock(&h->lock);
+    for ( i = 0; i < HPET_TIMER_NUM; i++ )
+        spin_lock(&h->timer_lock[i]);
+}
+
+static void hpet_unlock_all(HPETState *h)
+{
+    unsigned int i;
+
+    for ( i = HPET_TIMER_NUM; i-- > 0; )
+        spin_unlock(&h->timer_lock[i]);
+    spin_unlock(&h->lock);
+}
+
+static inline void hpet_mc_begin(HPETState *h)
 {
     ASSERT(spin_is_locked(&h->lock));
+    h->mc_seq++;
+    smp_wmb();
+}
 
-    if ( hpet_enabled(h) )
-        return guest_time_hpet(h->vcpu) + h->mc_offset;
-    else 
-        return h->hpet.mc64;
+static inline void hpet_mc_end(HPETState *h)
+{
+    smp_wmb();
+    h->mc_seq++;
+}
+
+static uint64_t hpet_read_maincounter(HPETState *h)
+{
+    uint32_t seq;
+    uint64_t mc;
+
+    do {
+        while ( (seq = *(volatile uint32_t *)&h->mc_seq) & 1 )
+            cpu_relax();
+        smp_rmb();
+
+        if ( hpet_enabled(h) )
+            mc = guest_time_hpet(h->vcpu) + h->mc_offset;
+        else
+            mc = h->hpet.mc64;
+
+        smp_rmb();
+    } while ( seq != *(volatile uint32_t *)&h->mc_seq );
+
+    return mc;
+}
+
+/* Is this a per-timer register, covered by that timer's lock alone? */
+static inline int hpet_timer_reg(unsigned long addr)
+{
+    addr &= ~7;
+    return (addr >= HPET_T0_CFG) && (addr < HPET_T3_CFG);
 }
 
+#define hpet_reg_timer(addr) ((((addr) & ~7) - HPET_T0_CFG) >> 5)
+
 static uint64_t hpet_get_comparator(HPETState *h, unsigned int tn)
 {
     uint64_t comparator;
     uint64_t elapsed;
 
+    ASSERT(spin_is_locked(&h->timer_lock[tn]));
+
     comparator = h->hpet.comparator64[tn];
     if ( timer_is_periodic(h, tn) )
     {
@@ -177,6 +238,7 @@ static int hpet_read(
     unsigned long *pval)
 {
     HPETState *h = &v->domain->arch.hvm_domain.pl_time.vhpet;
+    spinlock_t *lock = NULL;
     unsigned long result;
     uint64_t val;
 
@@ -188,16 +250,23 @@ static int hpet_read(
         goto out;
     }
 
-    spin_lock(&h->lock);
+    if ( hpet_timer_reg(addr) )
+        lock = &h->timer_lock[hpet_reg_timer(addr)];
+    else if ( (addr & ~7) != HPET_COUNTER )
+        lock = &h->lock;
+
+    if ( lock != NULL )
+        spin_lock(lock);
 
     val = hpet_read64(h, addr);
 
+    if ( lock != NULL )
+        spin_unlock(lock);
+
     result = val;
     if ( length != 8 )
         result = (val >> ((addr & 7) * 8)) & ((1ULL << (length * 8)) - 1);
 
-    spin_unlock(&h->lock);
-
  out:
     *pval = result;
     return X86EMUL_OKAY;
@@ -206,7 +275,7 @@ static int hpet_read(
 static void hpet_stop_timer(HPETState *h, unsigned int tn)
 {
     ASSERT(tn < HPET_TIMER_NUM);
-    ASSERT(spin_is_locked(&h->lock));
+    ASSERT(spin_is_locked(&h->timer_lock[tn]));
     destroy_periodic_time(&h->pt[tn]);
     /* read the comparator to get it updated so a read while stopped will
      * return the expected value. */
@@ -224,7 +293,7 @@ static void hpet_set_timer(HPETState *h, unsigned int tn)
     unsigned int oneshot;
 
     ASSERT(tn < HPET_TIMER_NUM);
-    ASSERT(spin_is_locked(&h->lock));
+    ASSERT(spin_is_locked(&h->timer_lock[tn]));
 
     if ( (tn == 0) && (h->hpet.config & HPET_CFG_LEGACY) )
     {
@@ -306,7 +375,10 @@ static int hpet_write(
     if ( hpet_check_access_length(addr, length) != 0 )
         goto out;
 
-    spin_lock(&h->lock);
+    if ( hpet_timer_reg(addr) )
+        spin_lock(&h->timer_lock[hpet_reg_timer(addr)]);
+    else
+        hpet_lock_all(h);
 
     old_val = hpet_read64(h, addr);
     new_val = val;
@@ -318,6 +390,7 @@ static int hpet_write(
     switch ( addr & ~7 )
     {
     case HPET_CFG:
+        hpet_mc_begin(h);
         h->hpet.config = hpet_fixup_reg(new_val, old_val, 0x3);
 
         if ( !(old_val & HPET_CFG_ENABLE) && (new_val & HPET_CFG_ENABLE) )
@@ -342,10 +415,13 @@ static int hpet_write(
                 if ( timer_enabled(h, i) )
                     set_stop_timer(i);
         }
+        hpet_mc_end(h);
         break;
 
     case HPET_COUNTER:
+        hpet_mc_begin(h);
         h->hpet.mc64 = new_val;
+        hpet_mc_end(h);
         if ( hpet_enabled(h) )
         {
             gdprintk(XENLOG_WARNING, 
@@ -465,7 +541,10 @@ static int hpet_write(
 #undef set_start_timer
 #undef set_restart_timer
 
-    spin_unlock(&h->lock);
+    if ( hpet_timer_reg(addr) )
+        spin_unlock(&h->timer_lock[hpet_reg_timer(addr)]);
+    else
+        hpet_unlock_all(h);
 
  out:
     return X86EMUL_OKAY;
@@ -490,10 +569,12 @@ static int hpet_save(struct domain *d, hvm_domain_context_t *h)
     HPETState *hp = &d->arch.hvm_domain.pl_time.vhpet;
     int rc;
 
-    spin_lock(&hp->lock);
+    hpet_lock_all(hp);
 
     /* Write the proper value into the main counter */
+    hpet_mc_begin(hp);
     hp->hpet.mc64 = hp->mc_offset + guest_time_hpet(hp->vcpu);
+    hpet_mc_end(hp);
 
     /* Save the HPET registers */
     rc = _hvm_init_entry(h, HVM_SAVE_CODE(HPET), 0, HVM_SAVE_LENGTH(HPET));
@@ -524,7 +605,7 @@ static int hpet_save(struct domain *d, hvm_domain_context_t *h)
         rec->timers[2].cmp = hp->hpet.comparator64[2];
     }
 
-    spin_unlock(&hp->lock);
+    hpet_unlock_all(hp);
 
     return rc;
 }
@@ -536,18 +617,20 @@ static int hpet_load(struct domain *d, hvm_domain_context_t *h)
     uint64_t cmp;
     int i;
 
-    spin_lock(&hp->lock);
+    hpet_lock_all(hp);
 
     /* Reload the HPET registers */
     if ( _hvm_check_entry(h, HVM_SAVE_CODE(HPET), HVM_SAVE_LENGTH(HPET)) )
     {
-        spin_unlock(&hp->lock);
+        hpet_unlock_all(hp);
         return -EINVAL;
     }
 
     rec = (struct hvm_hw_hpet *)&h->data[h->cur];
     h->cur += HVM_SAVE_LENGTH(HPET);
 
+    hpet_mc_begin(hp);
+
 #define C(x) hp->hpet.x = rec->x
     C(capability);
     C(config);
@@ -574,6 +657,8 @@ static int hpet_load(struct domain *d, hvm_domain_context_t *h)
     /* Recalculate the offset between the main counter and guest time */
     hp->mc_offset = hp->hpet.mc64 - guest_time_hpet(hp->vcpu);
 
+    hpet_mc_end(hp);
+
     /* restart all timers */
 
     if ( hpet_enabled(hp) )
@@ -581,7 +666,7 @@ static int hpet_load(struct domain *d, hvm_domain_context_t *h)
             if ( timer_enabled(hp, i) )
                 hpet_set_timer(hp, i);
  
-    spin_unlock(&hp->lock);
+    hpet_unlock_all(hp);
 
     return 0;
 }
@@ -596,6 +681,8 @@ void hpet_init(struct vcpu *v)
     memset(h, 0, sizeof(HPETState));
 
     spin_lock_init(&h->lock);
+    for ( i = 0; i < HPET_TIMER_NUM; i++ )
+        spin_lock_init(&h->timer_lock[i]);
 
     h->vcpu = v;
     h->stime_freq = S_TO_NS;
@@ -624,14 +711,14 @@ void hpet_deinit(struct domain *d)
     int i;
     HPETState *h = &d->arch.hvm_domain.pl_time.vhpet;
 
-    spin_lock(&h->lock);
+    hpet_lock_all(h);
 
     if ( hpet_enabled(h) )
         for ( i = 0; i < HPET_TIMER_NUM; i++ )
             if ( timer_enabled(h, i) )
                 hpet_stop_timer(h, i);
 
-    spin_unlock(&h->lock);
+    hpet_unlock_all(h);
 }
 
 void hpet_reset(struct domain *d)
@@ -35,6 +35,7 @@
 #include <xen/paging.h>
 #include <asm/shadow.h>
 #include <asm/hap.h>
+#include <asm/mem_sharing.h>
 #include <asm/current.h>
 #include <asm/e820.h>
 #include <asm/io.h>
@@ -49,6 +50,7 @@
 #include <asm/hvm/vpt.h>
 #include <asm/hvm/support.h>
 #include <asm/hvm/cacheattr.h>
+#include <asm/hvm/emulate.h>
 #include <asm/hvm/trace.h>
 #include <public/sched.h>
 #include <public/hvm/ioreq.h>
@@ -234,7 +236,7 @@ static int hvm_set_ioreq_page(
     unsigned long mfn;
     void *va;
 
-    mfn = mfn_x(gfn_to_mfn(d, gmfn, &p2mt));
+    mfn = mfn_x(gfn_to_mfn_unshare(d, gmfn, &p2mt));
     if ( !p2m_is_ram(p2mt) )
         return -EINVAL;
     ASSERT(mfn_valid(mfn));
@@ -312,6 +314,8 @@ int hvm_domain_initialise(struct domain *d)
     spin_lock_init(&d->arch.hvm_domain.pbuf_lock);
     spin_lock_init(&d->arch.hvm_domain.irq_lock);
     spin_lock_init(&d->arch.hvm_domain.uc_lock);
+    spin_lock_init(&d->arch.hvm_domain.posted_io_lock);
+    rwlock_init(&d->arch.hvm_domain.doorbell_lock);
 
     INIT_LIST_HEAD(&d->arch.hvm_domain.msixtbl_list);
     spin_lock_init(&d->arch.hvm_domain.msixtbl_list_lock);
@@ -322,6 +326,8 @@ int hvm_domain_initialise(struct domain *d)
 
     hvm_init_cacheattr_region_list(d);
 
+    hvm_insn_cache_init(d);
+
     rc = paging_enable(d, PG_refcounts|PG_translate|PG_external);
     if ( rc != 0 )
         goto fail1;
@@ -352,6 +358,7 @@ int hvm_domain_initialise(struct domain *d)
     stdvga_deinit(d);
     vioapic_deinit(d);
  fail1:
+    hvm_insn_cache_destroy(d);
     hvm_destroy_cacheattr_region_list(d);
     return rc;
 }
@@ -381,6 +388,7 @@ void hvm_domain_destroy(struct domain *d)
     rtc_deinit(d);
     stdvga_deinit(d);
     vioapic_deinit(d);
+    hvm_insn_cache_destroy(d);
     hvm_destroy_cacheattr_region_list(d);
 }
 
@@ -741,11 +749,111 @@ void hvm_vcpu_destroy(struct vcpu *v)
     hvm_vcpu_cacheattr_destroy(v);
     vlapic_destroy(v);
     hvm_funcs.vcpu_destroy(v);
+    xfree(v->arch.hvm_vcpu.exit_stats);
 
     /* Event channel is already freed by evtchn_destroy(). */
     /*free_xen_event_channel(v, v->arch.hvm_vcpu.xen_port);*/
 }
 
+void __hvm_exit_stats_begin(struct vcpu *v, unsigned int index)
+{
+    struct hvm_exit_stats *s = v->arch.hvm_vcpu.exit_stats;
+
+    if ( index >= XEN_HVM_EXIT_STATS_REASONS )
+        return;
+
+    rdtscll(s->exit_tsc);
+    s->pending = index + 1;
+}
+
+void __hvm_exit_stats_end(struct vcpu *v)
+{
+    struct hvm_exit_stats *s = v->arch.hvm_vcpu.exit_stats;
+    struct xen_domctl_hvm_exit_reason *r;
+    uint64_t now, cycles;
+    unsigned int bucket;
+
+    if ( s->pending == 0 )
+        return;
+
+    rdtscll(now);
+    cycles = now - s->exit_tsc;
+    r = &s->reason[s->pending - 1];
+    s->pending = 0;
+
+    /* Bucket 0 is under 512 cycles; each later bucket doubles. */
+    bucket = (cycles >> (XEN_HVM_EXIT_STATS_BUCKETS + 7))
+        ? XEN_HVM_EXIT_STATS_BUCKETS - 1 : fls((uint32_t)(cycles >> 9));
+
+    r->count++;
+    r->cycles += cycles;
+    r->hist[bucket]++;
+}
+
+int hvm_exit_stats_op(struct domain *d, struct xen_domctl_hvm_exit_stats *op)
+{
+    struct hvm_exit_stats *s;
+    struct vcpu *v;
+    int rc = 0;
+
+    op->vendor = (hvm_funcs.name[0] == 'S') ? XEN_HVM_EXIT_STATS_SVM
+                                             : XEN_HVM_EXIT_STATS_VMX;
+    op->tsc_khz = cpu_khz;
+
+    switch ( op->op )
+    {
+    case XEN_DOMCTL_HVM_EXIT_STATS_ENABLE:
+        for_each_vcpu ( d, v )
+        {
+            if ( v->arch.hvm_vcpu.exit_stats != NULL )
+                continue;
+            if ( (s = xmalloc(struct hvm_exit_stats)) == NULL )
+                return -ENOMEM;
+            memset(s, 0, sizeof(*s));
+            /* Nothing is pending in a new block, so the vcpu may be running. */
+            wmb();
+            v->arch.hvm_vcpu.exit_stats = s;
+        }
+        break;
+
+    case XEN_DOMCTL_HVM_EXIT_STATS_DISABLE:
+        domain_pause(d);
+        for_each_vcpu ( d, v )
+        {
+            xfree(v->arch.hvm_vcpu.exit_stats);
+            v->arch.hvm_vcpu.exit_stats = NULL;
+        }
+        domain_unpause(d);
+        break;
+
+    case XEN_DOMCTL_HVM_EXIT_STATS_RESET:
+        domain_pause(d);
+        for_each_vcpu ( d, v )
+            if ( (s = v->arch.hvm_vcpu.exit_stats) != NULL )
+                memset(s, 0, sizeof(*s));
+        domain_unpause(d);
+        break;
+
+    case XEN_DOMCTL_HVM_EXIT_STATS_GET:
+        if ( (op->vcpu >= MAX_VIRT_CPUS) || ((v = d->vcpu[op->vcpu]) == NULL) )
+            return -ESRCH;
+        if ( (s = v->arch.hvm_vcpu.exit_stats) == NULL )
+            return -ENOENT;
+        /* Counters are read while the vcpu runs; a sample may be torn. */
+        op->nr_reasons = min_t(uint32_t, op->nr_reasons,
+                               XEN_HVM_EXIT_STATS_REASONS);
+        if ( copy_to_guest(op->reasons, s->reason, op->nr_reasons) )
+            rc = -EFAULT;
+        break;
+
+    default:
+        rc = -EINVAL;
+        break;
+    }
+
+    return rc;
+}
+
 void hvm_vcpu_down(struct vcpu *v)
 {
     struct domain *d = v->domain;
@@ -833,6 +941,17 @@ bool_t hvm_hap_nested_page_fault(unsigned long gfn)
 
     mfn = gfn_to_mfn_type_current(gfn, &p2mt, p2m_guest);
 
+    /*
+     * Shared pages are mapped read-only, so this is a write: give the
+     * guest its own copy of the page and let it retry.
+     */
+    if ( p2m_is_shared(p2mt) )
+    {
+        if ( mem_sharing_unshare_page(current->domain, gfn, 0) != 0 )
+            domain_crash(current->domain);
+        return 1;
+    }
+
     /*
      * If this GFN is emulated MMIO or marked as read-only, pass the fault
      * to the mmio handler.
@@ -844,12 +963,14 @@ bool_t hvm_hap_nested_page_fault(unsigned long gfn)
         return 1;
     }
 
-    /* Log-dirty: mark the page dirty and let the guest write it again */
+    /* Log-dirty: mark the page dirty and let the guest write it again.
+     * Mark only once the page is writable, so that anyone who sees the
+     * mark and re-arms the page does so after our type change. */
     if ( paging_mode_log_dirty(current->domain)
          && p2m_is_ram(p2mt) && (p2mt != p2m_ram_ro) )
     {
-        paging_mark_dirty(current->domain, mfn_x(mfn));
         p2m_change_type(current->domain, gfn, p2m_ram_logdirty, p2m_ram_rw);
+        paging_mark_dirty(current->domain, mfn_x(mfn));
         return 1;
     }
 
@@ -966,7 +1087,7 @@ int hvm_set_cr0(unsigned long value)
         {
             /* The guest CR3 must be pointing to the guest physical. */
             gfn = v->arch.hvm_vcpu.guest_cr[3]>>PAGE_SHIFT;
-            mfn = mfn_x(gfn_to_mfn_current(gfn, &p2mt));
+            mfn = mfn_x(gfn_to_mfn_unshare(v->domain, gfn, &p2mt));
             if ( !p2m_is_ram(p2mt) || !mfn_valid(mfn) ||
                  !get_page(mfn_to_page(mfn), v->domain))
             {
@@ -1033,7 +1154,10 @@ int hvm_set_cr0(unsigned long value)
     hvm_update_guest_cr(v, 0);
 
     if ( (value ^ old_value) & X86_CR0_PG )
+    {
         paging_update_paging_modes(v);
+        hvm_insn_cache_flush(v->domain);
+    }
 
     return X86EMUL_OKAY;
 
@@ -1053,7 +1177,8 @@ int hvm_set_cr3(unsigned long value)
     {
         /* Shadow-mode CR3 change. Check PDBR and update refcounts. */
         HVM_DBG_LOG(DBG_LEVEL_VMMU, "CR3 value = %lx", value);
-        mfn = mfn_x(gfn_to_mfn_current(value >> PAGE_SHIFT, &p2mt));
+        mfn = mfn_x(gfn_to_mfn_unshare(v->domain, value >> PAGE_SHIFT,
+                                       &p2mt));
         if ( !p2m_is_ram(p2mt) || !mfn_valid(mfn) ||
              !get_page(mfn_to_page(mfn), v->domain) )
               goto bad_cr3;
@@ -1064,6 +1189,10 @@ int hvm_set_cr3(unsigned long value)
         HVM_DBG_LOG(DBG_LEVEL_VMMU, "Update CR3 value = %lx", value);
     }
 
+    /* Any CR3 write flushes: a freed pagetable root may come back as a
+     * new address space with the same CR3 value. */
+    hvm_insn_cache_flush(v->domain);
+
     v->arch.hvm_vcpu.guest_cr[3] = value;
     paging_update_cr3(v);
     return X86EMUL_OKAY;
@@ -1100,7 +1229,10 @@ int hvm_set_cr4(unsigned long value)
 
     /* Modifying CR4.{PSE,PAE,PGE} invalidates all TLB entries, inc. Global. */
     if ( (old_cr ^ value) & (X86_CR4_PSE | X86_CR4_PGE | X86_CR4_PAE) )
+    {
         paging_update_paging_modes(v);
+        hvm_insn_cache_flush(v->domain);
+    }
 
     return X86EMUL_OKAY;
 
@@ -1210,8 +1342,8 @@ static void *hvm_map_entry(unsigned long va)
      * we still treat it as a kernel-mode read (i.e. no access checks). */
     pfec = PFEC_page_present;
     gfn = paging_gva_to_gfn(current, va, &pfec);
-    mfn = mfn_x(gfn_to_mfn_current(gfn, &p2mt));
-    if ( !p2m_is_ram(p2mt) )
+    mfn = mfn_x(gfn_to_mfn_unshare(current->domain, gfn, &p2mt));
+    if ( !p2m_is_ram(p2mt) || p2m_is_shared(p2mt) )
     {
         gdprintk(XENLOG_ERR, "Failed to look up descriptor table entry\n");
         domain_crash(current->domain);
@@ -1566,10 +1698,16 @@ static enum hvm_copy_result __hvm_copy(
             gfn = addr >> PAGE_SHIFT;
         }
 
-        mfn = mfn_x(gfn_to_mfn_current(gfn, &p2mt));
+        if ( flags & HVMCOPY_to_guest )
+            mfn = mfn_x(gfn_to_mfn_unshare(curr->domain, gfn, &p2mt));
+        else
+            mfn = mfn_x(gfn_to_mfn_current(gfn, &p2mt));
 
         if ( !p2m_is_ram(p2mt) )
             return HVMCOPY_bad_gfn_to_mfn;
+        /* Still shared: we ran out of memory for a private copy. */
+        if ( (flags & HVMCOPY_to_guest) && p2m_is_shared(p2mt) )
+            return HVMCOPY_bad_gfn_to_mfn;
         ASSERT(mfn_valid(mfn));
 
         p = (char *)map_domain_page(mfn) + (addr & ~PAGE_MASK);
@@ -1731,6 +1869,8 @@ void hvm_cpuid(unsigned int input, unsigned int *eax, unsigned int *ebx,
         *ebx |= (v->vcpu_id * 2) << 24;
         if ( vlapic_hw_disabled(vcpu_vlapic(v)) )
             __clear_bit(X86_FEATURE_APIC & 31, edx);
+        else
+            __set_bit(X86_FEATURE_TSC_DEADLINE & 31, ecx);
     }
 }
 
@@ -1769,6 +1909,10 @@ int hvm_msr_read_intercept(struct cpu_user_regs *regs)
         msr_content = vcpu_vlapic(v)->hw.apic_base_msr;
         break;
 
+    case MSR_IA32_TSC_DEADLINE:
+        msr_content = vlapic_tdt_msr_get(vcpu_vlapic(v));
+        break;
+
     case MSR_IA32_MCG_CAP:
     case MSR_IA32_MCG_STATUS:
     case MSR_IA32_MC0_STATUS:
@@ -1873,6 +2017,10 @@ int hvm_msr_write_intercept(struct cpu_user_regs *regs)
         vlapic_msr_set(vcpu_vlapic(v), msr_content);
         break;
 
+    case MSR_IA32_TSC_DEADLINE:
+        vlapic_tdt_msr_set(vcpu_vlapic(v), msr_content);
+        break;
+
     case MSR_IA32_CR_PAT:
         if ( !pat_msr_set(&v->arch.hvm_vcpu.pat_cr, msr_content) )
            goto gp_fault;
@@ -2439,47 +2587,70 @@ static int hvmop_set_pci_link_route(
     return rc;
 }
 
-static int hvmop_flush_tlb_all(void)
+/*
+ * Flush the TLBs of the vcpus of the current domain for which flush_vcpu()
+ * returns true, pausing only those while it is done.  flush_vcpu() must
+ * give the same answer each time it is asked about a vcpu.
+ */
+int hvm_flush_vcpu_tlbs(bool_t (*flush_vcpu)(void *ctxt, struct vcpu *v),
+                        void *ctxt)
 {
     struct domain *d = current->domain;
     struct vcpu *v;
-
-    if ( !is_hvm_domain(d) )
-        return -EINVAL;
+    cpumask_t flush_mask = CPU_MASK_NONE;
 
     /* Avoid deadlock if more than one vcpu tries this at the same time. */
     if ( !spin_trylock(&d->hypercall_deadlock_mutex) )
         return -EAGAIN;
 
-    /* Pause all other vcpus. */
+    /* Pause the other target vcpus. */
     for_each_vcpu ( d, v )
-        if ( v != current )
+        if ( (v != current) && flush_vcpu(ctxt, v) )
             vcpu_pause_nosync(v);
 
-    /* Now that all VCPUs are signalled to deschedule, we wait... */
+    /* Now that the target VCPUs are signalled to deschedule, we wait... */
     for_each_vcpu ( d, v )
-        if ( v != current )
+        if ( (v != current) && flush_vcpu(ctxt, v) )
             while ( !vcpu_runnable(v) && v->is_running )
                 cpu_relax();
 
-    /* All other vcpus are paused, safe to unlock now. */
+    /* All target vcpus are paused, safe to unlock now. */
     spin_unlock(&d->hypercall_deadlock_mutex);
 
     /* Flush paging-mode soft state (e.g., va->gfn cache; PAE PDPE cache). */
     for_each_vcpu ( d, v )
+    {
+        if ( !flush_vcpu(ctxt, v) )
+            continue;
         paging_update_cr3(v);
+        cpus_or(flush_mask, flush_mask, v->vcpu_dirty_cpumask);
+    }
 
-    /* Flush all dirty TLBs. */
-    flush_tlb_mask(d->domain_dirty_cpumask);
+    /* Flush TLBs of the CPUs the target vcpus may have run on. */
+    flush_tlb_mask(flush_mask);
+    hvm_insn_cache_flush(d);
 
     /* Done. */
     for_each_vcpu ( d, v )
-        if ( v != current )
+        if ( (v != current) && flush_vcpu(ctxt, v) )
             vcpu_unpause(v);
 
     return 0;
 }
 
+static bool_t always_flush(void *ctxt, struct vcpu *v)
+{
+    return 1;
+}
+
+static int hvmop_flush_tlb_all(void)
+{
+    if ( !is_hvm_domain(current->domain) )
+        return -EINVAL;
+
+    return hvm_flush_vcpu_tlbs(always_flush, NULL);
+}
+
 long do_hvm_op(unsigned long op, XEN_GUEST_HANDLE(void) arg)
 
 {
@@ -2710,6 +2881,105 @@ long do_hvm_op(unsigned long op, XEN_GUEST_HANDLE(void) arg)
         break;
     }
 
+    case HVMOP_map_dirty_vram:
+    {
+        struct xen_hvm_map_dirty_vram a;
+        struct domain *d;
+        uint64_t mfn = 0;
+
+        if ( copy_from_guest(&a, arg, 1) )
+            return -EFAULT;
+
+        rc = rcu_lock_target_domain_by_id(a.domid, &d);
+        if ( rc != 0 )
+            return rc;
+
+        rc = -EINVAL;
+        if ( !is_hvm_domain(d) )
+            goto param_fail5;
+
+        rc = xsm_hvm_param(d, op);
+        if ( rc )
+            goto param_fail5;
+
+        rc = -ESRCH;
+        if ( d->is_dying )
+            goto param_fail5;
+
+        rc = -EINVAL;
+        if ( d->vcpu[0] == NULL )
+            goto param_fail5;
+
+        rc = -EOPNOTSUPP;
+        if ( !paging_mode_hap(d) )
+            goto param_fail5;
+
+        rc = hap_map_dirty_vram(d, a.first_pfn, a.nr, &mfn);
+        a.bitmap_mfn = mfn;
+        if ( (rc == 0) && copy_to_guest(arg, &a, 1) )
+            rc = -EFAULT;
+
+    param_fail5:
+        rcu_unlock_domain(d);
+        break;
+    }
+
+    case HVMOP_set_posted_io_range:
+    {
+        struct xen_hvm_set_posted_io_range a;
+        struct domain *d;
+
+        if ( copy_from_guest(&a, arg, 1) )
+            return -EFAULT;
+
+        rc = rcu_lock_target_domain_by_id(a.domid, &d);
+        if ( rc != 0 )
+            return rc;
+
+        rc = -EINVAL;
+        if ( !is_hvm_domain(d) )
+            goto param_fail6;
+
+        rc = xsm_hvm_param(d, op);
+        if ( rc )
+            goto param_fail6;
+
+        rc = hvm_set_posted_io_range(d, a.type, a.enable, a.first, a.last);
+
+    param_fail6:
+        rcu_unlock_domain(d);
+        break;
+    }
+
+    case HVMOP_set_doorbell:
+    {
+        struct xen_hvm_set_doorbell a;
+        struct domain *d;
+
+        if ( copy_from_guest(&a, arg, 1) )
+            return -EFAULT;
+
+        rc = rcu_lock_target_domain_by_id(a.domid, &d);
+        if ( rc != 0 )
+            return rc;
+
+        rc = -EINVAL;
+        if ( !is_hvm_domain(d) )
+            goto param_fail7;
+
+        rc = xsm_hvm_param(d, op);
+        if ( rc )
+            goto param_fail7;
+
+        rc = hvm_set_doorbell(d, &a);
+        if ( (rc == 0) && a.enable && copy_to_guest(arg, &a, 1) )
+            rc = -EFAULT;
+
+    param_fail7:
+        rcu_unlock_domain(d);
+        break;
+    }
+
     case HVMOP_modified_memory:
     {
         struct xen_hvm_modified_memory a;
@@ -2798,8 +3068,12 @@ long do_hvm_op(unsigned long op, XEN_GUEST_HANDLE(void) arg)
         {
             p2m_type_t t;
             mfn_t mfn;
-            mfn = gfn_to_mfn(d, pfn, &t);
+            mfn = gfn_to_mfn_unshare(d, pfn, &t);
             p2m_change_type(d, pfn, t, memtype[a.hvmmem_type]);
+            /* Log-dirty will not write-protect this page again until it
+             * has been reported dirty. */
+            if ( (memtype[a.hvmmem_type] == p2m_ram_rw) && (t != p2m_ram_rw) )
+                paging_mark_dirty(d, mfn_x(mfn));
         }
          
     param_fail4:
@@ -61,13 +61,21 @@ static int hvm_mmio_access(struct vcpu *v,
         {
             rc = read_handler(v, p->addr, p->size, &data);
             p->data = data;
+            return rc;
         }
-        else /* p->dir == IOREQ_WRITE */
-            rc = write_handler(v, p->addr, p->size, p->data);
-        return rc;
-    }
 
-    if ( p->dir == IOREQ_READ )
+        /* p->dir == IOREQ_WRITE: REP STOS stores the same value each time. */
+        for ( i = 0; i < p->count; i++ )
+        {
+            rc = write_handler(
+                v,
+                p->addr + (sign * i * p->size),
+                p->size, p->data);
+            if ( rc != X86EMUL_OKAY )
+                break;
+        }
+    }
+    else if ( p->dir == IOREQ_READ )
     {
         for ( i = 0; i < p->count; i++ )
         {
@@ -112,16 +120,23 @@ static int hvm_mmio_access(struct vcpu *v,
 int hvm_mmio_intercept(ioreq_t *p)
 {
     struct vcpu *v = current;
-    int i;
+    int i = v->arch.hvm_vcpu.mmio_last_hit;
 
-    for ( i = 0; i < HVM_MMIO_HANDLER_NR; i++ )
-        if ( hvm_mmio_handlers[i]->check_handler(v, p->addr) )
-            return hvm_mmio_access(
-                v, p,
-                hvm_mmio_handlers[i]->read_handler,
-                hvm_mmio_handlers[i]->write_handler);
+    /* Device MMIO comes in bursts: try the last handler hit first. */
+    if ( !hvm_mmio_handlers[i]->check_handler(v, p->addr) )
+    {
+        for ( i = 0; i < HVM_MMIO_HANDLER_NR; i++ )
+            if ( hvm_mmio_handlers[i]->check_handler(v, p->addr) )
+                break;
+        if ( i == HVM_MMIO_HANDLER_NR )
+            return X86EMUL_UNHANDLEABLE;
+        v->arch.hvm_vcpu.mmio_last_hit = i;
+    }
 
-    return X86EMUL_UNHANDLEABLE;
+    return hvm_mmio_access(
+        v, p,
+        hvm_mmio_handlers[i]->read_handler,
+        hvm_mmio_handlers[i]->write_handler);
 }
 
 static int process_portio_intercept(portio_action_t action, ioreq_t *p)
@@ -177,6 +192,20 @@ static int process_portio_intercept(portio_action_t action, ioreq_t *p)
     return rc;
 }
 
+static inline int io_handler_match(
+    const struct io_handler *h, int type, const ioreq_t *p)
+{
+    return ((h->type == type) && (p->addr >= h->addr) &&
+            ((p->addr + p->size) <= (h->addr + h->size)));
+}
+
+/* Does @h sort at or before the (type, addr) key? */
+static inline int io_handler_le(
+    const struct io_handler *h, int type, unsigned long addr)
+{
+    return ((h->type < type) || ((h->type == type) && (h->addr <= addr)));
+}
+
 /*
  * Check if the request is handled inside xen
  * return value: 0 --not handled; 1 --handled
@@ -186,29 +215,38 @@ int hvm_io_intercept(ioreq_t *p, int type)
     struct vcpu *v = current;
     struct hvm_io_handler *handler =
         &v->domain->arch.hvm_domain.io_handler;
-    int i;
-    unsigned long addr, size;
+    struct io_handler *h;
+    int i, lo, hi;
 
     if ( (type == HVM_PORTIO) && (dpci_ioport_intercept(p)) )
         return X86EMUL_OKAY;
 
-    for ( i = 0; i < handler->num_slot; i++ )
+    /* Try the last handler this vcpu hit, then binary-search the index. */
+    i = v->arch.hvm_vcpu.io_last_hit;
+    if ( (i >= handler->num_slot) ||
+         !io_handler_match(&handler->hdl_list[i], type, p) )
     {
-        if ( type != handler->hdl_list[i].type )
-            continue;
-        addr = handler->hdl_list[i].addr;
-        size = handler->hdl_list[i].size;
-        if ( (p->addr >= addr) &&
-             ((p->addr + p->size) <= (addr + size)) )
+        /* Find the last handler sorting at or before (type, p->addr). */
+        lo = 0;
+        hi = handler->num_slot;
+        while ( lo < hi )
         {
-            if ( type == HVM_PORTIO )
-                return process_portio_intercept(
-                    handler->hdl_list[i].action.portio, p);
-            return handler->hdl_list[i].action.mmio(p);
+            i = (lo + hi) / 2;
+            if ( io_handler_le(&handler->hdl_list[i], type, p->addr) )
+                lo = i + 1;
+            else
+                hi = i;
         }
+        i = lo - 1;
+        if ( (i < 0) || !io_handler_match(&handler->hdl_list[i], type, p) )
+            return X86EMUL_UNHANDLEABLE;
+        v->arch.hvm_vcpu.io_last_hit = i;
     }
 
-    return X86EMUL_UNHANDLEABLE;
+    h = &handler->hdl_list[i];
+    if ( type == HVM_PORTIO )
+        return process_portio_intercept(h->action.portio, p);
+    return h->action.mmio(p);
 }
 
 void register_io_handler(
@@ -220,6 +258,20 @@ void register_io_handler(
 
     BUG_ON(num >= MAX_IO_HANDLER);
 
+    /* Insertion sort on (type, addr); ranges of one type must not overlap. */
+    while ( (num > 0) && !io_handler_le(&handler->hdl_list[num - 1],
+                                        type, addr) )
+    {
+        handler->hdl_list[num] = handler->hdl_list[num - 1];
+        num--;
+    }
+    BUG_ON((num > 0) && (handler->hdl_list[num - 1].type == type) &&
+           (handler->hdl_list[num - 1].addr +
+            handler->hdl_list[num - 1].size > addr));
+    BUG_ON((num < handler->num_slot) &&
+           (handler->hdl_list[num + 1].type == type) &&
+           (addr + size > handler->hdl_list[num + 1].addr));
+
     handler->hdl_list[num].addr = addr;
     handler->hdl_list[num].size = size;
     if ( (handler->hdl_list[num].type = type) == HVM_PORTIO )
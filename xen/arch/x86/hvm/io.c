@@ -27,6 +27,7 @@
 #include <xen/trace.h>
 #include <xen/event.h>
 #include <xen/hypercall.h>
+#include <xen/perfc.h>
 #include <asm/current.h>
 #include <asm/cpufeature.h>
 #include <asm/processor.h>
@@ -45,6 +46,7 @@
 #include <public/sched.h>
 #include <xen/iocap.h>
 #include <public/hvm/ioreq.h>
+#include <public/hvm/hvm_op.h>
 
 int hvm_buffered_io_send(ioreq_t *p)
 {
@@ -54,19 +56,21 @@ int hvm_buffered_io_send(ioreq_t *p)
     buf_ioreq_t bp;
     /* Timeoffset sends 64b data, but no address. Use two consecutive slots. */
     int qw = 0;
+    /* Addresses beyond 1MB take an extra IOREQ_TYPE_ADDR_HI slot first. */
+    int hi = (p->addr > 0xffffful);
+    unsigned int slot;
 
     /* Ensure buffered_iopage fits in a page */
     BUILD_BUG_ON(sizeof(buffered_iopage_t) > PAGE_SIZE);
 
     /*
      * Return 0 for the cases we can't deal with:
-     *  - 'addr' is only a 20-bit field, so we cannot address beyond 1MB
      *  - we cannot buffer accesses to guest memory buffers, as the guest
      *    may expect the memory buffer to be synchronously accessed
      *  - the count field is usually used with data_is_ptr and since we don't
      *    support data_is_ptr we do not waste space for the count field either
      */
-    if ( (p->addr > 0xffffful) || p->data_is_ptr || (p->count != 1) )
+    if ( p->data_is_ptr || (p->count != 1) )
         return 0;
 
     bp.type = p->type;
@@ -91,38 +95,236 @@ int hvm_buffered_io_send(ioreq_t *p)
         return 0;
     }
     
-    bp.data = p->data;
-    bp.addr = p->addr;
-    
     spin_lock(&iorp->lock);
 
     if ( (pg->write_pointer - pg->read_pointer) >=
-         (IOREQ_BUFFER_SLOT_NUM - qw) )
+         (IOREQ_BUFFER_SLOT_NUM - qw - hi) )
     {
         /* The queue is full: send the iopacket through the normal path. */
         spin_unlock(&iorp->lock);
         return 0;
     }
-    
-    memcpy(&pg->buf_ioreq[pg->write_pointer % IOREQ_BUFFER_SLOT_NUM],
+
+    slot = pg->write_pointer;
+
+    if ( hi )
+    {
+        buf_ioreq_t hp = { .type = IOREQ_TYPE_ADDR_HI, .dir = p->dir };
+        hp.data = p->addr >> 20;
+        memcpy(&pg->buf_ioreq[slot++ % IOREQ_BUFFER_SLOT_NUM],
+               &hp, sizeof(hp));
+    }
+
+    bp.data = p->data;
+    bp.addr = p->addr & 0xffffful;
+    memcpy(&pg->buf_ioreq[slot++ % IOREQ_BUFFER_SLOT_NUM],
            &bp, sizeof(bp));
     
     if ( qw )
     {
         bp.data = p->data >> 32;
-        memcpy(&pg->buf_ioreq[(pg->write_pointer+1) % IOREQ_BUFFER_SLOT_NUM],
+        memcpy(&pg->buf_ioreq[slot++ % IOREQ_BUFFER_SLOT_NUM],
                &bp, sizeof(bp));
     }
 
     /* Make the ioreq_t visible /before/ write_pointer. */
     wmb();
-    pg->write_pointer += qw ? 2 : 1;
+    pg->write_pointer = slot;
 
     spin_unlock(&iorp->lock);
     
     return 1;
 }
 
+/*
+ * Queue a write that no internal handler claimed on the buffered ioreq page
+ * if the device model declared its target posted-write safe.  Returns 1 if
+ * the write was queued and needs no synchronous round trip.
+ */
+int hvm_posted_io_send(ioreq_t *p)
+{
+    struct domain *d = current->domain;
+    struct hvm_domain *hd = &d->arch.hvm_domain;
+    unsigned int i;
+    int posted = 0;
+
+    if ( (hd->nr_posted_io == 0) || (hd->buf_ioreq.va == NULL) ||
+         (p->dir != IOREQ_WRITE) || p->data_is_ptr || (p->count != 1) )
+        return 0;
+
+    spin_lock(&hd->posted_io_lock);
+    for ( i = 0; i < hd->nr_posted_io; i++ )
+    {
+        struct hvm_posted_io_range *r = &hd->posted_io[i];
+        if ( (r->type == p->type) && (p->addr >= r->first) &&
+             ((p->addr + p->size - 1) <= r->last) )
+        {
+            posted = 1;
+            break;
+        }
+    }
+    spin_unlock(&hd->posted_io_lock);
+
+    return posted && hvm_buffered_io_send(p);
+}
+
+int hvm_set_posted_io_range(struct domain *d, uint8_t type, int enable,
+                            uint64_t first, uint64_t last)
+{
+    struct hvm_domain *hd = &d->arch.hvm_domain;
+    unsigned int i;
+    int rc = 0;
+
+    if ( ((type != IOREQ_TYPE_PIO) && (type != IOREQ_TYPE_COPY)) ||
+         (first > last) )
+        return -EINVAL;
+
+    spin_lock(&hd->posted_io_lock);
+
+    for ( i = 0; i < hd->nr_posted_io; i++ )
+        if ( (hd->posted_io[i].type == type) &&
+             (hd->posted_io[i].first == first) &&
+             (hd->posted_io[i].last == last) )
+            break;
+
+    if ( !enable )
+    {
+        if ( i == hd->nr_posted_io )
+            rc = -ENOENT;
+        else
+            hd->posted_io[i] = hd->posted_io[--hd->nr_posted_io];
+    }
+    else if ( i != hd->nr_posted_io )
+        rc = -EEXIST;
+    else if ( hd->nr_posted_io == HVM_NR_POSTED_IO_RANGES )
+        rc = -ENOSPC;
+    else
+    {
+        hd->posted_io[i].type  = type;
+        hd->posted_io[i].first = first;
+        hd->posted_io[i].last  = last;
+        hd->nr_posted_io++;
+    }
+
+    spin_unlock(&hd->posted_io_lock);
+
+    return rc;
+}
+
+/*
+ * Complete a write to a registered doorbell by signalling its event channel
+ * rather than sending an ioreq.  The read lock is held across the notify so
+ * that hvm_set_doorbell() cannot close the channel underneath us.  Kicks
+ * from different vcpus still serialise on the domain's event_lock, which
+ * notify_via_xen_event_channel() takes.
+ */
+int hvm_doorbell_send(ioreq_t *p)
+{
+    struct hvm_domain *hd = &current->domain->arch.hvm_domain;
+    buffered_iopage_t *pg = hd->buf_ioreq.va;
+    unsigned int i;
+    int rung = 0;
+
+    if ( (hd->nr_doorbells == 0) || (p->dir != IOREQ_WRITE) ||
+         p->data_is_ptr || (p->count != 1) )
+        return 0;
+
+    /*
+     * Posted writes still on the buffered ioreq page were issued before
+     * this kick and the backend must see them first.  Only the device
+     * model can drain that ring, and it does so before it handles any
+     * synchronous ioreq, so leave the write to that path.
+     */
+    if ( (pg != NULL) && (pg->read_pointer != pg->write_pointer) )
+        return 0;
+
+    read_lock(&hd->doorbell_lock);
+    for ( i = 0; i < hd->nr_doorbells; i++ )
+    {
+        struct hvm_doorbell *db = &hd->doorbells[i];
+        if ( (db->type == p->type) && (db->addr == p->addr) &&
+             (db->size == p->size) &&
+             (!(db->flags & HVM_DOORBELL_DATAMATCH) || (db->data == p->data)) )
+        {
+            notify_via_xen_event_channel(db->port);
+            rung = 1;
+            break;
+        }
+    }
+    read_unlock(&hd->doorbell_lock);
+
+    if ( rung )
+        perfc_incr(hvm_doorbell);
+
+    return rung;
+}
+
+int hvm_set_doorbell(struct domain *d, struct xen_hvm_set_doorbell *a)
+{
+    struct hvm_domain *hd = &d->arch.hvm_domain;
+    struct vcpu *v = d->vcpu[0];
+    uint64_t data = 0;
+    unsigned int i;
+    int rc = 0, port = -1;
+
+    if ( ((a->type != IOREQ_TYPE_PIO) && (a->type != IOREQ_TYPE_COPY)) ||
+         ((a->size != 1) && (a->size != 2) && (a->size != 4) &&
+          (a->size != 8)) ||
+         (a->flags & ~HVM_DOORBELL_DATAMATCH) || (v == NULL) )
+        return -EINVAL;
+
+    if ( a->flags & HVM_DOORBELL_DATAMATCH )
+        data = (a->size == 8) ? a->data
+                              : a->data & ((1ULL << (a->size * 8)) - 1);
+
+    write_lock(&hd->doorbell_lock);
+
+    for ( i = 0; i < hd->nr_doorbells; i++ )
+        if ( (hd->doorbells[i].type == a->type) &&
+             (hd->doorbells[i].addr == a->addr) &&
+             (hd->doorbells[i].size == a->size) &&
+             (hd->doorbells[i].flags == a->flags) &&
+             (hd->doorbells[i].data == data) )
+            break;
+
+    if ( !a->enable )
+    {
+        if ( i == hd->nr_doorbells )
+            rc = -ENOENT;
+        else
+        {
+            port = hd->doorbells[i].port;
+            hd->doorbells[i] = hd->doorbells[--hd->nr_doorbells];
+        }
+    }
+    else if ( i != hd->nr_doorbells )
+        rc = -EEXIST;
+    else if ( hd->nr_doorbells == HVM_NR_DOORBELLS )
+        rc = -ENOSPC;
+    else if ( (port = alloc_unbound_xen_event_channel(
+                   v, current->domain->domain_id)) < 0 )
+        rc = port;
+    else
+    {
+        hd->doorbells[i].type  = a->type;
+        hd->doorbells[i].size  = a->size;
+        hd->doorbells[i].flags = a->flags;
+        hd->doorbells[i].port  = port;
+        hd->doorbells[i].addr  = a->addr;
+        hd->doorbells[i].data  = data;
+        hd->nr_doorbells++;
+        a->port = port;
+    }
+
+    write_unlock(&hd->doorbell_lock);
+
+    /* No kick can be using the channel any more. */
+    if ( !a->enable && (rc == 0) )
+        free_xen_event_channel(v, port);
+
+    return rc;
+}
+
 void send_timeoffset_req(unsigned long timeoff)
 {
     ioreq_t p[1];
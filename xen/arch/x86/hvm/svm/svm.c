@@ -40,6 +40,7 @@
 #include <asm/spinlock.h>
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/support.h>
+#include <asm/hvm/emulate.h>
 #include <asm/hvm/io.h>
 #include <asm/hvm/svm/asid.h>
 #include <asm/hvm/svm/svm.h>
@@ -927,6 +928,10 @@ void start_svm(struct cpuinfo_x86 *c)
     svm_function_table.hap_supported = cpu_has_svm_npt;
 
     svm_function_table.hap_capabilities = HVM_HAP_SUPERPAGE_2MB;
+#ifdef __x86_64__
+    if ( cpu_has_page1gb )
+        svm_function_table.hap_capabilities |= HVM_HAP_SUPERPAGE_1GB;
+#endif
 
     hvm_enable(&svm_function_table);
 }
@@ -1269,6 +1274,7 @@ static void svm_invlpg_intercept(unsigned long vaddr)
 {
     struct vcpu *curr = current;
     HVMTRACE_LONG_2D(INVLPG, 0, TRC_PAR_LONG(vaddr));
+    hvm_insn_cache_flush(curr->domain);
     paging_invlpg(curr, vaddr);
     svm_asid_g_invlpg(curr, vaddr);
 }
@@ -1281,6 +1287,8 @@ asmlinkage void svm_vmexit_handler(struct cpu_user_regs *regs)
     eventinj_t eventinj;
     int inst_len, rc;
 
+    vlapic_exit_guest(v);
+
     if ( paging_mode_hap(v->domain) )
         v->arch.hvm_vcpu.guest_cr[3] = v->arch.hvm_vcpu.hw_cr[3] = vmcb->cr3;
 
@@ -1313,6 +1321,9 @@ asmlinkage void svm_vmexit_handler(struct cpu_user_regs *regs)
     }
 
     perfc_incra(svmexits, exit_reason);
+    hvm_exit_stats_begin(v, (exit_reason == VMEXIT_NPF)
+                         ? XEN_HVM_EXIT_STATS_SVM_NPF
+                         : hvm_exit_stats_hw_index(exit_reason));
 
     hvm_maybe_deassert_evtchn_irq();
 
@@ -1472,6 +1483,14 @@ asmlinkage void svm_vmexit_handler(struct cpu_user_regs *regs)
         svm_vmexit_do_rdtsc(regs);
         break;
 
+    case VMEXIT_PAUSE:
+        /*
+         * The pause filter has expired: the guest is spinning, let a
+         * sibling run.  PAUSE is re-executed, reloading the filter count.
+         */
+        vcpu_yield_to_sibling();
+        break;
+
     case VMEXIT_RDTSCP:
     case VMEXIT_MONITOR:
     case VMEXIT_MWAIT:
@@ -43,6 +43,13 @@ extern int svm_dbg_on;
 #define IOPM_SIZE   (12 * 1024)
 #define MSRPM_SIZE  (8  * 1024)
 
+/*
+ * Pause filter: intercept the PAUSE that completes this many back-to-back
+ * PAUSEs, so a vcpu spinning on a lock can yield.  0 disables the filter.
+ */
+static unsigned int pause_filter = 3000;
+integer_param("pause_filter", pause_filter);
+
 struct vmcb_struct *alloc_vmcb(void) 
 {
     struct vmcb_struct *vmcb;
@@ -168,6 +175,13 @@ static int construct_vmcb(struct vcpu *v)
     if ( opt_softtsc )
         vmcb->general1_intercepts |= GENERAL1_INTERCEPT_RDTSC;
 
+    /* Spin loops. */
+    if ( cpu_has_pause_filter && pause_filter )
+    {
+        vmcb->pause_filter_count = min_t(unsigned int, pause_filter, 0xffff);
+        vmcb->general1_intercepts |= GENERAL1_INTERCEPT_PAUSE;
+    }
+
     /* Guest EFER: *must* contain SVME or VMRUN will fail. */
     vmcb->efer = EFER_SVME;
 
@@ -257,7 +257,7 @@ static void ioapic_inj_irq(
            (delivery_mode == dest_LowestPrio));
 
     if ( vlapic_set_irq(target, vector, trig_mode) )
-        vcpu_kick(vlapic_vcpu(target));
+        vlapic_kick(vlapic_vcpu(target));
 }
 
 static uint32_t ioapic_get_delivery_bitmask(
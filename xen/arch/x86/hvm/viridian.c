@@ -19,6 +19,8 @@
 #define VIRIDIAN_MSR_GUEST_OS_ID 0x40000000
 #define VIRIDIAN_MSR_HYPERCALL   0x40000001
 #define VIRIDIAN_MSR_VP_INDEX    0x40000002
+#define VIRIDIAN_MSR_TIME_REF_COUNT 0x40000020
+#define VIRIDIAN_MSR_REFERENCE_TSC  0x40000021
 #define VIRIDIAN_MSR_EOI         0x40000070
 #define VIRIDIAN_MSR_ICR         0x40000071
 #define VIRIDIAN_MSR_TPR         0x40000072
@@ -27,19 +29,36 @@
 /* Viridian Hypercall Status Codes. */
 #define HV_STATUS_SUCCESS                       0x0000
 #define HV_STATUS_INVALID_HYPERCALL_CODE        0x0002
+#define HV_STATUS_INVALID_PARAMETER             0x0005
 
 /* Viridian Hypercall Codes and Parameters. */
+#define HvFlushVirtualAddressSpace 2
+#define HvFlushVirtualAddressList  3
 #define HvNotifyLongSpinWait    8
 
+/* Viridian Hypercall Flags. */
+#define HV_FLUSH_ALL_PROCESSORS 1
+
 /* Viridian CPUID 4000003, Viridian MSR availability. */
+#define CPUID3A_MSR_TIME_REF_COUNT (1 << 1)
 #define CPUID3A_MSR_APIC_ACCESS (1 << 4)
 #define CPUID3A_MSR_HYPERCALL   (1 << 5)
 #define CPUID3A_MSR_VP_INDEX    (1 << 6)
+#define CPUID3A_MSR_REFERENCE_TSC (1 << 9)
 
 /* Viridian CPUID 4000004, Implementation Recommendations. */
+#define CPUID4A_HCALL_REMOTE_TLB_FLUSH (1 << 2)
 #define CPUID4A_MSR_BASED_APIC  (1 << 3)
 #define CPUID4A_RELAX_TIMER_INT (1 << 5)
 
+/* Layout of the reference TSC page. */
+struct viridian_reference_tsc_page {
+    uint32_t tsc_sequence;  /* 0: invalid, use the reference counter MSR */
+    uint32_t reserved1;
+    uint64_t tsc_scale;     /* 64.64 fixed point multiplier of guest TSC */
+    int64_t  tsc_offset;    /* 100ns units */
+};
+
 int cpuid_viridian_leaves(unsigned int leaf, unsigned int *eax,
                           unsigned int *ebx, unsigned int *ecx,
                           unsigned int *edx)
@@ -77,16 +96,19 @@ int cpuid_viridian_leaves(unsigned int leaf, unsigned int *eax,
         break;
     case 3:
         /* Which hypervisor MSRs are available to the guest */
-        *eax = (CPUID3A_MSR_APIC_ACCESS |
+        *eax = (CPUID3A_MSR_TIME_REF_COUNT |
+                CPUID3A_MSR_APIC_ACCESS |
                 CPUID3A_MSR_HYPERCALL   |
-                CPUID3A_MSR_VP_INDEX);
+                CPUID3A_MSR_VP_INDEX    |
+                CPUID3A_MSR_REFERENCE_TSC);
         break;
     case 4:
         /* Recommended hypercall usage. */
         if ( (d->arch.hvm_domain.viridian.guest_os_id.raw == 0) ||
              (d->arch.hvm_domain.viridian.guest_os_id.fields.os < 4) )
             break;
-        *eax = (CPUID4A_MSR_BASED_APIC |
+        *eax = (CPUID4A_HCALL_REMOTE_TLB_FLUSH |
+                CPUID4A_MSR_BASED_APIC |
                 CPUID4A_RELAX_TIMER_INT);
         *ebx = 2047; /* long spin count */
         break;
@@ -129,6 +151,75 @@ static void enable_hypercall_page(void)
     put_page_and_type(mfn_to_page(mfn));
 }
 
+/* Partition reference time: 100ns units since the domain was created. */
+static uint64_t time_ref_count(struct domain *d)
+{
+    struct pl_time *pl = &d->arch.hvm_domain.pl_time;
+
+    return ((uint64_t)(get_s_time() + pl->stime_offset) / 100 +
+            d->arch.hvm_domain.viridian.time_ref_offset);
+}
+
+/* High 64 bits of the 128-bit product a * b. */
+static uint64_t mul_hi64(uint64_t a, uint64_t b)
+{
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t mid1 = a_hi * b_lo, mid2 = a_lo * b_hi;
+    uint64_t carry = (((a_lo * b_lo) >> 32) +
+                      (uint32_t)mid1 + (uint32_t)mid2) >> 32;
+
+    return a_hi * b_hi + (mid1 >> 32) + (mid2 >> 32) + carry;
+}
+
+static void update_reference_tsc(struct domain *d)
+{
+    unsigned long gmfn = d->arch.hvm_domain.viridian.reference_tsc.fields.pfn;
+    unsigned long mfn = gmfn_to_mfn(d, gmfn);
+    struct viridian_reference_tsc_page *p;
+    uint64_t scale;
+    uint32_t seq;
+
+    if ( !mfn_valid(mfn) ||
+         !get_page_and_type(mfn_to_page(mfn), d, PGT_writable_page) )
+    {
+        gdprintk(XENLOG_WARNING, "Bad GMFN %lx (MFN %lx)\n", gmfn, mfn);
+        return;
+    }
+
+    p = map_domain_page(mfn);
+
+    /* Readers seeing a zero sequence fall back to the MSR meanwhile. */
+    seq = p->tsc_sequence;
+    p->tsc_sequence = 0;
+    wmb();
+
+    /*
+     * The page can only describe a guest TSC which ticks at the constant
+     * host rate. Otherwise leave it invalid.
+     */
+    if ( !opt_softtsc && boot_cpu_has(X86_FEATURE_CONSTANT_TSC) &&
+         (d->vcpu[0] != NULL) )
+    {
+        /* scale = (10^7 << 64) / tsc_hz, computed in two 32-bit steps. */
+        scale = ((10000ull << 32) / cpu_khz) << 32;
+        scale |= ((((10000ull << 32) % cpu_khz) << 32) / cpu_khz);
+
+        p->tsc_scale  = scale;
+        p->tsc_offset = time_ref_count(d) -
+                        mul_hi64(hvm_get_guest_tsc(d->vcpu[0]), scale);
+        wmb();
+
+        if ( (++seq == 0) || (seq == 0xffffffff) )
+            seq = 1;
+        p->tsc_sequence = seq;
+    }
+
+    unmap_domain_page(p);
+
+    put_page_and_type(mfn_to_page(mfn));
+}
+
 int wrmsr_viridian_regs(uint32_t idx, uint32_t eax, uint32_t edx)
 {
     struct domain *d = current->domain;
@@ -172,6 +263,14 @@ int wrmsr_viridian_regs(uint32_t idx, uint32_t eax, uint32_t edx)
         gdprintk(XENLOG_INFO, "Set VP index %"PRIu64".\n", val);
         break;
 
+    case VIRIDIAN_MSR_REFERENCE_TSC:
+        perfc_incr(mshv_wrmsr_ref_tsc);
+        gdprintk(XENLOG_INFO, "Set reference TSC page %"PRIx64".\n", val);
+        d->arch.hvm_domain.viridian.reference_tsc.raw = val;
+        if ( d->arch.hvm_domain.viridian.reference_tsc.fields.enabled )
+            update_reference_tsc(d);
+        break;
+
     case VIRIDIAN_MSR_EOI:
         perfc_incr(mshv_wrmsr_eoi);
         vlapic_EOI_set(vcpu_vlapic(current));
@@ -249,6 +348,16 @@ int rdmsr_viridian_regs(uint32_t idx, uint32_t *eax, uint32_t *edx)
         val = v->vcpu_id;
         break;
 
+    case VIRIDIAN_MSR_TIME_REF_COUNT:
+        perfc_incr(mshv_rdmsr_time_ref_count);
+        val = time_ref_count(v->domain);
+        break;
+
+    case VIRIDIAN_MSR_REFERENCE_TSC:
+        perfc_incr(mshv_rdmsr_ref_tsc);
+        val = v->domain->arch.hvm_domain.viridian.reference_tsc.raw;
+        break;
+
     case VIRIDIAN_MSR_ICR:
         perfc_incr(mshv_rdmsr_icr);
         val = (((uint64_t)vlapic_get_reg(vcpu_vlapic(v), APIC_ICR2) << 32) |
@@ -269,6 +378,14 @@ int rdmsr_viridian_regs(uint32_t idx, uint32_t *eax, uint32_t *edx)
     return 1;
 }
 
+/* The processor mask only covers the first 64 vcpus: flush the rest. */
+static bool_t viridian_flush_vcpu(void *ctxt, struct vcpu *v)
+{
+    uint64_t mask = *(uint64_t *)ctxt;
+
+    return (v->vcpu_id >= 64) || (mask & (1ull << v->vcpu_id));
+}
+
 int viridian_hypercall(struct cpu_user_regs *regs)
 {
     int mode = hvm_guest_x86_mode(current);
@@ -279,7 +396,8 @@ int viridian_hypercall(struct cpu_user_regs *regs)
         uint64_t raw;
         struct {
             uint16_t call_code;
-            uint16_t rsvd1;
+            uint16_t fast:1;
+            uint16_t rsvd1:15;
             unsigned rep_count:12;
             unsigned rsvd2:4;
             unsigned rep_start:12;
@@ -321,9 +439,46 @@ int viridian_hypercall(struct cpu_user_regs *regs)
     {
     case HvNotifyLongSpinWait:
         perfc_incr(mshv_call_long_wait);
-        do_sched_op_compat(SCHEDOP_yield, 0);
+        vcpu_yield_to_sibling();
+        status = HV_STATUS_SUCCESS;
+        break;
+    case HvFlushVirtualAddressSpace:
+    case HvFlushVirtualAddressList:
+    {
+        struct {
+            uint64_t address_space;
+            uint64_t flags;
+            uint64_t processor_mask;
+        } input_params;
+
+        if ( input.call_code == HvFlushVirtualAddressSpace )
+            perfc_incr(mshv_call_flush_tlb_all);
+        else
+            perfc_incr(mshv_call_flush_tlb_list);
+
+        /* These calls are never made with the register-based convention. */
+        status = HV_STATUS_INVALID_PARAMETER;
+        if ( input.fast ||
+             (hvm_copy_from_guest_phys(&input_params, input_params_gpa,
+                                       sizeof(input_params)) != HVMCOPY_okay) )
+            break;
+
+        if ( input_params.flags & HV_FLUSH_ALL_PROCESSORS )
+            input_params.processor_mask = ~0ull;
+
+        /*
+         * The paging layer flushes whole vcpu TLBs, which covers both the
+         * address space and the list of addresses being asked for. If
+         * another vcpu is flushing, re-execute the hypercall.
+         */
+        if ( hvm_flush_vcpu_tlbs(viridian_flush_vcpu,
+                                 &input_params.processor_mask) )
+            return HVM_HCALL_preempted;
+
+        output.rep_complete = input.rep_count;
         status = HV_STATUS_SUCCESS;
         break;
+    }
     default:
         status = HV_STATUS_INVALID_HYPERCALL_CODE;
         break;
@@ -374,3 +529,39 @@ static int viridian_load_cpu_ctxt(struct domain *d, hvm_domain_context_t *h)
 
 HVM_REGISTER_SAVE_RESTORE(VIRIDIAN, viridian_save_cpu_ctxt,
                           viridian_load_cpu_ctxt, 1, HVMSR_PER_DOM);
+
+static int viridian_save_time_ctxt(struct domain *d, hvm_domain_context_t *h)
+{
+    struct hvm_viridian_time_context ctxt;
+
+    if ( !is_viridian_domain(d) )
+        return 0;
+
+    ctxt.reference_tsc  = d->arch.hvm_domain.viridian.reference_tsc.raw;
+    ctxt.time_ref_count = time_ref_count(d);
+
+    return (hvm_save_entry(VIRIDIAN_TIME, 0, h, &ctxt) != 0);
+}
+
+static int viridian_load_time_ctxt(struct domain *d, hvm_domain_context_t *h)
+{
+    struct hvm_viridian_time_context ctxt;
+
+    if ( hvm_load_entry(VIRIDIAN_TIME, h, &ctxt) != 0 )
+        return -EINVAL;
+
+    /* Continue the reference counter from where it was saved. */
+    d->arch.hvm_domain.viridian.time_ref_offset = 0;
+    d->arch.hvm_domain.viridian.time_ref_offset =
+        ctxt.time_ref_count - time_ref_count(d);
+
+    /* The TSC rate may differ on this host: rewrite the page. */
+    d->arch.hvm_domain.viridian.reference_tsc.raw = ctxt.reference_tsc;
+    if ( d->arch.hvm_domain.viridian.reference_tsc.fields.enabled )
+        update_reference_tsc(d);
+
+    return 0;
+}
+
+HVM_REGISTER_SAVE_RESTORE(VIRIDIAN_TIME, viridian_save_time_ctxt,
+                          viridian_load_time_ctxt, 1, HVMSR_PER_DOM);
@@ -28,6 +28,7 @@
 #include <xen/trace.h>
 #include <xen/lib.h>
 #include <xen/sched.h>
+#include <xen/perfc.h>
 #include <xen/numa.h>
 #include <asm/current.h>
 #include <asm/page.h>
@@ -54,7 +55,7 @@
 static unsigned int vlapic_lvt_mask[VLAPIC_LVT_NUM] =
 {
      /* LVTT */
-     LVT_MASK | APIC_LVT_TIMER_PERIODIC,
+     LVT_MASK | APIC_LVT_TIMER_MODE_MASK,
      /* LVTTHMR */
      LVT_MASK | APIC_MODE_MASK,
      /* LVTPC */
@@ -79,6 +80,9 @@ static unsigned int vlapic_lvt_mask[VLAPIC_LVT_NUM] =
 #define vlapic_lvtt_period(vlapic)                              \
     (vlapic_get_reg(vlapic, APIC_LVTT) & APIC_LVT_TIMER_PERIODIC)
 
+#define vlapic_lvtt_tdt(vlapic)                                 \
+    (vlapic_get_reg(vlapic, APIC_LVTT) & APIC_LVT_TIMER_TSCDEADLINE)
+
 
 /*
  * Generic APIC bitmap vector update & search routines.
@@ -97,16 +101,52 @@ static unsigned int vlapic_lvt_mask[VLAPIC_LVT_NUM] =
 #define vlapic_clear_vector(vec, bitmap)                                \
     clear_bit(VEC_POS(vec), (unsigned long *)((bitmap) + REG_POS(vec)))
 
-static int vlapic_find_highest_vector(void *bitmap)
+/*
+ * Find the highest vector set in bitmap, visiting only the 32-bit words
+ * whose bit is set in summary.  A summary bit may be stale-set but is never
+ * clear for a non-zero word.
+ */
+static int vlapic_find_highest_vector(void *bitmap, unsigned long summary)
 {
     uint32_t *word = bitmap;
-    int word_offset = MAX_VECTOR / 32;
+    int word_offset;
+
+    while ( summary != 0 )
+    {
+        word_offset = fls(summary) - 1;
+        if ( word[word_offset*4] != 0 )
+            return (fls(word[word_offset*4]) - 1) + (word_offset * 32);
+        summary &= ~(1UL << word_offset);
+    }
+
+    return -1;
+}
+
+/* Clear a summary bit, unless a racing setter made its word non-zero. */
+static void vlapic_clear_summary(int vector, void *bitmap,
+                                 unsigned long *summary)
+{
+    uint32_t *word = (uint32_t *)((char *)bitmap + REG_POS(vector));
+
+    if ( *word != 0 )
+        return;
+    clear_bit(vector / 32, summary);
+    if ( *word != 0 )
+        set_bit(vector / 32, summary);
+}
 
-    /* Work backwards through the bitmap (first 32-bit word in every four). */
-    while ( (word_offset != 0) && (word[(--word_offset)*4] == 0) )
-        continue;
+static void vlapic_sync_summaries(struct vlapic *vlapic)
+{
+    int i;
 
-    return (fls(word[word_offset*4]) - 1) + (word_offset * 32);
+    vlapic->irr_summary = vlapic->isr_summary = 0;
+    for ( i = 0; i < MAX_VECTOR / 32; i++ )
+    {
+        if ( vlapic_get_reg(vlapic, APIC_IRR + 0x10 * i) )
+            set_bit(i, &vlapic->irr_summary);
+        if ( vlapic_get_reg(vlapic, APIC_ISR + 0x10 * i) )
+            set_bit(i, &vlapic->isr_summary);
+    }
 }
 
 
@@ -116,17 +156,24 @@ static int vlapic_find_highest_vector(void *bitmap)
 
 static int vlapic_test_and_set_irr(int vector, struct vlapic *vlapic)
 {
-    return vlapic_test_and_set_vector(vector, &vlapic->regs->data[APIC_IRR]);
+    int ret = vlapic_test_and_set_vector(vector, &vlapic->regs->data[APIC_IRR]);
+
+    /* The IRR bit must be visible before the summary bit. */
+    set_bit(vector / 32, &vlapic->irr_summary);
+    return ret;
 }
 
 static void vlapic_clear_irr(int vector, struct vlapic *vlapic)
 {
     vlapic_clear_vector(vector, &vlapic->regs->data[APIC_IRR]);
+    vlapic_clear_summary(vector, &vlapic->regs->data[APIC_IRR],
+                         &vlapic->irr_summary);
 }
 
 static int vlapic_find_highest_irr(struct vlapic *vlapic)
 {
-    return vlapic_find_highest_vector(&vlapic->regs->data[APIC_IRR]);
+    return vlapic_find_highest_vector(&vlapic->regs->data[APIC_IRR],
+                                      vlapic->irr_summary);
 }
 
 int vlapic_set_irq(struct vlapic *vlapic, uint8_t vec, uint8_t trig)
@@ -143,7 +190,49 @@ int vlapic_set_irq(struct vlapic *vlapic, uint8_t vec, uint8_t trig)
 
 static int vlapic_find_highest_isr(struct vlapic *vlapic)
 {
-    return vlapic_find_highest_vector(&vlapic->regs->data[APIC_ISR]);
+    return vlapic_find_highest_vector(&vlapic->regs->data[APIC_ISR],
+                                      vlapic->isr_summary);
+}
+
+/*
+ * Make v notice newly set IRR bits.  Like vcpu_kick(), but a vcpu that is
+ * running in Xen rather than in the guest evaluates its IRR before its next
+ * VM entry, so it is not interrupted.  Of the senders to a vcpu in the
+ * guest only the first interrupts it: the one exit that follows picks up
+ * every vector pended meanwhile.
+ */
+void vlapic_kick(struct vcpu *v)
+{
+    vcpu_unblock(v);
+
+    /* Order the IRR update before the in_guest test (vlapic_enter_guest). */
+    smp_mb();
+
+    if ( (v == current) && !in_irq() )
+        return;
+
+    if ( test_and_clear_bool(vcpu_vlapic(v)->in_guest) )
+    {
+        perfc_incr(vlapic_kick_ipi);
+        cpu_raise_softirq(v->processor, VCPU_KICK_SOFTIRQ);
+    }
+    else
+        perfc_incr(vlapic_kick_elided);
+}
+
+/*
+ * Called on every VM entry path before pending interrupts are evaluated,
+ * and on every VM exit.
+ */
+void vlapic_enter_guest(struct vcpu *v)
+{
+    vcpu_vlapic(v)->in_guest = 1;
+    smp_mb();
+}
+
+void vlapic_exit_guest(struct vcpu *v)
+{
+    vcpu_vlapic(v)->in_guest = 0;
 }
 
 uint32_t vlapic_get_ppr(struct vlapic *vlapic)
@@ -340,7 +429,7 @@ static int vlapic_accept_irq(struct vcpu *v, int delivery_mode,
             vlapic_set_vector(vector, &vlapic->regs->data[APIC_TMR]);
         }
 
-        vcpu_kick(v);
+        vlapic_kick(v);
         break;
 
     case APIC_DM_REMRD:
@@ -414,6 +503,8 @@ void vlapic_EOI_set(struct vlapic *vlapic)
         return;
 
     vlapic_clear_vector(vector, &vlapic->regs->data[APIC_ISR]);
+    vlapic_clear_summary(vector, &vlapic->regs->data[APIC_ISR],
+                         &vlapic->isr_summary);
 
     if ( vlapic_test_and_clear_vector(vector, &vlapic->regs->data[APIC_TMR]) )
         vioapic_update_EOI(vlapic_domain(vlapic), vector);
@@ -511,7 +602,7 @@ static void vlapic_read_aligned(
         break;
 
     case APIC_TMCCT: /* Timer CCR */
-        *result = vlapic_get_tmcct(vlapic);
+        *result = vlapic_lvtt_tdt(vlapic) ? 0 : vlapic_get_tmcct(vlapic);
         break;
 
     default:
@@ -580,6 +671,12 @@ void vlapic_pt_cb(struct vcpu *v, void *data)
     *(s_time_t *)data = hvm_get_guest_time(v);
 }
 
+/* The deadline MSR reads as zero once the timer has fired. */
+static void vlapic_tdt_pt_cb(struct vcpu *v, void *data)
+{
+    *(uint64_t *)data = 0;
+}
+
 static int vlapic_write(struct vcpu *v, unsigned long address,
                         unsigned long len, unsigned long val)
 {
@@ -687,6 +784,17 @@ static int vlapic_write(struct vcpu *v, unsigned long address,
         break;
 
     case APIC_LVTT:         /* LVT Timer Reg */
+        /* Timer mode 3 is reserved: treat it as periodic. */
+        if ( (val & APIC_LVT_TIMER_MODE_MASK) == APIC_LVT_TIMER_MODE_MASK )
+            val &= ~APIC_LVT_TIMER_TSCDEADLINE;
+        /* Switching into or out of TSC-deadline mode disarms the timer. */
+        if ( (val ^ vlapic_get_reg(vlapic, APIC_LVTT)) &
+             APIC_LVT_TIMER_TSCDEADLINE )
+        {
+            destroy_periodic_time(&vlapic->pt);
+            vlapic_set_reg(vlapic, APIC_TMICT, 0);
+            vlapic->tdt_msr = 0;
+        }
         vlapic->pt.irq = val & APIC_VECTOR_MASK;
     case APIC_LVTTHMR:      /* LVT Thermal Monitor */
     case APIC_LVTPC:        /* LVT Performance Counter */
@@ -704,6 +812,10 @@ static int vlapic_write(struct vcpu *v, unsigned long address,
         uint64_t period = (uint64_t)APIC_BUS_CYCLE_NS *
                             (uint32_t)val * vlapic->hw.timer_divisor;
 
+        /* The initial count is ignored in TSC-deadline mode. */
+        if ( vlapic_lvtt_tdt(vlapic) )
+            break;
+
         vlapic_set_reg(vlapic, APIC_TMICT, val);
         create_periodic_time(current, &vlapic->pt, period, 
                              vlapic_lvtt_period(vlapic) ? period : 0,
@@ -776,6 +888,65 @@ void vlapic_msr_set(struct vlapic *vlapic, uint64_t value)
                 "apic base msr is 0x%016"PRIx64, vlapic->hw.apic_base_msr);
 }
 
+/* Convert a guest TSC interval into nanoseconds of guest time. */
+static uint64_t vlapic_tsc_to_ns(uint64_t tsc)
+{
+    uint64_t ns;
+
+    if ( opt_softtsc )
+        return tsc;
+
+    ns = ((tsc / cpu_khz) * 1000000UL +
+          ((tsc % cpu_khz) * 1000000UL) / cpu_khz);
+
+    /* Keep NOW() + ns well clear of s_time_t overflow. */
+    return min_t(uint64_t, ns, STIME_MAX >> 1);
+}
+
+static void vlapic_tdt_arm(struct vlapic *vlapic)
+{
+    struct vcpu *v = vlapic_vcpu(vlapic);
+    uint64_t guest_tsc = hvm_get_guest_tsc(v), delta = 0;
+
+    if ( vlapic->tdt_msr > guest_tsc )
+        delta = vlapic_tsc_to_ns(vlapic->tdt_msr - guest_tsc);
+
+    vlapic->pt.irq = vlapic_get_reg(vlapic, APIC_LVTT) & APIC_VECTOR_MASK;
+    create_periodic_time(v, &vlapic->pt, delta, 0, vlapic->pt.irq,
+                         vlapic_tdt_pt_cb, &vlapic->tdt_msr);
+
+    HVM_DBG_LOG(DBG_LEVEL_VLAPIC_TIMER,
+                "tsc deadline %"PRIx64", guest tsc %"PRIx64", "
+                "delta %"PRIu64"ns", vlapic->tdt_msr, guest_tsc, delta);
+}
+
+/*
+ * IA32_TSC_DEADLINE.  Writing a deadline re-arms the one-shot timer directly
+ * from the MSR intercept; zero disarms it.  Outside TSC-deadline mode writes
+ * are ignored and reads return zero.
+ */
+void vlapic_tdt_msr_set(struct vlapic *vlapic, uint64_t value)
+{
+    if ( vlapic_hw_disabled(vlapic) || !vlapic_lvtt_tdt(vlapic) )
+        return;
+
+    perfc_incr(vlapic_tdt_write);
+
+    vlapic->tdt_msr = value;
+    if ( value == 0 )
+        destroy_periodic_time(&vlapic->pt);
+    else
+        vlapic_tdt_arm(vlapic);
+}
+
+uint64_t vlapic_tdt_msr_get(struct vlapic *vlapic)
+{
+    if ( vlapic_hw_disabled(vlapic) || !vlapic_lvtt_tdt(vlapic) )
+        return 0;
+
+    return vlapic->tdt_msr;
+}
+
 int vlapic_accept_pic_intr(struct vcpu *v)
 {
     struct vlapic *vlapic = vcpu_vlapic(v);
@@ -815,6 +986,7 @@ int vlapic_ack_pending_irq(struct vcpu *v, int vector)
     struct vlapic *vlapic = vcpu_vlapic(v);
 
     vlapic_set_vector(vector, &vlapic->regs->data[APIC_ISR]);
+    set_bit(vector / 32, &vlapic->isr_summary);
     vlapic_clear_irr(vector, vlapic);
 
     return 1;
@@ -835,6 +1007,7 @@ void vlapic_reset(struct vlapic *vlapic)
         vlapic_set_reg(vlapic, APIC_ISR + 0x10 * i, 0);
         vlapic_set_reg(vlapic, APIC_TMR + 0x10 * i, 0);
     }
+    vlapic_sync_summaries(vlapic);
     vlapic_set_reg(vlapic, APIC_ICR,     0);
     vlapic_set_reg(vlapic, APIC_ICR2,    0);
     vlapic_set_reg(vlapic, APIC_LDR,     0);
@@ -850,6 +1023,7 @@ void vlapic_reset(struct vlapic *vlapic)
 
     vlapic_set_reg(vlapic, APIC_SPIV, 0xff);
     vlapic->hw.disabled |= VLAPIC_SW_DISABLED;
+    vlapic->tdt_msr = 0;
 
     destroy_periodic_time(&vlapic->pt);
 }
@@ -946,14 +1120,59 @@ static int lapic_load_regs(struct domain *d, hvm_domain_context_t *h)
     if ( hvm_load_entry(LAPIC_REGS, h, s->regs) != 0 ) 
         return -EINVAL;
 
+    vlapic_sync_summaries(s);
     lapic_rearm(s);
     return 0;
 }
 
+static int lapic_save_tdt(struct domain *d, hvm_domain_context_t *h)
+{
+    struct vcpu *v;
+    struct hvm_hw_lapic_tdt ctxt;
+    int rc = 0;
+
+    for_each_vcpu ( d, v )
+    {
+        ctxt.tdt_msr = vcpu_vlapic(v)->tdt_msr;
+        if ( (rc = hvm_save_entry(LAPIC_TDT, v->vcpu_id, h, &ctxt)) != 0 )
+            break;
+    }
+
+    return rc;
+}
+
+/* Loaded after LAPIC_REGS, so the LVTT timer mode is already in place. */
+static int lapic_load_tdt(struct domain *d, hvm_domain_context_t *h)
+{
+    uint16_t vcpuid;
+    struct vcpu *v;
+    struct vlapic *s;
+    struct hvm_hw_lapic_tdt ctxt;
+
+    vcpuid = hvm_load_instance(h);
+    if ( vcpuid > MAX_VIRT_CPUS || (v = d->vcpu[vcpuid]) == NULL )
+    {
+        gdprintk(XENLOG_ERR, "HVM restore: domain has no vlapic %u\n", vcpuid);
+        return -EINVAL;
+    }
+    s = vcpu_vlapic(v);
+
+    if ( hvm_load_entry(LAPIC_TDT, h, &ctxt) != 0 )
+        return -EINVAL;
+
+    s->tdt_msr = ctxt.tdt_msr;
+    if ( vlapic_lvtt_tdt(s) && (s->tdt_msr != 0) )
+        vlapic_tdt_arm(s);
+
+    return 0;
+}
+
 HVM_REGISTER_SAVE_RESTORE(LAPIC, lapic_save_hidden, lapic_load_hidden,
                           1, HVMSR_PER_VCPU);
 HVM_REGISTER_SAVE_RESTORE(LAPIC_REGS, lapic_save_regs, lapic_load_regs,
                           1, HVMSR_PER_VCPU);
+HVM_REGISTER_SAVE_RESTORE(LAPIC_TDT, lapic_save_tdt, lapic_load_tdt,
+                          1, HVMSR_PER_VCPU);
 
 int vlapic_init(struct vcpu *v)
 {
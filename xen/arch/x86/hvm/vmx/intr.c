@@ -74,7 +74,7 @@ static void enable_intr_window(struct vcpu *v, struct hvm_intack intack)
 
     ASSERT(intack.source != hvm_intsrc_none);
 
-    if ( unlikely(tb_init_done) )
+    if ( unlikely(tb_event_enabled(TRC_HVM)) )
     {
         unsigned int intr = __vmread(VM_ENTRY_INTR_INFO);
         HVMTRACE_3D(INTR_WINDOW, intack.vector, intack.source,
@@ -117,6 +117,9 @@ asmlinkage void vmx_intr_assist(void)
     unsigned int tpr_threshold = 0;
     enum hvm_intblk intblk;
 
+    vlapic_enter_guest(v);
+    hvm_exit_stats_end(v);
+
     /* Block event injection when single step with MTF. */
     if ( unlikely(v->arch.hvm_vcpu.single_step) )
     {
@@ -41,6 +41,17 @@
 static int opt_vpid_enabled = 1;
 boolean_param("vpid", opt_vpid_enabled);
 
+/*
+ * Pause-loop exiting: a PAUSE that follows the previous one by at most
+ * ple_gap cycles is part of the same spin loop; a loop lasting more than
+ * ple_window cycles exits so the spinning vcpu can yield.  ple_gap=0
+ * disables the feature.
+ */
+static unsigned int ple_gap = 128;
+integer_param("ple_gap", ple_gap);
+static unsigned int ple_window = 4096;
+integer_param("ple_window", ple_window);
+
 /* Dynamic (run-time adjusted) execution control flags. */
 u32 vmx_pin_based_exec_control __read_mostly;
 u32 vmx_cpu_based_exec_control __read_mostly;
@@ -70,6 +81,7 @@ static void __init vmx_display_features(void)
     P(cpu_has_vmx_vpid, "Virtual-Processor Identifiers (VPID)");
     P(cpu_has_vmx_vnmi, "Virtual NMI");
     P(cpu_has_vmx_msr_bitmap, "MSR direct-access bitmap");
+    P(cpu_has_vmx_ple, "Pause-Loop Exiting");
 #undef P
 
     if ( !printed )
@@ -77,6 +89,8 @@ static void __init vmx_display_features(void)
 
     if ( cpu_has_vmx_ept_2mb )
         printk("EPT supports 2MB super page.\n");
+    if ( cpu_has_vmx_ept_1gb )
+        printk("EPT supports 1GB super page.\n");
 }
 
 static u32 adjust_vmx_controls(u32 ctl_min, u32 ctl_opt, u32 msr)
@@ -145,6 +159,8 @@ static void vmx_init_vmcs_config(void)
                SECONDARY_EXEC_ENABLE_EPT);
         if ( opt_vpid_enabled )
             opt |= SECONDARY_EXEC_ENABLE_VPID;
+        if ( ple_gap )
+            opt |= SECONDARY_EXEC_PAUSE_LOOP_EXITING;
         _vmx_secondary_exec_control = adjust_vmx_controls(
             min, opt, MSR_IA32_VMX_PROCBASED_CTLS2);
     }
@@ -712,6 +728,12 @@ static int construct_vmcs(struct vcpu *v)
 #endif
     }
 
+    if ( cpu_has_vmx_ple )
+    {
+        __vmwrite(PLE_GAP, ple_gap);
+        __vmwrite(PLE_WINDOW, ple_window);
+    }
+
     if ( cpu_has_vmx_vpid )
     {
         v->arch.hvm_vmx.vpid =
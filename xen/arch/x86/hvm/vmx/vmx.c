@@ -39,6 +39,7 @@
 #include <asm/p2m.h>
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/support.h>
+#include <asm/hvm/emulate.h>
 #include <asm/hvm/vmx/vmx.h>
 #include <asm/hvm/vmx/vmcs.h>
 #include <public/sched.h>
@@ -1423,6 +1424,10 @@ void start_vmx(void)
 
         if ( cpu_has_vmx_ept_2mb )
             vmx_function_table.hap_capabilities |= HVM_HAP_SUPERPAGE_2MB;
+#ifdef __x86_64__
+        if ( cpu_has_vmx_ept_1gb )
+            vmx_function_table.hap_capabilities |= HVM_HAP_SUPERPAGE_1GB;
+#endif
     }
 
     if ( cpu_has_vmx_vpid )
@@ -1550,6 +1555,7 @@ static void vmx_invlpg_intercept(unsigned long vaddr)
 {
     struct vcpu *curr = current;
     HVMTRACE_LONG_2D(INVLPG, /*invlpga=*/ 0, TRC_PAR_LONG(vaddr));
+    hvm_insn_cache_flush(curr->domain);
     if ( paging_invlpg(curr, vaddr) )
         vpid_sync_vcpu_gva(curr, vaddr);
 }
@@ -2212,6 +2218,8 @@ asmlinkage void vmx_vmexit_handler(struct cpu_user_regs *regs)
     unsigned long exit_qualification, inst_len = 0;
     struct vcpu *v = current;
 
+    vlapic_exit_guest(v);
+
     if ( paging_mode_hap(v->domain) && hvm_paging_enabled(v) )
         v->arch.hvm_vcpu.guest_cr[3] = v->arch.hvm_vcpu.hw_cr[3] =
             __vmread(GUEST_CR3);
@@ -2228,6 +2236,7 @@ asmlinkage void vmx_vmexit_handler(struct cpu_user_regs *regs)
                     0, 0, 0, 0);
 
     perfc_incra(vmexits, exit_reason);
+    hvm_exit_stats_begin(v, hvm_exit_stats_hw_index((uint16_t)exit_reason));
 
     /* Handle the interrupt we missed before allowing any more in. */
     switch ( (uint16_t)exit_reason )
@@ -2545,6 +2554,13 @@ asmlinkage void vmx_vmexit_handler(struct cpu_user_regs *regs)
         break;
     }
 
+    case EXIT_REASON_PAUSE_INSTRUCTION:
+        /* Pause-loop exit: the guest is spinning, let a sibling run. */
+        inst_len = __get_instruction_length(); /* Safe: PAUSE */
+        __update_guest_eip(inst_len);
+        vcpu_yield_to_sibling();
+        break;
+
     case EXIT_REASON_MONITOR_TRAP_FLAG:
     {
         v->arch.hvm_vmx.exec_control &= ~CPU_BASED_MONITOR_TRAP_FLAG;
@@ -18,6 +18,7 @@
  */
 
 #include <xen/time.h>
+#include <xen/perfc.h>
 #include <asm/hvm/support.h>
 #include <asm/hvm/vpt.h>
 #include <asm/event.h>
@@ -29,7 +30,6 @@ void hvm_init_guest_time(struct domain *d)
 {
     struct pl_time *pl = &d->arch.hvm_domain.pl_time;
 
-    spin_lock_init(&pl->pl_time_lock);
     pl->stime_offset = -(u64)get_s_time();
     pl->last_guest_time = 0;
 }
@@ -37,18 +37,26 @@ void hvm_init_guest_time(struct domain *d)
 u64 hvm_get_guest_time(struct vcpu *v)
 {
     struct pl_time *pl = &v->domain->arch.hvm_domain.pl_time;
-    u64 now;
+    u64 sample, now, old, prev;
 
     /* Called from device models shared with PV guests. Be careful. */
     ASSERT(is_hvm_vcpu(v));
 
-    spin_lock(&pl->pl_time_lock);
-    now = get_s_time() + pl->stime_offset;
-    if ( (int64_t)(now - pl->last_guest_time) >= 0 )
-        pl->last_guest_time = now;
-    else
-        now = pl->last_guest_time;
-    spin_unlock(&pl->pl_time_lock);
+    /*
+     * Never go backwards relative to any vcpu's earlier read.  A cmpxchg
+     * rather than a lock, so concurrent readers (e.g. of the vHPET main
+     * counter) do not serialise; it also validates 'old' against tearing
+     * on 32-bit builds.
+     */
+    sample = get_s_time() + pl->stime_offset;
+    old = pl->last_guest_time;
+    for ( ; ; )
+    {
+        now = ((int64_t)(sample - old) < 0) ? old : sample;
+        if ( (prev = cmpxchg(&pl->last_guest_time, old, now)) == old )
+            break;
+        old = prev;
+    }
 
     return now + v->arch.hvm_vcpu.stime_offset;
 }
@@ -199,6 +207,13 @@ static void pt_timer_fn(void *data)
 
     pt_lock(pt);
 
+    /* A one-shot timer re-armed while we waited for the lock. */
+    if ( pt->one_shot && (NOW() < pt->scheduled) )
+    {
+        pt_unlock(pt);
+        return;
+    }
+
     pt->pending_intr_nr++;
     pt->do_not_freeze = 0;
 
@@ -359,9 +374,23 @@ void create_periodic_time(
     struct vcpu *v, struct periodic_time *pt, uint64_t delta,
     uint64_t period, uint8_t irq, time_cb *cb, void *data)
 {
+    bool_t rearm;
+
     ASSERT(pt->source != 0);
 
-    destroy_periodic_time(pt);
+    /*
+     * Re-arming a one-shot timer on the vcpu that already owns it keeps the
+     * existing timer: set_timer() moves it, and pt_timer_fn() discards a
+     * stale expiry that raced with us.  Anything else goes through
+     * kill_timer()/init_timer().
+     */
+    rearm = (!period && (pt->vcpu == v) &&
+             (pt->timer.status != TIMER_STATUS_killed) &&
+             (pt->timer.cpu == v->processor));
+    if ( rearm )
+        perfc_incr(vpt_one_shot_rearm);
+    else
+        destroy_periodic_time(pt);
 
     spin_lock(&v->arch.hvm_vcpu.tm_lock);
 
@@ -407,10 +436,14 @@ void create_periodic_time(
     pt->cb = cb;
     pt->priv = data;
 
-    pt->on_list = 1;
-    list_add(&pt->list, &v->arch.hvm_vcpu.tm_list);
+    if ( !pt->on_list )
+    {
+        pt->on_list = 1;
+        list_add(&pt->list, &v->arch.hvm_vcpu.tm_list);
+    }
 
-    init_timer(&pt->timer, pt_timer_fn, pt, v->processor);
+    if ( !rearm )
+        init_timer(&pt->timer, pt_timer_fn, pt, v->processor);
     set_timer(&pt->timer, pt->scheduled);
 
     spin_unlock(&v->arch.hvm_vcpu.tm_lock);
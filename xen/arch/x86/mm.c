@@ -109,6 +109,7 @@
 #include <asm/e820.h>
 #include <asm/hypercall.h>
 #include <asm/shared.h>
+#include <asm/mem_sharing.h>
 #include <public/memory.h>
 #include <xsm/xsm.h>
 #include <xen/trace.h>
@@ -150,8 +151,8 @@ static DEFINE_PER_CPU(struct percpu_mm_info, percpu_mm_info);
  */
 #define FOREIGNDOM (this_cpu(percpu_mm_info).foreign ?: current->domain)
 
-/* Private domain structs for DOMID_XEN and DOMID_IO. */
-struct domain *dom_xen, *dom_io;
+/* Private domain structs for DOMID_XEN, DOMID_IO and DOMID_COW. */
+struct domain *dom_xen, *dom_io, *dom_cow;
 
 /* Frame table and its size in pages. */
 struct page_info *frame_table;
@@ -224,6 +225,15 @@ void __init arch_init_memory(void)
     dom_io = domain_create(DOMID_IO, DOMCRF_dummy, 0);
     BUG_ON(dom_io == NULL);
 
+    /*
+     * Initialise our DOMID_COW domain.
+     * This domain owns the frames behind shared, copy-on-write guest pages.
+     * It has no allocation limit: its frames are accounted to nobody.
+     */
+    dom_cow = domain_create(DOMID_COW, DOMCRF_dummy, 0);
+    BUG_ON(dom_cow == NULL);
+    dom_cow->max_pages = ~0U;
+
     /* First 1MB of RAM is historically marked as I/O. */
     for ( i = 0; i < 0x100; i++ )
         share_xen_page_with_guest(mfn_to_page(i), dom_io, XENSHARE_writable);
@@ -747,6 +757,13 @@ get_page_from_l1e(
     if ( real_pg_owner == NULL )
         goto could_not_pin;
 
+    /* Read-only foreign mappings of a translated guest's shared pages
+     * (e.g. by the sharing daemon itself) do not need to unshare them. */
+    if ( (real_pg_owner == dom_cow) && !(l1f & _PAGE_RW) &&
+         (pg_owner != l1e_owner) && paging_mode_translate(pg_owner) &&
+         IS_PRIV_FOR(l1e_owner, pg_owner) )
+        pg_owner = real_pg_owner;
+
     if ( unlikely(real_pg_owner != pg_owner) )
     {
         /*
@@ -1687,8 +1704,13 @@ static int mod_l1_entry(l1_pgentry_t *pl1e, l1_pgentry_t nl1e,
 
     if ( l1e_get_flags(nl1e) & _PAGE_PRESENT )
     {
-        /* Translate foreign guest addresses. */
-        mfn = mfn_x(gfn_to_mfn(FOREIGNDOM, l1e_get_pfn(nl1e), &p2mt));
+        /* Translate foreign guest addresses.  Writable mappings of shared
+         * pages need the foreign domain's own copy. */
+        if ( l1e_get_flags(nl1e) & _PAGE_RW )
+            mfn = mfn_x(gfn_to_mfn_unshare(FOREIGNDOM, l1e_get_pfn(nl1e),
+                                           &p2mt));
+        else
+            mfn = mfn_x(gfn_to_mfn(FOREIGNDOM, l1e_get_pfn(nl1e), &p2mt));
         if ( !p2m_is_ram(p2mt) || unlikely(mfn == INVALID_MFN) )
             return 0;
         ASSERT((mfn & ~(PADDR_MASK >> PAGE_SHIFT)) == 0);
@@ -3581,8 +3603,12 @@ int steal_page(
     } while ( (y = cmpxchg(&page->count_info, x, x | 1)) != x );
 
     /* Unlink from original owner. */
-    if ( !(memflags & MEMF_no_refcount) && !--d->tot_pages )
-        drop_dom_ref = 1;
+    if ( !(memflags & MEMF_no_refcount) )
+    {
+        domain_adjust_node_pages(d, page, -1);
+        if ( !--d->tot_pages )
+            drop_dom_ref = 1;
+    }
     page_list_del(page, &d->page_list);
 
     spin_unlock(&d->page_alloc_lock);
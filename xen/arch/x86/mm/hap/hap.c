@@ -108,11 +108,45 @@ void hap_clean_vram_tracking(struct domain *d)
     flush_tlb_mask(d->domain_dirty_cpumask);
 }
 
+/* Re-arm the pages written since the last harvest of the shared bitmap.
+ * They were writable for a while after the guest's write was reported,
+ * so report them again. */
+static void hap_rearm_dirty_vram(struct domain *d)
+{
+    struct sh_dirty_vram *vram = d->dirty_vram;
+    unsigned long nr = vram->end_pfn - vram->begin_pfn;
+    unsigned long i, *rearm = vram->rearm_bitmap + BITS_TO_LONGS(nr);
+
+    /* Snapshot into the scratch half, racing with paging_mark_dirty() */
+    for ( i = 0; i < BITS_TO_LONGS(nr); i++ )
+        rearm[i] = vram->rearm_bitmap[i] ? xchg(&vram->rearm_bitmap[i], 0) : 0;
+
+    p2m_change_type_bitmap(d, vram->begin_pfn, rearm, nr,
+                           p2m_ram_rw, p2m_ram_logdirty);
+
+    for ( i = find_first_bit(rearm, nr);
+          i < nr;
+          i = find_next_bit(rearm, nr, i + 1) )
+        set_bit(i, vram->shared_bitmap);
+}
+
+static void hap_free_dirty_vram(struct domain *d)
+{
+    struct sh_dirty_vram *vram = paging_detach_dirty_vram(d);
+
+    if ( vram )
+    {
+        xfree(vram->rearm_bitmap);
+        xfree(vram);
+    }
+}
+
 void hap_vram_tracking_init(struct domain *d)
 {
     paging_log_dirty_init(d, hap_enable_vram_tracking,
                           hap_disable_vram_tracking,
-                          hap_clean_vram_tracking);
+                          hap_clean_vram_tracking,
+                          NULL);
 }
 
 int hap_track_dirty_vram(struct domain *d,
@@ -124,25 +158,25 @@ int hap_track_dirty_vram(struct domain *d,
 
     if ( nr )
     {
-        if ( paging_mode_log_dirty(d) && d->dirty_vram )
+        /* Another range, or the shared-bitmap mode: start afresh. */
+        if ( paging_mode_log_dirty(d) && d->dirty_vram &&
+             (begin_pfn != d->dirty_vram->begin_pfn ||
+              begin_pfn + nr != d->dirty_vram->end_pfn ||
+              d->dirty_vram->shared_bitmap) )
         {
-            if ( begin_pfn != d->dirty_vram->begin_pfn ||
-                 begin_pfn + nr != d->dirty_vram->end_pfn )
-            {
-                paging_log_dirty_disable(d);
-                d->dirty_vram->begin_pfn = begin_pfn;
-                d->dirty_vram->end_pfn = begin_pfn + nr;
-                rc = paging_log_dirty_enable(d);
-                if (rc != 0)
-                    goto param_fail;
-            }
+            paging_log_dirty_disable(d);
+            hap_free_dirty_vram(d);
         }
+
+        if ( paging_mode_log_dirty(d) && d->dirty_vram )
+            ; /* Already tracking this range. */
         else if ( !paging_mode_log_dirty(d) && !d->dirty_vram )
         {
             rc -ENOMEM;
             if ( (d->dirty_vram = xmalloc(struct sh_dirty_vram)) == NULL )
                 goto param_fail;
 
+            memset(d->dirty_vram, 0, sizeof(*d->dirty_vram));
             d->dirty_vram->begin_pfn = begin_pfn;
             d->dirty_vram->end_pfn = begin_pfn + nr;
             hap_vram_tracking_init(d);
@@ -165,8 +199,7 @@ int hap_track_dirty_vram(struct domain *d,
     {
         if ( paging_mode_log_dirty(d) && d->dirty_vram ) {
             rc = paging_log_dirty_disable(d);
-            xfree(d->dirty_vram);
-            d->dirty_vram = NULL;
+            hap_free_dirty_vram(d);
         } else
             rc = 0;
     }
@@ -174,11 +207,88 @@ int hap_track_dirty_vram(struct domain *d,
     return rc;
 
 param_fail:
-    if ( d->dirty_vram )
+    hap_free_dirty_vram(d);
+    return rc;
+}
+
+int hap_map_dirty_vram(struct domain *d,
+                       unsigned long begin_pfn,
+                       unsigned long nr,
+                       uint64_t *bitmap_mfn)
+{
+    struct sh_dirty_vram *vram = d->dirty_vram;
+    unsigned long *page = d->arch.paging.hap.dirty_vram_page;
+    int rc;
+
+    if ( (nr > PAGE_SIZE * 8) || (begin_pfn + nr < begin_pfn) )
+        return -EINVAL;
+
+    /* Same range as last time: the device model has harvested some bits
+     * and wants tracking of those pages back. */
+    if ( nr && paging_mode_log_dirty(d) && vram && vram->shared_bitmap &&
+         begin_pfn == vram->begin_pfn && begin_pfn + nr == vram->end_pfn )
     {
-        xfree(d->dirty_vram);
-        d->dirty_vram = NULL;
+        hap_rearm_dirty_vram(d);
+        *bitmap_mfn = virt_to_mfn(page);
+        return 0;
+    }
+
+    /* Stop any other VRAM tracking first. */
+    if ( vram )
+    {
+        if ( paging_mode_log_dirty(d) )
+            paging_log_dirty_disable(d);
+        hap_free_dirty_vram(d);
     }
+
+    if ( !nr )
+        return 0;
+
+    /* Log-dirty for some other reason, e.g. live migration */
+    if ( paging_mode_log_dirty(d) )
+        return -ENODATA;
+
+    if ( page == NULL )
+    {
+        if ( (page = alloc_xenheap_page()) == NULL )
+            return -ENOMEM;
+        clear_page(page);
+        /* Like the trace buffers: mapped by the device model via DOMID_XEN */
+        share_xen_page_with_privileged_guests(virt_to_page(page),
+                                              XENSHARE_writable);
+        d->arch.paging.hap.dirty_vram_page = page;
+    }
+
+    if ( (vram = xmalloc(struct sh_dirty_vram)) == NULL )
+        return -ENOMEM;
+    memset(vram, 0, sizeof(*vram));
+    vram->begin_pfn = begin_pfn;
+    vram->end_pfn = begin_pfn + nr;
+    /* The second half is scratch space for hap_rearm_dirty_vram() */
+    if ( (vram->rearm_bitmap = xmalloc_array(unsigned long,
+                                             2 * BITS_TO_LONGS(nr))) == NULL )
+    {
+        xfree(vram);
+        return -ENOMEM;
+    }
+    bitmap_zero(vram->rearm_bitmap, nr);
+
+    /* Nothing is known about the old contents: report everything. */
+    clear_page(page);
+    bitmap_fill(page, nr);
+    vram->shared_bitmap = page;
+    d->dirty_vram = vram;
+
+    hap_vram_tracking_init(d);
+    rc = paging_log_dirty_enable(d);
+    if ( rc != 0 )
+        goto out;
+
+    *bitmap_mfn = virt_to_mfn(page);
+    return 0;
+
+ out:
+    hap_free_dirty_vram(d);
     return rc;
 }
 
@@ -194,10 +304,10 @@ int hap_enable_log_dirty(struct domain *d)
     d->arch.paging.mode |= PG_log_dirty;
     hap_unlock(d);
 
-    /* set l1e entries of P2M table to be read-only. */
-    p2m_change_entry_type_global(d, p2m_ram_rw, p2m_ram_logdirty);
-    flush_tlb_mask(d->domain_dirty_cpumask);
-    return 0;
+    /* set l1e entries of P2M table to be read-only.  This may be
+     * preempted, in which case the domctl is retried to finish it. */
+    return p2m_change_entry_type_global_preemptible(d, p2m_ram_rw,
+                                                    p2m_ram_logdirty);
 }
 
 int hap_disable_log_dirty(struct domain *d)
@@ -207,8 +317,8 @@ int hap_disable_log_dirty(struct domain *d)
     hap_unlock(d);
 
     /* set l1e entries of P2M table with normal mode */
-    p2m_change_entry_type_global(d, p2m_ram_logdirty, p2m_ram_rw);
-    return 0;
+    return p2m_change_entry_type_global_preemptible(d, p2m_ram_logdirty,
+                                                    p2m_ram_rw);
 }
 
 void hap_clean_dirty_bitmap(struct domain *d)
@@ -218,19 +328,29 @@ void hap_clean_dirty_bitmap(struct domain *d)
     flush_tlb_mask(d->domain_dirty_cpumask);
 }
 
+/* Write-protect again only the pages that were reported dirty: the rest
+ * are still p2m_ram_logdirty since the last clean, so there is no need to
+ * walk the whole p2m. */
+void hap_clean_dirty_pfns(struct domain *d, unsigned long begin_pfn,
+                          const unsigned long *bitmap, unsigned int nr)
+{
+    p2m_change_type_bitmap(d, begin_pfn, bitmap, nr,
+                           p2m_ram_rw, p2m_ram_logdirty);
+}
+
 void hap_logdirty_init(struct domain *d)
 {
     if ( paging_mode_log_dirty(d) && d->dirty_vram )
     {
         paging_log_dirty_disable(d);
-        xfree(d->dirty_vram);
-        d->dirty_vram = NULL;
+        hap_free_dirty_vram(d);
     }
 
     /* Reinitialize logdirty mechanism */
     paging_log_dirty_init(d, hap_enable_log_dirty,
                           hap_disable_log_dirty,
-                          hap_clean_dirty_bitmap);
+                          hap_clean_dirty_bitmap,
+                          hap_clean_dirty_pfns);
 }
 
 /************************************************/
@@ -590,6 +710,22 @@ void hap_final_teardown(struct domain *d)
 
     p2m_teardown(d);
     ASSERT(d->arch.paging.hap.p2m_pages == 0);
+
+    hap_free_dirty_vram(d);
+    if ( d->arch.paging.hap.dirty_vram_page != NULL )
+    {
+        struct page_info *pg = virt_to_page(d->arch.paging.hap.dirty_vram_page);
+
+        /* A device model that still maps the page keeps it: leak it then,
+         * rather than hand the frame out again. */
+        if ( test_and_clear_bit(_PGC_allocated, &pg->count_info) &&
+             ((pg->count_info & PGC_count_mask) == 1) )
+        {
+            put_page(pg);
+            free_xenheap_page(d->arch.paging.hap.dirty_vram_page);
+        }
+        d->arch.paging.hap.dirty_vram_page = NULL;
+    }
 }
 
 void hap_teardown(struct domain *d)
@@ -785,8 +921,14 @@ hap_write_p2m_entry(struct vcpu *v, unsigned long gfn, l1_pgentry_t *p,
     old_flags = l1e_get_flags(*p);
     safe_write_pte(p, new);
     if ( (old_flags & _PAGE_PRESENT)
-         && (level == 1 || (level == 2 && (old_flags & _PAGE_PSE))) )
-             flush_tlb_mask(v->domain->domain_dirty_cpumask);
+         && (level == 1 || level == 3
+             || (level == 2 && (old_flags & _PAGE_PSE))) )
+    {
+        if ( v->domain->arch.p2m->defer_flush )
+            v->domain->arch.p2m->need_flush |= P2M_FLUSH_TLB;
+        else
+            flush_tlb_mask(v->domain->domain_dirty_cpumask);
+    }
 
 #if CONFIG_PAGING_LEVELS == 3
     /* install P2M in monitor table for PAE Xen */
@@ -28,6 +28,7 @@
 #include <xen/iommu.h>
 #include <asm/mtrr.h>
 #include <asm/hvm/cacheattr.h>
+#include <asm/event.h>
 
 static void ept_p2m_type_to_flags(ept_entry_t *entry, p2m_type_t type)
 {
@@ -44,6 +45,7 @@ static void ept_p2m_type_to_flags(ept_entry_t *entry, p2m_type_t type)
             return;
         case p2m_ram_logdirty:
         case p2m_ram_ro:
+        case p2m_ram_shared:
             entry->r = entry->x = 1;
             entry->w = 0;
             return;
@@ -116,6 +118,51 @@ static int ept_next_level(struct domain *d, bool_t read_only,
     }
 }
 
+/*
+ * Replace the superpage leaf @ept_entry at @level (1 = 2MB, 2 = 1GB) with a
+ * table of 512 entries one level down, each inheriting the superpage's type.
+ * The new entries are themselves superpages unless @level is 1.
+ */
+static int ept_split_super_page(struct domain *d, ept_entry_t *ept_entry,
+                                unsigned long gfn, int level)
+{
+    ept_entry_t new_ept_entry, *split_table, *split_ept_entry;
+    unsigned long split_mfn = ept_entry->mfn;
+    p2m_type_t split_p2mt = ept_entry->avail1;
+    unsigned int split_order = (level - 1) * EPT_TABLE_ORDER;
+    uint8_t igmt = 0;
+    int i;
+
+    gfn &= ~((1UL << (level * EPT_TABLE_ORDER)) - 1);
+
+    if ( !ept_set_middle_entry(d, &new_ept_entry) )
+        return 0;
+
+    split_table = map_domain_page(new_ept_entry.mfn);
+
+    for ( i = 0; i < EPT_PAGETABLE_ENTRIES; i++ )
+    {
+        split_ept_entry = split_table + i;
+        split_ept_entry->emt = epte_get_entry_emt(d,
+                                    gfn + (i << split_order),
+                                    split_mfn + (i << split_order),
+                                    &igmt, (split_p2mt == p2m_mmio_direct));
+        split_ept_entry->igmt = igmt;
+        split_ept_entry->sp_avail = (level > 1);
+        split_ept_entry->mfn = split_mfn + (i << split_order);
+        split_ept_entry->avail1 = split_p2mt;
+        split_ept_entry->rsvd = 0;
+        split_ept_entry->avail2 = 0;
+        /* last step */
+        ept_p2m_type_to_flags(split_ept_entry, split_p2mt);
+    }
+
+    unmap_domain_page(split_table);
+    *ept_entry = new_ept_entry;
+
+    return 1;
+}
+
 /*
  * ept_set_entry() computes 'need_modify_vtd_table' for itself,
  * by observing whether any gfn->mfn translations are modified.
@@ -125,7 +172,7 @@ ept_set_entry(struct domain *d, unsigned long gfn, mfn_t mfn,
               unsigned int order, p2m_type_t p2mt)
 {
     ept_entry_t *table = NULL;
-    unsigned long gfn_remainder = gfn, offset = 0;
+    unsigned long gfn_remainder = gfn;
     ept_entry_t *ept_entry = NULL;
     u32 index;
     int i, rv = 0, ret = 0;
@@ -134,9 +181,9 @@ ept_set_entry(struct domain *d, unsigned long gfn, mfn_t mfn,
     uint8_t igmt = 0;
     int need_modify_vtd_table = 1;
 
-    /* we only support 4k and 2m pages now */
-
-    BUG_ON(order && order != EPT_TABLE_ORDER);
+    /* we support 4k, 2m and 1g pages */
+    BUG_ON((order % EPT_TABLE_ORDER) || (walk_level > 2));
+    BUG_ON((walk_level == 2) && !hvm_hap_has_1gb(d));
 
     if (  order != 0 )
         if ( (gfn & ((1UL << order) - 1)) )
@@ -150,115 +197,54 @@ ept_set_entry(struct domain *d, unsigned long gfn, mfn_t mfn,
     {
         ret = ept_next_level(d, 0, &table, &gfn_remainder,
           i * EPT_TABLE_ORDER, order);
-        if ( !ret )
-            goto out;
-        else if ( ret != GUEST_TABLE_NORMAL_PAGE )
-            break;
-    }
 
-    index = gfn_remainder >> ( i ?  (i * EPT_TABLE_ORDER): order);
-    walk_level = ( i ? ( i * EPT_TABLE_ORDER) : order) / EPT_TABLE_ORDER;
-    offset = (gfn_remainder & ( ((1 << (i*EPT_TABLE_ORDER)) - 1)));
-
-    ept_entry = table + index;
-
-    if ( ret != GUEST_TABLE_SPLIT_PAGE )
-    {
-        if ( mfn_valid(mfn_x(mfn)) || (p2mt == p2m_mmio_direct) )
+        /*
+         * A superpage above the target level is split into the next level
+         * down, keeping the rest of its range mapped as it was.
+         */
+        if ( ret == GUEST_TABLE_SPLIT_PAGE )
         {
-            ept_entry->emt = epte_get_entry_emt(d, gfn, mfn_x(mfn),
-                                &igmt, direct_mmio);
-            ept_entry->igmt = igmt;
-            ept_entry->sp_avail = walk_level ? 1 : 0;
-
-            if ( ret == GUEST_TABLE_SUPER_PAGE )
-            {
-                if ( ept_entry->mfn == (mfn_x(mfn) - offset) )
-                    need_modify_vtd_table = 0;  
-                else                  
-                    ept_entry->mfn = mfn_x(mfn) - offset;
-
-                if ( ept_entry->avail1 == p2m_ram_logdirty &&
-                  p2mt == p2m_ram_rw )
-                    for ( i = 0; i < 512; i++ )
-                        paging_mark_dirty(d, mfn_x(mfn)-offset+i);
-            }
-            else
-            {
-                if ( ept_entry->mfn == mfn_x(mfn) )
-                    need_modify_vtd_table = 0;
-                else
-                    ept_entry->mfn = mfn_x(mfn);
-            }
-
-            ept_entry->avail1 = p2mt;
-            ept_entry->rsvd = 0;
-            ept_entry->avail2 = 0;
-            /* last step */
-            ept_p2m_type_to_flags(ept_entry, p2mt);
+            index = gfn_remainder >> (i * EPT_TABLE_ORDER);
+            if ( !ept_split_super_page(d, table + index, gfn, i) )
+                goto out;
+            ret = ept_next_level(d, 0, &table, &gfn_remainder,
+                                 i * EPT_TABLE_ORDER, order);
         }
-        else
-            ept_entry->epte = 0;
-    }
-    else
-    {
-        /* It's super page before, now set one of the 4k pages, so
-         * we should split the 2m page to 4k pages now.
-         */
 
-        ept_entry_t *split_table = NULL;
-        ept_entry_t *split_ept_entry = NULL;
-        unsigned long split_mfn = ept_entry->mfn;
-        p2m_type_t split_p2mt = ept_entry->avail1;
-        ept_entry_t new_ept_entry;
-
-        /* alloc new page for new ept middle level entry which is
-         * before a leaf super entry
-         */
-
-        if ( !ept_set_middle_entry(d, &new_ept_entry) )
+        if ( ret != GUEST_TABLE_NORMAL_PAGE )
             goto out;
+    }
 
-        /* split the super page before to 4k pages */
-
-        split_table = map_domain_page(new_ept_entry.mfn);
-        offset = gfn & ((1 << EPT_TABLE_ORDER) - 1);
-
-        for ( i = 0; i < 512; i++ )
-        {
-            split_ept_entry = split_table + i;
-            split_ept_entry->emt = epte_get_entry_emt(d,
-                                        gfn-offset+i, split_mfn+i, 
-                                        &igmt, direct_mmio);
-            split_ept_entry->igmt = igmt;
-
-            split_ept_entry->sp_avail =  0;
-
-            split_ept_entry->mfn = split_mfn+i;
-
-            split_ept_entry->avail1 = split_p2mt;
-            split_ept_entry->rsvd = 0;
-            split_ept_entry->avail2 = 0;
-            /* last step */
-            ept_p2m_type_to_flags(split_ept_entry, split_p2mt);
-        }
-
-        /* Set the destinated 4k page as normal */
-        split_ept_entry = split_table + offset;
-        split_ept_entry->emt = epte_get_entry_emt(d, gfn, mfn_x(mfn), 
-                                                &igmt, direct_mmio);
-        split_ept_entry->igmt = igmt;
+    index = gfn_remainder >> order;
+    ept_entry = table + index;
 
-        if ( split_ept_entry->mfn == mfn_x(mfn) )
+    if ( mfn_valid(mfn_x(mfn)) || (p2mt == p2m_mmio_direct) )
+    {
+        ept_entry->emt = epte_get_entry_emt(d, gfn, mfn_x(mfn),
+                            &igmt, direct_mmio);
+        ept_entry->igmt = igmt;
+
+        if ( walk_level && ept_entry->sp_avail &&
+             (ept_entry->avail1 == p2m_ram_logdirty) &&
+             (p2mt == p2m_ram_rw) )
+            for ( i = 0; i < (1 << order); i++ )
+                paging_mark_dirty(d, mfn_x(mfn) + i);
+
+        if ( (ept_entry->epte & 0x7) &&
+             (ept_entry->sp_avail == (walk_level != 0)) &&
+             (ept_entry->mfn == mfn_x(mfn)) )
             need_modify_vtd_table = 0;
-        else
-            split_ept_entry->mfn = mfn_x(mfn);
-        split_ept_entry->avail1 = p2mt;
-        ept_p2m_type_to_flags(split_ept_entry, p2mt);
 
-        unmap_domain_page(split_table);
-        *ept_entry = new_ept_entry;
+        ept_entry->sp_avail = walk_level ? 1 : 0;
+        ept_entry->mfn = mfn_x(mfn);
+        ept_entry->avail1 = p2mt;
+        ept_entry->rsvd = 0;
+        ept_entry->avail2 = 0;
+        /* last step */
+        ept_p2m_type_to_flags(ept_entry, p2mt);
     }
+    else
+        ept_entry->epte = 0;
 
     /* Track the highest gfn for which we have ever had a valid mapping */
     if ( mfn_valid(mfn_x(mfn))
@@ -271,32 +257,25 @@ ept_set_entry(struct domain *d, unsigned long gfn, mfn_t mfn,
 out:
     unmap_domain_page(table);
 
-    ept_sync_domain(d);
+    if ( d->arch.p2m->defer_flush )
+        d->arch.p2m->need_flush |= P2M_FLUSH_EPT;
+    else
+        ept_sync_domain(d);
 
     /* Now the p2m table is not shared with vt-d page table */
 
-    if ( iommu_enabled && is_hvm_domain(d)  
+    if ( rv && iommu_enabled && is_hvm_domain(d)  
              && need_modify_vtd_table )
     {
         if ( p2mt == p2m_ram_rw )
         {
-            if ( order == EPT_TABLE_ORDER )
-            {
-                for ( i = 0; i < ( 1 << order ); i++ )
-                    iommu_map_page(d, gfn-offset+i, mfn_x(mfn)-offset+i);
-            }
-            else if ( !order )
-                iommu_map_page(d, gfn, mfn_x(mfn));
+            for ( i = 0; i < (1 << order); i++ )
+                iommu_map_page(d, gfn + i, mfn_x(mfn) + i);
         }
         else
         {
-            if ( order == EPT_TABLE_ORDER )
-            {
-                for ( i = 0; i < ( 1 << order ); i++ )
-                    iommu_unmap_page(d, gfn-offset+i);
-            }
-            else if ( !order )
-                iommu_unmap_page(d, gfn);
+            for ( i = 0; i < (1 << order); i++ )
+                iommu_unmap_page(d, gfn + i);
         }
     }
 
@@ -356,7 +335,8 @@ static mfn_t ept_get_entry(struct domain *d, unsigned long gfn, p2m_type_t *t,
     return mfn;
 }
 
-static uint64_t ept_get_entry_content(struct domain *d, unsigned long gfn)
+static uint64_t ept_get_entry_content(struct domain *d, unsigned long gfn,
+                                      int *level)
 {
     ept_entry_t *table =
         map_domain_page(mfn_x(pagetable_get_mfn(d->arch.phys_table)));
@@ -384,6 +364,7 @@ static uint64_t ept_get_entry_content(struct domain *d, unsigned long gfn)
     index = gfn_remainder >> ( i * EPT_TABLE_ORDER);
     ept_entry = table + index;
     content = ept_entry->epte;
+    *level = i;
 
  out:
     unmap_domain_page(table);
@@ -417,45 +398,46 @@ void ept_change_entry_emt_with_range(struct domain *d, unsigned long start_gfn,
     unsigned long gfn;
     p2m_type_t p2mt;
     uint64_t epte;
-    int order = 0;
-    unsigned long mfn;
+    int order, level;
+    unsigned long mfn, nr;
     uint8_t o_igmt, o_emt;
 
     p2m_lock(d->arch.p2m);
     for ( gfn = start_gfn; gfn <= end_gfn; gfn++ )
     {
-        epte = ept_get_entry_content(d, gfn);
+        epte = ept_get_entry_content(d, gfn, &level);
         if ( epte == 0 )
             continue;
-        mfn = (epte & EPTE_MFN_MASK) >> PAGE_SHIFT;
+        order = level * EPT_TABLE_ORDER;
+        nr = 1UL << order;
+        /* A superpage entry maps gfn at an offset from its base frame. */
+        mfn = ((epte & EPTE_MFN_MASK) >> PAGE_SHIFT) + (gfn & (nr - 1));
         if ( !mfn_valid(mfn) )
             continue;
         p2mt = (epte & EPTE_AVAIL1_MASK) >> EPTE_AVAIL1_SHIFT;
         o_igmt = (epte & EPTE_IGMT_MASK) >> EPTE_IGMT_SHIFT;
         o_emt = (epte & EPTE_EMT_MASK) >> EPTE_EMT_SHIFT;
-        order = 0;
 
         if ( epte & EPTE_SUPER_PAGE_MASK )
         {
-            if ( !(gfn & ( (1 << EPT_TABLE_ORDER) - 1)) &&
-              ((gfn + 0x1FF) <= end_gfn) )
+            if ( !(gfn & (nr - 1)) && ((gfn + nr - 1) <= end_gfn) )
             {
-                /* gfn assigned with 2M, and the end covers more than 2m areas.
-                 * Set emt for super page.
+                /* gfn starts a 2M/1G entry wholly inside the range.
+                 * Set emt for the super page.
                  */
-                order = EPT_TABLE_ORDER;
                 if ( need_modify_ept_entry(d, gfn, mfn, 
                                             o_igmt, o_emt, p2mt) )
                     ept_set_entry(d, gfn, _mfn(mfn), order, p2mt);
-                gfn += 0x1FF;
+                gfn += nr - 1;
             }
             else
             {
-                /* change emt for partial entries of the 2m area. */
+                /* Change emt for a partial entry of the super page. This
+                 * splits it, so the following gfns are looked up afresh.
+                 */
                 if ( need_modify_ept_entry(d, gfn, mfn, 
                                             o_igmt, o_emt, p2mt) )
-                    ept_set_entry(d, gfn, _mfn(mfn), order, p2mt);
-                gfn = ((gfn >> EPT_TABLE_ORDER) << EPT_TABLE_ORDER) + 0x1FF;
+                    ept_set_entry(d, gfn, _mfn(mfn), 0, p2mt);
             }
         }
         else /* gfn assigned with 4k */
@@ -470,28 +452,37 @@ void ept_change_entry_emt_with_range(struct domain *d, unsigned long start_gfn,
 
 /* Walk the whole p2m table, changing any entries of the old type
  * to the new type.  This is used in hardware-assisted paging to
- * quickly enable or diable log-dirty tracking */
+ * quickly enable or diable log-dirty tracking.  See
+ * p2m_change_type_global() for the meaning of resume. */
 
-static void ept_change_entry_type_global(struct domain *d,
-                                            p2m_type_t ot, p2m_type_t nt)
+static int ept_change_entry_type_global(struct domain *d,
+                                        p2m_type_t ot, p2m_type_t nt,
+                                        unsigned long *resume)
 {
     ept_entry_t *l4e, *l3e, *l2e, *l1e;
     int i4, i3, i2, i1;
+    unsigned long start = resume ? *resume : 0;
+    int rc = 0;
 
     if ( pagetable_get_pfn(d->arch.phys_table) == 0 )
-        return;
+        return 0;
 
     BUG_ON(EPT_DEFAULT_GAW != 3);
 
     l4e = map_domain_page(mfn_x(pagetable_get_mfn(d->arch.phys_table)));
-    for (i4 = 0; i4 < EPT_PAGETABLE_ENTRIES; i4++ )
+    for ( i4 = start >> (3 * EPT_TABLE_ORDER);
+          i4 < EPT_PAGETABLE_ENTRIES && !rc;
+          i4++ )
     {
         if ( !l4e[i4].epte )
             continue;
         if ( !l4e[i4].sp_avail )
         {
             l3e = map_domain_page(l4e[i4].mfn);
-            for ( i3 = 0; i3 < EPT_PAGETABLE_ENTRIES; i3++ )
+            i3 = (i4 == (start >> (3 * EPT_TABLE_ORDER)))
+                 ? (start >> (2 * EPT_TABLE_ORDER)) & (EPT_PAGETABLE_ENTRIES - 1)
+                 : 0;
+            for ( ; i3 < EPT_PAGETABLE_ENTRIES; i3++ )
             {
                 if ( !l3e[i3].epte )
                     continue;
@@ -525,6 +516,15 @@ static void ept_change_entry_type_global(struct domain *d,
                         }
                     }
                     unmap_domain_page(l2e);
+
+                    if ( resume && hypercall_preempt_check() )
+                    {
+                        *resume = ((unsigned long)i4 << (3 * EPT_TABLE_ORDER)) |
+                                  ((unsigned long)(i3 + 1) <<
+                                   (2 * EPT_TABLE_ORDER));
+                        rc = -EAGAIN;
+                        break;
+                    }
                 }
                 else
                 {
@@ -547,6 +547,8 @@ static void ept_change_entry_type_global(struct domain *d,
     unmap_domain_page(l4e);
 
     ept_sync_domain(d);
+
+    return rc;
 }
 
 void ept_p2m_init(struct domain *d)
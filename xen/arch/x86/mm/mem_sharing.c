@@ -0,0 +1,526 @@
+/******************************************************************************
+ * arch/x86/mm/mem_sharing.c
+ *
+ * Transparent sharing of identical guest pages between HVM domains.
+ *
+ * A privileged daemon finds candidate pages by content and nominates them.
+ * Nomination makes the gfn read-only (p2m_ram_shared) and moves its frame
+ * to dom_cow, so that it is no longer accounted to the guest.  Two
+ * nominated gfns with identical contents can then be merged onto a single
+ * frame; the other frame is freed.  A write to a shared gfn breaks the
+ * sharing by giving the gfn a private copy again.
+ *
+ * All sharing state is covered by a single lock, which is taken before the
+ * p2m lock of any domain involved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <xen/config.h>
+#include <xen/types.h>
+#include <xen/lib.h>
+#include <xen/init.h>
+#include <xen/mm.h>
+#include <xen/sched.h>
+#include <xen/errno.h>
+#include <xen/perfc.h>
+#include <xen/domain_page.h>
+#include <xen/iommu.h>
+#include <asm/page.h>
+#include <asm/paging.h>
+#include <asm/p2m.h>
+#include <asm/mem_sharing.h>
+
+/* One gfn mapping a shared frame. */
+struct gfn_info {
+    struct list_head list;
+    domid_t          domain;
+    unsigned long    gfn;
+};
+
+/* A frame owned by dom_cow, and every gfn that maps it. */
+struct shr_frame {
+    struct list_head hash_list;
+    unsigned long    mfn;
+    uint64_t         hash;        /* Hash of the (read-only) contents */
+    unsigned int     nr_gfns;
+    struct list_head gfns;
+};
+
+#define SHR_HASH_BUCKETS 1021
+static struct list_head shr_hash[SHR_HASH_BUCKETS];
+static DEFINE_SPINLOCK(shr_lock);
+
+static unsigned long nr_shared_frames; /* Frames owned by dom_cow */
+static unsigned long nr_shared_gfns;   /* Gfns that map those frames */
+
+/* 64-bit FNV-1a over the page, a word at a time. */
+static uint64_t shr_hash_page(unsigned long mfn)
+{
+    const uint64_t *p = map_domain_page(mfn);
+    uint64_t h = 0xcbf29ce484222325ULL;
+    unsigned int i;
+
+    for ( i = 0; i < PAGE_SIZE / sizeof(*p); i++ )
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+
+    unmap_domain_page(p);
+    return h;
+}
+
+static int shr_pages_equal(unsigned long mfn1, unsigned long mfn2)
+{
+    void *p1 = map_domain_page(mfn1);
+    void *p2 = map_domain_page(mfn2);
+    int equal = !memcmp(p1, p2, PAGE_SIZE);
+
+    unmap_domain_page(p2);
+    unmap_domain_page(p1);
+    return equal;
+}
+
+static struct shr_frame *shr_lookup(unsigned long mfn)
+{
+    struct shr_frame *f;
+
+    list_for_each_entry ( f, &shr_hash[mfn % SHR_HASH_BUCKETS], hash_list )
+        if ( f->mfn == mfn )
+            return f;
+
+    return NULL;
+}
+
+static struct gfn_info *shr_lookup_gfn(struct shr_frame *f,
+                                       struct domain *d, unsigned long gfn)
+{
+    struct gfn_info *g;
+
+    list_for_each_entry ( g, &f->gfns, list )
+        if ( (g->domain == d->domain_id) && (g->gfn == gfn) )
+            return g;
+
+    return NULL;
+}
+
+/* Can this page be taken away from its owner and made read-only?  It must
+ * be plain RAM that nobody else holds a reference to. */
+static int shr_page_is_sharable(struct page_info *page)
+{
+    if ( is_xen_heap_page(page) )
+        return 0;
+    if ( (page->count_info & (PGC_count_mask|PGC_allocated)) !=
+         (1 | PGC_allocated) )
+        return 0;
+    if ( page->count_info & PGC_page_table )
+        return 0;
+    return ((page->u.inuse.type_info & PGT_count_mask) == 0);
+}
+
+/* Give an unmapped shared frame back to the heap.  Its contents belonged
+ * to guests, so scrub it: dom_cow is never dying, so the allocator won't. */
+static void shr_free_frame(unsigned long mfn)
+{
+    struct page_info *page = mfn_to_page(mfn);
+    void *p = map_domain_page(mfn);
+
+    clear_page(p);
+    unmap_domain_page(p);
+    if ( test_and_clear_bit(_PGC_allocated, &page->count_info) )
+        put_page(page);
+}
+
+/* Remove a gfn from its frame, and free the frame if it was the last one.
+ * The caller has already pointed the gfn's p2m entry elsewhere. */
+static void shr_drop_gfn(struct domain *d, struct shr_frame *f,
+                         struct gfn_info *g)
+{
+    list_del(&g->list);
+    xfree(g);
+    f->nr_gfns--;
+    nr_shared_gfns--;
+    d->arch.p2m->shared_gfns--;
+
+    if ( f->nr_gfns != 0 )
+        return;
+
+    list_del(&f->hash_list);
+    nr_shared_frames--;
+    shr_free_frame(f->mfn);
+    xfree(f);
+}
+
+static int shr_set_entry(struct domain *d, unsigned long gfn, mfn_t mfn,
+                         p2m_type_t p2mt)
+{
+    int rc;
+
+    p2m_lock(d->arch.p2m);
+    rc = set_p2m_entry(d, gfn, mfn, 0, p2mt);
+    p2m_unlock(d->arch.p2m);
+
+    return rc;
+}
+
+int mem_sharing_nominate_page(struct domain *d, unsigned long gfn,
+                              uint64_t *phash)
+{
+    struct shr_frame *f;
+    struct gfn_info *g;
+    struct page_info *page;
+    p2m_type_t p2mt;
+    mfn_t mfn;
+    int rc;
+
+    /* Shared frames are not mapped in the IOMMU, so a passed-through
+     * device could not DMA to them.  Shadow pagetables would refuse to
+     * map a dom_cow frame for the guest, so HAP is required too. */
+    if ( !is_hvm_domain(d) || !paging_mode_hap(d) || need_iommu(d) ||
+         d->is_dying )
+        return -EINVAL;
+
+    f = xmalloc(struct shr_frame);
+    g = xmalloc(struct gfn_info);
+    if ( (f == NULL) || (g == NULL) )
+    {
+        rc = -ENOMEM;
+        goto out_free;
+    }
+
+    spin_lock(&shr_lock);
+
+    /* Checked again under the lock: mem_sharing_teardown() must not miss
+     * a gfn nominated once it has run. */
+    rc = -EINVAL;
+    if ( d->is_dying )
+        goto out_unlock;
+
+    mfn = gfn_to_mfn_query(d, gfn, &p2mt);
+    if ( p2m_is_shared(p2mt) )
+    {
+        struct shr_frame *of = shr_lookup(mfn_x(mfn));
+
+        /* Already nominated or shared: just report the hash. */
+        BUG_ON(of == NULL);
+        *phash = of->hash;
+        rc = 0;
+        goto out_unlock;
+    }
+
+    rc = -EINVAL;
+    if ( (p2mt != p2m_ram_rw) || !mfn_valid(mfn_x(mfn)) )
+        goto out_unlock;
+
+    rc = -EBUSY;
+    page = mfn_to_page(mfn_x(mfn));
+    if ( !shr_page_is_sharable(page) || (page_get_owner(page) != d) )
+        goto out_unlock;
+
+    /* Write-protect the gfn first, so the contents we hash are final.
+     * Splitting a superpage mapping to do so can fail. */
+    rc = -ENOMEM;
+    if ( !shr_set_entry(d, gfn, mfn, p2m_ram_shared) )
+        goto out_unlock;
+
+    rc = -EBUSY;
+    if ( steal_page(d, page, 0) != 0 )
+    {
+        shr_set_entry(d, gfn, mfn, p2m_ram_rw);
+        goto out_unlock;
+    }
+    if ( assign_pages(dom_cow, page, 0, 0) != 0 )
+        BUG();
+    set_gpfn_from_mfn(mfn_x(mfn), INVALID_M2P_ENTRY);
+
+    f->mfn = mfn_x(mfn);
+    f->hash = shr_hash_page(mfn_x(mfn));
+    f->nr_gfns = 1;
+    INIT_LIST_HEAD(&f->gfns);
+    g->domain = d->domain_id;
+    g->gfn = gfn;
+    list_add(&g->list, &f->gfns);
+    list_add(&f->hash_list, &shr_hash[f->mfn % SHR_HASH_BUCKETS]);
+
+    nr_shared_frames++;
+    nr_shared_gfns++;
+    d->arch.p2m->shared_gfns++;
+    perfc_incr(mem_sharing_nominate);
+
+    *phash = f->hash;
+    spin_unlock(&shr_lock);
+    return 0;
+
+ out_unlock:
+    spin_unlock(&shr_lock);
+ out_free:
+    xfree(g);
+    xfree(f);
+    return rc;
+}
+
+int mem_sharing_share_pages(struct domain *sd, unsigned long sgfn,
+                            struct domain *cd, unsigned long cgfn)
+{
+    struct shr_frame *sf, *cf;
+    struct gfn_info *g, *tmp;
+    struct domain *d;
+    p2m_type_t smt, cmt;
+    mfn_t smfn, cmfn;
+    int rc = -EINVAL;
+
+    if ( !is_hvm_domain(sd) || !is_hvm_domain(cd) )
+        return -EINVAL;
+
+    spin_lock(&shr_lock);
+
+    smfn = gfn_to_mfn_query(sd, sgfn, &smt);
+    cmfn = gfn_to_mfn_query(cd, cgfn, &cmt);
+    if ( !p2m_is_shared(smt) || !p2m_is_shared(cmt) )
+        goto out;
+
+    rc = 0;
+    if ( mfn_x(smfn) == mfn_x(cmfn) )
+        goto out;
+
+    sf = shr_lookup(mfn_x(smfn));
+    cf = shr_lookup(mfn_x(cmfn));
+    BUG_ON((sf == NULL) || (cf == NULL));
+
+    rc = -EINVAL;
+    if ( (sf->hash != cf->hash) || !shr_pages_equal(sf->mfn, cf->mfn) )
+        goto out;
+
+    /* Move every gfn of the client frame over to the source frame. */
+    list_for_each_entry_safe ( g, tmp, &cf->gfns, list )
+    {
+        /* A domain that is gone has no p2m left to update. */
+        if ( (d = get_domain_by_id(g->domain)) == NULL )
+        {
+            list_del(&g->list);
+            xfree(g);
+            cf->nr_gfns--;
+            nr_shared_gfns--;
+            continue;
+        }
+        if ( !shr_set_entry(d, g->gfn, smfn, p2m_ram_shared) )
+            domain_crash(d);
+        list_move(&g->list, &sf->gfns);
+        cf->nr_gfns--;
+        sf->nr_gfns++;
+        put_domain(d);
+    }
+
+    /* The client frame is now unreferenced by any p2m: free it. */
+    list_del(&cf->hash_list);
+    nr_shared_frames--;
+    shr_free_frame(cf->mfn);
+    xfree(cf);
+
+    perfc_incr(mem_sharing_share);
+    rc = 0;
+
+ out:
+    spin_unlock(&shr_lock);
+    return rc;
+}
+
+int mem_sharing_unshare_page(struct domain *d, unsigned long gfn,
+                             unsigned int flags)
+{
+    struct shr_frame *f;
+    struct gfn_info *g;
+    struct page_info *page;
+    p2m_type_t p2mt;
+    mfn_t mfn;
+    void *s, *t;
+    int rc = 0;
+
+    spin_lock(&shr_lock);
+
+    /* Someone else may have got here first. */
+    mfn = gfn_to_mfn_query(d, gfn, &p2mt);
+    if ( !p2m_is_shared(p2mt) )
+        goto out;
+
+    f = shr_lookup(mfn_x(mfn));
+    BUG_ON(f == NULL);
+    g = shr_lookup_gfn(f, d, gfn);
+    BUG_ON(g == NULL);
+
+    if ( flags & MEM_SHARING_DESTROY_GFN )
+    {
+        shr_set_entry(d, gfn, _mfn(INVALID_MFN), p2m_invalid);
+        shr_drop_gfn(d, f, g);
+        goto out;
+    }
+
+    /* The last gfn of a frame can simply take the frame back, provided
+     * nobody (e.g. the scanning daemon) still has it mapped. */
+    page = mfn_to_page(mfn_x(mfn));
+    if ( (f->nr_gfns == 1) && shr_page_is_sharable(page) &&
+         (steal_page(dom_cow, page, 0) == 0) )
+    {
+        if ( assign_pages(d, page, 0, 0) == 0 )
+        {
+            shr_set_entry(d, gfn, mfn, p2m_ram_rw);
+            set_gpfn_from_mfn(mfn_x(mfn), gfn);
+            paging_mark_dirty(d, mfn_x(mfn));
+            list_del(&g->list);
+            xfree(g);
+            list_del(&f->hash_list);
+            xfree(f);
+            nr_shared_frames--;
+            nr_shared_gfns--;
+            d->arch.p2m->shared_gfns--;
+            perfc_incr(mem_sharing_unshare_reclaim);
+            goto out;
+        }
+        if ( assign_pages(dom_cow, page, 0, 0) != 0 )
+            BUG();
+    }
+
+    /* Otherwise give the gfn a private copy of the frame. */
+    page = alloc_domheap_page(d, 0);
+    if ( page == NULL )
+    {
+        gdprintk(XENLOG_WARNING, "Out of memory unsharing gfn %lx of d%d\n",
+                 gfn, d->domain_id);
+        rc = -ENOMEM;
+        goto out;
+    }
+
+    s = map_domain_page(mfn_x(mfn));
+    t = map_domain_page(page_to_mfn(page));
+    memcpy(t, s, PAGE_SIZE);
+    unmap_domain_page(t);
+    unmap_domain_page(s);
+
+    if ( !shr_set_entry(d, gfn, _mfn(page_to_mfn(page)), p2m_ram_rw) )
+    {
+        free_domheap_page(page);
+        rc = -ENOMEM;
+        goto out;
+    }
+    set_gpfn_from_mfn(page_to_mfn(page), gfn);
+    paging_mark_dirty(d, page_to_mfn(page));
+    shr_drop_gfn(d, f, g);
+    perfc_incr(mem_sharing_unshare_copy);
+
+ out:
+    spin_unlock(&shr_lock);
+    return rc;
+}
+
+/* Forget every gfn of a dying domain, freeing frames nobody else maps.
+ * Called from domain_relinquish_resources(), while the domain can still be
+ * found by id, so that sharing never sees a gfn of a vanished domain. */
+void mem_sharing_teardown(struct domain *d)
+{
+    struct shr_frame *f, *ftmp;
+    struct gfn_info *g, *gtmp;
+    unsigned int i;
+    int last;
+
+    if ( (d->arch.p2m == NULL) || (d->arch.p2m->shared_gfns == 0) )
+        return;
+
+    spin_lock(&shr_lock);
+
+    for ( i = 0; i < SHR_HASH_BUCKETS; i++ )
+        list_for_each_entry_safe ( f, ftmp, &shr_hash[i], hash_list )
+            list_for_each_entry_safe ( g, gtmp, &f->gfns, list )
+            {
+                if ( g->domain != d->domain_id )
+                    continue;
+                /* Nothing may reach the frame through this p2m again. */
+                shr_set_entry(d, g->gfn, _mfn(INVALID_MFN), p2m_invalid);
+                /* Dropping the last gfn frees the frame. */
+                last = (f->nr_gfns == 1);
+                shr_drop_gfn(d, f, g);
+                if ( last )
+                    break;
+            }
+
+    ASSERT(d->arch.p2m->shared_gfns == 0);
+
+    spin_unlock(&shr_lock);
+}
+
+int mem_sharing_domctl(struct domain *d, xen_domctl_mem_sharing_op_t *mec)
+{
+    struct domain *cd;
+    int rc;
+
+    switch ( mec->op )
+    {
+    case XEN_DOMCTL_MEM_SHARING_OP_NOMINATE_GFN:
+    {
+        uint64_t hash;
+
+        rc = mem_sharing_nominate_page(d, mec->u.nominate.gfn, &hash);
+        mec->u.nominate.hash = hash;
+        break;
+    }
+
+    case XEN_DOMCTL_MEM_SHARING_OP_SHARE:
+        rc = -ESRCH;
+        cd = get_domain_by_id(mec->u.share.client_domain);
+        if ( cd == NULL )
+            break;
+        rc = mem_sharing_share_pages(d, mec->u.share.source_gfn,
+                                     cd, mec->u.share.client_gfn);
+        put_domain(cd);
+        break;
+
+    case XEN_DOMCTL_MEM_SHARING_OP_UNSHARE:
+        rc = mem_sharing_unshare_page(d, mec->u.unshare.gfn, 0);
+        break;
+
+    case XEN_DOMCTL_MEM_SHARING_OP_STATS:
+        spin_lock(&shr_lock);
+        mec->u.stats.shared_frames = nr_shared_frames;
+        mec->u.stats.shared_gfns = nr_shared_gfns;
+        mec->u.stats.domain_gfns =
+            (d->arch.p2m != NULL) ? d->arch.p2m->shared_gfns : 0;
+        spin_unlock(&shr_lock);
+        rc = 0;
+        break;
+
+    default:
+        rc = -ENOSYS;
+        break;
+    }
+
+    return rc;
+}
+
+static int __init mem_sharing_init(void)
+{
+    unsigned int i;
+
+    for ( i = 0; i < SHR_HASH_BUCKETS; i++ )
+        INIT_LIST_HEAD(&shr_hash[i]);
+
+    return 0;
+}
+__initcall(mem_sharing_init);
+
+/*
+ * Local variables:
+ * mode: C
+ * c-set-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
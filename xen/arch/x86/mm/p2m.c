@@ -27,6 +27,8 @@
 #include <asm/page.h>
 #include <asm/paging.h>
 #include <asm/p2m.h>
+#include <asm/mem_sharing.h>
+#include <asm/event.h> /* hypercall_preempt_check() */
 #include <asm/hvm/vmx/vmx.h> /* ept_p2m_init() */
 #include <xen/iommu.h>
 
@@ -76,6 +78,7 @@ static unsigned long p2m_type_to_flags(p2m_type_t t)
     case p2m_ram_logdirty:
         return flags | P2M_BASE_FLAGS;
     case p2m_ram_ro:
+    case p2m_ram_shared:
         return flags | P2M_BASE_FLAGS;
     case p2m_mmio_dm:
         return flags;
@@ -170,6 +173,36 @@ p2m_next_level(struct domain *d, mfn_t *table_mfn, void **table,
 
     ASSERT(l1e_get_flags(*p2m_entry) & (_PAGE_PRESENT|_PAGE_PSE));
 
+    /* split 1GB page into 2MB pages in P2M table */
+    if ( type == PGT_l2_page_table && (l1e_get_flags(*p2m_entry) & _PAGE_PSE) )
+    {
+        unsigned long flags, pfn;
+        struct page_info *pg = d->arch.p2m->alloc_page(d);
+        if ( pg == NULL )
+            return 0;
+        page_list_add_tail(pg, &d->arch.p2m->pages);
+        pg->u.inuse.type_info = PGT_l2_page_table | 1 | PGT_validated;
+        pg->count_info |= 1;
+
+        /* The 2MB entries keep _PAGE_PSE, so the flags carry over as-is. */
+        flags = l1e_get_flags(*p2m_entry);
+        pfn = l1e_get_pfn(*p2m_entry);
+
+        l1_entry = map_domain_page(mfn_x(page_to_mfn(pg)));
+        for ( i = 0; i < L2_PAGETABLE_ENTRIES; i++ )
+        {
+            new_entry = l1e_from_pfn(pfn + (i * L1_PAGETABLE_ENTRIES), flags);
+            paging_write_p2m_entry(d, gfn,
+                                   l1_entry+i, *table_mfn, new_entry, 2);
+        }
+        unmap_domain_page(l1_entry);
+
+        new_entry = l1e_from_pfn(mfn_x(page_to_mfn(pg)),
+                                 __PAGE_HYPERVISOR|_PAGE_USER);
+        paging_write_p2m_entry(d, gfn,
+                               p2m_entry, *table_mfn, new_entry, 3);
+    }
+
     /* split single large page into 4KB page in P2M table */
     if ( type == PGT_l1_page_table && (l1e_get_flags(*p2m_entry) & _PAGE_PSE) )
     {
@@ -216,9 +249,6 @@ p2m_next_level(struct domain *d, mfn_t *table_mfn, void **table,
 /*
  * Populate-on-demand functionality
  */
-static
-int set_p2m_entry(struct domain *d, unsigned long gfn, mfn_t mfn, 
-                  unsigned int page_order, p2m_type_t p2mt);
 
 int
 p2m_pod_cache_add(struct domain *d,
@@ -536,6 +566,7 @@ p2m_pod_empty_cache(struct domain *d)
 
     /* After this barrier no new PoD activities can happen. */
     BUG_ON(!d->is_dying);
+    kill_timer(&p2md->pod.sweep_timer);
     spin_barrier(&p2md->lock);
 
     spin_lock(&d->page_alloc_lock);
@@ -655,7 +686,7 @@ p2m_pod_decrease_reservation(struct domain *d,
             BUG_ON(p2md->pod.entry_count < 0);
             pod--;
         }
-        else if ( steal_for_cache && p2m_is_ram(t) )
+        else if ( steal_for_cache && p2m_is_ram(t) && !p2m_is_shared(t) )
         {
             struct page_info *page;
 
@@ -702,6 +733,10 @@ p2m_pod_dump_data(struct domain *d)
     
     printk("    PoD entries=%d cachesize=%d\n",
            p2md->pod.entry_count, p2md->pod.count);
+    printk("    PoD sweeper %s: scanned=%lu reclaimed=%lu time=%"PRIu64"us\n",
+           p2md->pod.sweep_active ? "active" : "idle",
+           p2md->pod.sweep_scanned, p2md->pod.sweep_reclaimed,
+           (uint64_t)(p2md->pod.sweep_time / 1000));
 }
 
 
@@ -749,6 +784,7 @@ p2m_pod_zero_check_superpage(struct domain *d, unsigned long gfn)
          *   2 or less for shadow, 1 for hap)
          */
         if ( !p2m_is_ram(type)
+             || p2m_is_shared(type)
              || type != type0
              || ( (mfn_to_page(mfn)->count_info & PGC_allocated) == 0 )
              || ( (mfn_to_page(mfn)->count_info & (PGC_page_table|PGC_xen_heap)) != 0 )
@@ -846,6 +882,7 @@ p2m_pod_zero_check(struct domain *d, unsigned long *gfns, int count)
         /* If this is ram, and not a pagetable or from the xen heap, and probably not mapped
            elsewhere, map it; otherwise, skip. */
         if ( p2m_is_ram(types[i])
+             && !p2m_is_shared(types[i])
              && ( (mfn_to_page(mfns[i])->count_info & PGC_allocated) != 0 ) 
              && ( (mfn_to_page(mfns[i])->count_info & (PGC_page_table|PGC_xen_heap)) == 0 ) 
              && ( (mfn_to_page(mfns[i])->count_info & PGC_count_mask) <= max_ref ) )
@@ -998,6 +1035,117 @@ p2m_pod_emergency_sweep(struct domain *d)
 
 }
 
+/* Background sweeper.  The emergency sweeps above only run once the cache
+ * is empty and a vcpu is already stalled in a PoD fault.  While a domain
+ * has more outstanding PoD entries than its cache can cover, this timer
+ * scans a bounded number of gfns per period and moves zeroed pages into
+ * the cache ahead of demand.  Unlike the emergency sweep it never splits
+ * a superpage mapping: it reclaims either the whole 2MB or none of it. */
+#define POD_BG_PERIOD     MILLISECS(50)
+#define POD_BG_BATCH      (4 * SUPERPAGE_PAGES) /* gfns per period */
+#define POD_BG_CACHE_LOW  (4 * SUPERPAGE_PAGES) /* idle above this */
+
+/* Is [gfn, gfn+SUPERPAGE_PAGES) backed by one aligned, contiguous mfn
+ * range?  If so it is (or could be) a superpage mapping, and only
+ * p2m_pod_zero_check_superpage() may reclaim it. */
+static int
+p2m_pod_looks_super(struct domain *d, unsigned long gfn)
+{
+    p2m_type_t t0, t1;
+    mfn_t m0, m1;
+
+    m0 = gfn_to_mfn_query(d, gfn, &t0);
+    m1 = gfn_to_mfn_query(d, gfn + SUPERPAGE_PAGES - 1, &t1);
+
+    return ( p2m_is_ram(t0) && t0 == t1
+             && superpage_aligned(mfn_x(m0))
+             && mfn_x(m1) == mfn_x(m0) + SUPERPAGE_PAGES - 1 );
+}
+
+static void
+p2m_pod_sweep_timer_fn(void *data)
+{
+    struct domain *d = data;
+    struct p2m_domain *p2md = d->arch.p2m;
+    unsigned long gfns[POD_SWEEP_STRIDE];
+    unsigned long gfn, end, i, j;
+    s_time_t start = NOW();
+    int count;
+    p2m_type_t t;
+
+    p2m_lock(p2md);
+
+    /* Stop once the cache covers every outstanding PoD entry, or the
+     * domain is going away.  The next PoD entry re-arms the timer. */
+    if ( unlikely(d->is_dying)
+         || p2md->pod.entry_count <= p2md->pod.count )
+    {
+        p2md->pod.sweep_active = 0;
+        p2m_unlock(p2md);
+        return;
+    }
+
+    if ( p2md->pod.count >= POD_BG_CACHE_LOW )
+        goto out;
+
+    count = p2md->pod.count;
+    gfn = p2md->pod.sweep_cursor;
+    if ( gfn > p2md->max_mapped_pfn )
+        gfn = 0;
+    end = gfn + POD_BG_BATCH;
+
+    for ( ; gfn < end && gfn <= p2md->max_mapped_pfn;
+          gfn += SUPERPAGE_PAGES )
+    {
+        p2md->pod.sweep_scanned += SUPERPAGE_PAGES;
+
+        if ( p2m_pod_looks_super(d, gfn) )
+        {
+            p2m_pod_zero_check_superpage(d, gfn);
+            continue;
+        }
+
+        for ( i = 0, j = 0; i < SUPERPAGE_PAGES; i++ )
+        {
+            gfn_to_mfn_query(d, gfn + i, &t);
+            if ( !p2m_is_ram(t) || p2m_is_shared(t) )
+                continue;
+            gfns[j++] = gfn + i;
+            if ( j == POD_SWEEP_STRIDE )
+            {
+                p2m_pod_zero_check(d, gfns, j);
+                j = 0;
+            }
+        }
+        if ( j )
+            p2m_pod_zero_check(d, gfns, j);
+    }
+
+    p2md->pod.sweep_cursor = gfn;
+    if ( p2md->pod.count > count )
+        p2md->pod.sweep_reclaimed += p2md->pod.count - count;
+
+ out:
+    p2md->pod.sweep_time += NOW() - start;
+    p2m_unlock(p2md);
+
+    set_timer(&p2md->pod.sweep_timer, NOW() + POD_BG_PERIOD);
+}
+
+/* Arm the background sweeper if it isn't already.  Lock: p2m */
+static void
+p2m_pod_sweep_start(struct domain *d)
+{
+    struct p2m_domain *p2md = d->arch.p2m;
+
+    ASSERT(p2m_locked_by_me(p2md));
+
+    if ( p2md->pod.sweep_active || d->is_dying )
+        return;
+    p2md->pod.sweep_active = 1;
+    set_timer(&p2md->pod.sweep_timer, NOW() + POD_BG_PERIOD);
+}
+
 int
 p2m_pod_demand_populate(struct domain *d, unsigned long gfn,
                         unsigned int order,
@@ -1051,7 +1199,11 @@ p2m_pod_demand_populate(struct domain *d, unsigned long gfn,
     set_p2m_entry(d, gfn_aligned, mfn, order, p2m_ram_rw);
 
     for( i = 0 ; i < (1UL << order) ; i++ )
+    {
         set_gpfn_from_mfn(mfn_x(mfn) + i, gfn_aligned + i);
+        /* See guest_physmap_add_entry() */
+        paging_mark_dirty(d, mfn_x(mfn) + i);
+    }
     
     p2md->pod.entry_count -= (1 << order); /* Lock: p2m */
     BUG_ON(p2md->pod.entry_count < 0);
@@ -1129,6 +1281,27 @@ p2m_set_entry(struct domain *d, unsigned long gfn, mfn_t mfn,
                          L4_PAGETABLE_SHIFT - PAGE_SHIFT,
                          L4_PAGETABLE_ENTRIES, PGT_l3_page_table) )
         goto out;
+
+    if ( page_order == (L3_PAGETABLE_SHIFT - PAGE_SHIFT) )
+    {
+        p2m_entry = p2m_find_entry(table, &gfn_remainder, gfn,
+                                   L3_PAGETABLE_SHIFT - PAGE_SHIFT,
+                                   L3_PAGETABLE_ENTRIES);
+        ASSERT(p2m_entry);
+
+        /*
+         * Any L2/L1 tables below this entry are simply dropped: they stay
+         * on the p2m page list and are freed when the p2m is torn down.
+         */
+        if ( mfn_valid(mfn) || p2m_is_magic(p2mt) )
+            entry_content = l1e_from_pfn(mfn_x(mfn),
+                                         p2m_type_to_flags(p2mt) | _PAGE_PSE);
+        else
+            entry_content = l1e_empty();
+
+        paging_write_p2m_entry(d, gfn, p2m_entry, table_mfn, entry_content, 3);
+        goto done;
+    }
 #endif
     /*
      * When using PAE Xen, we only allow 33 bits of pseudo-physical
@@ -1190,6 +1363,9 @@ p2m_set_entry(struct domain *d, unsigned long gfn, mfn_t mfn,
         paging_write_p2m_entry(d, gfn, p2m_entry, table_mfn, entry_content, 2);
     }
 
+#if CONFIG_PAGING_LEVELS >= 4
+ done:
+#endif
     /* Track the highest gfn for which we have ever had a valid mapping */
     if ( mfn_valid(mfn) 
          && (gfn + (1UL << page_order) - 1 > d->arch.p2m->max_mapped_pfn) )
@@ -1266,6 +1442,19 @@ p2m_gfn_to_mfn(struct domain *d, unsigned long gfn, p2m_type_t *t,
             unmap_domain_page(l3e);
             return _mfn(INVALID_MFN);
         }
+#if CONFIG_PAGING_LEVELS >= 4
+        if ( l3e_get_flags(*l3e) & _PAGE_PSE )
+        {
+            mfn = _mfn(l3e_get_pfn(*l3e) +
+                       l2_table_offset(addr) * L1_PAGETABLE_ENTRIES +
+                       l1_table_offset(addr));
+            *t = p2m_flags_to_type(l3e_get_flags(*l3e));
+            unmap_domain_page(l3e);
+
+            ASSERT(mfn_valid(mfn) || !p2m_is_ram(*t));
+            return (p2m_is_valid(*t)) ? mfn : _mfn(INVALID_MFN);
+        }
+#endif
         mfn = _mfn(l3e_get_pfn(*l3e));
         unmap_domain_page(l3e);
     }
@@ -1351,6 +1540,35 @@ static mfn_t p2m_gfn_to_mfn_current(unsigned long gfn, p2m_type_t *t,
         ASSERT(gfn < (RO_MPT_VIRT_END - RO_MPT_VIRT_START) 
                / sizeof(l1_pgentry_t));
 
+#if CONFIG_PAGING_LEVELS >= 4
+        /*
+         * Read & process L3. A 1GB superpage must be caught here: the
+         * linear mapping of the L2 and L1 below it is guest memory.
+         */
+        {
+            l3_pgentry_t l3e = l3e_empty();
+
+            ret = __copy_from_user(&l3e,
+                                   &__linear_l2_table[
+                                       l2_linear_offset(RO_MPT_VIRT_START)
+                                       + l3_linear_offset(addr)],
+                                   sizeof(l3e));
+            if ( (ret == 0) &&
+                 ((l3e_get_flags(l3e) & (_PAGE_PRESENT|_PAGE_PSE)) ==
+                  (_PAGE_PRESENT|_PAGE_PSE)) )
+            {
+                p2mt = p2m_flags_to_type(l3e_get_flags(l3e));
+                if ( p2m_is_valid(p2mt) )
+                    mfn = _mfn(l3e_get_pfn(l3e) +
+                               l2_table_offset(addr) * L1_PAGETABLE_ENTRIES +
+                               l1_table_offset(addr));
+                else
+                    p2mt = p2m_mmio_dm;
+                goto out;
+            }
+        }
+#endif
+
         /*
          * Read & process L2
          */
@@ -1471,6 +1689,7 @@ int p2m_init(struct domain *d)
     INIT_PAGE_LIST_HEAD(&p2m->pages);
     INIT_PAGE_LIST_HEAD(&p2m->pod.super);
     INIT_PAGE_LIST_HEAD(&p2m->pod.single);
+    init_timer(&p2m->pod.sweep_timer, p2m_pod_sweep_timer_fn, d, 0);
 
     p2m->set_entry = p2m_set_entry;
     p2m->get_entry = p2m_gfn_to_mfn;
@@ -1490,11 +1709,62 @@ void p2m_change_entry_type_global(struct domain *d,
     struct p2m_domain *p2m = d->arch.p2m;
 
     p2m_lock(p2m);
-    p2m->change_entry_type_global(d, ot, nt);
+    p2m->defer_flush = 1;
+    p2m->change_entry_type_global(d, ot, nt, NULL);
+    /* A complete walk also finishes any preempted walk for these types. */
+    if ( p2m->global_change.ot == ot && p2m->global_change.nt == nt )
+        p2m->global_change.pending = 0;
+    p2m_flush_deferred(d);
     p2m_unlock(p2m);
 }
 
-static
+int p2m_change_entry_type_global_preemptible(struct domain *d,
+                                             p2m_type_t ot, p2m_type_t nt)
+{
+    struct p2m_domain *p2m = d->arch.p2m;
+    int rc;
+
+    p2m_lock(p2m);
+
+    /* Carry on from where a preempted walk for the same change stopped.
+     * A walk for some other change is abandoned: whoever started it
+     * will start again from the beginning when it retries. */
+    if ( !p2m->global_change.pending ||
+         p2m->global_change.ot != ot || p2m->global_change.nt != nt )
+    {
+        p2m->global_change.pending = 1;
+        p2m->global_change.ot = ot;
+        p2m->global_change.nt = nt;
+        p2m->global_change.next = 0;
+    }
+
+    /* Whatever part has been changed must be flushed before we return,
+     * since the guest may run before we are called again. */
+    p2m->defer_flush = 1;
+    rc = p2m->change_entry_type_global(d, ot, nt, &p2m->global_change.next);
+    if ( rc != -EAGAIN )
+        p2m->global_change.pending = 0;
+    p2m_flush_deferred(d);
+
+    p2m_unlock(p2m);
+
+    return rc;
+}
+
+void p2m_flush_deferred(struct domain *d)
+{
+    struct p2m_domain *p2m = d->arch.p2m;
+
+    ASSERT(p2m_locked_by_me(p2m));
+
+    p2m->defer_flush = 0;
+    if ( p2m->need_flush & P2M_FLUSH_EPT )
+        ept_sync_domain(d);
+    if ( p2m->need_flush & P2M_FLUSH_TLB )
+        flush_tlb_mask(d->domain_dirty_cpumask);
+    p2m->need_flush = 0;
+}
+
 int set_p2m_entry(struct domain *d, unsigned long gfn, mfn_t mfn, 
                     unsigned int page_order, p2m_type_t p2mt)
 {
@@ -1504,6 +1774,14 @@ int set_p2m_entry(struct domain *d, unsigned long gfn, mfn_t mfn,
 
     while ( todo )
     {
+#if CONFIG_PAGING_LEVELS >= 4
+        if ( (((gfn | mfn_x(mfn) | todo) &
+               ((1ul << (L3_PAGETABLE_SHIFT - PAGE_SHIFT)) - 1)) == 0) &&
+             is_hvm_domain(d) && d->arch.hvm_domain.hap_enabled &&
+             hvm_hap_has_1gb(d) )
+            order = L3_PAGETABLE_SHIFT - PAGE_SHIFT;
+        else
+#endif
         order = ((((gfn | mfn_x(mfn) | todo) & (SUPERPAGE_PAGES - 1)) == 0) &&
                  hvm_hap_has_2mb(d)) ? 9 : 0;
 
@@ -1623,6 +1901,7 @@ void p2m_teardown(struct domain *d)
 
 void p2m_final_teardown(struct domain *d)
 {
+    kill_timer(&d->arch.p2m->pod.sweep_timer);
     xfree(d->arch.p2m);
     d->arch.p2m = NULL;
 }
@@ -1759,6 +2038,14 @@ static void audit_p2m(struct domain *d)
                     gfn += 1 << (L3_PAGETABLE_SHIFT - PAGE_SHIFT);
                     continue;
                 }
+#if CONFIG_PAGING_LEVELS >= 4
+                /* 1GB superpages are not audited. */
+                if ( l3e_get_flags(l3e[i3]) & _PAGE_PSE )
+                {
+                    gfn += 1 << (L3_PAGETABLE_SHIFT - PAGE_SHIFT);
+                    continue;
+                }
+#endif
                 l2e = map_domain_page(mfn_x(_mfn(l3e_get_pfn(l3e[i3]))));
                 for ( i2 = 0; i2 < L2_PAGETABLE_ENTRIES; i2++ )
                 {
@@ -1806,6 +2093,10 @@ static void audit_p2m(struct domain *d)
                         }
                         mfn = l1e_get_pfn(l1e[i1]);
                         ASSERT(mfn_valid(_mfn(mfn)));
+                        /* Shared frames have no single m2p entry */
+                        if ( p2m_is_shared(p2m_flags_to_type(
+                                 l1e_get_flags(l1e[i1]))) )
+                            continue;
                         m2pfn = get_gpfn_from_mfn(mfn);
                         if ( m2pfn != gfn )
                         {
@@ -1960,6 +2251,7 @@ guest_physmap_mark_populate_on_demand(struct domain *d, unsigned long gfn,
         p2md->pod.entry_count += 1 << order; /* Lock: p2m */
         p2md->pod.entry_count -= pod_count;
         BUG_ON(p2md->pod.entry_count < 0);
+        p2m_pod_sweep_start(d);
     }
 
     audit_p2m(d);
@@ -2000,6 +2292,18 @@ guest_physmap_add_entry(struct domain *d, unsigned long gfn,
     if ( rc != 0 )
         return rc;
 
+    /* Shared gfns being replaced must be dropped by the sharing code,
+     * which takes the p2m lock itself.  Skip the walk if nothing in the
+     * domain is shared: for a 1GB extent it is 2^18 lookups. */
+    if ( d->arch.p2m->shared_gfns != 0 )
+        for ( i = 0; i < (1UL << page_order); i++ )
+        {
+            omfn = gfn_to_mfn_query(d, gfn + i, &ot);
+            if ( p2m_is_shared(ot) )
+                mem_sharing_unshare_page(d, gfn + i,
+                                         MEM_SHARING_DESTROY_GFN);
+        }
+
     p2m_lock(d->arch.p2m);
     audit_p2m(d);
 
@@ -2056,7 +2360,13 @@ guest_physmap_add_entry(struct domain *d, unsigned long gfn,
         if ( !set_p2m_entry(d, gfn, _mfn(mfn), page_order, t) )
             rc = -EINVAL;
         for ( i = 0; i < (1UL << page_order); i++ )
+        {
             set_gpfn_from_mfn(mfn+i, gfn+i);
+            /* HAP log-dirty only re-protects pages that were reported
+             * dirty, so new writable mappings must be logged. */
+            if ( t == p2m_ram_rw )
+                paging_mark_dirty(d, mfn+i);
+        }
     }
     else
     {
@@ -2080,10 +2390,28 @@ guest_physmap_add_entry(struct domain *d, unsigned long gfn,
 
 /* Walk the whole p2m table, changing any entries of the old type
  * to the new type.  This is used in hardware-assisted paging to 
- * quickly enable or diable log-dirty tracking */
-void p2m_change_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt)
+ * quickly enable or diable log-dirty tracking.  A preemptible walk
+ * checks for preemption after each 1GB of guest address space. */
+#if CONFIG_PAGING_LEVELS == 4
+#define P2M_L3_SLOT_GFN(i4, i3)                                         \
+    (((unsigned long)(i4) << (L4_PAGETABLE_SHIFT - PAGE_SHIFT)) |       \
+     ((unsigned long)(i3) << (L3_PAGETABLE_SHIFT - PAGE_SHIFT)))
+/* First l3 slot of l4 slot i4 not below gfn start */
+#define P2M_L3_SLOT_FIRST(i4, start)                                    \
+    (((i4) == ((start) >> (L4_PAGETABLE_SHIFT - PAGE_SHIFT)))           \
+     ? (((start) >> (L3_PAGETABLE_SHIFT - PAGE_SHIFT))                  \
+        & (L3_PAGETABLE_ENTRIES - 1)) : 0)
+#else
+#define P2M_L3_SLOT_GFN(i4, i3)                                         \
+    ((unsigned long)(i3) << (L3_PAGETABLE_SHIFT - PAGE_SHIFT))
+#define P2M_L3_SLOT_FIRST(i4, start)                                    \
+    ((start) >> (L3_PAGETABLE_SHIFT - PAGE_SHIFT))
+#endif
+
+int p2m_change_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt,
+                           unsigned long *resume)
 {
-    unsigned long mfn, gfn, flags;
+    unsigned long mfn, gfn, flags, start = resume ? *resume : 0;
     l1_pgentry_t l1e_content;
     l1_pgentry_t *l1e;
     l2_pgentry_t *l2e;
@@ -2091,16 +2419,17 @@ void p2m_change_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt)
     int i1, i2;
     l3_pgentry_t *l3e;
     int i3;
+    int rc = 0;
 #if CONFIG_PAGING_LEVELS == 4
     l4_pgentry_t *l4e;
     int i4;
 #endif /* CONFIG_PAGING_LEVELS == 4 */
 
     if ( !paging_mode_translate(d) )
-        return;
+        return 0;
 
     if ( pagetable_get_pfn(d->arch.phys_table) == 0 )
-        return;
+        return 0;
 
     ASSERT(p2m_locked_by_me(d->arch.p2m));
 
@@ -2111,7 +2440,9 @@ void p2m_change_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt)
 #endif
 
 #if CONFIG_PAGING_LEVELS >= 4
-    for ( i4 = 0; i4 < L4_PAGETABLE_ENTRIES; i4++ )
+    for ( i4 = start >> (L4_PAGETABLE_SHIFT - PAGE_SHIFT);
+          i4 < L4_PAGETABLE_ENTRIES;
+          i4++ )
     {
         if ( !(l4e_get_flags(l4e[i4]) & _PAGE_PRESENT) )
         {
@@ -2119,7 +2450,7 @@ void p2m_change_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt)
         }
         l3e = map_domain_page(l4e_get_pfn(l4e[i4]));
 #endif
-        for ( i3 = 0;
+        for ( i3 = P2M_L3_SLOT_FIRST(i4, start);
               i3 < ((CONFIG_PAGING_LEVELS==4) ? L3_PAGETABLE_ENTRIES : 8);
               i3++ )
         {
@@ -2127,6 +2458,22 @@ void p2m_change_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt)
             {
                 continue;
             }
+#if CONFIG_PAGING_LEVELS >= 4
+            if ( (l3e_get_flags(l3e[i3]) & _PAGE_PSE) )
+            {
+                flags = l3e_get_flags(l3e[i3]);
+                if ( p2m_flags_to_type(flags) != ot )
+                    continue;
+                mfn = l3e_get_pfn(l3e[i3]);
+                gfn = get_gpfn_from_mfn(mfn);
+                flags = p2m_type_to_flags(nt);
+                l1e_content = l1e_from_pfn(mfn, flags | _PAGE_PSE);
+                paging_write_p2m_entry(d, gfn, (l1_pgentry_t *)&l3e[i3],
+                                       _mfn(l4e_get_pfn(l4e[i4])),
+                                       l1e_content, 3);
+                continue;
+            }
+#endif
             l2mfn = _mfn(l3e_get_pfn(l3e[i3]));
             l2e = map_domain_page(l3e_get_pfn(l3e[i3]));
             for ( i2 = 0; i2 < L2_PAGETABLE_ENTRIES; i2++ )
@@ -2169,9 +2516,18 @@ void p2m_change_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt)
                 unmap_domain_page(l1e);
             }
             unmap_domain_page(l2e);
+
+            if ( resume && hypercall_preempt_check() )
+            {
+                *resume = P2M_L3_SLOT_GFN(i4, i3 + 1);
+                rc = -EAGAIN;
+                break;
+            }
         }
 #if CONFIG_PAGING_LEVELS >= 4
         unmap_domain_page(l3e);
+        if ( rc )
+            break;
     }
 #endif
 
@@ -2181,6 +2537,7 @@ void p2m_change_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt)
     unmap_domain_page(l3e);
 #endif
 
+    return rc;
 }
 
 /* Modify the p2m type of a single gfn from ot to nt, returning the 
@@ -2202,6 +2559,31 @@ p2m_type_t p2m_change_type(struct domain *d, unsigned long gfn,
     return pt;
 }
 
+void p2m_change_type_bitmap(struct domain *d, unsigned long begin_gfn,
+                            const unsigned long *bitmap, unsigned int nr,
+                            p2m_type_t ot, p2m_type_t nt)
+{
+    struct p2m_domain *p2m = d->arch.p2m;
+    unsigned int i;
+    p2m_type_t pt;
+    mfn_t mfn;
+
+    p2m_lock(p2m);
+    p2m->defer_flush = 1;
+
+    for ( i = find_first_bit(bitmap, nr);
+          i < nr;
+          i = find_next_bit(bitmap, nr, i + 1) )
+    {
+        mfn = gfn_to_mfn_query(d, begin_gfn + i, &pt);
+        if ( pt == ot )
+            set_p2m_entry(d, begin_gfn + i, mfn, 0, nt);
+    }
+
+    p2m_flush_deferred(d);
+    p2m_unlock(p2m);
+}
+
 int
 set_mmio_p2m_entry(struct domain *d, unsigned long gfn, mfn_t mfn)
 {
@@ -213,21 +213,28 @@ int paging_log_dirty_enable(struct domain *d)
 
     if ( paging_mode_log_dirty(d) )
     {
-        ret = -EINVAL;
-        goto out;
+        /* Already on, unless we are finishing a preempted enable. */
+        if ( !d->arch.paging.log_dirty.preempted )
+        {
+            ret = -EINVAL;
+            goto out;
+        }
     }
-
-    ret = paging_alloc_log_dirty_bitmap(d);
-    if ( ret != 0 )
+    else
     {
-        paging_free_log_dirty_bitmap(d);
-        goto out;
+        ret = paging_alloc_log_dirty_bitmap(d);
+        if ( ret != 0 )
+        {
+            paging_free_log_dirty_bitmap(d);
+            goto out;
+        }
     }
 
     log_dirty_unlock(d);
 
     /* Safe because the domain is paused. */
     ret = d->arch.paging.log_dirty.enable_log_dirty(d);
+    d->arch.paging.log_dirty.preempted = (ret == -EAGAIN);
 
     /* Possibility of leaving the bitmap allocated here but it'll be
      * tidied on domain teardown. */
@@ -248,6 +255,7 @@ int paging_log_dirty_disable(struct domain *d)
     domain_pause(d);
     /* Safe because the domain is paused. */
     ret = d->arch.paging.log_dirty.disable_log_dirty(d);
+    d->arch.paging.log_dirty.preempted = (ret == -EAGAIN);
     log_dirty_lock(d);
     if ( !paging_mode_log_dirty(d) )
         paging_free_log_dirty_bitmap(d);
@@ -287,6 +295,20 @@ void paging_mark_dirty(struct domain *d, unsigned long guest_mfn)
     if ( unlikely(!VALID_M2P(pfn)) )
         goto out;
 
+    /* VRAM tracked through a bitmap shared with the device model: that is
+     * the only place the bit is wanted.  See hap_map_dirty_vram(). */
+    if ( d->dirty_vram && d->dirty_vram->shared_bitmap )
+    {
+        struct sh_dirty_vram *vram = d->dirty_vram;
+
+        if ( (pfn >= vram->begin_pfn) && (pfn < vram->end_pfn) )
+        {
+            set_bit(pfn - vram->begin_pfn, vram->rearm_bitmap);
+            set_bit(pfn - vram->begin_pfn, vram->shared_bitmap);
+        }
+        goto out;
+    }
+
     i1 = L1_LOGDIRTY_IDX(pfn);
     i2 = L2_LOGDIRTY_IDX(pfn);
     i3 = L3_LOGDIRTY_IDX(pfn);
@@ -341,14 +363,21 @@ int paging_log_dirty_op(struct domain *d, struct xen_domctl_shadow_op *sc)
     int rv = 0, clean = 0, peek = 1;
     unsigned long pages = 0;
     mfn_t *l4, *l3, *l2;
-    unsigned long *l1;
+    unsigned long *l1, *rearm = NULL;
     int i4, i3, i2;
 
+    clean = (sc->op == XEN_DOMCTL_SHADOW_OP_CLEAN);
+
+    /* If the paging mode can re-arm individual pfns, only the pages that
+     * were reported dirty need to be write-protected again.  Each leaf is
+     * copied aside so that can be done without the log-dirty lock.  If
+     * there is no memory for the copy, fall back to re-arming everything. */
+    if ( clean && d->arch.paging.log_dirty.clean_dirty_pfns )
+        rearm = alloc_xenheap_page();
+
     domain_pause(d);
     log_dirty_lock(d);
 
-    clean = (sc->op == XEN_DOMCTL_SHADOW_OP_CLEAN);
-
     PAGING_DEBUG(LOGDIRTY, "log-dirty %s: dom %u faults=%u dirty=%u\n",
                  (clean) ? "clean" : "peek",
                  d->domain_id,
@@ -416,10 +445,25 @@ int paging_log_dirty_op(struct domain *d, struct xen_domctl_shadow_op *sc)
                     }
                 }
                 if ( clean && l1 != zeroes )
+                {
+                    if ( rearm )
+                        copy_page(rearm, l1);
                     clear_page(l1);
-                pages += bytes << 3;
+                }
                 if ( l1 != zeroes )
                     unmap_domain_page(l1);
+                if ( rearm && l1 != zeroes &&
+                     find_first_bit(rearm, LOGDIRTY_LEAF_PFNS) <
+                     LOGDIRTY_LEAF_PFNS )
+                {
+                    /* Safe to drop the lock: the domain is paused and the
+                     * tree is only freed by log-dirty disable/teardown. */
+                    log_dirty_unlock(d);
+                    d->arch.paging.log_dirty.clean_dirty_pfns(
+                        d, pages, rearm, LOGDIRTY_LEAF_PFNS);
+                    log_dirty_lock(d);
+                }
+                pages += bytes << 3;
             }
             if ( l2 )
                 unmap_domain_page(l2);
@@ -435,18 +479,183 @@ int paging_log_dirty_op(struct domain *d, struct xen_domctl_shadow_op *sc)
 
     log_dirty_unlock(d);
 
-    if ( clean )
+    if ( clean && !rearm )
     {
         /* We need to further call clean_dirty_bitmap() functions of specific
          * paging modes (shadow or hap).  Safe because the domain is paused. */
         d->arch.paging.log_dirty.clean_dirty_bitmap(d);
     }
     domain_unpause(d);
+    if ( rearm )
+        free_xenheap_page(rearm);
     return rv;
 
  out:
     log_dirty_unlock(d);
     domain_unpause(d);
+    if ( rearm )
+        free_xenheap_page(rearm);
+    return rv;
+}
+
+/* Map the log-dirty leaf covering pfn, or return NULL if there is none.
+ * Caller holds the log-dirty lock. */
+static unsigned long *paging_map_log_dirty_leaf(struct domain *d,
+                                                unsigned long pfn)
+{
+    mfn_t mfn, *node;
+
+    node = map_domain_page(mfn_x(d->arch.paging.log_dirty.top));
+    mfn = node[L4_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(node);
+    if ( !mfn_valid(mfn) )
+        return NULL;
+
+    node = map_domain_page(mfn_x(mfn));
+    mfn = node[L3_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(node);
+    if ( !mfn_valid(mfn) )
+        return NULL;
+
+    node = map_domain_page(mfn_x(mfn));
+    mfn = node[L2_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(node);
+    if ( !mfn_valid(mfn) )
+        return NULL;
+
+    return map_domain_page(mfn_x(mfn));
+}
+
+/* Return the dirty pfns in [start_pfn, end_pfn) as a list of extents,
+ * optionally cleaning them.  See XEN_DOMCTL_log_dirty_extents. */
+int paging_log_dirty_extents(struct domain *d,
+                             struct xen_domctl_log_dirty_extents *op)
+{
+    xen_domctl_log_dirty_extent_t ext = { 0, 0 };
+    unsigned long pfn, base, next, end = op->end_pfn;
+    unsigned long *l1, *rearm = NULL;
+    unsigned int i, lo, hi, nr = 0;
+    uint64_t dirty = 0;
+    int clean, full = 0, rv = 0;
+
+    if ( (op->flags & ~XEN_DOMCTL_LOG_DIRTY_CLEAN) ||
+         (op->start_pfn > op->end_pfn) )
+        return -EINVAL;
+
+    if ( unlikely(d == current->domain) || unlikely(d->vcpu[0] == NULL) )
+        return -EINVAL;
+
+    clean = !!(op->flags & XEN_DOMCTL_LOG_DIRTY_CLEAN);
+    if ( clean && d->arch.paging.log_dirty.clean_dirty_pfns &&
+         (rearm = alloc_xenheap_page()) == NULL )
+        return -ENOMEM;
+    if ( rearm )
+        clear_page(rearm);
+
+    domain_pause(d);
+
+    for ( pfn = op->start_pfn; (pfn < end) && !full; pfn = next )
+    {
+        base = pfn - L1_LOGDIRTY_IDX(pfn);
+        next = base + LOGDIRTY_LEAF_PFNS;
+        lo = pfn - base;
+        hi = (end < next) ? end - base : LOGDIRTY_LEAF_PFNS;
+
+        log_dirty_lock(d);
+
+        if ( !mfn_valid(d->arch.paging.log_dirty.top) )
+        {
+            rv = -EINVAL;
+            log_dirty_unlock(d);
+            break;
+        }
+
+        if ( unlikely(d->arch.paging.log_dirty.failed_allocs) )
+        {
+            printk("%s: %d failed page allocs while logging dirty pages\n",
+                   __FUNCTION__, d->arch.paging.log_dirty.failed_allocs);
+            rv = -ENOMEM;
+            log_dirty_unlock(d);
+            break;
+        }
+
+        if ( (l1 = paging_map_log_dirty_leaf(d, base)) == NULL )
+        {
+            log_dirty_unlock(d);
+            continue;
+        }
+
+        for ( i = find_next_bit(l1, hi, lo);
+              i < hi;
+              i = find_next_bit(l1, hi, i + 1) )
+        {
+            if ( ext.nr_pfns && (ext.first_pfn + ext.nr_pfns == base + i) )
+            {
+                ext.nr_pfns++;
+            }
+            else
+            {
+                if ( ext.nr_pfns )
+                {
+                    if ( copy_to_guest_offset(op->extents, nr, &ext, 1) )
+                        rv = -EFAULT;
+                    dirty += ext.nr_pfns;
+                    nr++;
+                    ext.nr_pfns = 0;
+                }
+                /* No room to start another extent: resume from here. */
+                if ( (nr == op->nr_extents) || rv )
+                {
+                    full = 1;
+                    next = base + i;
+                    break;
+                }
+                ext.first_pfn = base + i;
+                ext.nr_pfns = 1;
+            }
+
+            if ( clean )
+            {
+                __clear_bit(i, l1);
+                if ( rearm )
+                    __set_bit(i, rearm);
+            }
+        }
+
+        unmap_domain_page(l1);
+        log_dirty_unlock(d);
+
+        /* As in paging_log_dirty_op(), the domain is paused so it is safe
+         * to re-arm with the log-dirty lock dropped. */
+        if ( rearm &&
+             find_first_bit(rearm, LOGDIRTY_LEAF_PFNS) < LOGDIRTY_LEAF_PFNS )
+        {
+            d->arch.paging.log_dirty.clean_dirty_pfns(
+                d, base, rearm, LOGDIRTY_LEAF_PFNS);
+            clear_page(rearm);
+        }
+    }
+
+    if ( ext.nr_pfns && !rv )
+    {
+        if ( copy_to_guest_offset(op->extents, nr, &ext, 1) )
+            rv = -EFAULT;
+        dirty += ext.nr_pfns;
+        nr++;
+    }
+
+    if ( clean && !rearm && dirty )
+        d->arch.paging.log_dirty.clean_dirty_bitmap(d);
+
+    domain_unpause(d);
+
+    if ( rearm )
+        free_xenheap_page(rearm);
+
+    op->start_pfn = (pfn < end) ? pfn : end;
+    op->nr_extents = nr;
+    op->dirty_pages = dirty;
+
     return rv;
 }
 
@@ -602,17 +811,36 @@ int paging_log_dirty_range(struct domain *d,
     return rv;
 }
 
-/* Note that this function takes three function pointers. Callers must supply
+/* Unhook d->dirty_vram so that it can be freed: paging_mark_dirty() only
+ * looks at it with the log-dirty lock held. */
+struct sh_dirty_vram *paging_detach_dirty_vram(struct domain *d)
+{
+    struct sh_dirty_vram *vram;
+
+    log_dirty_lock(d);
+    vram = d->dirty_vram;
+    d->dirty_vram = NULL;
+    log_dirty_unlock(d);
+
+    return vram;
+}
+
+/* Note that this function takes four function pointers. Callers must supply
  * these functions for log dirty code to call. This function usually is
  * invoked when paging is enabled. Check shadow_enable() and hap_enable() for
- * reference.
+ * reference.  clean_dirty_pfns may be NULL, in which case every CLEAN
+ * re-arms the whole domain with clean_dirty_bitmap.
  *
  * These function pointers must not be followed with the log-dirty lock held.
  */
 void paging_log_dirty_init(struct domain *d,
                            int    (*enable_log_dirty)(struct domain *d),
                            int    (*disable_log_dirty)(struct domain *d),
-                           void   (*clean_dirty_bitmap)(struct domain *d))
+                           void   (*clean_dirty_bitmap)(struct domain *d),
+                           void   (*clean_dirty_pfns)(struct domain *d,
+                                                      unsigned long begin_pfn,
+                                                      const unsigned long *bitmap,
+                                                      unsigned int nr))
 {
     /* We initialize log dirty lock first */
     log_dirty_lock_init(d);
@@ -620,6 +848,7 @@ void paging_log_dirty_init(struct domain *d,
     d->arch.paging.log_dirty.enable_log_dirty = enable_log_dirty;
     d->arch.paging.log_dirty.disable_log_dirty = disable_log_dirty;
     d->arch.paging.log_dirty.clean_dirty_bitmap = clean_dirty_bitmap;
+    d->arch.paging.log_dirty.clean_dirty_pfns = clean_dirty_pfns;
     d->arch.paging.log_dirty.top = _mfn(INVALID_MFN);
 }
 
@@ -663,6 +892,16 @@ void paging_vcpu_init(struct vcpu *v)
 }
 
 
+/* Enabling or disabling log-dirty mode walks the whole p2m under HAP, and
+ * may be preempted part way through.  Retry the domctl to finish it. */
+static int paging_log_dirty_continue(int rc, XEN_GUEST_HANDLE(void) u_domctl)
+{
+    if ( rc == -EAGAIN )
+        rc = hypercall_create_continuation(__HYPERVISOR_domctl, "h",
+                                           u_domctl);
+    return rc;
+}
+
 int paging_domctl(struct domain *d, xen_domctl_shadow_op_t *sc,
                   XEN_GUEST_HANDLE(void) u_domctl)
 {
@@ -702,22 +941,25 @@ int paging_domctl(struct domain *d, xen_domctl_shadow_op_t *sc,
     switch ( sc->op )
     {
     case XEN_DOMCTL_SHADOW_OP_ENABLE_LOGDIRTY:
-        if ( hap_enabled(d) )
+        /* A retried, preempted enable must keep the bitmap it allocated. */
+        if ( hap_enabled(d) && !d->arch.paging.log_dirty.preempted )
             hap_logdirty_init(d);
-        return paging_log_dirty_enable(d);
+        return paging_log_dirty_continue(paging_log_dirty_enable(d),
+                                         u_domctl);
 
     case XEN_DOMCTL_SHADOW_OP_ENABLE:
         if ( sc->mode & XEN_DOMCTL_SHADOW_ENABLE_LOG_DIRTY )
         {
-            if ( hap_enabled(d) )
+            if ( hap_enabled(d) && !d->arch.paging.log_dirty.preempted )
                 hap_logdirty_init(d);
-            return paging_log_dirty_enable(d);
+            return paging_log_dirty_continue(paging_log_dirty_enable(d),
+                                             u_domctl);
         }
 
     case XEN_DOMCTL_SHADOW_OP_OFF:
-        if ( paging_mode_log_dirty(d) )
+        if ( paging_mode_log_dirty(d) || d->arch.paging.log_dirty.preempted )
             if ( (rc = paging_log_dirty_disable(d)) != 0 )
-                return rc;
+                return paging_log_dirty_continue(rc, u_domctl);
 
     case XEN_DOMCTL_SHADOW_OP_CLEAN:
     case XEN_DOMCTL_SHADOW_OP_PEEK:
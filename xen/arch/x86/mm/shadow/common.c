@@ -41,6 +41,8 @@
 
 DEFINE_PER_CPU(uint32_t,trace_shadow_path_flags);
 
+static void shadow_auto_alloc(void *data);
+
 /* Set up the shadow-specific parts of a domain struct at start of day.
  * Called for every domain from arch_domain_create() */
 void shadow_domain_init(struct domain *d)
@@ -51,10 +53,12 @@ void shadow_domain_init(struct domain *d)
         INIT_PAGE_LIST_HEAD(&d->arch.paging.shadow.freelists[i]);
     INIT_PAGE_LIST_HEAD(&d->arch.paging.shadow.p2m_freelist);
     INIT_PAGE_LIST_HEAD(&d->arch.paging.shadow.pinned_shadows);
+    init_timer(&d->arch.paging.shadow.auto_timer, shadow_auto_alloc, d, 0);
 
     /* Use shadow pagetables for log-dirty support */
     paging_log_dirty_init(d, shadow_enable_log_dirty, 
-                          shadow_disable_log_dirty, shadow_clean_dirty_bitmap);
+                          shadow_disable_log_dirty, shadow_clean_dirty_bitmap,
+                          NULL);
 
 #if (SHADOW_OPTIMIZATIONS & SHOPT_OUT_OF_SYNC)
     d->arch.paging.shadow.oos_active = 0;
@@ -703,7 +707,7 @@ static int oos_remove_write_access(struct vcpu *v, mfn_t gmfn,
 
 static inline void trace_resync(int event, mfn_t gmfn)
 {
-    if ( tb_init_done )
+    if ( tb_event_enabled(TRC_SHADOW) )
     {
         /* Convert gmfn to gfn */
         unsigned long gfn = mfn_to_gfn(current->domain, gmfn);
@@ -1330,7 +1334,7 @@ static void shadow_unhook_mappings(struct vcpu *v, mfn_t smfn)
 
 static inline void trace_shadow_prealloc_unpin(struct domain *d, mfn_t smfn)
 {
-    if ( tb_init_done )
+    if ( tb_event_enabled(TRC_SHADOW) )
     {
         /* Convert smfn to gfn */
         unsigned long gfn;
@@ -1372,6 +1376,7 @@ static void _shadow_prealloc(
         /* Unpin this top-level shadow */
         trace_shadow_prealloc_unpin(d, smfn);
         sh_unpin(v, smfn);
+        d->arch.paging.shadow.evictions++;
 
         /* See if that freed up enough space */
         if ( space_is_available(d, order, count) ) return;
@@ -1390,6 +1395,7 @@ static void _shadow_prealloc(
                 TRACE_SHADOW_PATH_FLAG(TRCE_SFLAG_PREALLOC_UNHOOK);
                 shadow_unhook_mappings(v, 
                                pagetable_get_mfn(v2->arch.shadow_table[i]));
+                d->arch.paging.shadow.evictions++;
 
                 /* See if that freed up enough space */
                 if ( space_is_available(d, order, count) )
@@ -1432,6 +1438,8 @@ static void shadow_blow_tables(struct domain *d)
 
     ASSERT(v != NULL);
 
+    d->arch.paging.shadow.blows++;
+
     /* Pass one: unpin all pinned pages */
     page_list_for_each_safe_reverse(sp, t, &d->arch.paging.shadow.pinned_shadows)
     {
@@ -1776,6 +1784,8 @@ static void p2m_install_entry_in_monitors(struct domain *d,
 }
 #endif
 
+static void shadow_hash_resize(struct domain *d);
+
 /* Set the pool of shadow pages to the required number of pages.
  * Input will be rounded up to at least shadow_min_acceptable_pages(),
  * plus space for the p2m table.
@@ -1850,9 +1860,93 @@ static unsigned int sh_set_allocation(struct domain *d,
         }
     }
 
+    /* Keep the hash chains short as the pool grows (or save memory as it
+     * shrinks).  Nothing to do on the way down to zero: the table is about
+     * to be torn down. */
+    if ( pages != 0 )
+        shadow_hash_resize(d);
+
     return 0;
 }
 
+/* Shadow pool auto-sizing.  Once a second, look at how many shadows had
+ * to be evicted to make room during the last period.  A pool that keeps
+ * evicting is grown; one that has evicted nothing, taken few faults and
+ * sat at least half empty for a while is shrunk.  Steps are bounded so
+ * a single timer run never allocates or frees too much at once. */
+#define SHADOW_AUTO_PERIOD          MILLISECS(1000)
+#define SHADOW_AUTO_GROW_EVICTIONS  32    /* per period */
+#define SHADOW_AUTO_IDLE_FAULTS     1000  /* per period */
+#define SHADOW_AUTO_IDLE_PERIODS    10
+#define SHADOW_AUTO_MIN_STEP        (1U << (20 - PAGE_SHIFT))  /* 1MB */
+#define SHADOW_AUTO_MAX_STEP        (16U << (20 - PAGE_SHIFT)) /* 16MB */
+
+static void shadow_auto_alloc(void *data)
+{
+    struct domain *d = data;
+    struct shadow_domain *sd = &d->arch.paging.shadow;
+    unsigned int evictions, faults, total, target, step;
+
+    if ( d->is_dying )
+        return;
+
+    shadow_lock(d);
+
+    if ( (sd->auto_max_pages == 0) || !shadow_mode_enabled(d) )
+    {
+        shadow_unlock(d);
+        return;
+    }
+
+    evictions = sd->evictions - sd->auto_last_evictions;
+    faults = sd->faults - sd->auto_last_faults;
+    sd->auto_last_evictions = sd->evictions;
+    sd->auto_last_faults = sd->faults;
+
+    total = target = sd->total_pages;
+
+    if ( total < sd->auto_min_pages )
+        target = min(total + SHADOW_AUTO_MAX_STEP, sd->auto_min_pages);
+    else if ( total > sd->auto_max_pages )
+        target = max(total - SHADOW_AUTO_MAX_STEP, sd->auto_max_pages);
+    else if ( evictions >= SHADOW_AUTO_GROW_EVICTIONS )
+    {
+        sd->auto_idle = 0;
+        step = min(max(total / 4, SHADOW_AUTO_MIN_STEP), SHADOW_AUTO_MAX_STEP);
+        target = min(total + step, sd->auto_max_pages);
+    }
+    else if ( (evictions == 0) && (faults < SHADOW_AUTO_IDLE_FAULTS) )
+    {
+        if ( (++sd->auto_idle >= SHADOW_AUTO_IDLE_PERIODS) &&
+             (sd->free_pages > total / 2) )
+        {
+            sd->auto_idle = 0;
+            step = min(total / 8, SHADOW_AUTO_MAX_STEP);
+            target = max(total - step, sd->auto_min_pages);
+        }
+    }
+    else
+        sd->auto_idle = 0;
+
+    if ( target != total )
+    {
+        sh_set_allocation(d, target, NULL);
+        /* Don't count our own shrinking as pressure next time round. */
+        sd->auto_last_evictions = sd->evictions;
+        if ( sd->total_pages > total )
+            sd->grows++;
+        else if ( sd->total_pages < total )
+            sd->shrinks++;
+        SHADOW_PRINTK("d=%u evictions=%u faults=%u: %u -> %u pages\n",
+                      d->domain_id, evictions, faults, total,
+                      sd->total_pages);
+    }
+
+    shadow_unlock(d);
+
+    set_timer(&sd->auto_timer, NOW() + SHADOW_AUTO_PERIOD);
+}
+
 /* Return the size of the shadow pool, rounded up to the nearest MB */
 static unsigned int shadow_get_allocation(struct domain *d)
 {
@@ -1866,18 +1960,31 @@ static unsigned int shadow_get_allocation(struct domain *d)
  * The table itself is an array of pointers to shadows; the shadows are then 
  * threaded on a singly-linked list of shadows with the same hash value */
 
-#define SHADOW_HASH_BUCKETS 251
-/* Other possibly useful primes are 509, 1021, 2039, 4093, 8191, 16381 */
+/* The table is sized with the shadow pool, at roughly one bucket for every
+ * four shadow pages, using the largest of these primes that fits. */
+static const unsigned int shadow_hash_sizes[] = {
+    251, 509, 1021, 2039, 4093, 8191, 16381, 32749, 65521
+};
+
+static unsigned int shadow_hash_buckets(struct domain *d)
+{
+    unsigned int i, target = d->arch.paging.shadow.total_pages / 4;
+
+    for ( i = 1; i < ARRAY_SIZE(shadow_hash_sizes); i++ )
+        if ( shadow_hash_sizes[i] > target )
+            break;
+    return shadow_hash_sizes[i - 1];
+}
 
 /* Hash function that takes a gfn or mfn, plus another byte of type info */
 typedef u32 key_t;
-static inline key_t sh_hash(unsigned long n, unsigned int t) 
+static inline key_t sh_hash(struct domain *d, unsigned long n, unsigned int t)
 {
     unsigned char *p = (unsigned char *)&n;
     key_t k = t;
     int i;
     for ( i = 0; i < sizeof(n) ; i++ ) k = (u32)p[i] + (k<<6) + (k<<16) - k;
-    return k % SHADOW_HASH_BUCKETS;
+    return k % d->arch.paging.shadow.hash_buckets;
 }
 
 #if SHADOW_AUDIT & (SHADOW_AUDIT_HASH|SHADOW_AUDIT_HASH_FULL)
@@ -1901,7 +2008,7 @@ static void sh_hash_audit_bucket(struct domain *d, int bucket)
         BUG_ON( sp->u.sh.type == 0 );
         BUG_ON( sp->u.sh.type > SH_type_max_shadow );
         /* Wrong bucket? */
-        BUG_ON( sh_hash(sp->v.sh.back, sp->u.sh.type) != bucket );
+        BUG_ON( sh_hash(d, sp->v.sh.back, sp->u.sh.type) != bucket );
         /* Duplicate entry? */
         for ( x = next_shadow(sp); x; x = next_shadow(x) )
             BUG_ON( x->v.sh.back == sp->v.sh.back &&
@@ -1966,7 +2073,7 @@ static void sh_hash_audit(struct domain *d)
     if ( !(SHADOW_AUDIT_ENABLE) )
         return;
 
-    for ( i = 0; i < SHADOW_HASH_BUCKETS; i++ ) 
+    for ( i = 0; i < d->arch.paging.shadow.hash_buckets; i++ ) 
     {
         sh_hash_audit_bucket(d, i);
     }
@@ -1981,18 +2088,88 @@ static void sh_hash_audit(struct domain *d)
 static int shadow_hash_alloc(struct domain *d)
 {
     struct page_info **table;
+    unsigned int buckets = shadow_hash_buckets(d);
 
     ASSERT(shadow_locked_by_me(d));
     ASSERT(!d->arch.paging.shadow.hash_table);
 
-    table = xmalloc_array(struct page_info *, SHADOW_HASH_BUCKETS);
+    table = xmalloc_array(struct page_info *, buckets);
     if ( !table ) return 1;
     memset(table, 0, 
-           SHADOW_HASH_BUCKETS * sizeof (struct page_info *));
+           buckets * sizeof (struct page_info *));
     d->arch.paging.shadow.hash_table = table;
+    d->arch.paging.shadow.hash_buckets = buckets;
     return 0;
 }
 
+/* Move every entry into a table sized for the current shadow pool.
+ * If the new table can't be allocated we just keep the old one. */
+static void shadow_hash_resize(struct domain *d)
+{
+    struct page_info **old = d->arch.paging.shadow.hash_table;
+    struct page_info **table, *sp, *next;
+    unsigned int i, old_buckets = d->arch.paging.shadow.hash_buckets;
+    unsigned int buckets = shadow_hash_buckets(d);
+    key_t key;
+
+    ASSERT(shadow_locked_by_me(d));
+
+    if ( !old || (buckets == old_buckets) ||
+         d->arch.paging.shadow.hash_walking )
+        return;
+
+    table = xmalloc_array(struct page_info *, buckets);
+    if ( !table )
+        return;
+    memset(table, 0, buckets * sizeof (struct page_info *));
+
+    d->arch.paging.shadow.hash_table = table;
+    d->arch.paging.shadow.hash_buckets = buckets;
+    for ( i = 0; i < old_buckets; i++ )
+    {
+        for ( sp = old[i]; sp; sp = next )
+        {
+            next = next_shadow(sp);
+            key = sh_hash(d, sp->v.sh.back, sp->u.sh.type);
+            set_next_shadow(sp, table[key]);
+            table[key] = sp;
+        }
+    }
+    xfree(old);
+
+    perfc_incr(shadow_hash_resizes);
+    SHADOW_PRINTK("d=%u: %u -> %u buckets\n",
+                  d->domain_id, old_buckets, buckets);
+    sh_hash_audit(d);
+}
+
+/* Forget any cached lookups of smfn, or of everything if smfn is invalid */
+static void sh_hash_mru_flush(struct domain *d, mfn_t smfn)
+{
+    struct vcpu *v;
+    int i;
+
+    for_each_vcpu ( d, v )
+        for ( i = 0; i < SHADOW_HASH_MRU_ENTRIES; i++ )
+            if ( !mfn_valid(smfn) ||
+                 (mfn_x(v->arch.paging.shadow.hash_mru[i].smfn) ==
+                  mfn_x(smfn)) )
+                v->arch.paging.shadow.hash_mru[i].t = 0;
+}
+
+/* Record a lookup at the front of this vcpu's MRU list */
+static inline void sh_hash_mru_add(struct vcpu *v, unsigned long n,
+                                   unsigned int t, mfn_t smfn)
+{
+    struct shadow_hash_mru *mru = v->arch.paging.shadow.hash_mru;
+
+    memmove(&mru[1], &mru[0],
+            (SHADOW_HASH_MRU_ENTRIES - 1) * sizeof(*mru));
+    mru[0].n = n;
+    mru[0].t = t;
+    mru[0].smfn = smfn;
+}
+
 /* Tear down the hash table and return all memory to Xen.
  * This function does not care whether the table is populated. */
 static void shadow_hash_teardown(struct domain *d)
@@ -2000,8 +2177,10 @@ static void shadow_hash_teardown(struct domain *d)
     ASSERT(shadow_locked_by_me(d));
     ASSERT(d->arch.paging.shadow.hash_table);
 
+    sh_hash_mru_flush(d, _mfn(INVALID_MFN));
     xfree(d->arch.paging.shadow.hash_table);
     d->arch.paging.shadow.hash_table = NULL;
+    d->arch.paging.shadow.hash_buckets = 0;
 }
 
 
@@ -2010,8 +2189,12 @@ mfn_t shadow_hash_lookup(struct vcpu *v, unsigned long n, unsigned int t)
  * or INVALID_MFN if it doesn't exist */
 {
     struct domain *d = v->domain;
+    struct shadow_hash_mru *mru = v->arch.paging.shadow.hash_mru;
+    struct shadow_hash_mru hit;
     struct page_info *sp, *prev;
+    unsigned int depth = 0;
     key_t key;
+    int i;
 
     ASSERT(shadow_locked_by_me(d));
     ASSERT(d->arch.paging.shadow.hash_table);
@@ -2020,15 +2203,37 @@ mfn_t shadow_hash_lookup(struct vcpu *v, unsigned long n, unsigned int t)
     sh_hash_audit(d);
 
     perfc_incr(shadow_hash_lookups);
-    key = sh_hash(n, t);
+
+    /* The fault path tends to look up the same few shadows over and
+     * over: try this vcpu's recent lookups before hashing. */
+    for ( i = 0; i < SHADOW_HASH_MRU_ENTRIES; i++ )
+    {
+        if ( mru[i].n == n && mru[i].t == t )
+        {
+            perfc_incr(shadow_hash_mru_hit);
+            if ( i != 0 )
+            {
+                hit = mru[i];
+                memmove(&mru[1], &mru[0], i * sizeof(*mru));
+                mru[0] = hit;
+            }
+            return mru[0].smfn;
+        }
+    }
+    perfc_incr(shadow_hash_mru_miss);
+
+    key = sh_hash(d, n, t);
     sh_hash_audit_bucket(d, key);
 
     sp = d->arch.paging.shadow.hash_table[key];
     prev = NULL;
     while(sp)
     {
+        depth++;
         if ( sp->v.sh.back == n && sp->u.sh.type == t )
         {
+            perfc_incra(shadow_hash_chain, min(depth, 7u));
+            sh_hash_mru_add(v, n, t, page_to_mfn(sp));
             /* Pull-to-front if 'sp' isn't already the head item */
             if ( unlikely(sp != d->arch.paging.shadow.hash_table[key]) )
             {
@@ -2055,6 +2260,7 @@ mfn_t shadow_hash_lookup(struct vcpu *v, unsigned long n, unsigned int t)
         sp = next_shadow(sp);
     }
 
+    perfc_incra(shadow_hash_chain, min(depth, 7u));
     perfc_incr(shadow_hash_lookup_miss);
     return _mfn(INVALID_MFN);
 }
@@ -2074,7 +2280,7 @@ void shadow_hash_insert(struct vcpu *v, unsigned long n, unsigned int t,
     sh_hash_audit(d);
 
     perfc_incr(shadow_hash_inserts);
-    key = sh_hash(n, t);
+    key = sh_hash(d, n, t);
     sh_hash_audit_bucket(d, key);
     
     /* Insert this shadow at the top of the bucket */
@@ -2100,8 +2306,10 @@ void shadow_hash_delete(struct vcpu *v, unsigned long n, unsigned int t,
     sh_hash_audit(d);
 
     perfc_incr(shadow_hash_deletes);
-    key = sh_hash(n, t);
+    key = sh_hash(d, n, t);
     sh_hash_audit_bucket(d, key);
+
+    sh_hash_mru_flush(d, smfn);
     
     sp = mfn_to_page(smfn);
     if ( d->arch.paging.shadow.hash_table[key] == sp ) 
@@ -2152,7 +2360,7 @@ static void hash_foreach(struct vcpu *v,
     ASSERT(d->arch.paging.shadow.hash_walking == 0);
     d->arch.paging.shadow.hash_walking = 1;
 
-    for ( i = 0; i < SHADOW_HASH_BUCKETS; i++ ) 
+    for ( i = 0; i < d->arch.paging.shadow.hash_buckets; i++ ) 
     {
         /* WARNING: This is not safe against changes to the hash table.
          * The callback *must* return non-zero if it has inserted or
@@ -2245,7 +2453,7 @@ void sh_destroy_shadow(struct vcpu *v, mfn_t smfn)
 
 static inline void trace_shadow_wrmap_bf(mfn_t gmfn)
 {
-    if ( tb_init_done )
+    if ( tb_event_enabled(TRC_SHADOW) )
     {
         /* Convert gmfn to gfn */
         unsigned long gfn = mfn_to_gfn(current->domain, gmfn);
@@ -3169,6 +3377,10 @@ void shadow_teardown(struct domain *d)
     ASSERT(d->is_dying);
     ASSERT(d != current->domain);
 
+    /* The auto-sizing timer takes the shadow lock */
+    if ( !shadow_locked_by_me(d) )
+        kill_timer(&d->arch.paging.shadow.auto_timer);
+
     if ( !shadow_locked_by_me(d) )
         shadow_lock(d); /* Keep various asserts happy */
 
@@ -3273,6 +3485,8 @@ void shadow_teardown(struct domain *d)
 void shadow_final_teardown(struct domain *d)
 /* Called by arch_domain_destroy(), when it's safe to pull down the p2m map. */
 {
+    kill_timer(&d->arch.paging.shadow.auto_timer);
+
     SHADOW_PRINTK("dom %u final teardown starts."
                    "  Shadow pages total = %u, free = %u, p2m=%u\n",
                    d->domain_id,
@@ -3636,6 +3850,7 @@ int shadow_track_dirty_vram(struct domain *d,
         rc = -ENOMEM;
         if ( (d->dirty_vram = xmalloc(struct sh_dirty_vram)) == NULL )
             goto out;
+        memset(d->dirty_vram, 0, sizeof(*d->dirty_vram));
         d->dirty_vram->begin_pfn = begin_pfn;
         d->dirty_vram->end_pfn = end_pfn;
 
@@ -3829,6 +4044,42 @@ int shadow_domctl(struct domain *d,
             sc->mb = shadow_get_allocation(d);
         return rc;
 
+    case XEN_DOMCTL_SHADOW_OP_SET_AUTO_ALLOCATION:
+        if ( ((sc->max_mb != 0) && (sc->min_mb > sc->max_mb)) ||
+             (((uint64_t)sc->min_mb << (20 - PAGE_SHIFT)) > UINT_MAX) ||
+             (((uint64_t)sc->max_mb << (20 - PAGE_SHIFT)) > UINT_MAX) )
+            return -EINVAL;
+        shadow_lock(d);
+        d->arch.paging.shadow.auto_min_pages =
+            (uint64_t)sc->min_mb << (20 - PAGE_SHIFT);
+        d->arch.paging.shadow.auto_max_pages =
+            (uint64_t)sc->max_mb << (20 - PAGE_SHIFT);
+        d->arch.paging.shadow.auto_idle = 0;
+        d->arch.paging.shadow.auto_last_evictions =
+            d->arch.paging.shadow.evictions;
+        d->arch.paging.shadow.auto_last_faults = d->arch.paging.shadow.faults;
+        shadow_unlock(d);
+        if ( sc->max_mb != 0 )
+            set_timer(&d->arch.paging.shadow.auto_timer,
+                      NOW() + SHADOW_AUTO_PERIOD);
+        else
+            stop_timer(&d->arch.paging.shadow.auto_timer);
+        sc->mb = shadow_get_allocation(d);
+        return 0;
+
+    case XEN_DOMCTL_SHADOW_OP_GET_AUTO_ALLOCATION:
+        shadow_lock(d);
+        sc->mb = shadow_get_allocation(d);
+        sc->min_mb = d->arch.paging.shadow.auto_min_pages >> (20 - PAGE_SHIFT);
+        sc->max_mb = d->arch.paging.shadow.auto_max_pages >> (20 - PAGE_SHIFT);
+        sc->pool_stats.evictions = d->arch.paging.shadow.evictions;
+        sc->pool_stats.blows = d->arch.paging.shadow.blows;
+        sc->pool_stats.faults = d->arch.paging.shadow.faults;
+        sc->pool_stats.grows = d->arch.paging.shadow.grows;
+        sc->pool_stats.shrinks = d->arch.paging.shadow.shrinks;
+        shadow_unlock(d);
+        return 0;
+
     default:
         SHADOW_ERROR("Bad shadow op %u\n", sc->op);
         return -EINVAL;
@@ -35,6 +35,7 @@
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/cacheattr.h>
 #include <asm/mtrr.h>
+#include <asm/mem_sharing.h>
 #include <asm/guest_pt.h>
 #include <public/sched.h>
 #include "private.h"
@@ -650,8 +651,8 @@ _sh_propagate(struct vcpu *v,
             sflags &= ~_PAGE_RW;
     }
 
-    /* Read-only memory */
-    if ( p2mt == p2m_ram_ro ) 
+    /* Read-only memory, including shared pages */
+    if ( (p2mt == p2m_ram_ro) || p2m_is_shared(p2mt) )
         sflags &= ~_PAGE_RW;
     
     // protect guest page tables
@@ -2803,7 +2804,7 @@ typedef u32 guest_pa_t;
 
 static inline void trace_shadow_gen(u32 event, guest_va_t va)
 {
-    if ( tb_init_done )
+    if ( tb_event_enabled(TRC_SHADOW) )
     {
         event |= (GUEST_PAGING_LEVELS-2)<<8;
         __trace_var(event, 0/*!tsc*/, sizeof(va), (unsigned char*)&va);
@@ -2813,7 +2814,7 @@ static inline void trace_shadow_gen(u32 event, guest_va_t va)
 static inline void trace_shadow_fixup(guest_l1e_t gl1e,
                                       guest_va_t va)
 {
-    if ( tb_init_done )
+    if ( tb_event_enabled(TRC_SHADOW) )
     {
         struct {
             /* for PAE, guest_l1e may be 64 while guest_va may be 32;
@@ -2837,7 +2838,7 @@ static inline void trace_shadow_fixup(guest_l1e_t gl1e,
 static inline void trace_not_shadow_fault(guest_l1e_t gl1e,
                                           guest_va_t va)
 {
-    if ( tb_init_done )
+    if ( tb_event_enabled(TRC_SHADOW) )
     {
         struct {
             /* for PAE, guest_l1e may be 64 while guest_va may be 32;
@@ -2862,7 +2863,7 @@ static inline void trace_shadow_emulate_other(u32 event,
                                                  guest_va_t va,
                                                  gfn_t gfn)
 {
-    if ( tb_init_done )
+    if ( tb_event_enabled(TRC_SHADOW) )
     {
         struct {
             /* for PAE, guest_l1e may be 64 while guest_va may be 32;
@@ -2892,7 +2893,7 @@ static DEFINE_PER_CPU(guest_pa_t,trace_emulate_write_val);
 
 static inline void trace_shadow_emulate(guest_l1e_t gl1e, unsigned long va)
 {
-    if ( tb_init_done )
+    if ( tb_event_enabled(TRC_SHADOW) )
     {
         struct {
             /* for PAE, guest_l1e may be 64 while guest_va may be 32;
@@ -2951,6 +2952,7 @@ static int sh_page_fault(struct vcpu *v,
                   regs->eip);
 
     perfc_incr(shadow_fault);
+    d->arch.paging.shadow.faults++;
 
 #if SHADOW_OPTIMIZATIONS & SHOPT_FAST_EMULATION
     /* If faulting frame is successfully emulated in last shadow fault
@@ -3127,6 +3129,18 @@ static int sh_page_fault(struct vcpu *v,
     gfn = guest_l1e_get_gfn(gw.l1e);
     gmfn = gfn_to_mfn_guest(d, gfn, &p2mt);
 
+    /* Writing to a shared page: give the guest its own copy first, so
+     * that the shadow we build maps that. */
+    if ( p2m_is_shared(p2mt) && (ft == ft_demand_write) )
+    {
+        if ( mem_sharing_unshare_page(d, gfn_x(gfn), 0) != 0 )
+        {
+            domain_crash(d);
+            return 0;
+        }
+        gmfn = gfn_to_mfn_guest(d, gfn, &p2mt);
+    }
+
     if ( shadow_mode_refcounts(d) && 
          (!p2m_is_valid(p2mt) || (!p2m_is_mmio(p2mt) && !mfn_valid(gmfn))) )
     {
@@ -4598,6 +4612,16 @@ static mfn_t emulate_gva_to_mfn(struct vcpu *v,
         mfn = gfn_to_mfn_query(v->domain, _gfn(gfn), &p2mt);
     else
         mfn = gfn_to_mfn(v->domain, _gfn(gfn), &p2mt);
+
+    /* Writes to shared pages need a private copy, which we can't make
+     * with the shadow lock held. */
+    if ( p2m_is_shared(p2mt) )
+    {
+        if ( shadow_locked_by_me(v->domain) ||
+             (mem_sharing_unshare_page(v->domain, gfn, 0) != 0) )
+            return _mfn(BAD_GFN_TO_MFN);
+        mfn = gfn_to_mfn(v->domain, _gfn(gfn), &p2mt);
+    }
         
     if ( p2mt == p2m_ram_ro )
         return _mfn(READONLY_GFN);
@@ -4786,7 +4810,7 @@ sh_x86_emulate_write(struct vcpu *v, unsigned long vaddr, void *src,
     shadow_lock(v->domain);
     memcpy(addr, src, bytes);
 
-    if ( tb_init_done )
+    if ( tb_event_enabled(TRC_SHADOW) )
     {
 #if GUEST_PAGING_LEVELS == 3
         if ( vaddr == this_cpu(trace_emulate_initial_va) )
@@ -875,6 +875,40 @@ long do_domctl(XEN_GUEST_HANDLE(xen_domctl_t) u_domctl)
     }
     break;
 
+    case XEN_DOMCTL_getnodepages:
+    {
+        struct domain *d;
+        unsigned int i, nr = op->u.getnodepages.nr_nodes;
+        uint64_t pages;
+
+        ret = -ESRCH;
+        d = rcu_lock_domain_by_id(op->domain);
+        if ( d == NULL )
+            break;
+
+        ret = xsm_getdomaininfo(d);
+        if ( ret )
+            goto getnodepages_out;
+
+        for ( i = 0; (i < nr) && (i < MAX_NUMNODES); i++ )
+        {
+            pages = d->node_pages[i];
+            if ( copy_to_guest_offset(op->u.getnodepages.pages, i, &pages, 1) )
+            {
+                ret = -EFAULT;
+                goto getnodepages_out;
+            }
+        }
+
+        op->u.getnodepages.nr_nodes = MAX_NUMNODES;
+        if ( copy_to_guest(u_domctl, op, 1) )
+            ret = -EFAULT;
+
+    getnodepages_out:
+        rcu_unlock_domain(d);
+    }
+    break;
+
     case XEN_DOMCTL_subscribe:
     {
         struct domain *d;
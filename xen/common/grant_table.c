@@ -35,6 +35,9 @@
 #include <xen/iommu.h>
 #include <xen/paging.h>
 #include <xsm/xsm.h>
+#ifdef CONFIG_X86
+#include <asm/mem_sharing.h>
+#endif
 
 #ifndef max_nr_grant_frames
 unsigned int max_nr_grant_frames = DEFAULT_MAX_NR_GRANT_FRAMES;
@@ -111,6 +114,21 @@ static unsigned inline int max_nr_maptrack_frames(void)
 #define active_entry(t, e) \
     ((t)->active[(e)/ACGNT_PER_PAGE][(e)%ACGNT_PER_PAGE])
 
+/* Granted frames are referenced (and maybe written) by other domains, so
+ * they cannot stay shared copy-on-write behind the granting domain. */
+static inline unsigned long
+gnttab_gmfn_to_mfn(
+    struct domain *d, unsigned long gmfn)
+{
+#ifdef CONFIG_X86
+    p2m_type_t p2mt;
+
+    if ( paging_mode_translate(d) )
+        (void)gfn_to_mfn_unshare(d, gmfn, &p2mt);
+#endif
+    return gmfn_to_mfn(d, gmfn);
+}
+
 static inline int
 __get_maptrack_handle(
     struct grant_table *t)
@@ -317,7 +335,7 @@ __gnttab_map_grant_ref(
         {
             act->domid = scombo.shorts.domid;
             act->gfn = sha->frame;
-            act->frame = gmfn_to_mfn(rd, sha->frame);
+            act->frame = gnttab_gmfn_to_mfn(rd, sha->frame);
         }
     }
 
@@ -1199,6 +1217,7 @@ gnttab_transfer(
         /* Okay, add the page to 'e'. */
         if ( unlikely(e->tot_pages++ == 0) )
             get_knownalive_domain(e);
+        domain_adjust_node_pages(e, page, 1);
         page_list_add_tail(page, &e->page_list);
         page_set_owner(page, e);
 
@@ -1344,7 +1363,7 @@ __acquire_grant_for_copy(
         {
             act->domid = scombo.shorts.domid;
             act->gfn = sha->frame;
-            act->frame = gmfn_to_mfn(rd, sha->frame);
+            act->frame = gnttab_gmfn_to_mfn(rd, sha->frame);
         }
     }
 
@@ -1408,7 +1427,7 @@ __gnttab_copy(
     }
     else
     {
-        s_frame = gmfn_to_mfn(sd, op->source.u.gmfn);
+        s_frame = gnttab_gmfn_to_mfn(sd, op->source.u.gmfn);
     }
     if ( unlikely(!mfn_valid(s_frame)) )
         PIN_FAIL(error_out, GNTST_general_error,
@@ -1431,7 +1450,7 @@ __gnttab_copy(
     }
     else
     {
-        d_frame = gmfn_to_mfn(dd, op->dest.u.gmfn);
+        d_frame = gnttab_gmfn_to_mfn(dd, op->dest.u.gmfn);
     }
     if ( unlikely(!mfn_valid(d_frame)) )
         PIN_FAIL(error_out, GNTST_general_error,
@@ -24,6 +24,9 @@
 #include <xen/numa.h>
 #include <public/memory.h>
 #include <xsm/xsm.h>
+#ifdef CONFIG_X86
+#include <asm/mem_sharing.h>
+#endif
 
 struct memop_args {
     /* INPUT */
@@ -153,6 +156,19 @@ int guest_remove_page(struct domain *d, unsigned long gmfn)
     struct page_info *page;
     unsigned long mfn;
 
+#ifdef CONFIG_X86
+    /* Shared frames belong to dom_cow: just drop this gfn's mapping. */
+    if ( paging_mode_translate(d) )
+    {
+        p2m_type_t p2mt;
+
+        (void)gfn_to_mfn_query(d, gmfn, &p2mt);
+        if ( p2m_is_shared(p2mt) )
+            return (mem_sharing_unshare_page(d, gmfn,
+                                             MEM_SHARING_DESTROY_GFN) == 0);
+    }
+#endif
+
     mfn = gmfn_to_mfn(d, gmfn);
     if ( unlikely(!mfn_valid(mfn)) )
     {
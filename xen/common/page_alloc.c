@@ -1133,6 +1133,7 @@ int assign_pages(
             get_knownalive_domain(d);
 
         d->tot_pages += 1 << order;
+        domain_adjust_node_pages(d, pg, 1 << order);
     }
 
     for ( i = 0; i < (1 << order); i++ )
@@ -1154,6 +1155,14 @@ int assign_pages(
 }
 
 
+/* Keep d->node_pages[] in step with d->tot_pages.  The nr pages from pg
+ * onwards are contiguous, and so all on one node. */
+void domain_adjust_node_pages(struct domain *d, struct page_info *pg, int nr)
+{
+    ASSERT(spin_is_locked(&d->page_alloc_lock));
+    d->node_pages[phys_to_nid(page_to_maddr(pg))] += nr;
+}
+
 struct page_info *alloc_domheap_pages(
     struct domain *d, unsigned int order, unsigned int memflags)
 {
@@ -1219,6 +1228,7 @@ void free_domheap_pages(struct page_info *pg, unsigned int order)
         }
 
         d->tot_pages -= 1 << order;
+        domain_adjust_node_pages(d, pg, -(1 << order));
         drop_dom_ref = (d->tot_pages == 0);
 
         spin_unlock_recursive(&d->page_alloc_lock);
@@ -19,6 +19,7 @@
 #include <xen/perfc.h>
 #include <xen/sched-if.h>
 #include <xen/softirq.h>
+#include <xen/numa.h>
 #include <asm/atomic.h>
 #include <xen/errno.h>
 
@@ -49,6 +50,10 @@
     (CSCHED_CREDITS_PER_TICK * CSCHED_TICKS_PER_TSLICE)
 #define CSCHED_CREDITS_PER_ACCT     \
     (CSCHED_CREDITS_PER_TICK * CSCHED_TICKS_PER_ACCT)
+#define CSCHED_NSECS_PER_CREDIT     \
+    (MILLISECS(CSCHED_MSECS_PER_TICK) / CSCHED_CREDITS_PER_TICK)
+#define CSCHED_DEFAULT_LATENCY_US   1000
+#define CSCHED_MIN_BOOST_SLICE      MICROSECS(50)
 
 
 /*
@@ -66,6 +71,23 @@
 #define CSCHED_FLAG_VCPU_PARKED 0x0001  /* VCPU over capped credits */
 
 
+/*
+ * Load balancing domains
+ *
+ * Each PCPU looks for work to steal in widening circles of peers: first its
+ * hyperthread siblings, then the other cores of its package, then the rest
+ * of its NUMA node and finally the whole system. Each level's mask includes
+ * the levels below it.  The package stands in for the last-level cache,
+ * which it matches on single-LLC parts; cpu_core_map is the finest level
+ * above SMT that the topology code provides.
+ */
+#define CSCHED_BALANCE_SMT      0       /* hyperthread siblings */
+#define CSCHED_BALANCE_PKG      1       /* cores of the same package */
+#define CSCHED_BALANCE_NODE     2       /* CPUs on the same NUMA node */
+#define CSCHED_BALANCE_SYSTEM   3       /* all online CPUs */
+#define CSCHED_BALANCE_LEVELS   4
+
+
 /*
  * Useful macros
  */
@@ -110,6 +132,8 @@ struct csched_pcpu {
     uint32_t runq_sort_last;
     struct timer ticker;
     unsigned int tick;
+    cpumask_t balance_mask[CSCHED_BALANCE_LEVELS];
+    s_time_t remote_steal_last;
 };
 
 /*
@@ -121,8 +145,12 @@ struct csched_vcpu {
     struct csched_dom *sdom;
     struct vcpu *vcpu;
     atomic_t credit;
+    s_time_t start_time;   /* when we last started running or accounting */
+    s_time_t residual;     /* run time not yet converted to credits */
+    s_time_t boost_time;   /* run time since we were last boosted */
     uint16_t flags;
     int16_t pri;
+    bool_t yielding;       /* step aside at the next schedule; own cpu only */
 #ifdef CSCHED_STATS
     struct {
         int credit_last;
@@ -145,6 +173,7 @@ struct csched_dom {
     uint16_t active_vcpu_count;
     uint16_t weight;
     uint16_t cap;
+    uint16_t latency;
 };
 
 /*
@@ -257,11 +286,36 @@ __runq_tickle(unsigned int cpu, struct csched_vcpu *new)
         cpumask_raise_softirq(mask, SCHEDULE_SOFTIRQ);
 }
 
+/*
+ * (Re)build the load balancing domains of a PCPU from the CPU topology.
+ * Topology information is only complete once all secondary CPUs have been
+ * brought up, so this is called again when the tickers are started, and
+ * for every PCPU whenever a CPU is brought up later.
+ */
+static void
+csched_pcpu_build_domains(int cpu)
+{
+    struct csched_pcpu * const spc = CSCHED_PCPU(cpu);
+    cpumask_t *mask = spc->balance_mask;
+
+    mask[CSCHED_BALANCE_SMT] = cpu_sibling_map[cpu];
+    cpu_set(cpu, mask[CSCHED_BALANCE_SMT]);
+
+    cpus_or(mask[CSCHED_BALANCE_PKG], mask[CSCHED_BALANCE_SMT],
+            cpu_core_map[cpu]);
+
+    cpus_or(mask[CSCHED_BALANCE_NODE], mask[CSCHED_BALANCE_PKG],
+            node_to_cpumask(cpu_to_node(cpu)));
+
+    cpus_setall(mask[CSCHED_BALANCE_SYSTEM]);
+}
+
 static int
 csched_pcpu_init(int cpu)
 {
     struct csched_pcpu *spc;
     unsigned long flags;
+    int i;
 
     /* Allocate per-PCPU info */
     spc = xmalloc(struct csched_pcpu);
@@ -280,8 +334,15 @@ csched_pcpu_init(int cpu)
     init_timer(&spc->ticker, csched_tick, (void *)(unsigned long)cpu, cpu);
     INIT_LIST_HEAD(&spc->runq);
     spc->runq_sort_last = csched_priv.runq_sort;
+    spc->remote_steal_last = 0;
     per_cpu(schedule_data, cpu).sched_priv = spc;
 
+    /* A new CPU changes its siblings' topology masks as well as its own. */
+    for_each_online_cpu ( i )
+        if ( per_cpu(schedule_data, i).sched_priv != NULL )
+            csched_pcpu_build_domains(i);
+    csched_pcpu_build_domains(cpu);
+
     /* Start off idling... */
     BUG_ON(!is_idle_vcpu(per_cpu(schedule_data, cpu).curr));
     cpu_set(cpu, csched_priv.idlers);
@@ -336,6 +397,15 @@ unsigned int get_vcpu_migration_delay(void)
     return vcpu_migration_delay;
 }
 
+/*
+ * Minimum delay, in microseconds, between two steals by the same PCPU from
+ * a runqueue on another NUMA node. Cross-node migration leaves the VCPU
+ * away from its memory and cache footprint, so we don't want idle PCPUs to
+ * keep pulling work over the interconnect. 0 disables the rate limit.
+ */
+static unsigned int sched_node_steal_delay = 10000;
+integer_param("sched_node_steal_delay", sched_node_steal_delay);
+
 static inline int
 __csched_vcpu_is_cache_hot(struct vcpu *v)
 {
@@ -394,6 +464,23 @@ csched_cpu_pick(struct vcpu *vc)
     cpus_and(cpus, cpus, idlers);
     cpu_clear(cpu, cpus);
 
+    /*
+     * If there is an idler on the same NUMA node as the current processor,
+     * don't consider idlers on other nodes: moving there would separate the
+     * VCPU from its caches and, usually, from its memory.
+     */
+    if ( !cpus_empty(cpus) )
+    {
+        cpumask_t node_idlers;
+
+        cpus_and(node_idlers, cpus,
+                 CSCHED_PCPU(cpu)->balance_mask[CSCHED_BALANCE_NODE]);
+        if ( !cpus_empty(node_idlers) )
+            cpus = node_idlers;
+        else
+            CSCHED_STAT_CRANK(pick_cpu_remote_node);
+    }
+
     while ( !cpus_empty(cpus) )
     {
         cpumask_t cpu_idlers;
@@ -477,6 +564,65 @@ __csched_vcpu_acct_stop_locked(struct csched_vcpu *svc)
     }
 }
 
+/*
+ * Debit the running VCPU for the time it actually ran since we last looked
+ * at it, rather than a full tick's worth of credits whenever the tick
+ * happens to land on it. Time that doesn't add up to a whole credit is
+ * carried over to the next call.
+ *
+ * This is also where a boosted VCPU loses its boost: it may run for up to
+ * its domain's latency budget after waking before being treated like any
+ * other VCPU with credits left.
+ */
+static void
+csched_burn_credits(struct csched_vcpu *svc, s_time_t now)
+{
+    s_time_t delta;
+    unsigned int credits;
+    unsigned int latency;
+
+    ASSERT( svc == CSCHED_VCPU(per_cpu(schedule_data,
+                                       svc->vcpu->processor).curr) );
+    ASSERT( svc->sdom != NULL );
+
+    delta = now - svc->start_time;
+    if ( delta <= 0 )
+        return;
+    svc->start_time = now;
+
+    svc->residual += delta;
+    credits = svc->residual / CSCHED_NSECS_PER_CREDIT;
+    if ( credits != 0 )
+    {
+        svc->residual -= (s_time_t)credits * CSCHED_NSECS_PER_CREDIT;
+        atomic_sub(credits, &svc->credit);
+    }
+
+    if ( svc->pri == CSCHED_PRI_TS_BOOST )
+    {
+        latency = svc->sdom->latency ? : CSCHED_DEFAULT_LATENCY_US;
+        svc->boost_time += delta;
+        if ( svc->boost_time >= MICROSECS(latency) )
+        {
+            CSCHED_STAT_CRANK(vcpu_unboost);
+            svc->pri = CSCHED_PRI_TS_UNDER;
+        }
+    }
+}
+
+/*
+ * Boosted run time a VCPU has left. Its time slice is cut to this, so the
+ * boost ends within the latency budget rather than at the next tick.
+ */
+static inline s_time_t
+csched_boost_left(const struct csched_vcpu *svc)
+{
+    unsigned int latency = svc->sdom->latency ? : CSCHED_DEFAULT_LATENCY_US;
+
+    return (svc->boost_time < MICROSECS(latency))
+           ? MICROSECS(latency) - svc->boost_time : 0;
+}
+
 static void
 csched_vcpu_acct(unsigned int cpu)
 {
@@ -486,17 +632,10 @@ csched_vcpu_acct(unsigned int cpu)
     ASSERT( svc->sdom != NULL );
 
     /*
-     * If this VCPU's priority was boosted when it last awoke, reset it.
-     * If the VCPU is found here, then it's consuming a non-negligeable
-     * amount of CPU resources and should no longer be boosted.
-     */
-    if ( svc->pri == CSCHED_PRI_TS_BOOST )
-        svc->pri = CSCHED_PRI_TS_UNDER;
-
-    /*
-     * Update credits
+     * Update credits, and drop the boost of VCPUs that have been running
+     * for longer than their latency budget.
      */
-    atomic_sub(CSCHED_CREDITS_PER_TICK, &svc->credit);
+    csched_burn_credits(svc, NOW());
 
     /*
      * Put this VCPU and domain back on the active list if it was
@@ -538,8 +677,12 @@ csched_vcpu_init(struct vcpu *vc)
     svc->sdom = sdom;
     svc->vcpu = vc;
     atomic_set(&svc->credit, 0);
+    svc->start_time = NOW();
+    svc->residual = 0;
+    svc->boost_time = 0;
     svc->flags = 0U;
     svc->pri = is_idle_domain(dom) ? CSCHED_PRI_IDLE : CSCHED_PRI_TS_UNDER;
+    svc->yielding = 0;
     CSCHED_VCPU_STATS_RESET(svc);
     vc->sched_priv = svc;
 
@@ -629,7 +772,8 @@ csched_vcpu_wake(struct vcpu *vc)
      *
      * This allows wake-to-run latency sensitive VCPUs to preempt
      * more CPU resource intensive VCPUs without impacting overall 
-     * system fairness.
+     * system fairness. How long a VCPU may run before losing its boost
+     * is set per domain (see csched_burn_credits()).
      *
      * The one exception is for VCPUs of capped domains unpausing
      * after earning credits they had overspent. We don't boost
@@ -639,6 +783,7 @@ csched_vcpu_wake(struct vcpu *vc)
          !(svc->flags & CSCHED_FLAG_VCPU_PARKED) )
     {
         svc->pri = CSCHED_PRI_TS_BOOST;
+        svc->boost_time = 0;
     }
 
     /* Put the VCPU on the runq and tickle CPUs */
@@ -646,6 +791,41 @@ csched_vcpu_wake(struct vcpu *vc)
     __runq_tickle(cpu, svc);
 }
 
+static void
+csched_vcpu_yield(struct vcpu *vc, struct vcpu *target)
+{
+    struct csched_vcpu * const svc = CSCHED_VCPU(vc);
+    struct csched_vcpu *stgt;
+    unsigned long flags;
+
+    CSCHED_STAT_CRANK(vcpu_yield);
+
+    /* Let csched_schedule() prefer any other work queued on this CPU. */
+    svc->yielding = 1;
+
+    if ( target == NULL )
+        return;
+
+    /*
+     * Boost the sibling we are yielding to, as if it had just woken up,
+     * so that it preempts whatever is running on its CPU.  As with wake,
+     * vcpus over their credit or parked by a cap are left alone.
+     */
+    stgt = CSCHED_VCPU(target);
+    vcpu_schedule_lock_irqsave(target, flags);
+    if ( __vcpu_on_runq(stgt) && (stgt->pri == CSCHED_PRI_TS_UNDER) &&
+         !(stgt->flags & CSCHED_FLAG_VCPU_PARKED) )
+    {
+        CSCHED_STAT_CRANK(vcpu_yield_boost);
+        __runq_remove(stgt);
+        stgt->pri = CSCHED_PRI_TS_BOOST;
+        stgt->boost_time = 0;
+        __runq_insert(target->processor, stgt);
+        __runq_tickle(target->processor, stgt);
+    }
+    vcpu_schedule_unlock_irqrestore(target, flags);
+}
+
 static int
 csched_dom_cntl(
     struct domain *d,
@@ -654,10 +834,15 @@ csched_dom_cntl(
     struct csched_dom * const sdom = CSCHED_DOM(d);
     unsigned long flags;
 
+    /* There is no admission control: any parameters are acceptable. */
+    if ( op->cmd == XEN_DOMCTL_SCHEDOP_admit )
+        return 0;
+
     if ( op->cmd == XEN_DOMCTL_SCHEDOP_getinfo )
     {
         op->u.credit.weight = sdom->weight;
         op->u.credit.cap = sdom->cap;
+        op->u.credit.latency = sdom->latency;
     }
     else
     {
@@ -678,6 +863,9 @@ csched_dom_cntl(
         if ( op->u.credit.cap != (uint16_t)~0U )
             sdom->cap = op->u.credit.cap;
 
+        if ( op->u.credit.latency != (uint16_t)~0U )
+            sdom->latency = op->u.credit.latency;
+
         spin_unlock_irqrestore(&csched_priv.lock, flags);
     }
 
@@ -705,6 +893,7 @@ csched_dom_init(struct domain *dom)
     sdom->dom = dom;
     sdom->weight = CSCHED_DEFAULT_WEIGHT;
     sdom->cap = 0U;
+    sdom->latency = 0U;
     dom->sched_priv = sdom;
 
     return 0;
@@ -1042,9 +1231,11 @@ csched_runq_steal(int peer_cpu, int cpu, int pri)
 static struct csched_vcpu *
 csched_load_balance(int cpu, struct csched_vcpu *snext)
 {
+    struct csched_pcpu * const spc = CSCHED_PCPU(cpu);
     struct csched_vcpu *speer;
-    cpumask_t workers;
-    int peer_cpu;
+    cpumask_t workers, visited, level_workers;
+    int peer_cpu, level;
+    s_time_t now;
 
     BUG_ON( cpu != snext->vcpu->processor );
 
@@ -1060,38 +1251,82 @@ csched_load_balance(int cpu, struct csched_vcpu *snext)
         CSCHED_STAT_CRANK(load_balance_other);
 
     /*
-     * Peek at non-idling CPUs in the system, starting with our
-     * immediate neighbour.
+     * Peek at non-idling CPUs in the system, one balancing domain at a
+     * time, starting with the CPUs we share the most cache with.
      */
     cpus_andnot(workers, cpu_online_map, csched_priv.idlers);
     cpu_clear(cpu, workers);
-    peer_cpu = cpu;
+    cpus_clear(visited);
+    cpu_set(cpu, visited);
 
-    while ( !cpus_empty(workers) )
+    for ( level = 0; level < CSCHED_BALANCE_LEVELS; level++ )
     {
-        peer_cpu = cycle_cpu(peer_cpu, workers);
-        cpu_clear(peer_cpu, workers);
+        cpus_and(level_workers, workers, spc->balance_mask[level]);
+        cpus_andnot(level_workers, level_workers, visited);
+        cpus_or(visited, visited, spc->balance_mask[level]);
+
+        if ( cpus_empty(level_workers) )
+            continue;
 
         /*
-         * Get ahold of the scheduler lock for this peer CPU.
-         *
-         * Note: We don't spin on this lock but simply try it. Spinning could
-         * cause a deadlock if the peer CPU is also load balancing and trying
-         * to lock this CPU.
+         * Rate limit steals from other NUMA nodes.
          */
-        if ( !spin_trylock(&per_cpu(schedule_data, peer_cpu).schedule_lock) )
+        if ( level == CSCHED_BALANCE_SYSTEM && sched_node_steal_delay != 0 )
         {
-            CSCHED_STAT_CRANK(steal_trylock_failed);
-            continue;
+            now = NOW();
+            if ( (now - spc->remote_steal_last) <
+                 MICROSECS(sched_node_steal_delay) )
+            {
+                CSCHED_STAT_CRANK(steal_remote_ratelimit);
+                break;
+            }
         }
 
-        /*
-         * Any work over there to steal?
-         */
-        speer = csched_runq_steal(peer_cpu, cpu, snext->pri);
-        spin_unlock(&per_cpu(schedule_data, peer_cpu).schedule_lock);
-        if ( speer != NULL )
-            return speer;
+        peer_cpu = cpu;
+        while ( !cpus_empty(level_workers) )
+        {
+            peer_cpu = cycle_cpu(peer_cpu, level_workers);
+            cpu_clear(peer_cpu, level_workers);
+
+            /*
+             * Get ahold of the scheduler lock for this peer CPU.
+             *
+             * Note: We don't spin on this lock but simply try it. Spinning
+             * could cause a deadlock if the peer CPU is also load balancing
+             * and trying to lock this CPU.
+             */
+            if ( !spin_trylock(&per_cpu(schedule_data, peer_cpu).schedule_lock) )
+            {
+                CSCHED_STAT_CRANK(steal_trylock_failed);
+                continue;
+            }
+
+            /*
+             * Any work over there to steal?
+             */
+            speer = csched_runq_steal(peer_cpu, cpu, snext->pri);
+            spin_unlock(&per_cpu(schedule_data, peer_cpu).schedule_lock);
+            if ( speer != NULL )
+            {
+                switch ( level )
+                {
+                case CSCHED_BALANCE_SMT:
+                    CSCHED_STAT_CRANK(steal_smt);
+                    break;
+                case CSCHED_BALANCE_PKG:
+                    CSCHED_STAT_CRANK(steal_pkg);
+                    break;
+                case CSCHED_BALANCE_NODE:
+                    CSCHED_STAT_CRANK(steal_node);
+                    break;
+                default:
+                    CSCHED_STAT_CRANK(steal_remote);
+                    spc->remote_steal_last = NOW();
+                    break;
+                }
+                return speer;
+            }
+        }
     }
 
  out:
@@ -1116,6 +1351,10 @@ csched_schedule(s_time_t now)
     CSCHED_STAT_CRANK(schedule);
     CSCHED_VCPU_CHECK(current);
 
+    /* Charge the outgoing VCPU for the time it actually ran. */
+    if ( !is_idle_vcpu(current) )
+        csched_burn_credits(scurr, now);
+
     /*
      * Select next runnable local VCPU (ie top of local runq)
      */
@@ -1126,6 +1365,18 @@ csched_schedule(s_time_t now)
 
     snext = __runq_elem(runq->next);
 
+    /*
+     * A yielding VCPU goes behind the next runnable VCPU on the runq, even
+     * one of lower priority, but never gives way to the idle VCPU.
+     */
+    if ( unlikely(scurr->yielding) )
+    {
+        scurr->yielding = 0;
+        if ( (snext == scurr) && (runq->next->next != runq) &&
+             (__runq_elem(runq->next->next)->pri > CSCHED_PRI_IDLE) )
+            snext = __runq_elem(runq->next->next);
+    }
+
     /*
      * SMP Load balance:
      *
@@ -1153,11 +1404,18 @@ csched_schedule(s_time_t now)
         cpu_clear(cpu, csched_priv.idlers);
     }
 
+    if ( !is_idle_vcpu(snext->vcpu) )
+        snext->start_time = now;
+
     /*
      * Return task to run next...
      */
     ret.time = (is_idle_vcpu(snext->vcpu) ?
                 -1 : MILLISECS(CSCHED_MSECS_PER_TSLICE));
+    if ( (snext->pri == CSCHED_PRI_TS_BOOST) &&
+         (csched_boost_left(snext) < ret.time) )
+        ret.time = max_t(s_time_t, csched_boost_left(snext),
+                         CSCHED_MIN_BOOST_SLICE);
     ret.task = snext->vcpu;
 
     CSCHED_VCPU_CHECK(ret.task);
@@ -1178,7 +1436,8 @@ csched_dump_vcpu(struct csched_vcpu *svc)
 
     if ( sdom )
     {
-        printk(" credit=%i [w=%u]", atomic_read(&svc->credit), sdom->weight);
+        printk(" credit=%i [w=%u,l=%u]", atomic_read(&svc->credit),
+               sdom->weight, sdom->latency);
 #ifdef CSCHED_STATS
         printk(" (%d+%u) {a/i=%u/%u m=%u+%u}",
                 svc->stats.credit_last,
@@ -1208,7 +1467,10 @@ csched_dump_pcpu(int cpu)
     cpumask_scnprintf(cpustr, sizeof(cpustr), cpu_sibling_map[cpu]);
     printk(" sort=%d, sibling=%s, ", spc->runq_sort_last, cpustr);
     cpumask_scnprintf(cpustr, sizeof(cpustr), cpu_core_map[cpu]);
-    printk("core=%s\n", cpustr);
+    printk("core=%s, ", cpustr);
+    cpumask_scnprintf(cpustr, sizeof(cpustr),
+                      spc->balance_mask[CSCHED_BALANCE_NODE]);
+    printk("node=%s\n", cpustr);
 
     /* current VCPU */
     svc = CSCHED_VCPU(per_cpu(schedule_data, cpu).curr);
@@ -1247,9 +1509,11 @@ csched_dump(void)
            "\tdefault-weight     = %d\n"
            "\tmsecs per tick     = %dms\n"
            "\tcredits per tick   = %d\n"
+           "\tdefault latency    = %dus\n"
            "\tticks per tslice   = %d\n"
            "\tticks per acct     = %d\n"
-           "\tmigration delay    = %uus\n",
+           "\tmigration delay    = %uus\n"
+           "\tnode steal delay   = %uus\n",
            csched_priv.ncpus,
            csched_priv.master,
            csched_priv.credit,
@@ -1259,9 +1523,11 @@ csched_dump(void)
            CSCHED_DEFAULT_WEIGHT,
            CSCHED_MSECS_PER_TICK,
            CSCHED_CREDITS_PER_TICK,
+           CSCHED_DEFAULT_LATENCY_US,
            CSCHED_TICKS_PER_TSLICE,
            CSCHED_TICKS_PER_ACCT,
-           vcpu_migration_delay);
+           vcpu_migration_delay,
+           sched_node_steal_delay);
 
     cpumask_scnprintf(idlers_buf, sizeof(idlers_buf), csched_priv.idlers);
     printk("idlers: %s\n", idlers_buf);
@@ -1311,6 +1577,7 @@ static __init int csched_start_tickers(void)
     for_each_online_cpu ( cpu )
     {
         spc = CSCHED_PCPU(cpu);
+        csched_pcpu_build_domains(cpu);
         set_timer(&spc->ticker, NOW() + MILLISECS(CSCHED_MSECS_PER_TICK));
     }
 
@@ -1357,6 +1624,7 @@ struct scheduler sched_credit_def = {
 
     .sleep          = csched_vcpu_sleep,
     .wake           = csched_vcpu_wake,
+    .yield          = csched_vcpu_yield,
 
     .adjust         = csched_dom_cntl,
 
@@ -0,0 +1,847 @@
+/****************************************************************************
+ * Global EDF scheduler with constant bandwidth servers
+ ****************************************************************************
+ *
+ *        File: common/sched_rt.c
+ *
+ * Description: Global (multi-core) earliest deadline first scheduler.
+ *
+ * Each VCPU of a domain with a reservation is a hard constant bandwidth
+ * server (CBS): it may run for 'budget' nanoseconds in every 'period', and
+ * is scheduled by its current server deadline on any PCPU in its affinity
+ * mask. A VCPU which has exhausted its budget waits for replenishment at
+ * its deadline. Reservations are subject to admission control so that the
+ * real-time VCPUs remain schedulable on the online PCPUs.
+ *
+ * Domains without a reservation are best-effort: their VCPUs share, in
+ * round-robin order, whatever CPU time is left over by real-time VCPUs.
+ */
+
+#include <xen/config.h>
+#include <xen/init.h>
+#include <xen/lib.h>
+#include <xen/sched.h>
+#include <xen/domain.h>
+#include <xen/time.h>
+#include <xen/timer.h>
+#include <xen/perfc.h>
+#include <xen/sched-if.h>
+#include <xen/softirq.h>
+#include <xen/errno.h>
+
+
+/*
+ * Basic constants
+ */
+#define RT_MIN_PERIOD           MICROSECS(100)
+#define RT_MAX_PERIOD           SECONDS(1)
+#define RT_MIN_BUDGET           MICROSECS(10)
+#define RT_BE_TSLICE            MILLISECS(10)   /* best-effort time slice */
+#define RT_RETRY_DELAY          MICROSECS(50)
+
+/* Utilisations are fixed point fractions of one PCPU. */
+#define RT_UTIL_SHIFT           20
+#define RT_UTIL_ONE             (1ULL << RT_UTIL_SHIFT)
+
+
+/*
+ * Flags
+ */
+#define RT_FLAG_DEPLETED        0x0001  /* waiting for budget replenishment */
+
+
+/*
+ * Useful macros
+ */
+#define RT_VCPU(_vcpu)  ((struct rt_vcpu *) (_vcpu)->sched_priv)
+#define RT_DOM(_dom)    ((struct rt_dom *) (_dom)->sched_priv)
+
+
+/*
+ * Virtual CPU
+ */
+struct rt_vcpu {
+    struct list_head q_elem;    /* on runq, depletedq or beq */
+    struct rt_dom *sdom;
+    struct vcpu *vcpu;
+    s_time_t cur_budget;        /* budget left in the current period */
+    s_time_t cur_deadline;      /* current server deadline */
+    s_time_t last_start;        /* when we last started running */
+    uint16_t flags;
+    uint32_t deadline_miss;
+};
+
+/*
+ * Domain
+ */
+struct rt_dom {
+    struct list_head sdom_elem;
+    struct domain *dom;
+    s_time_t period;
+    s_time_t budget;            /* 0 means best-effort */
+    uint64_t util;              /* per-VCPU utilisation */
+};
+
+/*
+ * System-wide private data
+ */
+struct rt_private {
+    spinlock_t lock;
+    struct list_head sdom;
+    struct list_head runq;      /* RT VCPUs with budget, by deadline */
+    struct list_head depletedq; /* RT VCPUs without budget, by deadline */
+    struct list_head beq;       /* best-effort VCPUs, FIFO */
+    struct timer repl_timer;
+    uint64_t total_util;
+    uint32_t nr_admitted;
+    uint32_t nr_rejected;
+    uint32_t nr_replenish;
+    uint32_t nr_migrate;
+};
+
+
+/*
+ * Global variables
+ */
+static struct rt_private rt_priv;
+
+static inline int
+__vcpu_on_q(struct rt_vcpu *svc)
+{
+    return !list_empty(&svc->q_elem);
+}
+
+static inline struct rt_vcpu *
+__q_elem(struct list_head *elem)
+{
+    return list_entry(elem, struct rt_vcpu, q_elem);
+}
+
+static inline int
+__vcpu_is_rt(struct rt_vcpu *svc)
+{
+    return (svc->sdom != NULL) && (svc->sdom->budget != 0);
+}
+
+/* Does this VCPU currently compete at real-time priority? */
+static inline int
+__vcpu_is_rt_active(struct rt_vcpu *svc)
+{
+    return __vcpu_is_rt(svc) && !(svc->flags & RT_FLAG_DEPLETED);
+}
+
+/* Should VCPU 'new' preempt VCPU 'cur'? */
+static inline int
+__vcpu_preempts(struct rt_vcpu *new, struct rt_vcpu *cur)
+{
+    if ( is_idle_vcpu(cur->vcpu) )
+        return 1;
+    if ( !__vcpu_is_rt_active(new) )
+        return 0;
+    if ( !__vcpu_is_rt_active(cur) )
+        return 1;
+    return new->cur_deadline < cur->cur_deadline;
+}
+
+static void
+__q_insert_deadline(struct list_head *q, struct rt_vcpu *svc)
+{
+    struct list_head *iter;
+
+    list_for_each( iter, q )
+    {
+        const struct rt_vcpu * const iter_svc = __q_elem(iter);
+        if ( svc->cur_deadline < iter_svc->cur_deadline )
+            break;
+    }
+
+    list_add_tail(&svc->q_elem, iter);
+}
+
+/*
+ * Queue a runnable, non-running VCPU according to its current state.
+ * Must be called with the global lock held.
+ */
+static void
+__runq_insert(struct rt_vcpu *svc)
+{
+    BUG_ON( __vcpu_on_q(svc) );
+    BUG_ON( is_idle_vcpu(svc->vcpu) );
+
+    if ( !__vcpu_is_rt(svc) )
+    {
+        list_add_tail(&svc->q_elem, &rt_priv.beq);
+    }
+    else if ( svc->flags & RT_FLAG_DEPLETED )
+    {
+        __q_insert_deadline(&rt_priv.depletedq, svc);
+
+        /* Replenishments happen at the deadline of the first server. */
+        if ( rt_priv.depletedq.next == &svc->q_elem )
+            set_timer(&rt_priv.repl_timer, svc->cur_deadline);
+    }
+    else
+    {
+        __q_insert_deadline(&rt_priv.runq, svc);
+    }
+}
+
+static inline void
+__runq_remove(struct rt_vcpu *svc)
+{
+    BUG_ON( !__vcpu_on_q(svc) );
+    list_del_init(&svc->q_elem);
+}
+
+/*
+ * Find a PCPU for a newly queued VCPU: an idler if there is one, otherwise
+ * the PCPU running the lowest priority VCPU, provided the new one should
+ * preempt it.
+ */
+static void
+__runq_tickle(struct rt_vcpu *new)
+{
+    struct rt_vcpu *cur, *latest = NULL;
+    cpumask_t cpus;
+    int cpu, latest_cpu = -1;
+
+    cpus_and(cpus, cpu_online_map, new->vcpu->cpu_affinity);
+
+    /* Give a preference to the VCPU's own processor. */
+    cpu = new->vcpu->processor;
+    if ( cpu_isset(cpu, cpus) &&
+         is_idle_vcpu(per_cpu(schedule_data, cpu).curr) )
+    {
+        cpu_raise_softirq(cpu, SCHEDULE_SOFTIRQ);
+        return;
+    }
+
+    for_each_cpu_mask ( cpu, cpus )
+    {
+        cur = RT_VCPU(per_cpu(schedule_data, cpu).curr);
+
+        if ( is_idle_vcpu(cur->vcpu) )
+        {
+            cpu_raise_softirq(cpu, SCHEDULE_SOFTIRQ);
+            return;
+        }
+
+        if ( (latest == NULL) || __vcpu_preempts(latest, cur) )
+        {
+            latest = cur;
+            latest_cpu = cpu;
+        }
+    }
+
+    if ( (latest != NULL) && __vcpu_preempts(new, latest) )
+        cpu_raise_softirq(latest_cpu, SCHEDULE_SOFTIRQ);
+}
+
+/*
+ * Start a new server period: full budget, deadline one period on from the
+ * old one (or from now if that is already in the past).
+ */
+static void
+__vcpu_replenish(struct rt_vcpu *svc, s_time_t now)
+{
+    struct rt_dom * const sdom = svc->sdom;
+
+    ASSERT( __vcpu_is_rt(svc) );
+
+    if ( svc->cur_deadline <= now )
+        svc->cur_deadline +=
+            ((now - svc->cur_deadline) / sdom->period + 1) * sdom->period;
+    svc->cur_budget = sdom->budget;
+    svc->flags &= ~RT_FLAG_DEPLETED;
+    rt_priv.nr_replenish++;
+}
+
+/* Charge the running VCPU for the time it has run since last_start. */
+static void
+__vcpu_burn_budget(struct rt_vcpu *svc, s_time_t now)
+{
+    s_time_t delta;
+
+    if ( !__vcpu_is_rt(svc) )
+        return;
+
+    delta = now - svc->last_start;
+    if ( delta <= 0 )
+        return;
+    svc->last_start = now;
+
+    svc->cur_budget -= delta;
+    if ( svc->cur_budget <= 0 )
+    {
+        svc->cur_budget = 0;
+        svc->flags |= RT_FLAG_DEPLETED;
+    }
+
+    /* Still running on this server's budget past its deadline? */
+    if ( now > svc->cur_deadline )
+        svc->deadline_miss++;
+}
+
+static void
+rt_repl_timer_fn(void *unused)
+{
+    struct list_head *iter, *next;
+    struct rt_vcpu *svc;
+    unsigned long flags;
+    s_time_t now = NOW();
+
+    spin_lock_irqsave(&rt_priv.lock, flags);
+
+    list_for_each_safe( iter, next, &rt_priv.depletedq )
+    {
+        svc = __q_elem(iter);
+        if ( svc->cur_deadline > now )
+        {
+            set_timer(&rt_priv.repl_timer, svc->cur_deadline);
+            break;
+        }
+
+        __runq_remove(svc);
+        __vcpu_replenish(svc, now);
+        __runq_insert(svc);
+        __runq_tickle(svc);
+    }
+
+    spin_unlock_irqrestore(&rt_priv.lock, flags);
+}
+
+/*
+ * VCPUs are counted whether they are up or not, so that bringing one
+ * online can never take the system past what was admitted.
+ */
+static int
+rt_dom_nr_vcpus(struct domain *d, unsigned int extra)
+{
+    struct vcpu *v;
+    int nr = extra;
+
+    for_each_vcpu ( d, v )
+        nr++;
+
+    return nr ? : 1;
+}
+
+/*
+ * Admission control for global EDF: the set of servers is schedulable on
+ * m PCPUs if their total utilisation U and the largest single utilisation
+ * Umax satisfy U <= m - (m - 1) * Umax (Goossens, Funk and Baruah).
+ *
+ * Must be called with the global lock held. Stores in '*total_util' the
+ * total utilisation that would result from giving 'sdom', with 'extra'
+ * VCPUs on top of those it has now, the requested reservation, and
+ * returns 0, or -ENOSPC if that would make the system unschedulable.
+ */
+static int
+rt_admit(struct rt_dom *sdom, s_time_t period, s_time_t budget,
+         unsigned int extra, uint64_t *total_util)
+{
+    struct list_head *iter;
+    struct rt_dom *iter_sdom;
+    uint64_t util, total = 0, max = 0;
+    unsigned int m = num_online_cpus();
+
+    list_for_each( iter, &rt_priv.sdom )
+    {
+        iter_sdom = list_entry(iter, struct rt_dom, sdom_elem);
+        if ( (iter_sdom == sdom) || (iter_sdom->budget == 0) )
+            continue;
+        total += iter_sdom->util * rt_dom_nr_vcpus(iter_sdom->dom, 0);
+        if ( iter_sdom->util > max )
+            max = iter_sdom->util;
+    }
+
+    if ( budget != 0 )
+    {
+        util = ((uint64_t)budget << RT_UTIL_SHIFT) / period;
+        total += util * rt_dom_nr_vcpus(sdom->dom, extra);
+        if ( util > max )
+            max = util;
+    }
+
+    *total_util = total;
+
+    if ( total + (m - 1) * max > m * RT_UTIL_ONE )
+        return -ENOSPC;
+
+    return 0;
+}
+
+static int
+rt_vcpu_init(struct vcpu *vc)
+{
+    struct rt_dom * const sdom = RT_DOM(vc->domain);
+    struct rt_vcpu *svc;
+    uint64_t total_util;
+    unsigned long flags;
+    int rc;
+
+    /*
+     * A VCPU added to a domain that already has a reservation brings its
+     * share of it along, so it must pass admission control too.
+     */
+    if ( (sdom != NULL) && (sdom->budget != 0) )
+    {
+        spin_lock_irqsave(&rt_priv.lock, flags);
+        rc = rt_admit(sdom, sdom->period, sdom->budget, 1, &total_util);
+        if ( rc == 0 )
+            rt_priv.total_util = total_util;
+        else
+            rt_priv.nr_rejected++;
+        spin_unlock_irqrestore(&rt_priv.lock, flags);
+        if ( rc != 0 )
+            return -1;
+    }
+
+    /* Allocate per-VCPU info */
+    svc = xmalloc(struct rt_vcpu);
+    if ( svc == NULL )
+        return -1;
+
+    INIT_LIST_HEAD(&svc->q_elem);
+    svc->sdom = sdom;
+    svc->vcpu = vc;
+    svc->cur_budget = 0;
+    svc->cur_deadline = 0;
+    svc->last_start = 0;
+    svc->flags = 0U;
+    svc->deadline_miss = 0;
+    vc->sched_priv = svc;
+
+    return 0;
+}
+
+static void
+rt_vcpu_destroy(struct vcpu *vc)
+{
+    struct rt_vcpu * const svc = RT_VCPU(vc);
+    unsigned long flags;
+
+    spin_lock_irqsave(&rt_priv.lock, flags);
+    if ( __vcpu_on_q(svc) )
+        __runq_remove(svc);
+    spin_unlock_irqrestore(&rt_priv.lock, flags);
+
+    xfree(svc);
+}
+
+static void
+rt_vcpu_sleep(struct vcpu *vc)
+{
+    struct rt_vcpu * const svc = RT_VCPU(vc);
+    unsigned long flags;
+
+    BUG_ON( is_idle_vcpu(vc) );
+
+    if ( per_cpu(schedule_data, vc->processor).curr == vc )
+    {
+        cpu_raise_softirq(vc->processor, SCHEDULE_SOFTIRQ);
+        return;
+    }
+
+    spin_lock_irqsave(&rt_priv.lock, flags);
+    if ( __vcpu_on_q(svc) )
+        __runq_remove(svc);
+    spin_unlock_irqrestore(&rt_priv.lock, flags);
+}
+
+static void
+rt_vcpu_wake(struct vcpu *vc)
+{
+    struct rt_vcpu * const svc = RT_VCPU(vc);
+    struct rt_dom * const sdom = svc->sdom;
+    unsigned long flags;
+    s_time_t now;
+
+    BUG_ON( is_idle_vcpu(vc) );
+
+    if ( unlikely(per_cpu(schedule_data, vc->processor).curr == vc) )
+        return;
+
+    spin_lock_irqsave(&rt_priv.lock, flags);
+
+    if ( unlikely(__vcpu_on_q(svc)) )
+        goto out;
+
+    /*
+     * CBS wake-up rule: if the server can't use its remaining budget
+     * before its deadline without exceeding its bandwidth, it starts a new
+     * period now. Otherwise it keeps its current budget and deadline, so
+     * that a VCPU can't gain bandwidth by blocking and waking.
+     */
+    if ( __vcpu_is_rt(svc) )
+    {
+        now = NOW();
+        if ( (now >= svc->cur_deadline) ||
+             (svc->cur_budget * sdom->period >
+              (svc->cur_deadline - now) * sdom->budget) )
+        {
+            svc->cur_deadline = now + sdom->period;
+            svc->cur_budget = sdom->budget;
+            svc->flags &= ~RT_FLAG_DEPLETED;
+        }
+    }
+
+    __runq_insert(svc);
+    __runq_tickle(svc);
+
+ out:
+    spin_unlock_irqrestore(&rt_priv.lock, flags);
+}
+
+static int
+rt_cpu_pick(struct vcpu *vc)
+{
+    cpumask_t cpus;
+    int cpu;
+
+    cpus_and(cpus, cpu_online_map, vc->cpu_affinity);
+    ASSERT( !cpus_empty(cpus) );
+
+    if ( cpu_isset(vc->processor, cpus) )
+        return vc->processor;
+
+    for_each_cpu_mask ( cpu, cpus )
+        if ( is_idle_vcpu(per_cpu(schedule_data, cpu).curr) )
+            return cpu;
+
+    return first_cpu(cpus);
+}
+
+static int
+rt_dom_cntl(
+    struct domain *d,
+    struct xen_domctl_scheduler_op *op)
+{
+    struct rt_dom * const sdom = RT_DOM(d);
+    struct rt_vcpu *svc;
+    struct vcpu *v;
+    s_time_t period, budget, now;
+    uint64_t total_util;
+    unsigned long flags;
+    int rc;
+
+    if ( op->cmd == XEN_DOMCTL_SCHEDOP_getinfo )
+    {
+        op->u.rt.period = sdom->period;
+        op->u.rt.budget = sdom->budget;
+        return 0;
+    }
+
+    period = op->u.rt.period;
+    budget = op->u.rt.budget;
+
+    if ( (budget != 0) &&
+         ((period < RT_MIN_PERIOD) || (period > RT_MAX_PERIOD) ||
+          (budget < RT_MIN_BUDGET) || (budget > period)) )
+        return -EINVAL;
+
+    spin_lock_irqsave(&rt_priv.lock, flags);
+
+    rc = rt_admit(sdom, period, budget, 0, &total_util);
+    if ( (rc != 0) || (op->cmd == XEN_DOMCTL_SCHEDOP_admit) )
+    {
+        if ( rc != 0 )
+            rt_priv.nr_rejected++;
+        goto out;
+    }
+
+    ASSERT(op->cmd == XEN_DOMCTL_SCHEDOP_putinfo);
+
+    rt_priv.total_util = total_util;
+    rt_priv.nr_admitted++;
+
+    sdom->period = (budget != 0) ? period : 0;
+    sdom->budget = budget;
+    sdom->util = (budget != 0)
+        ? ((uint64_t)budget << RT_UTIL_SHIFT) / period : 0;
+
+    /*
+     * Start all servers afresh with the new parameters, and have them
+     * take effect at once: re-sort queued VCPUs and find them a PCPU, and
+     * make running ones go through the scheduler again.
+     */
+    now = NOW();
+    for_each_vcpu ( d, v )
+    {
+        svc = RT_VCPU(v);
+        svc->cur_budget = budget;
+        svc->cur_deadline = now + sdom->period;
+        svc->last_start = now;
+        svc->flags &= ~RT_FLAG_DEPLETED;
+        if ( __vcpu_on_q(svc) )
+        {
+            __runq_remove(svc);
+            __runq_insert(svc);
+            __runq_tickle(svc);
+        }
+        else if ( per_cpu(schedule_data, v->processor).curr == v )
+            cpu_raise_softirq(v->processor, SCHEDULE_SOFTIRQ);
+    }
+
+ out:
+    spin_unlock_irqrestore(&rt_priv.lock, flags);
+
+    return rc;
+}
+
+static int
+rt_dom_init(struct domain *dom)
+{
+    struct rt_dom *sdom;
+    unsigned long flags;
+
+    if ( is_idle_domain(dom) )
+        return 0;
+
+    sdom = xmalloc(struct rt_dom);
+    if ( sdom == NULL )
+        return -ENOMEM;
+
+    /* Domains start off best-effort. */
+    INIT_LIST_HEAD(&sdom->sdom_elem);
+    sdom->dom = dom;
+    sdom->period = 0;
+    sdom->budget = 0;
+    sdom->util = 0;
+    dom->sched_priv = sdom;
+
+    spin_lock_irqsave(&rt_priv.lock, flags);
+    list_add_tail(&sdom->sdom_elem, &rt_priv.sdom);
+    spin_unlock_irqrestore(&rt_priv.lock, flags);
+
+    return 0;
+}
+
+static void
+rt_dom_destroy(struct domain *dom)
+{
+    struct rt_dom * const sdom = RT_DOM(dom);
+    uint64_t total_util;
+    unsigned long flags;
+
+    spin_lock_irqsave(&rt_priv.lock, flags);
+    list_del_init(&sdom->sdom_elem);
+    if ( sdom->budget != 0 )
+    {
+        rt_admit(sdom, 0, 0, 0, &total_util);
+        rt_priv.total_util = total_util;
+    }
+    spin_unlock_irqrestore(&rt_priv.lock, flags);
+
+    xfree(sdom);
+}
+
+/*
+ * Pick the highest priority queued VCPU that may run on this PCPU. VCPUs
+ * still in the scheduling tail of another PCPU are skipped; so are VCPUs
+ * whose current PCPU we can't lock to migrate them here.
+ */
+static struct rt_vcpu *
+__runq_pick(int cpu, struct list_head *q, int *skipped)
+{
+    struct list_head *iter;
+    struct rt_vcpu *svc;
+    struct vcpu *vc;
+    int old_cpu;
+
+    list_for_each( iter, q )
+    {
+        svc = __q_elem(iter);
+        vc = svc->vcpu;
+
+        if ( !cpu_isset(cpu, vc->cpu_affinity) )
+            continue;
+
+        if ( vc != current )
+        {
+            if ( vc->is_running )
+            {
+                *skipped = 1;
+                continue;
+            }
+
+            old_cpu = vc->processor;
+            if ( old_cpu != cpu )
+            {
+                /*
+                 * Don't spin: the peer might be trying to get the global
+                 * lock while holding its schedule lock.
+                 */
+                if ( !spin_trylock(
+                         &per_cpu(schedule_data, old_cpu).schedule_lock) )
+                {
+                    *skipped = 1;
+                    continue;
+                }
+                vc->processor = cpu;
+                spin_unlock(&per_cpu(schedule_data, old_cpu).schedule_lock);
+                rt_priv.nr_migrate++;
+            }
+        }
+
+        __runq_remove(svc);
+        return svc;
+    }
+
+    return NULL;
+}
+
+static struct task_slice
+rt_schedule(s_time_t now)
+{
+    const int cpu = smp_processor_id();
+    struct rt_vcpu * const scurr = RT_VCPU(current);
+    struct rt_vcpu *snext;
+    struct task_slice ret;
+    int skipped = 0;
+
+    spin_lock(&rt_priv.lock);
+
+    /* Charge the outgoing VCPU and put it back in the queues. */
+    if ( !is_idle_vcpu(current) )
+    {
+        __vcpu_burn_budget(scurr, now);
+        if ( vcpu_runnable(current) )
+            __runq_insert(scurr);
+    }
+
+    snext = __runq_pick(cpu, &rt_priv.runq, &skipped);
+    if ( snext == NULL )
+        snext = __runq_pick(cpu, &rt_priv.beq, &skipped);
+    if ( snext == NULL )
+        snext = RT_VCPU(idle_vcpu[cpu]);
+
+    snext->last_start = now;
+
+    if ( __vcpu_is_rt_active(snext) )
+        ret.time = snext->cur_budget;
+    else if ( !is_idle_vcpu(snext->vcpu) )
+        ret.time = RT_BE_TSLICE;
+    else
+        ret.time = skipped ? RT_RETRY_DELAY : -1;
+    ret.task = snext->vcpu;
+
+    spin_unlock(&rt_priv.lock);
+
+    return ret;
+}
+
+static void
+rt_dump_vcpu(struct rt_vcpu *svc)
+{
+    printk("[%i.%i] cpu=%i",
+           svc->vcpu->domain->domain_id,
+           svc->vcpu->vcpu_id,
+           svc->vcpu->processor);
+
+    if ( __vcpu_is_rt(svc) )
+        printk(" budget=%"PRId64" deadline=%"PRId64" miss=%u%s",
+               svc->cur_budget, svc->cur_deadline, svc->deadline_miss,
+               (svc->flags & RT_FLAG_DEPLETED) ? " depleted" : "");
+
+    printk("\n");
+}
+
+static void
+rt_dump_pcpu(int cpu)
+{
+    printk("run: ");
+    rt_dump_vcpu(RT_VCPU(per_cpu(schedule_data, cpu).curr));
+}
+
+static void
+rt_dump_q(const char *name, struct list_head *q)
+{
+    struct list_head *iter;
+    int loop = 0;
+
+    printk("%s:\n", name);
+    list_for_each( iter, q )
+    {
+        printk("\t%3d: ", ++loop);
+        rt_dump_vcpu(__q_elem(iter));
+    }
+}
+
+static void
+rt_dump(void)
+{
+    struct list_head *iter;
+    struct rt_dom *sdom;
+    unsigned long flags;
+
+    spin_lock_irqsave(&rt_priv.lock, flags);
+
+    printk("info:\n"
+           "\tutilisation        = %"PRIu64"/%u%%\n"
+           "\tadmitted           = %u\n"
+           "\trejected           = %u\n"
+           "\treplenishments     = %u\n"
+           "\tmigrations         = %u\n",
+           (rt_priv.total_util * 100) >> RT_UTIL_SHIFT,
+           num_online_cpus() * 100,
+           rt_priv.nr_admitted,
+           rt_priv.nr_rejected,
+           rt_priv.nr_replenish,
+           rt_priv.nr_migrate);
+
+    printk("reservations:\n");
+    list_for_each( iter, &rt_priv.sdom )
+    {
+        sdom = list_entry(iter, struct rt_dom, sdom_elem);
+        if ( sdom->budget != 0 )
+            printk("\tdom%d: budget=%"PRId64" period=%"PRId64"\n",
+                   sdom->dom->domain_id, sdom->budget, sdom->period);
+    }
+
+    rt_dump_q("runq", &rt_priv.runq);
+    rt_dump_q("depletedq", &rt_priv.depletedq);
+    rt_dump_q("beq", &rt_priv.beq);
+
+    spin_unlock_irqrestore(&rt_priv.lock, flags);
+}
+
+static void
+rt_init(void)
+{
+    spin_lock_init(&rt_priv.lock);
+    INIT_LIST_HEAD(&rt_priv.sdom);
+    INIT_LIST_HEAD(&rt_priv.runq);
+    INIT_LIST_HEAD(&rt_priv.depletedq);
+    INIT_LIST_HEAD(&rt_priv.beq);
+    init_timer(&rt_priv.repl_timer, rt_repl_timer_fn, NULL, 0);
+    rt_priv.total_util = 0;
+    rt_priv.nr_admitted = 0;
+    rt_priv.nr_rejected = 0;
+    rt_priv.nr_replenish = 0;
+    rt_priv.nr_migrate = 0;
+}
+
+struct scheduler sched_rt_def = {
+    .name           = "SMP Global EDF Scheduler",
+    .opt_name       = "rt",
+    .sched_id       = XEN_SCHEDULER_RT,
+
+    .init_domain    = rt_dom_init,
+    .destroy_domain = rt_dom_destroy,
+
+    .init_vcpu      = rt_vcpu_init,
+    .destroy_vcpu   = rt_vcpu_destroy,
+
+    .sleep          = rt_vcpu_sleep,
+    .wake           = rt_vcpu_wake,
+
+    .adjust         = rt_dom_cntl,
+
+    .pick_cpu       = rt_cpu_pick,
+    .do_schedule    = rt_schedule,
+
+    .dump_cpu_state = rt_dump_pcpu,
+    .dump_settings  = rt_dump,
+    .init           = rt_init,
+};
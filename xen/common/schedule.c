@@ -58,9 +58,11 @@ DEFINE_PER_CPU(struct schedule_data, schedule_data);
 
 extern struct scheduler sched_sedf_def;
 extern struct scheduler sched_credit_def;
+extern struct scheduler sched_rt_def;
 static struct scheduler *schedulers[] = { 
     &sched_sedf_def,
     &sched_credit_def,
+    &sched_rt_def,
     NULL
 };
 
@@ -75,7 +77,7 @@ static inline void trace_runstate_change(struct vcpu *v, int new_state)
     struct { uint32_t vcpu:16, domain:16; } d;
     uint32_t event;
 
-    if ( likely(!tb_init_done) )
+    if ( likely(!tb_event_enabled(TRC_SCHED)) )
         return;
 
     d.vcpu = v->vcpu_id;
@@ -92,7 +94,7 @@ static inline void trace_continue_running(struct vcpu *v)
 {
     struct { uint32_t vcpu:16, domain:16; } d;
 
-    if ( likely(!tb_init_done) )
+    if ( likely(!tb_event_enabled(TRC_SCHED)) )
         return;
 
     d.vcpu = v->vcpu_id;
@@ -537,6 +539,40 @@ static long do_yield(void)
     return 0;
 }
 
+/*
+ * Directed yield for a vcpu that has been spinning for a long time, most
+ * likely on a lock held by a sibling that was preempted.  Pick a runnable
+ * but descheduled vcpu of the same domain, searching from the one after
+ * us so that several spinners do not all pick the same sibling, and ask
+ * the scheduler to run it ahead of us.  Without a candidate this is a
+ * plain yield.
+ */
+void vcpu_yield_to_sibling(void)
+{
+    struct vcpu *v = current, *t, *target = NULL;
+    struct domain *d = v->domain;
+    unsigned int i;
+
+    for ( i = 1; i < MAX_VIRT_CPUS; i++ )
+    {
+        t = d->vcpu[(v->vcpu_id + i) % MAX_VIRT_CPUS];
+        if ( (t != NULL) && !t->is_running && vcpu_runnable(t) )
+        {
+            target = t;
+            break;
+        }
+    }
+
+    if ( target != NULL )
+        perfc_incr(sched_yield_directed);
+    else
+        perfc_incr(sched_yield_undirected);
+
+    TRACE_2D(TRC_SCHED_YIELD, d->domain_id, v->vcpu_id);
+    SCHED_OP(yield, v, target);
+    raise_softirq(SCHEDULE_SOFTIRQ);
+}
+
 long do_sched_op_compat(int cmd, unsigned long arg)
 {
     long ret = 0;
@@ -723,9 +759,14 @@ long sched_adjust(struct domain *d, struct xen_domctl_scheduler_op *op)
     
     if ( (op->sched_id != ops.sched_id) ||
          ((op->cmd != XEN_DOMCTL_SCHEDOP_putinfo) &&
-          (op->cmd != XEN_DOMCTL_SCHEDOP_getinfo)) )
+          (op->cmd != XEN_DOMCTL_SCHEDOP_getinfo) &&
+          (op->cmd != XEN_DOMCTL_SCHEDOP_admit)) )
         return -EINVAL;
 
+    /* Admission checks don't change anything: no need to pause. */
+    if ( op->cmd == XEN_DOMCTL_SCHEDOP_admit )
+        return SCHED_OP(adjust, d, op);
+
     /*
      * Most VCPUs we can simply pause. If we are adjusting this VCPU then
      * we acquire the local schedule_lock to guard against concurrent updates.
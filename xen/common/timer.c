@@ -28,12 +28,34 @@
 static unsigned int timer_slop __read_mostly = 50000; /* 50 us */
 integer_param("timer_slop", timer_slop);
 
+/*
+ * Two-level timing wheel for near-future timers. Level 0 has TW0_SIZE slots
+ * of (1 << TIMER_WHEEL_SHIFT) ns each (~16ms in total); level 1 has TW1_SIZE
+ * slots each spanning a full turn of level 0 (~1s in total). Timers beyond
+ * the reach of level 1 are kept on the heap.
+ */
+#define TIMER_WHEEL_SHIFT 16
+#define TW0_BITS          8
+#define TW0_SIZE          (1U << TW0_BITS)
+#define TW0_MASK          (TW0_SIZE - 1)
+#define TW1_BITS          6
+#define TW1_SIZE          (1U << TW1_BITS)
+#define TW1_MASK          (TW1_SIZE - 1)
+
+struct timer_wheel {
+    uint64_t         clk;          /* next level-0 tick to be processed */
+    unsigned int     nr[2];        /* number of timers on each level */
+    struct list_head l0[TW0_SIZE];
+    struct list_head l1[TW1_SIZE];
+};
+
 struct timers {
     spinlock_t     lock;
     bool_t         overflow;
     struct timer **heap;
     struct timer  *list;
     struct timer  *running;
+    struct timer_wheel *wheel;
 } __cacheline_aligned;
 
 static DEFINE_PER_CPU(struct timers, timers);
@@ -163,6 +185,157 @@ static int add_to_list(struct timer **pprev, struct timer *t)
 }
 
 
+/****************************************************************************
+ * TIMING WHEEL OPERATIONS.
+ */
+
+static inline uint64_t wheel_tick(s_time_t t)
+{
+    return (t < 0) ? 0 : ((uint64_t)t >> TIMER_WHEEL_SHIFT);
+}
+
+/* Add @t to @w if it falls within the wheel's reach. Return TRUE on success. */
+static int add_to_wheel(struct timer_wheel *w, struct timer *t)
+{
+    uint64_t tick;
+
+    /* An empty wheel can safely be wound forward to the current time. */
+    if ( (w->nr[0] | w->nr[1]) == 0 )
+    {
+        tick = wheel_tick(NOW());
+        if ( tick > w->clk )
+            w->clk = tick;
+    }
+
+    tick = wheel_tick(t->expires);
+    if ( tick < w->clk )
+        tick = w->clk;
+
+    if ( (tick - w->clk) < TW0_SIZE )
+    {
+        list_add_tail(&t->wheel_elem, &w->l0[tick & TW0_MASK]);
+        t->status = TIMER_STATUS_in_wheel0;
+        w->nr[0]++;
+        return 1;
+    }
+
+    if ( ((tick >> TW0_BITS) - (w->clk >> TW0_BITS)) < TW1_SIZE )
+    {
+        list_add_tail(&t->wheel_elem, &w->l1[(tick >> TW0_BITS) & TW1_MASK]);
+        t->status = TIMER_STATUS_in_wheel1;
+        w->nr[1]++;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void remove_from_wheel(struct timer_wheel *w, struct timer *t)
+{
+    list_del(&t->wheel_elem);
+    w->nr[t->status - TIMER_STATUS_in_wheel0]--;
+}
+
+/* Redistribute the level-1 slot that has just come within reach of level 0. */
+static void cascade_wheel(struct timer_wheel *w)
+{
+    struct list_head *head = &w->l1[(w->clk >> TW0_BITS) & TW1_MASK];
+    struct timer *t;
+
+    while ( !list_empty(head) )
+    {
+        t = list_entry(head->next, struct timer, wheel_elem);
+        remove_from_wheel(w, t);
+        t->status = TIMER_STATUS_inactive;
+        if ( !add_to_wheel(w, t) )
+            BUG();
+        perfc_incr(timer_wheel_cascade);
+    }
+}
+
+/* Find the earliest expired timer in the current level-0 slot, if any. */
+static struct timer *wheel_expired(struct timer_wheel *w, s_time_t now)
+{
+    struct list_head *head = &w->l0[w->clk & TW0_MASK], *ent;
+    struct timer *t;
+
+    list_for_each ( ent, head )
+    {
+        t = list_entry(ent, struct timer, wheel_elem);
+        if ( t->expires < now )
+            return t;
+    }
+
+    return NULL;
+}
+
+/*
+ * Find the batch of wheel timers that can be serviced by a single deadline,
+ * in the same way as for the heap. Returns FALSE if the wheel is empty.
+ */
+static int wheel_deadline(
+    struct timer_wheel *w, s_time_t *start, s_time_t *end)
+{
+    struct list_head *head = NULL, *l1_head = NULL, *ent;
+    struct timer *t;
+    unsigned int i;
+    s_time_t s, e, l1_start = STIME_MAX;
+
+    if ( w->nr[1] != 0 )
+    {
+        for ( i = 1; list_empty(&w->l1[((w->clk >> TW0_BITS) + i) &
+                                       TW1_MASK]); i++ )
+            continue;
+        l1_head = &w->l1[((w->clk >> TW0_BITS) + i) & TW1_MASK];
+        l1_start = (s_time_t)((((w->clk >> TW0_BITS) + i) << TW0_BITS)
+                              << TIMER_WHEEL_SHIFT);
+    }
+
+    if ( w->nr[0] != 0 )
+    {
+        for ( i = 0; list_empty(&w->l0[(w->clk + i) & TW0_MASK]); i++ )
+            continue;
+        head = &w->l0[(w->clk + i) & TW0_MASK];
+    }
+    else if ( l1_head != NULL )
+        head = l1_head;
+    else
+        return 0;
+
+    /* Slots are unsorted: first find the tightest end, then the batch. */
+    e = STIME_MAX;
+    list_for_each ( ent, head )
+    {
+        t = list_entry(ent, struct timer, wheel_elem);
+        if ( t->expires_end < e )
+            e = t->expires_end;
+    }
+
+    s = 0;
+    list_for_each ( ent, head )
+    {
+        t = list_entry(ent, struct timer, wheel_elem);
+        if ( (t->expires <= e) && (t->expires > s) )
+            s = t->expires;
+    }
+
+    /*
+     * A level-1 timer may be due before a later level-0 one. It is only
+     * seen once its slot is cascaded, so do not sleep past that boundary.
+     */
+    if ( (head != l1_head) && (e > l1_start) )
+    {
+        e = l1_start;
+        if ( s > e )
+            s = e;
+    }
+
+    *start = s;
+    *end = e;
+    return 1;
+}
+
+
 /****************************************************************************
  * TIMER OPERATIONS.
  */
@@ -179,6 +352,12 @@ static int remove_entry(struct timers *timers, struct timer *t)
     case TIMER_STATUS_in_list:
         rc = remove_from_list(&timers->list, t);
         break;
+    case TIMER_STATUS_in_wheel0:
+    case TIMER_STATUS_in_wheel1:
+        /* A stale deadline merely causes one spurious softirq. */
+        remove_from_wheel(timers->wheel, t);
+        rc = 0;
+        break;
     default:
         rc = 0;
         BUG();
@@ -194,7 +373,16 @@ static int add_entry(struct timers *timers, struct timer *t)
 
     ASSERT(t->status == TIMER_STATUS_inactive);
 
+    /* Near-future timers go on the wheel in O(1). */
+    if ( (timers->wheel != NULL) && add_to_wheel(timers->wheel, t) )
+    {
+        s_time_t deadline = per_cpu(timer_deadline, t->cpu);
+        perfc_incr(timer_wheel_add);
+        return ((deadline == 0) || (t->expires < deadline));
+    }
+
     /* Try to add to heap. t->heap_offset indicates whether we succeed. */
+    perfc_incr(timer_heap_add);
     t->heap_offset = 0;
     t->status = TIMER_STATUS_in_heap;
     rc = add_to_heap(timers->heap, t);
@@ -365,11 +553,28 @@ static void timer_softirq_action(void)
 {
     struct timer  *t, **heap, *next;
     struct timers *ts;
+    struct timer_wheel *w;
     s_time_t       now;
+    unsigned int   i;
 
     ts = &this_cpu(timers);
     heap = ts->heap;
 
+    /* CPUs are given their timing wheel the first time they run timers. */
+    if ( unlikely(ts->wheel == NULL) &&
+         ((w = xmalloc(struct timer_wheel)) != NULL) )
+    {
+        for ( i = 0; i < TW0_SIZE; i++ )
+            INIT_LIST_HEAD(&w->l0[i]);
+        for ( i = 0; i < TW1_SIZE; i++ )
+            INIT_LIST_HEAD(&w->l1[i]);
+        w->nr[0] = w->nr[1] = 0;
+        w->clk = wheel_tick(NOW());
+        spin_lock_irq(&ts->lock);
+        ts->wheel = w;
+        spin_unlock_irq(&ts->lock);
+    }
+
     /* If we overflowed the heap, try to allocate a larger heap. */
     if ( unlikely(ts->overflow) )
     {
@@ -411,6 +616,49 @@ static void timer_softirq_action(void)
         execute_timer(ts, t);
     }
 
+    /* Execute ready wheel timers, advancing the wheel up to now. */
+    if ( (w = ts->wheel) != NULL )
+    {
+        uint64_t now_tick = wheel_tick(now);
+
+        while ( w->clk <= now_tick )
+        {
+            if ( (w->nr[0] | w->nr[1]) == 0 )
+            {
+                w->clk = now_tick;
+                break;
+            }
+
+            if ( w->nr[0] == 0 )
+            {
+                /* Skip straight to the next level-1 boundary. */
+                uint64_t next = ((w->clk >> TW0_BITS) + 1) << TW0_BITS;
+                if ( next > now_tick )
+                {
+                    w->clk = now_tick;
+                    break;
+                }
+                w->clk = next;
+                cascade_wheel(w);
+                continue;
+            }
+
+            while ( (t = wheel_expired(w, now)) != NULL )
+            {
+                remove_from_wheel(w, t);
+                t->status = TIMER_STATUS_inactive;
+                execute_timer(ts, t);
+            }
+
+            /* Cannot move past a slot that still holds pending timers. */
+            if ( !list_empty(&w->l0[w->clk & TW0_MASK]) )
+                break;
+
+            if ( (++w->clk & TW0_MASK) == 0 )
+                cascade_wheel(w);
+        }
+    }
+
     /* Try to move timers from linked list to more efficient heap. */
     next = ts->list;
     ts->list = NULL;
@@ -425,10 +673,15 @@ static void timer_softirq_action(void)
     if ( unlikely(ts->overflow) )
     {
         /* Find earliest deadline at head of list or top of heap. */
+        s_time_t start, end;
+
         this_cpu(timer_deadline) = ts->list->expires;
         if ( (GET_HEAP_SIZE(heap) != 0) &&
              ((t = heap[1])->expires < this_cpu(timer_deadline)) )
             this_cpu(timer_deadline) = t->expires;
+        if ( (w != NULL) && wheel_deadline(w, &start, &end) &&
+             (start < this_cpu(timer_deadline)) )
+            this_cpu(timer_deadline) = start;
     }
     else
     {
@@ -437,7 +690,7 @@ static void timer_softirq_action(void)
          * on the heap. To do this we take timers from the heap while their
          * valid deadline ranges continue to intersect.
          */
-        s_time_t start = 0, end = STIME_MAX;
+        s_time_t start = 0, end = STIME_MAX, wstart, wend;
         struct timer **list_tail = &ts->list;
 
         while ( (GET_HEAP_SIZE(heap) != 0) &&
@@ -455,6 +708,20 @@ static void timer_softirq_action(void)
                 end = t->expires_end;
         }
 
+        /*
+         * Merge with the wheel's batch if the two ranges intersect; otherwise
+         * the earlier of the two must be serviced first.
+         */
+        if ( (w != NULL) && wheel_deadline(w, &wstart, &wend) )
+        {
+            if ( start == 0 )
+                start = wstart;
+            else if ( (wstart <= end) && (start <= wend) )
+                start = max(start, wstart);
+            else
+                start = min(start, wstart);
+        }
+
         this_cpu(timer_deadline) = start;
     }
 
@@ -476,6 +743,7 @@ static void dump_timerq(unsigned char key)
 {
     struct timer  *t;
     struct timers *ts;
+    struct timer_wheel *w;
     unsigned long  flags;
     s_time_t       now = NOW();
     int            i, j;
@@ -500,11 +768,87 @@ static void dump_timerq(unsigned char key)
             printk (" L%d : %p ex=0x%08X%08X %p %p\n",
                     j, t, (u32)(t->expires>>32), (u32)t->expires,
                     t->data, t->function);
+        if ( (w = ts->wheel) != NULL )
+        {
+            printk("  wheel: clk=%"PRIu64" near=%u far=%u\n",
+                   w->clk, w->nr[0], w->nr[1]);
+            for ( j = 0; j < TW0_SIZE + TW1_SIZE; j++ )
+            {
+                struct list_head *head, *ent;
+                head = (j < TW0_SIZE) ? &w->l0[j] : &w->l1[j - TW0_SIZE];
+                list_for_each ( ent, head )
+                {
+                    t = list_entry(ent, struct timer, wheel_elem);
+                    printk (" W%d : %p ex=0x%08X%08X %p %p\n",
+                            j, t, (u32)(t->expires>>32), (u32)t->expires,
+                            t->data, t->function);
+                }
+            }
+        }
         spin_unlock_irqrestore(&ts->lock, flags);
         printk("\n");
     }
 }
 
+#define TIMER_BENCH_NR     1024
+#define TIMER_BENCH_ROUNDS 16
+
+static void timer_bench_fn(void *unused)
+{
+}
+
+/*
+ * Arm and cancel a batch of timers on the local CPU, first with expiries in
+ * the near future (timing wheel) and then far in the future (heap).
+ */
+static void run_timer_bench(unsigned char key)
+{
+    static const struct {
+        const char *name;
+        s_time_t    offset, range;
+    } bench[] = {
+        { "near", MILLISECS(1), MILLISECS(10) },
+        { "far",  SECONDS(2),   SECONDS(100) },
+    };
+    struct timer *timers;
+    unsigned int cpu = smp_processor_id(), b, i, r;
+    s_time_t base, elapsed;
+
+    timers = xmalloc_array(struct timer, TIMER_BENCH_NR);
+    if ( timers == NULL )
+    {
+        printk("Timer benchmark: out of memory\n");
+        return;
+    }
+
+    for ( i = 0; i < TIMER_BENCH_NR; i++ )
+        init_timer(&timers[i], timer_bench_fn, NULL, cpu);
+
+    printk("Timer benchmark on CPU%d: %d timers x %d rounds\n",
+           cpu, TIMER_BENCH_NR, TIMER_BENCH_ROUNDS);
+
+    for ( b = 0; b < ARRAY_SIZE(bench); b++ )
+    {
+        elapsed = NOW();
+        for ( r = 0; r < TIMER_BENCH_ROUNDS; r++ )
+        {
+            base = NOW() + bench[b].offset;
+            for ( i = 0; i < TIMER_BENCH_NR; i++ )
+                set_timer(&timers[i], base +
+                          ((s_time_t)i * bench[b].range) / TIMER_BENCH_NR);
+            for ( i = 0; i < TIMER_BENCH_NR; i++ )
+                stop_timer(&timers[i]);
+        }
+        elapsed = NOW() - elapsed;
+        printk("  %-4s: %"PRId64" ns per set/stop pair\n", bench[b].name,
+               elapsed / (TIMER_BENCH_NR * TIMER_BENCH_ROUNDS));
+    }
+
+    for ( i = 0; i < TIMER_BENCH_NR; i++ )
+        kill_timer(&timers[i]);
+    xfree(timers);
+}
+
 
 void __init timer_init(void)
 {
@@ -527,6 +871,7 @@ void __init timer_init(void)
     }
 
     register_keyhandler('a', dump_timerq, "dump timer queues");
+    register_keyhandler('b', run_timer_bench, "run timer benchmark");
 }
 
 /*
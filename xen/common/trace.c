@@ -68,6 +68,75 @@ static cpumask_t tb_cpu_mask = CPU_MASK_ALL;
 /* which tracing events are enabled */
 static u32 tb_event_mask = TRC_ALL;
 
+/* Trace classes occupy one bit each in event bits 16-27. */
+#define TRC_NR_CLASSES 12
+#define TRC_CLS_MASK   ((1u << TRC_NR_CLASSES) - 1)
+
+/* Per-class subclass enable bitmaps (event bits 12-15). */
+static u8 tb_subcls_mask[TRC_NR_CLASSES] = {
+    [0 ... TRC_NR_CLASSES-1] = (TRC_ALL >> TRC_SUBCLS_SHIFT) & 0xf
+};
+
+/* Classes currently being traced; zero while tracing is disabled. */
+u32 tb_cls_enabled __read_mostly;
+
+/*
+ * Recompute tb_cls_enabled. Must be called whenever tb_init_done,
+ * tb_event_mask or tb_subcls_mask change.
+ */
+static void tb_update_cls_enabled(void)
+{
+    u32 cls = 0;
+    int i;
+
+    if ( tb_init_done )
+    {
+        cls = (tb_event_mask >> TRC_CLS_SHIFT) & TRC_CLS_MASK;
+        for ( i = 0; i < TRC_NR_CLASSES; i++ )
+            if ( tb_subcls_mask[i] == 0 )
+                cls &= ~(1u << i);
+    }
+
+    /* Buffers and masks must be visible before the trace points fire. */
+    wmb();
+    tb_cls_enabled = cls;
+}
+
+/* Set the subclass bitmap of every class selected in @mask. */
+static void tb_set_cls_mask(u32 mask)
+{
+    u32 cls = (mask >> TRC_CLS_SHIFT) & TRC_CLS_MASK;
+    u8 subcls = (mask >> TRC_SUBCLS_SHIFT) & 0xf;
+    int i;
+
+    for ( i = 0; i < TRC_NR_CLASSES; i++ )
+    {
+        if ( !(cls & (1u << i)) )
+            continue;
+        tb_subcls_mask[i] = subcls;
+        if ( subcls )
+            tb_event_mask |= (1u << (i + TRC_CLS_SHIFT));
+        else
+            tb_event_mask &= ~(1u << (i + TRC_CLS_SHIFT));
+    }
+}
+
+/* Slow-path filter for an event whose class is known to be enabled. */
+static inline int tb_event_wanted(u32 event)
+{
+    u32 cls = tb_event_enabled(event) & TRC_CLS_MASK;
+
+    if ( cls == 0 )
+        return 0;
+
+    /* match subclass against the class's own bitmap */
+    if ( (tb_subcls_mask[find_first_set_bit(cls)]
+          & ((event >> TRC_SUBCLS_SHIFT) & 0xf)) == 0 )
+        return 0;
+
+    return cpu_isset(smp_processor_id(), tb_cpu_mask);
+}
+
 /**
  * alloc_trace_bufs - performs initialization of the per-cpu trace buffers.
  *
@@ -148,28 +217,7 @@ static int tb_set_size(int size)
 
 int trace_will_trace_event(u32 event)
 {
-    if ( !tb_init_done )
-        return 0;
-
-    /*
-     * Copied from __trace_var()
-     */
-    if ( (tb_event_mask & event) == 0 )
-        return 0;
-
-    /* match class */
-    if ( ((tb_event_mask >> TRC_CLS_SHIFT) & (event >> TRC_CLS_SHIFT)) == 0 )
-        return 0;
-
-    /* then match subclass */
-    if ( (((tb_event_mask >> TRC_SUBCLS_SHIFT) & 0xf )
-                & ((event >> TRC_SUBCLS_SHIFT) & 0xf )) == 0 )
-        return 0;
-
-    if ( !cpu_isset(smp_processor_id(), tb_cpu_mask) )
-        return 0;
-
-    return 1;
+    return tb_event_wanted(event);
 }
 
 /**
@@ -192,6 +240,7 @@ void __init init_trace_bufs(void)
         printk("Xen trace buffers: initialised\n");
         wmb(); /* above must be visible before tb_init_done flag set */
         tb_init_done = 1;
+        tb_update_cls_enabled();
     }
 }
 
@@ -218,6 +267,13 @@ int tb_control(xen_sysctl_tbuf_op_t *tbc)
         break;
     case XEN_SYSCTL_TBUFOP_set_evt_mask:
         tb_event_mask = tbc->evt_mask;
+        memset(tb_subcls_mask, (tb_event_mask >> TRC_SUBCLS_SHIFT) & 0xf,
+               sizeof(tb_subcls_mask));
+        tb_update_cls_enabled();
+        break;
+    case XEN_SYSCTL_TBUFOP_set_cls_mask:
+        tb_set_cls_mask(tbc->evt_mask);
+        tb_update_cls_enabled();
         break;
     case XEN_SYSCTL_TBUFOP_set_size:
         rc = !tb_init_done ? tb_set_size(tbc->size) : -EINVAL;
@@ -227,7 +283,10 @@ int tb_control(xen_sysctl_tbuf_op_t *tbc)
         if ( opt_tbuf_size == 0 ) 
             rc = -EINVAL;
         else
+        {
             tb_init_done = 1;
+            tb_update_cls_enabled();
+        }
         break;
     case XEN_SYSCTL_TBUFOP_disable:
         /*
@@ -235,6 +294,7 @@ int tb_control(xen_sysctl_tbuf_op_t *tbc)
          * does not deallocate any memory.
          */
         tb_init_done = 0;
+        tb_update_cls_enabled();
         break;
     default:
         rc = -EINVAL;
@@ -430,7 +490,7 @@ void __trace_var(u32 event, int cycles, int extra, unsigned char *extra_data)
     int extra_word;
     int started_below_highwater;
 
-    if( !tb_init_done )
+    if ( !tb_event_wanted(event) )
         return;
 
     /* Convert byte count into word count, rounding up */
@@ -444,22 +504,7 @@ void __trace_var(u32 event, int cycles, int extra, unsigned char *extra_data)
     /* Round size up to nearest word */
     extra = extra_word * sizeof(u32);
 
-    if ( (tb_event_mask & event) == 0 )
-        return;
-
-    /* match class */
-    if ( ((tb_event_mask >> TRC_CLS_SHIFT) & (event >> TRC_CLS_SHIFT)) == 0 )
-        return;
-
-    /* then match subclass */
-    if ( (((tb_event_mask >> TRC_SUBCLS_SHIFT) & 0xf )
-                & ((event >> TRC_SUBCLS_SHIFT) & 0xf )) == 0 )
-        return;
-
-    if ( !cpu_isset(smp_processor_id(), tb_cpu_mask) )
-        return;
-
-    /* Read tb_init_done /before/ t_bufs. */
+    /* Read tb_cls_enabled /before/ t_bufs. */
     rmb();
 
     buf = this_cpu(t_bufs);
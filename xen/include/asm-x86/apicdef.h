@@ -89,6 +89,8 @@
 #define			APIC_TIMER_BASE_TMBASE		0x1
 #define			APIC_TIMER_BASE_DIV		0x2
 #define			APIC_LVT_TIMER_PERIODIC		(1<<17)
+#define			APIC_LVT_TIMER_TSCDEADLINE	(1<<18)
+#define			APIC_LVT_TIMER_MODE_MASK	(0x3<<17)
 #define			APIC_LVT_MASKED			(1<<16)
 #define			APIC_LVT_LEVEL_TRIGGER		(1<<15)
 #define			APIC_LVT_REMOTE_IRR		(1<<14)
@@ -92,6 +92,7 @@ struct shadow_domain {
 
     /* Shadow hashtable */
     struct page_info **hash_table;
+    unsigned int hash_buckets; /* Resized along with the shadow pool */
     int hash_walking;  /* Some function is walking the hash table */
 
     /* Fast MMIO path heuristic */
@@ -104,6 +105,23 @@ struct shadow_domain {
 
     /* OOS */
     int oos_active;
+
+    /* Pool auto-sizing: bounds in pages (auto_max_pages == 0: off),
+     * the periodic timer, and where the counters below stood at the
+     * start of the current period. */
+    unsigned int      auto_min_pages;
+    unsigned int      auto_max_pages;
+    unsigned int      auto_idle;   /* consecutive quiet periods */
+    unsigned int      auto_last_evictions;
+    unsigned int      auto_last_faults;
+    struct timer      auto_timer;
+
+    /* Pool pressure statistics (approximate: faults aren't locked) */
+    unsigned int      evictions;
+    unsigned int      blows;
+    unsigned int      faults;
+    unsigned int      grows;
+    unsigned int      shrinks;
 };
 
 struct shadow_vcpu {
@@ -132,6 +150,14 @@ struct shadow_vcpu {
         mfn_t smfn[SHADOW_OOS_FIXUPS];
         unsigned long off[SHADOW_OOS_FIXUPS];
     } oos_fixup[SHADOW_OOS_PAGES];
+
+    /* Most recent shadow hash lookups by this vcpu, newest first.
+     * An entry with t == 0 is unused. */
+    struct shadow_hash_mru {
+        unsigned long n;
+        unsigned int t;
+        mfn_t smfn;
+    } hash_mru[SHADOW_HASH_MRU_ENTRIES];
 };
 
 /************************************************/
@@ -146,6 +172,10 @@ struct hap_domain {
     unsigned int      total_pages;  /* number of pages allocated */
     unsigned int      free_pages;   /* number of pages on freelists */
     unsigned int      p2m_pages;    /* number of pages allocates to p2m */
+
+    /* Bitmap page for HVMOP_map_dirty_vram, shared with privileged domains
+     * so the device model can map it.  Freed only at final teardown. */
+    unsigned long    *dirty_vram_page;
 };
 
 /************************************************/
@@ -166,10 +196,18 @@ struct log_dirty_domain {
     unsigned int   fault_count;
     unsigned int   dirty_count;
 
+    /* An enable or disable was preempted (-EAGAIN) and will be retried */
+    int            preempted;
+
     /* functions which are paging mode specific */
     int            (*enable_log_dirty   )(struct domain *d);
     int            (*disable_log_dirty  )(struct domain *d);
     void           (*clean_dirty_bitmap )(struct domain *d);
+    /* optional: re-arm only the pfns set in a bitmap */
+    void           (*clean_dirty_pfns   )(struct domain *d,
+                                          unsigned long begin_pfn,
+                                          const unsigned long *bitmap,
+                                          unsigned int nr);
 };
 
 struct paging_domain {
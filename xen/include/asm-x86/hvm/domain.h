@@ -49,6 +49,19 @@ struct hvm_domain {
 
     struct hvm_io_handler  io_handler;
 
+    /* Instruction-fetch translations of emulation sites (see emulate.c). */
+    struct hvm_insn_cache *insn_cache;
+
+    /* Device-model ranges accepting posted writes (HVMOP_set_posted_io_range). */
+    spinlock_t             posted_io_lock;
+    unsigned int           nr_posted_io;
+    struct hvm_posted_io_range posted_io[HVM_NR_POSTED_IO_RANGES];
+
+    /* Device-model doorbells (HVMOP_set_doorbell). */
+    rwlock_t               doorbell_lock;
+    unsigned int           nr_doorbells;
+    struct hvm_doorbell    doorbells[HVM_NR_DOORBELLS];
+
     /* Lock protects access to irq, vpic and vioapic. */
     spinlock_t             irq_lock;
     struct hvm_irq         irq;
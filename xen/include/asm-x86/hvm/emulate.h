@@ -37,6 +37,9 @@ struct hvm_emulate_ctxt {
 
 int hvm_emulate_one(
     struct hvm_emulate_ctxt *hvmemul_ctxt);
+void hvm_insn_cache_init(struct domain *d);
+void hvm_insn_cache_destroy(struct domain *d);
+void hvm_insn_cache_flush(struct domain *d);
 void hvm_emulate_prepare(
     struct hvm_emulate_ctxt *hvmemul_ctxt,
     struct cpu_user_regs *regs);
@@ -58,8 +58,10 @@ enum hvm_intblk {
 /*
  * HAP super page capabilities:
  * bit0: if 2MB super page is allowed?
+ * bit1: if 1GB super page is allowed?
  */
 #define HVM_HAP_SUPERPAGE_2MB   0x00000001
+#define HVM_HAP_SUPERPAGE_1GB   0x00000002
 
 /*
  * The hardware virtual machine (HVM) interface abstracts away from the
@@ -163,6 +165,40 @@ void hvm_init_guest_time(struct domain *d);
 void hvm_set_guest_time(struct vcpu *v, u64 guest_time);
 u64 hvm_get_guest_time(struct vcpu *v);
 
+int hvm_flush_vcpu_tlbs(bool_t (*flush_vcpu)(void *ctxt, struct vcpu *v),
+                        void *ctxt);
+
+/* Per-vcpu exit statistics: see XEN_DOMCTL_hvm_exit_stats. */
+struct hvm_exit_stats {
+    uint64_t     exit_tsc;          /* TSC when the pending exit was taken */
+    unsigned int pending;           /* index + 1 of the pending exit, or 0 */
+    struct xen_domctl_hvm_exit_reason reason[XEN_HVM_EXIT_STATS_REASONS];
+};
+
+int hvm_exit_stats_op(struct domain *d, struct xen_domctl_hvm_exit_stats *op);
+void __hvm_exit_stats_begin(struct vcpu *v, unsigned int index);
+void __hvm_exit_stats_end(struct vcpu *v);
+
+/* From the vmexit handlers, once the exit reason is known. */
+#define hvm_exit_stats_begin(v, index)                          \
+    do {                                                        \
+        if ( unlikely((v)->arch.hvm_vcpu.exit_stats != NULL) )  \
+            __hvm_exit_stats_begin(v, index);                   \
+    } while ( 0 )
+
+/* Index of a hardware exit code; codes beyond the range are not counted
+ * unless the caller maps them to a synthetic index itself. */
+#define hvm_exit_stats_hw_index(code)                           \
+    (((code) < XEN_HVM_EXIT_STATS_HW_REASONS)                   \
+     ? (code) : XEN_HVM_EXIT_STATS_REASONS)
+
+/* On the way back into the guest, or when the vcpu is descheduled. */
+#define hvm_exit_stats_end(v)                                   \
+    do {                                                        \
+        if ( unlikely((v)->arch.hvm_vcpu.exit_stats != NULL) )  \
+            __hvm_exit_stats_end(v);                            \
+    } while ( 0 )
+
 #define hvm_paging_enabled(v) \
     (!!((v)->arch.hvm_vcpu.guest_cr[0] & X86_CR0_PG))
 #define hvm_wp_enabled(v) \
@@ -175,6 +211,9 @@ u64 hvm_get_guest_time(struct vcpu *v);
 #define hvm_hap_has_2mb(d) \
     (hvm_funcs.hap_capabilities & HVM_HAP_SUPERPAGE_2MB)
 
+#define hvm_hap_has_1gb(d) \
+    (hvm_funcs.hap_capabilities & HVM_HAP_SUPERPAGE_1GB)
+
 #ifdef __x86_64__
 #define hvm_long_mode_enabled(v) \
     ((v)->arch.hvm_vcpu.guest_efer & EFER_LMA)
@@ -53,11 +53,30 @@ struct io_handler {
     } action;
 };
 
+/*
+ * hdl_list is kept sorted by (type, addr), so each type's handlers form a
+ * contiguous range index that hvm_io_intercept() binary-searches.
+ */
 struct hvm_io_handler {
     int     num_slot;
     struct  io_handler hdl_list[MAX_IO_HANDLER];
 };
 
+#define HVM_NR_POSTED_IO_RANGES     8
+struct hvm_posted_io_range {
+    uint8_t  type;               /* IOREQ_TYPE_PIO or IOREQ_TYPE_COPY */
+    uint64_t first, last;        /* inclusive */
+};
+
+#define HVM_NR_DOORBELLS            32
+struct hvm_doorbell {
+    uint8_t  type;               /* IOREQ_TYPE_PIO or IOREQ_TYPE_COPY */
+    uint8_t  size;
+    uint8_t  flags;              /* HVM_DOORBELL_* */
+    int      port;               /* Xen-bound event channel */
+    uint64_t addr, data;
+};
+
 struct hvm_mmio_handler {
     hvm_mmio_check_t check_handler;
     hvm_mmio_read_t read_handler;
@@ -81,6 +100,12 @@ static inline int hvm_buffered_io_intercept(ioreq_t *p)
 
 int hvm_mmio_intercept(ioreq_t *p);
 int hvm_buffered_io_send(ioreq_t *p);
+int hvm_posted_io_send(ioreq_t *p);
+int hvm_set_posted_io_range(struct domain *d, uint8_t type, int enable,
+                            uint64_t first, uint64_t last);
+struct xen_hvm_set_doorbell;
+int hvm_doorbell_send(ioreq_t *p);
+int hvm_set_doorbell(struct domain *d, struct xen_hvm_set_doorbell *a);
 
 static inline void register_portio_handler(
     struct domain *d, unsigned long addr,
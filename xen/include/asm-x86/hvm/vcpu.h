@@ -81,6 +81,13 @@ struct hvm_vcpu {
     enum hvm_io_state   io_state;
     unsigned long       io_data;
 
+    /* Per-exit-reason counters (XEN_DOMCTL_hvm_exit_stats), if enabled. */
+    struct hvm_exit_stats *exit_stats;
+
+    /* Last internal I/O and MMIO handlers hit: tried first next time. */
+    uint8_t             io_last_hit;
+    uint8_t             mmio_last_hit;
+
     /*
      * HVM emulation:
      *  Virtual address @mmio_gva maps to MMIO physical frame @mmio_gpfn.
@@ -33,10 +33,22 @@ union viridian_hypercall_gpa
     } fields;
 };
 
+union viridian_reference_tsc
+{   uint64_t raw;
+    struct
+    {
+        uint64_t enabled:1;
+        uint64_t reserved_preserved:11;
+        uint64_t pfn:48;
+    } fields;
+};
+
 struct viridian_domain
 {
     union viridian_guest_os_id guest_os_id;
     union viridian_hypercall_gpa hypercall_gpa;
+    union viridian_reference_tsc reference_tsc;
+    int64_t time_ref_offset; /* keeps the reference counter across restore */
 };
 
 int
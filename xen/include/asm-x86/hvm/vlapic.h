@@ -57,8 +57,13 @@ struct vlapic {
     struct hvm_hw_lapic_regs *regs;
     struct periodic_time     pt;
     s_time_t                 timer_last_update;
+    uint64_t                 tdt_msr;   /* TSC-deadline, 0 if disarmed */
     struct page_info         *regs_page;
     struct tasklet           init_tasklet;
+    /* Bit n set: IRR/ISR word n (vectors 32n to 32n+31) may be non-zero. */
+    unsigned long            irr_summary, isr_summary;
+    /* Set on the way into the guest, cleared on exit or by the first kick. */
+    bool_t                   in_guest;
 };
 
 static inline uint32_t vlapic_get_reg(struct vlapic *vlapic, uint32_t reg)
@@ -79,6 +84,9 @@ static inline int is_vlapic_lvtpc_enabled(struct vlapic *vlapic)
 }
 
 int vlapic_set_irq(struct vlapic *vlapic, uint8_t vec, uint8_t trig);
+void vlapic_kick(struct vcpu *v);
+void vlapic_enter_guest(struct vcpu *v);
+void vlapic_exit_guest(struct vcpu *v);
 
 int vlapic_has_pending_irq(struct vcpu *v);
 int vlapic_ack_pending_irq(struct vcpu *v, int vector);
@@ -89,6 +97,8 @@ void vlapic_destroy(struct vcpu *v);
 void vlapic_reset(struct vlapic *vlapic);
 
 void vlapic_msr_set(struct vlapic *vlapic, uint64_t value);
+void vlapic_tdt_msr_set(struct vlapic *vlapic, uint64_t value);
+uint64_t vlapic_tdt_msr_get(struct vlapic *vlapic);
 
 int vlapic_accept_pic_intr(struct vcpu *v);
 
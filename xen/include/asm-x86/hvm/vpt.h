@@ -97,8 +97,10 @@ typedef struct HPETState {
     uint64_t hpet_to_ns_scale; /* hpet ticks to ns (multiplied by 2^10) */
     uint64_t hpet_to_ns_limit; /* max hpet ticks convertable to ns      */
     uint64_t mc_offset;
+    uint32_t mc_seq;           /* odd while config/mc64/mc_offset change   */
     struct periodic_time pt[HPET_TIMER_NUM];
-    spinlock_t lock;
+    spinlock_t lock;           /* global registers; taken before timer_lock */
+    spinlock_t timer_lock[HPET_TIMER_NUM];
 } HPETState;
 
 typedef struct RTCState {
@@ -131,9 +133,8 @@ struct pl_time {    /* platform time */
     struct PMTState  vpmt;
     /* guest_time = Xen sys time + stime_offset */
     int64_t stime_offset;
-    /* Ensures monotonicity in appropriate timer modes. */
+    /* Ensures monotonicity in appropriate timer modes (updated by cmpxchg). */
     uint64_t last_guest_time;
-    spinlock_t pl_time_lock;
 };
 
 #define ticks_per_sec(v) (v->domain->arch.hvm_domain.tsc_frequency)
@@ -0,0 +1,63 @@
+/******************************************************************************
+ * include/asm-x86/mem_sharing.h
+ *
+ * Transparent sharing of identical guest pages between HVM domains.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _XEN_MEM_SHARING_H
+#define _XEN_MEM_SHARING_H
+
+#include <public/domctl.h>
+#include <asm/p2m.h>
+
+/* Flags for mem_sharing_unshare_page() */
+#define MEM_SHARING_DESTROY_GFN  (1u<<0) /* Drop the gfn rather than copy */
+
+int mem_sharing_nominate_page(struct domain *d, unsigned long gfn,
+                              uint64_t *phash);
+int mem_sharing_share_pages(struct domain *sd, unsigned long sgfn,
+                            struct domain *cd, unsigned long cgfn);
+int mem_sharing_unshare_page(struct domain *d, unsigned long gfn,
+                             unsigned int flags);
+void mem_sharing_teardown(struct domain *d);
+int mem_sharing_domctl(struct domain *d, xen_domctl_mem_sharing_op_t *mec);
+
+/* Look up a gfn that the caller intends to write to or take a reference
+ * on, breaking any sharing first.  If the unshare fails the shared type
+ * is returned and the caller's normal error path applies. */
+static inline mfn_t gfn_to_mfn_unshare(struct domain *d, unsigned long gfn,
+                                       p2m_type_t *p2mt)
+{
+    mfn_t mfn = _gfn_to_mfn_type(d, gfn, p2mt, p2m_alloc);
+
+    if ( unlikely(p2m_is_shared(*p2mt)) &&
+         (mem_sharing_unshare_page(d, gfn, 0) == 0) )
+        mfn = _gfn_to_mfn_type(d, gfn, p2mt, p2m_alloc);
+
+    return mfn;
+}
+
+#endif /* _XEN_MEM_SHARING_H */
+
+/*
+ * Local variables:
+ * mode: C
+ * c-set-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
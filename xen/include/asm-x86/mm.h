@@ -249,6 +249,9 @@ extern unsigned long allocator_bitmap_end;
 /* OOS fixup entries */
 #define SHADOW_OOS_FIXUPS 2
 
+/* Per-vcpu cache of recent shadow hash lookups */
+#define SHADOW_HASH_MRU_ENTRIES 4
+
 #define page_get_owner(_p)                                              \
     ((struct domain *)((_p)->v.inuse._domain ?                          \
                        mfn_to_virt((_p)->v.inuse._domain) : NULL))
@@ -502,5 +505,6 @@ unsigned int domain_clamp_alloc_bitsize(struct domain *d, unsigned int bits);
 unsigned long domain_get_maximum_gpfn(struct domain *d);
 
 extern struct domain *dom_xen, *dom_io;	/* for vmcoreinfo */
+extern struct domain *dom_cow;
 
 #endif /* __ASM_X86_MM_H__ */
@@ -28,6 +28,7 @@
 
 #include <xen/config.h>
 #include <xen/paging.h>
+#include <xen/timer.h>
 
 /*
  * The phys_to_machine_mapping maps guest physical frame numbers 
@@ -65,6 +66,7 @@ typedef enum {
     p2m_mmio_dm = 4,            /* Reads and write go to the device model */
     p2m_mmio_direct = 5,        /* Read/write mapping of genuine MMIO area */
     p2m_populate_on_demand = 6, /* Place-holder for empty memory */
+    p2m_ram_shared = 7,         /* Shared with other gfns; copy on write */
 } p2m_type_t;
 
 typedef enum {
@@ -79,7 +81,8 @@ typedef enum {
 /* RAM types, which map to real machine frames */
 #define P2M_RAM_TYPES (p2m_to_mask(p2m_ram_rw)          \
                        | p2m_to_mask(p2m_ram_logdirty)  \
-                       | p2m_to_mask(p2m_ram_ro))
+                       | p2m_to_mask(p2m_ram_ro)        \
+                       | p2m_to_mask(p2m_ram_shared))
 
 /* MMIO types, which don't have to map to anything in the frametable */
 #define P2M_MMIO_TYPES (p2m_to_mask(p2m_mmio_dm)        \
@@ -87,7 +90,11 @@ typedef enum {
 
 /* Read-only types, which must have the _PAGE_RW bit clear in their PTEs */
 #define P2M_RO_TYPES (p2m_to_mask(p2m_ram_logdirty)     \
-                      | p2m_to_mask(p2m_ram_ro))
+                      | p2m_to_mask(p2m_ram_ro)         \
+                      | p2m_to_mask(p2m_ram_shared))
+
+/* Shared types, which are backed by a frame owned by dom_cow */
+#define P2M_SHARED_TYPES (p2m_to_mask(p2m_ram_shared))
 
 #define P2M_MAGIC_TYPES (p2m_to_mask(p2m_populate_on_demand))
 
@@ -97,6 +104,7 @@ typedef enum {
 #define p2m_is_readonly(_t) (p2m_to_mask(_t) & P2M_RO_TYPES)
 #define p2m_is_magic(_t) (p2m_to_mask(_t) & P2M_MAGIC_TYPES)
 #define p2m_is_valid(_t) (p2m_to_mask(_t) & (P2M_RAM_TYPES | P2M_MMIO_TYPES))
+#define p2m_is_shared(_t) (p2m_to_mask(_t) & P2M_SHARED_TYPES)
 
 /* Populate-on-demand */
 #define POPULATE_ON_DEMAND_MFN  (1<<9)
@@ -125,13 +133,29 @@ struct p2m_domain {
     mfn_t              (*get_entry_current)(unsigned long gfn,
                                             p2m_type_t *p2mt,
                                             p2m_query_t q);
-    void               (*change_entry_type_global)(struct domain *d,
+    int                (*change_entry_type_global)(struct domain *d,
                                                    p2m_type_t ot,
-                                                   p2m_type_t nt);
+                                                   p2m_type_t nt,
+                                                   unsigned long *resume);
 
     /* Highest guest frame that's ever been mapped in the p2m */
     unsigned long max_mapped_pfn;
 
+    /* While defer_flush is set, updates made with the p2m lock held record
+     * the TLB/EPT flushes they need in need_flush (P2M_FLUSH_*) rather
+     * than issuing them; the batch is flushed once by p2m_flush_deferred().
+     * Both are covered by the p2m lock. */
+    int                defer_flush;
+    unsigned int       need_flush;
+
+    /* Progress of a preempted p2m_change_entry_type_global_preemptible():
+     * the walk of ot->nt is complete below gfn next.  Lock: p2m */
+    struct {
+        int            pending;
+        p2m_type_t     ot, nt;
+        unsigned long  next;
+    } global_change;
+
     /* Populate-on-demand variables
      * NB on locking.  {super,single,count} are
      * covered by d->page_alloc_lock, since they're almost always used in
@@ -155,9 +179,24 @@ struct p2m_domain {
         unsigned         reclaim_super; /* Last gpfn of a scan */
         unsigned         reclaim_single; /* Last gpfn of a scan */
         unsigned         max_guest;    /* gpfn of max guest demand-populate */
+
+        /* Background zero-page sweeper.  Lock: p2m */
+        struct timer     sweep_timer;
+        int              sweep_active;    /* timer is armed */
+        unsigned long    sweep_cursor;    /* next gfn to look at */
+        unsigned long    sweep_scanned;   /* gfns looked at */
+        unsigned long    sweep_reclaimed; /* pages put back in the cache */
+        s_time_t         sweep_time;      /* time spent sweeping */
     } pod;
+
+    /* Number of this domain's gfns that map a shared frame.  Covered by
+     * the page-sharing lock rather than the p2m lock. */
+    unsigned long      shared_gfns;
 };
 
+#define P2M_FLUSH_TLB   (1u<<0)  /* flush_tlb_mask(domain_dirty_cpumask) */
+#define P2M_FLUSH_EPT   (1u<<1)  /* ept_sync_domain() */
+
 /*
  * The P2M lock.  This protects all updates to the p2m table.
  * Updates are expected to be safe against concurrent reads,
@@ -342,14 +381,41 @@ static inline int guest_physmap_add_page(struct domain *d, unsigned long gfn,
 void guest_physmap_remove_page(struct domain *d, unsigned long gfn,
                                unsigned long mfn, unsigned int page_order);
 
-/* Change types across all p2m entries in a domain */
-void p2m_change_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt);
+/* Set a run of p2m entries directly.  The caller holds the p2m lock.
+ * Returns 0 on failure. */
+int set_p2m_entry(struct domain *d, unsigned long gfn, mfn_t mfn,
+                  unsigned int page_order, p2m_type_t p2mt);
+
+/* Change types across all p2m entries in a domain.  If resume is NULL
+ * the walk runs to completion.  Otherwise it starts at gfn *resume and may
+ * stop early for a pending preemption, returning -EAGAIN with *resume set
+ * to where to carry on. */
+int p2m_change_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt,
+                           unsigned long *resume);
 void p2m_change_entry_type_global(struct domain *d, p2m_type_t ot, p2m_type_t nt);
 
+/* As p2m_change_entry_type_global(), but for hypercall context: returns
+ * -EAGAIN if preempted, and the caller must retry with the same types
+ * (normally from a continuation) until it returns 0.  Progress is kept in
+ * the p2m, so the guest may run between the retries. */
+int p2m_change_entry_type_global_preemptible(struct domain *d,
+                                             p2m_type_t ot, p2m_type_t nt);
+
 /* Compare-exchange the type of a single p2m entry */
 p2m_type_t p2m_change_type(struct domain *d, unsigned long gfn,
                            p2m_type_t ot, p2m_type_t nt);
 
+/* Change the type of each gfn begin_gfn + i, for every bit i set in the
+ * nr-bit bitmap, from ot to nt.  The whole batch costs a single TLB/EPT
+ * flush, so this is much cheaper than repeated p2m_change_type(). */
+void p2m_change_type_bitmap(struct domain *d, unsigned long begin_gfn,
+                            const unsigned long *bitmap, unsigned int nr,
+                            p2m_type_t ot, p2m_type_t nt);
+
+/* Issue the flushes recorded while p2m->defer_flush was set, and stop
+ * deferring.  Caller holds the p2m lock. */
+void p2m_flush_deferred(struct domain *d);
+
 /* Set mmio addresses in the p2m table (for pass-through) */
 int set_mmio_p2m_entry(struct domain *d, unsigned long gfn, mfn_t mfn);
 int clear_mmio_p2m_entry(struct domain *d, unsigned long gfn);
@@ -145,6 +145,10 @@ int paging_log_dirty_range(struct domain *d,
                            unsigned long nr,
                            XEN_GUEST_HANDLE_64(uint8) dirty_bitmap);
 
+/* get the dirty pfns of a range as a list of extents */
+int paging_log_dirty_extents(struct domain *d,
+                             struct xen_domctl_log_dirty_extents *op);
+
 /* enable log dirty */
 int paging_log_dirty_enable(struct domain *d);
 
@@ -155,11 +159,18 @@ int paging_log_dirty_disable(struct domain *d);
 void paging_log_dirty_init(struct domain *d,
                            int  (*enable_log_dirty)(struct domain *d),
                            int  (*disable_log_dirty)(struct domain *d),
-                           void (*clean_dirty_bitmap)(struct domain *d));
+                           void (*clean_dirty_bitmap)(struct domain *d),
+                           void (*clean_dirty_pfns)(struct domain *d,
+                                                    unsigned long begin_pfn,
+                                                    const unsigned long *bitmap,
+                                                    unsigned int nr));
 
 /* mark a page as dirty */
 void paging_mark_dirty(struct domain *d, unsigned long guest_mfn);
 
+/* detach d->dirty_vram from the log-dirty code before freeing it */
+struct sh_dirty_vram *paging_detach_dirty_vram(struct domain *d);
+
 /*
  * Log-dirty radix tree indexing:
  *   All tree nodes are PAGE_SIZE bytes, mapped on-demand.
@@ -170,6 +181,7 @@ void paging_mark_dirty(struct domain *d, unsigned long guest_mfn);
  * TODO2: Abstract out the radix-tree mechanics?
  */
 #define LOGDIRTY_NODE_ENTRIES (1 << PAGETABLE_ORDER)
+#define LOGDIRTY_LEAF_PFNS    (1UL << (PAGE_SHIFT+3))
 #define L1_LOGDIRTY_IDX(pfn) ((pfn) & ((1 << (PAGE_SHIFT+3)) - 1))
 #define L2_LOGDIRTY_IDX(pfn) (((pfn) >> (PAGE_SHIFT+3)) & \
                               (LOGDIRTY_NODE_ENTRIES-1))
@@ -189,6 +201,10 @@ struct sh_dirty_vram {
     paddr_t *sl1ma;
     uint8_t *dirty_bitmap;
     s_time_t last_dirty;
+    /* HAP, HVMOP_map_dirty_vram only: the bitmap the device model maps,
+     * and the pfns made writable since they were last re-armed. */
+    unsigned long *shared_bitmap;
+    unsigned long *rearm_bitmap;
 };
 
 /*****************************************************************************
@@ -16,6 +16,10 @@ PERFCOUNTER_ARRAY(svmexits,             "SVMexits", SVM_PERF_EXIT_REASON_SIZE)
 PERFCOUNTER(seg_fixups,             "segmentation fixups")
 
 PERFCOUNTER(apic_timer,             "apic timer interrupts")
+PERFCOUNTER(vlapic_kick_ipi,        "vlapic kicks sent")
+PERFCOUNTER(vlapic_kick_elided,     "vlapic kicks elided")
+PERFCOUNTER(vlapic_tdt_write,       "vlapic tsc-deadline writes")
+PERFCOUNTER(vpt_one_shot_rearm,     "vpt one-shot timers re-armed")
 
 PERFCOUNTER(domain_page_tlb_flush,  "domain page tlb flushes")
 
@@ -35,6 +39,18 @@ PERFCOUNTER(exception_fixed,        "pre-exception fixed")
 
 PERFCOUNTER(guest_walk,            "guest pagetable walks")
 
+PERFCOUNTER(hvm_insn_cache_hit,    "hvm insn fetch cache hits")
+PERFCOUNTER(hvm_insn_cache_miss,   "hvm insn fetch cache misses")
+PERFCOUNTER(hvm_insn_cache_stale,  "hvm insn fetch cache code changes")
+PERFCOUNTER(hvm_insn_cache_flush,  "hvm insn fetch cache flushes")
+PERFCOUNTER(hvm_doorbell,          "hvm doorbell kicks")
+
+/* Page sharing counters */
+PERFCOUNTER(mem_sharing_nominate,        "page sharing nominations")
+PERFCOUNTER(mem_sharing_share,           "page sharing merges")
+PERFCOUNTER(mem_sharing_unshare_copy,    "page sharing COW copies")
+PERFCOUNTER(mem_sharing_unshare_reclaim, "page sharing COW reclaims")
+
 /* Shadow counters */
 PERFCOUNTER(shadow_alloc,          "calls to shadow_alloc")
 PERFCOUNTER(shadow_alloc_tlbflush, "shadow_alloc flushed TLBs")
@@ -72,6 +88,10 @@ PERFCOUNTER(shadow_validate_gl4e_calls, "calls to shadow_validate_gl4e")
 PERFCOUNTER(shadow_hash_lookups,   "calls to shadow_hash_lookup")
 PERFCOUNTER(shadow_hash_lookup_head, "shadow hash hit in bucket head")
 PERFCOUNTER(shadow_hash_lookup_miss, "shadow hash misses")
+PERFCOUNTER(shadow_hash_mru_hit,   "shadow hash per-vcpu MRU hits")
+PERFCOUNTER(shadow_hash_mru_miss,  "shadow hash per-vcpu MRU misses")
+PERFCOUNTER_ARRAY(shadow_hash_chain, "shadow hash chain entries walked", 8)
+PERFCOUNTER(shadow_hash_resizes,   "shadow hash table resizes")
 PERFCOUNTER(shadow_get_shadow_status, "calls to get_shadow_status")
 PERFCOUNTER(shadow_hash_inserts,   "calls to shadow_hash_insert")
 PERFCOUNTER(shadow_hash_deletes,   "calls to shadow_hash_delete")
@@ -120,12 +140,15 @@ PERFCOUNTER(mshv_rdmsr_hc_page,         "MS Hv rdmsr hypercall page")
 PERFCOUNTER(mshv_rdmsr_vp_index,        "MS Hv rdmsr vp index")
 PERFCOUNTER(mshv_rdmsr_icr,             "MS Hv rdmsr icr")
 PERFCOUNTER(mshv_rdmsr_tpr,             "MS Hv rdmsr tpr")
+PERFCOUNTER(mshv_rdmsr_time_ref_count,  "MS Hv rdmsr time ref count")
+PERFCOUNTER(mshv_rdmsr_ref_tsc,         "MS Hv rdmsr reference tsc")
 PERFCOUNTER(mshv_wrmsr_osid,            "MS Hv wrmsr Guest OS ID")
 PERFCOUNTER(mshv_wrmsr_hc_page,         "MS Hv wrmsr hypercall page")
 PERFCOUNTER(mshv_wrmsr_vp_index,        "MS Hv wrmsr vp index")
 PERFCOUNTER(mshv_wrmsr_icr,             "MS Hv wrmsr icr")
 PERFCOUNTER(mshv_wrmsr_tpr,             "MS Hv wrmsr tpr")
 PERFCOUNTER(mshv_wrmsr_eoi,             "MS Hv wrmsr eoi")
+PERFCOUNTER(mshv_wrmsr_ref_tsc,         "MS Hv wrmsr reference tsc")
 
 PERFCOUNTER(realmode_emulations, "realmode instructions emulated")
 PERFCOUNTER(realmode_exits,      "vmexits from realmode")
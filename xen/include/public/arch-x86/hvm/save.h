@@ -432,9 +432,30 @@ struct hvm_viridian_context {
 
 DECLARE_HVM_SAVE_TYPE(VIRIDIAN, 15, struct hvm_viridian_context);
 
+/*
+ * Viridian reference time state.
+ */
+
+struct hvm_viridian_time_context {
+    uint64_t reference_tsc;     /* reference TSC page MSR */
+    uint64_t time_ref_count;    /* partition reference counter, 100ns units */
+};
+
+DECLARE_HVM_SAVE_TYPE(VIRIDIAN_TIME, 16, struct hvm_viridian_time_context);
+
+/*
+ * LAPIC TSC-deadline timer state.
+ */
+
+struct hvm_hw_lapic_tdt {
+    uint64_t tdt_msr;           /* IA32_TSC_DEADLINE, guest TSC units */
+};
+
+DECLARE_HVM_SAVE_TYPE(LAPIC_TDT, 17, struct hvm_hw_lapic_tdt);
+
 /* 
  * Largest type-code in use
  */
-#define HVM_SAVE_CODE_MAX 15
+#define HVM_SAVE_CODE_MAX 17
 
 #endif /* __XEN_PUBLIC_HVM_SAVE_X86_H__ */
@@ -34,7 +34,7 @@
 
 #include "xen.h"
 
-#define XEN_DOMCTL_INTERFACE_VERSION 0x00000005
+#define XEN_DOMCTL_INTERFACE_VERSION 0x00000006
 
 struct xenctl_cpumap {
     XEN_GUEST_HANDLE_64(uint8) bitmap;
@@ -181,6 +181,14 @@ DEFINE_XEN_GUEST_HANDLE(xen_domctl_getpageframeinfo2_t);
 /* Memory allocation accessors. */
 #define XEN_DOMCTL_SHADOW_OP_GET_ALLOCATION   30
 #define XEN_DOMCTL_SHADOW_OP_SET_ALLOCATION   31
+ /*
+  * Let Xen size the shadow pool itself, within [min_mb, max_mb], from the
+  * rate at which shadows have to be evicted to make room.  max_mb == 0
+  * turns auto-sizing off and leaves the pool at its current size.
+  */
+#define XEN_DOMCTL_SHADOW_OP_SET_AUTO_ALLOCATION 33
+ /* Return the pool size, the auto-sizing bounds and pool_stats. */
+#define XEN_DOMCTL_SHADOW_OP_GET_AUTO_ALLOCATION 34
 
 /* Legacy enable operations. */
  /* Equiv. to ENABLE with no mode flags. */
@@ -218,6 +226,16 @@ struct xen_domctl_shadow_op_stats {
 typedef struct xen_domctl_shadow_op_stats xen_domctl_shadow_op_stats_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_shadow_op_stats_t);
 
+/* Totals since the domain was created. */
+struct xen_domctl_shadow_pool_stats {
+    uint32_t evictions;  /* shadows torn down to make room in the pool */
+    uint32_t blows;      /* times all of the domain's shadows were dropped */
+    uint32_t faults;     /* shadow page faults */
+    uint32_t grows;      /* auto-sizing steps up */
+    uint32_t shrinks;    /* auto-sizing steps down */
+};
+typedef struct xen_domctl_shadow_pool_stats xen_domctl_shadow_pool_stats_t;
+
 struct xen_domctl_shadow_op {
     /* IN variables. */
     uint32_t       op;       /* XEN_DOMCTL_SHADOW_OP_* */
@@ -232,6 +250,11 @@ struct xen_domctl_shadow_op {
     XEN_GUEST_HANDLE_64(uint8) dirty_bitmap;
     uint64_aligned_t pages; /* Size of buffer. Updated with actual size. */
     struct xen_domctl_shadow_op_stats stats;
+
+    /* OP_SET_AUTO_ALLOCATION / OP_GET_AUTO_ALLOCATION (mb is also set) */
+    uint32_t       min_mb;   /* Auto-sizing lower bound in MB */
+    uint32_t       max_mb;   /* Auto-sizing upper bound in MB; 0: off */
+    struct xen_domctl_shadow_pool_stats pool_stats; /* OUT: GET only */
 };
 typedef struct xen_domctl_shadow_op xen_domctl_shadow_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_shadow_op_t);
@@ -294,9 +317,12 @@ DEFINE_XEN_GUEST_HANDLE(xen_domctl_max_vcpus_t);
 /* Scheduler types. */
 #define XEN_SCHEDULER_SEDF     4
 #define XEN_SCHEDULER_CREDIT   5
+#define XEN_SCHEDULER_RT       6
 /* Set or get info? */
 #define XEN_DOMCTL_SCHEDOP_putinfo 0
 #define XEN_DOMCTL_SCHEDOP_getinfo 1
+/* Check whether putinfo would succeed, without applying it. */
+#define XEN_DOMCTL_SCHEDOP_admit   2
 struct xen_domctl_scheduler_op {
     uint32_t sched_id;  /* XEN_SCHEDULER_* */
     uint32_t cmd;       /* XEN_DOMCTL_SCHEDOP_* */
@@ -311,7 +337,23 @@ struct xen_domctl_scheduler_op {
         struct xen_domctl_sched_credit {
             uint16_t weight;
             uint16_t cap;
+            /*
+             * Run time (us) a VCPU may use at boosted priority after
+             * waking up, at most 65534. 0 selects the scheduler default;
+             * ~0 (65535) on putinfo leaves the current value unchanged.
+             */
+            uint16_t latency;
         } credit;
+        struct xen_domctl_sched_rt {
+            /*
+             * Per-VCPU reservation of 'budget' ns of CPU time in every
+             * 'period' ns. A zero budget makes the domain best-effort.
+             * putinfo and admit fail with -ENOSPC if the reservation would
+             * not pass admission control.
+             */
+            uint64_aligned_t period;
+            uint64_aligned_t budget;
+        } rt;
     } u;
 };
 typedef struct xen_domctl_scheduler_op xen_domctl_scheduler_op_t;
@@ -643,6 +685,140 @@ typedef struct xen_domctl_hvmcontext_partial {
 } xen_domctl_hvmcontext_partial_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_hvmcontext_partial_t);
 
+/*
+ * Transparent page sharing for HVM guests.
+ *
+ * NOMINATE_GFN makes a gfn of the target domain read-only and hands its
+ *   frame to the sharing code, returning a hash of the page contents.
+ *   The page must be ordinary RAM with no outstanding mappings.
+ * SHARE merges the nominated client gfn into the nominated source gfn
+ *   (of the target domain) if their contents are identical, freeing the
+ *   client's frame.  Returns -EINVAL if either gfn is not nominated or the
+ *   contents differ.
+ * UNSHARE gives the gfn back a private, writable copy of its frame.  This
+ *   is done automatically when the guest writes to a shared gfn.
+ * STATS reports how many frames are shared and how many gfns map them.
+ *   The number of frames saved is shared_gfns - shared_frames.
+ */
+#define XEN_DOMCTL_mem_sharing_op          56
+#define XEN_DOMCTL_MEM_SHARING_OP_NOMINATE_GFN  0
+#define XEN_DOMCTL_MEM_SHARING_OP_SHARE         1
+#define XEN_DOMCTL_MEM_SHARING_OP_UNSHARE       2
+#define XEN_DOMCTL_MEM_SHARING_OP_STATS         3
+struct xen_domctl_mem_sharing_op {
+    uint32_t op;                       /* IN: XEN_DOMCTL_MEM_SHARING_OP_* */
+    uint32_t pad;
+    union {
+        struct {
+            uint64_aligned_t gfn;      /* IN: gfn to nominate */
+            uint64_aligned_t hash;     /* OUT: hash of the page contents */
+        } nominate;
+        struct {
+            uint64_aligned_t source_gfn;    /* IN: gfn in target domain */
+            uint64_aligned_t client_gfn;    /* IN: gfn in client domain */
+            domid_t          client_domain; /* IN */
+        } share;
+        struct {
+            uint64_aligned_t gfn;      /* IN: gfn to unshare */
+        } unshare;
+        struct {
+            uint64_aligned_t shared_frames; /* OUT: frames owned by DOMID_COW */
+            uint64_aligned_t shared_gfns;   /* OUT: gfns mapping them */
+            uint64_aligned_t domain_gfns;   /* OUT: ... in target domain */
+        } stats;
+    } u;
+};
+typedef struct xen_domctl_mem_sharing_op xen_domctl_mem_sharing_op_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_mem_sharing_op_t);
+
+/*
+ * Harvest the log-dirty bitmap of a domain as a list of dirty extents
+ * rather than as a flat bitmap.  Pfns in [start_pfn, end_pfn) are scanned
+ * in order and each run of consecutive dirty pfns is returned as one
+ * extent.  If the buffer fills up, the scan stops early and start_pfn is
+ * updated to the first pfn that was not harvested, so the caller can
+ * resume from there; on completion start_pfn == end_pfn.
+ * With XEN_DOMCTL_LOG_DIRTY_CLEAN, the harvested pfns are cleared and
+ * write-protected again, as XEN_DOMCTL_SHADOW_OP_CLEAN does for the whole
+ * bitmap.
+ */
+#define XEN_DOMCTL_log_dirty_extents       57
+#define XEN_DOMCTL_LOG_DIRTY_CLEAN  (1U<<0)
+struct xen_domctl_log_dirty_extent {
+    uint64_aligned_t first_pfn;
+    uint64_aligned_t nr_pfns;
+};
+typedef struct xen_domctl_log_dirty_extent xen_domctl_log_dirty_extent_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_log_dirty_extent_t);
+struct xen_domctl_log_dirty_extents {
+    uint32_t flags;                 /* IN: XEN_DOMCTL_LOG_DIRTY_* */
+    uint32_t nr_extents;            /* IN: buffer size; OUT: extents used */
+    uint64_aligned_t start_pfn;     /* IN/OUT: see above */
+    uint64_aligned_t end_pfn;       /* IN */
+    uint64_aligned_t dirty_pages;   /* OUT: pfns covered by the extents */
+    XEN_GUEST_HANDLE_64(xen_domctl_log_dirty_extent_t) extents;
+};
+typedef struct xen_domctl_log_dirty_extents xen_domctl_log_dirty_extents_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_log_dirty_extents_t);
+
+/*
+ * Number of pages a domain has on each NUMA node.  pages[i] is filled in
+ * for node i < nr_nodes; nr_nodes is then set to the number of node ids
+ * the hypervisor can report.
+ */
+#define XEN_DOMCTL_getnodepages            58
+struct xen_domctl_getnodepages {
+    uint32_t nr_nodes;                      /* IN/OUT */
+    XEN_GUEST_HANDLE_64(uint64) pages;      /* OUT */
+};
+typedef struct xen_domctl_getnodepages xen_domctl_getnodepages_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_getnodepages_t);
+
+/*
+ * Per-vcpu HVM exit statistics.  Once enabled, every vmexit is counted
+ * against its exit reason together with the TSC cycles spent in Xen before
+ * the vcpu next heads back into the guest, or before it is descheduled if
+ * it blocks or is preempted first.  Time spent blocked or runnable is not
+ * counted.  The counters accumulate in the hypervisor, and GET harvests one
+ * vcpu's counters in a single call.
+ *
+ * Entries below XEN_HVM_EXIT_STATS_HW_REASONS are indexed by VMX basic exit
+ * reason or by SVM exit code.  Exits whose code lies outside that range get
+ * a synthetic index above it: SVM's VMEXIT_NPF (0x400) is counted at
+ * XEN_HVM_EXIT_STATS_SVM_NPF.  In
+ * hist[], bucket 0 counts exits handled in under 512 cycles, bucket n
+ * counts those in [2^(n+8), 2^(n+9)) cycles, and the last bucket also takes
+ * everything slower.
+ */
+#define XEN_DOMCTL_hvm_exit_stats          59
+#define XEN_DOMCTL_HVM_EXIT_STATS_DISABLE  0    /* Stop and free counters. */
+#define XEN_DOMCTL_HVM_EXIT_STATS_ENABLE   1    /* Allocate and start. */
+#define XEN_DOMCTL_HVM_EXIT_STATS_GET      2    /* Copy out one vcpu. */
+#define XEN_DOMCTL_HVM_EXIT_STATS_RESET    3    /* Zero all vcpus. */
+#define XEN_HVM_EXIT_STATS_HW_REASONS      256
+#define XEN_HVM_EXIT_STATS_SVM_NPF         (XEN_HVM_EXIT_STATS_HW_REASONS + 0)
+#define XEN_HVM_EXIT_STATS_REASONS         (XEN_HVM_EXIT_STATS_HW_REASONS + 1)
+#define XEN_HVM_EXIT_STATS_BUCKETS         16
+#define XEN_HVM_EXIT_STATS_VMX             1
+#define XEN_HVM_EXIT_STATS_SVM             2
+struct xen_domctl_hvm_exit_reason {
+    uint64_aligned_t count;         /* exits */
+    uint64_aligned_t cycles;        /* total cycles from exit to re-entry */
+    uint32_t hist[XEN_HVM_EXIT_STATS_BUCKETS];
+};
+typedef struct xen_domctl_hvm_exit_reason xen_domctl_hvm_exit_reason_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_hvm_exit_reason_t);
+struct xen_domctl_hvm_exit_stats {
+    uint32_t op;                    /* IN: XEN_DOMCTL_HVM_EXIT_STATS_* */
+    uint32_t vcpu;                  /* IN: GET */
+    uint32_t nr_reasons;            /* IN: buffer size; OUT: entries (GET) */
+    uint32_t vendor;                /* OUT: XEN_HVM_EXIT_STATS_VMX/SVM */
+    uint64_aligned_t tsc_khz;       /* OUT: cycles per millisecond */
+    XEN_GUEST_HANDLE_64(xen_domctl_hvm_exit_reason_t) reasons; /* OUT */
+};
+typedef struct xen_domctl_hvm_exit_stats xen_domctl_hvm_exit_stats_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_hvm_exit_stats_t);
+
 
 struct xen_domctl {
     uint32_t cmd;
@@ -685,6 +861,10 @@ struct xen_domctl {
         struct xen_domctl_set_target        set_target;
         struct xen_domctl_subscribe         subscribe;
         struct xen_domctl_debug_op          debug_op;
+        struct xen_domctl_mem_sharing_op    mem_sharing_op;
+        struct xen_domctl_log_dirty_extents log_dirty_extents;
+        struct xen_domctl_getnodepages      getnodepages;
+        struct xen_domctl_hvm_exit_stats    hvm_exit_stats;
 #if defined(__i386__) || defined(__x86_64__)
         struct xen_domctl_cpuid             cpuid;
 #endif
@@ -64,6 +64,17 @@ struct hvm_info_table {
      *    RAM above 4GB
      */
     uint32_t    high_mem_pgend;
+
+    /*
+     * VIRTUAL NUMA TOPOLOGY provided by HVM domain builder.
+     * Guest RAM, counted in pages upwards from 0x0 and continuing at
+     * 0x100000000 after low_mem_pgend, is split into nr_vnodes blocks of
+     * vnode_pages pages, one per virtual node; the last node also takes
+     * any remainder.  Vcpus are assigned to nodes in equal contiguous runs.
+     * If nr_vnodes is zero the guest is presented a flat machine.
+     */
+    uint32_t    nr_vnodes;
+    uint32_t    vnode_pages;
 };
 
 #endif /* __XEN_PUBLIC_HVM_HVM_INFO_TABLE_H__ */
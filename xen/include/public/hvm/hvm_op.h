@@ -125,6 +125,97 @@ struct xen_hvm_set_mem_type {
 typedef struct xen_hvm_set_mem_type xen_hvm_set_mem_type_t;
 DEFINE_XEN_GUEST_HANDLE(xen_hvm_set_mem_type_t);
 
+/*
+ * Track dirty VRAM through a bitmap page that Xen updates in place, so
+ * that a display refresh with nothing dirty needs no hypercall.  Only
+ * available with hardware-assisted paging; use HVMOP_track_dirty_vram
+ * otherwise.
+ *
+ * Xen atomically sets bit i of the page at bitmap_mfn whenever the guest
+ * writes to first_pfn + i.  To harvest, the device model atomically
+ * exchanges each non-zero word of the bitmap with zero.  If any bit was
+ * set it must then repeat this call with the same range, which re-arms
+ * tracking of the pages found dirty.  Those pages are reported once more
+ * on the following harvest, since writes made before the re-arm cannot
+ * be told apart.  Every page is reported dirty after the first call.
+ * nr == 0 stops tracking.  nr is limited to the bits in one page.
+ */
+#define HVMOP_map_dirty_vram    9
+struct xen_hvm_map_dirty_vram {
+    /* Domain to be tracked. */
+    domid_t  domid;
+    /* First pfn to track. */
+    uint64_aligned_t first_pfn;
+    /* Number of pages to track. */
+    uint64_aligned_t nr;
+    /* OUT variable. */
+    /* Frame holding the dirty bitmap, to be mapped from DOMID_XEN. */
+    uint64_aligned_t bitmap_mfn;
+};
+typedef struct xen_hvm_map_dirty_vram xen_hvm_map_dirty_vram_t;
+DEFINE_XEN_GUEST_HANDLE(xen_hvm_map_dirty_vram_t);
+
+/*
+ * Declare a range of device-model emulated I/O ports or MMIO as safe for
+ * posted writes.  Single writes to the range which no internal handler
+ * claims are queued on the buffered ioreq page and the vcpu carries on
+ * without waiting for the device model, which must drain that page before
+ * servicing any synchronous ioreq.  Buffered requests above 1MB are preceded
+ * by an IOREQ_TYPE_ADDR_HI slot, so only a device model which understands
+ * it may declare such a range.
+ */
+#define HVMOP_set_posted_io_range    10
+struct xen_hvm_set_posted_io_range {
+    /* Domain to be updated. */
+    domid_t  domid;
+    /* IOREQ_TYPE_PIO or IOREQ_TYPE_COPY. */
+    uint8_t  type;
+    /* Add (1) or remove (0) the range. */
+    uint8_t  enable;
+    /* First and last port or physical address, inclusive. */
+    uint64_aligned_t first;
+    uint64_aligned_t last;
+};
+typedef struct xen_hvm_set_posted_io_range xen_hvm_set_posted_io_range_t;
+DEFINE_XEN_GUEST_HANDLE(xen_hvm_set_posted_io_range_t);
+
+/*
+ * Register or remove a doorbell.  A write of exactly 'size' bytes to 'addr'
+ * (and, with HVM_DOORBELL_DATAMATCH, of exactly the value 'data') which no
+ * internal handler claims is completed by Xen at once.  Instead of an ioreq,
+ * an event is sent on the doorbell's event channel, and the written value is
+ * discarded.  On registration Xen allocates that channel in the target
+ * domain, unbound and awaiting the calling domain, and returns it in 'port'.
+ * Kicks are dropped until the caller binds to it.  Removal closes the
+ * channel.  While posted writes are still queued on the buffered ioreq page
+ * a kick is sent as an ordinary ioreq instead, so that it is seen after them.
+ */
+#define HVMOP_set_doorbell           11
+#define _HVM_DOORBELL_DATAMATCH      0
+#define HVM_DOORBELL_DATAMATCH       (1u << _HVM_DOORBELL_DATAMATCH)
+struct xen_hvm_set_doorbell {
+    /* Domain to be updated. */
+    domid_t  domid;
+    /* IOREQ_TYPE_PIO or IOREQ_TYPE_COPY. */
+    uint8_t  type;
+    /* Add (1) or remove (0) the doorbell. */
+    uint8_t  enable;
+    /* Access size in bytes: 1, 2, 4 or 8. */
+    uint8_t  size;
+    /* HVM_DOORBELL_* */
+    uint8_t  flags;
+    uint16_t pad;
+    /* Port or physical address of the doorbell register. */
+    uint64_aligned_t addr;
+    /* Value to match if HVM_DOORBELL_DATAMATCH. */
+    uint64_aligned_t data;
+    /* OUT variable (enable only). */
+    /* Event channel, in the target domain, signalled on each kick. */
+    uint32_t port;
+};
+typedef struct xen_hvm_set_doorbell xen_hvm_set_doorbell_t;
+DEFINE_XEN_GUEST_HANDLE(xen_hvm_set_doorbell_t);
+
 
 #endif /* defined(__XEN__) || defined(__XEN_TOOLS__) */
 
@@ -36,6 +36,7 @@
 #define IOREQ_TYPE_COPY         1 /* mmio ops */
 #define IOREQ_TYPE_TIMEOFFSET   7
 #define IOREQ_TYPE_INVALIDATE   8 /* mapcache */
+#define IOREQ_TYPE_ADDR_HI      9 /* buffered only: addr bits 20+ of next */
 
 /*
  * VMExit dispatcher should cooperate with instruction decoder to
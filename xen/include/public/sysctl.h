@@ -69,6 +69,8 @@ struct xen_sysctl_tbuf_op {
 #define XEN_SYSCTL_TBUFOP_set_size     3
 #define XEN_SYSCTL_TBUFOP_enable       4
 #define XEN_SYSCTL_TBUFOP_disable      5
+/* Set subclass bits of evt_mask for each class whose bit is set in evt_mask. */
+#define XEN_SYSCTL_TBUFOP_set_cls_mask 6
     uint32_t cmd;
     /* IN/OUT variables */
     struct xenctl_cpumap cpu_mask;
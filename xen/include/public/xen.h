@@ -354,6 +354,13 @@ typedef uint16_t domid_t;
  */
 #define DOMID_XEN  (0x7FF2U)
 
+/*
+ * DOMID_COW is used as the owner of machine frames that back the read-only,
+ * copy-on-write gfns of transparently shared guest memory.
+ * It is never a valid foreigndom for page-table updates.
+ */
+#define DOMID_COW  (0x7FF3U)
+
 /* DOMID_INVALID is used to identity invalid domid */
 #define DOMID_INVALID (0x7FFFU)
 
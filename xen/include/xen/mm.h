@@ -71,6 +71,9 @@ int assign_pages(
     struct page_info *pg,
     unsigned int order,
     unsigned int memflags);
+/* Call wherever d->tot_pages changes.  Lock: d->page_alloc_lock */
+void domain_adjust_node_pages(
+    struct domain *d, struct page_info *pg, int nr);
 
 /* memflags: */
 #define _MEMF_no_refcount 0
@@ -15,6 +15,12 @@ PERFCOUNTER(ipis,                   "#IPIs")
 PERFCOUNTER(sched_irq,              "sched: timer")
 PERFCOUNTER(sched_run,              "sched: runs through scheduler")
 PERFCOUNTER(sched_ctx,              "sched: context switches")
+PERFCOUNTER(sched_yield_directed,   "sched: yields to a sibling vcpu")
+PERFCOUNTER(sched_yield_undirected, "sched: spin yields w/o sibling")
+
+PERFCOUNTER(timer_wheel_add,        "timer: wheel inserts")
+PERFCOUNTER(timer_heap_add,         "timer: heap inserts")
+PERFCOUNTER(timer_wheel_cascade,    "timer: wheel cascades")
 
 PERFCOUNTER(vcpu_check,             "csched: vcpu_check")
 PERFCOUNTER(schedule,               "csched: schedule")
@@ -32,6 +38,9 @@ PERFCOUNTER(vcpu_wake_runnable,     "csched: vcpu_wake_runnable")
 PERFCOUNTER(vcpu_wake_not_runnable, "csched: vcpu_wake_not_runnable")
 PERFCOUNTER(vcpu_park,              "csched: vcpu_park")
 PERFCOUNTER(vcpu_unpark,            "csched: vcpu_unpark")
+PERFCOUNTER(vcpu_unboost,           "csched: vcpu_unboost")
+PERFCOUNTER(vcpu_yield,             "csched: vcpu_yield")
+PERFCOUNTER(vcpu_yield_boost,       "csched: vcpu_yield_boost")
 PERFCOUNTER(tickle_local_idler,     "csched: tickle_local_idler")
 PERFCOUNTER(tickle_local_over,      "csched: tickle_local_over")
 PERFCOUNTER(tickle_local_under,     "csched: tickle_local_under")
@@ -43,6 +52,12 @@ PERFCOUNTER(load_balance_over,      "csched: load_balance_over")
 PERFCOUNTER(load_balance_other,     "csched: load_balance_other")
 PERFCOUNTER(steal_trylock_failed,   "csched: steal_trylock_failed")
 PERFCOUNTER(steal_peer_idle,        "csched: steal_peer_idle")
+PERFCOUNTER(steal_smt,              "csched: steal_smt")
+PERFCOUNTER(steal_pkg,              "csched: steal_pkg")
+PERFCOUNTER(steal_node,             "csched: steal_node")
+PERFCOUNTER(steal_remote,           "csched: steal_remote")
+PERFCOUNTER(steal_remote_ratelimit, "csched: steal_remote_ratelimit")
+PERFCOUNTER(pick_cpu_remote_node,   "csched: pick_cpu_remote_node")
 PERFCOUNTER(migrate_queued,         "csched: migrate_queued")
 PERFCOUNTER(migrate_running,        "csched: migrate_running")
 PERFCOUNTER(dom_init,               "csched: dom_init")
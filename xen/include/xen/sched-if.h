@@ -69,6 +69,7 @@ struct scheduler {
 
     void         (*sleep)          (struct vcpu *);
     void         (*wake)           (struct vcpu *);
+    void         (*yield)          (struct vcpu *, struct vcpu *);
 
     struct task_slice (*do_schedule) (s_time_t);
 
@@ -20,6 +20,7 @@
 #include <xen/rcupdate.h>
 #include <xen/irq.h>
 #include <xen/mm.h>
+#include <xen/numa.h>
 
 #ifdef CONFIG_COMPAT
 #include <compat/vcpu.h>
@@ -179,6 +180,7 @@ struct domain
     unsigned int     tot_pages;       /* number of pages currently possesed */
     unsigned int     max_pages;       /* maximum value for tot_pages        */
     unsigned int     xenheap_pages;   /* # pages allocated from Xen heap    */
+    unsigned int     node_pages[MAX_NUMNODES]; /* tot_pages, by NUMA node */
 
     /* Scheduling. */
     void            *sched_priv;    /* scheduler-specific data */
@@ -534,6 +536,7 @@ void domain_unpause_by_systemcontroller(struct domain *d);
 void cpu_init(void);
 
 void vcpu_force_reschedule(struct vcpu *v);
+void vcpu_yield_to_sibling(void);
 void cpu_disable_scheduler(void);
 int vcpu_set_affinity(struct vcpu *v, cpumask_t *affinity);
 int vcpu_lock_affinity(struct vcpu *v, cpumask_t *affinity);
@@ -11,6 +11,7 @@
 #include <xen/spinlock.h>
 #include <xen/time.h>
 #include <xen/string.h>
+#include <xen/list.h>
 
 struct timer {
     /* System time expiry value (nanoseconds since boot). */
@@ -23,6 +24,8 @@ struct timer {
         unsigned int heap_offset;
         /* Linked list. */
         struct timer *list_next;
+        /* Timing-wheel slot. */
+        struct list_head wheel_elem;
     };
 
     /* On expiry, '(*function)(data)' will be executed in softirq context. */
@@ -37,6 +40,8 @@ struct timer {
 #define TIMER_STATUS_killed   1 /* Not in use; canot be activated.  */
 #define TIMER_STATUS_in_heap  2 /* In use; on timer heap.           */
 #define TIMER_STATUS_in_list  3 /* In use; on overflow linked list. */
+#define TIMER_STATUS_in_wheel0 4 /* In use; on near timing-wheel.    */
+#define TIMER_STATUS_in_wheel1 5 /* In use; on far timing-wheel.     */
     uint8_t status;
 };
 
@@ -23,6 +23,15 @@
 
 extern int tb_init_done;
 
+/*
+ * Bitmap of trace classes (event bits 16-27, see public/trace.h) that are
+ * currently being recorded. It is zero whenever tracing is disabled, so a
+ * trace point whose event is a compile-time constant costs one test and a
+ * predicted-not-taken branch when its class is off.
+ */
+extern u32 tb_cls_enabled;
+#define tb_event_enabled(e) (tb_cls_enabled & ((u32)(e) >> TRC_CLS_SHIFT))
+
 #include <xen/config.h>
 #include <public/sysctl.h>
 #include <public/trace.h>
@@ -41,7 +50,7 @@ void __trace_var(u32 event, int cycles, int extra, unsigned char *extra_data);
 static inline void trace_var(u32 event, int cycles, int extra,
                                unsigned char *extra_data)
 {
-    if ( unlikely(tb_init_done) )
+    if ( unlikely(tb_event_enabled(event)) )
         __trace_var(event, cycles, extra, extra_data);
 }
 
@@ -53,7 +62,7 @@ static inline void trace_var(u32 event, int cycles, int extra,
   
 #define TRACE_1D(_e,d1)                                         \
     do {                                                        \
-        if ( unlikely(tb_init_done) )                           \
+        if ( unlikely(tb_event_enabled(_e)) )                   \
         {                                                       \
             u32 _d[1];                                          \
             _d[0] = d1;                                         \
@@ -63,7 +72,7 @@ static inline void trace_var(u32 event, int cycles, int extra,
  
 #define TRACE_2D(_e,d1,d2)                                      \
     do {                                                        \
-        if ( unlikely(tb_init_done) )                           \
+        if ( unlikely(tb_event_enabled(_e)) )                   \
         {                                                       \
             u32 _d[2];                                          \
             _d[0] = d1;                                         \
@@ -74,7 +83,7 @@ static inline void trace_var(u32 event, int cycles, int extra,
  
 #define TRACE_3D(_e,d1,d2,d3)                                   \
     do {                                                        \
-        if ( unlikely(tb_init_done) )                           \
+        if ( unlikely(tb_event_enabled(_e)) )                   \
         {                                                       \
             u32 _d[3];                                          \
             _d[0] = d1;                                         \
@@ -86,7 +95,7 @@ static inline void trace_var(u32 event, int cycles, int extra,
  
 #define TRACE_4D(_e,d1,d2,d3,d4)                                \
     do {                                                        \
-        if ( unlikely(tb_init_done) )                           \
+        if ( unlikely(tb_event_enabled(_e)) )                   \
         {                                                       \
             u32 _d[4];                                          \
             _d[0] = d1;                                         \
@@ -99,7 +108,7 @@ static inline void trace_var(u32 event, int cycles, int extra,
  
 #define TRACE_5D(_e,d1,d2,d3,d4,d5)                             \
     do {                                                        \
-        if ( unlikely(tb_init_done) )                           \
+        if ( unlikely(tb_event_enabled(_e)) )                   \
         {                                                       \
             u32 _d[5];                                          \
             _d[0] = d1;                                         \
@@ -733,6 +733,8 @@ static int flask_shadow_control(struct domain *d, uint32_t op)
         case XEN_DOMCTL_SHADOW_OP_ENABLE_TRANSLATE:
         case XEN_DOMCTL_SHADOW_OP_GET_ALLOCATION:
         case XEN_DOMCTL_SHADOW_OP_SET_ALLOCATION:
+        case XEN_DOMCTL_SHADOW_OP_SET_AUTO_ALLOCATION:
+        case XEN_DOMCTL_SHADOW_OP_GET_AUTO_ALLOCATION:
             perm = SHADOW__ENABLE;
         break;
         case XEN_DOMCTL_SHADOW_OP_ENABLE_LOGDIRTY: